@@ -21,6 +21,7 @@
 #ifndef database_compression_hpp
 #define database_compression_hpp
 
+#include <cstddef>
 #include <string>
 
 namespace database {
@@ -32,6 +33,24 @@ namespace database {
             static std::string compress(const std::string & in);
             static std::string decompress(const std::string & in);
         
+            /**
+             * Compresses at the given level (1 is fastest, 10 is best).
+             * @param in The input.
+             * @param level The level.
+             */
+            static std::string compress(
+                const std::string & in, const int & level
+            );
+        
+            /**
+             * Decompresses into a buffer of at most length bytes.
+             * @param in The input.
+             * @param length The maximum decompressed length.
+             */
+            static std::string decompress(
+                const std::string & in, const std::size_t & length
+            );
+        
             /**
              * Runs test case.
              */
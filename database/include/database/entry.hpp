@@ -21,12 +21,12 @@
 #ifndef DATABASE_ENTRY_HPP
 #define DATABASE_ENTRY_HPP
 
-#include <chrono>
 #include <cstdint>
-#include <map>
+#include <ctime>
+#include <memory>
 #include <string>
-
-#include <boost/asio.hpp>
+#include <utility>
+#include <vector>
 
 namespace database {
 
@@ -34,46 +34,41 @@ namespace database {
     
     /**
      * Implements an entry.
+     * @note The pair table, the query string and the (lowercase, URI decoded)
+     * keys and values are kept in a single contiguous allocation. Keys are
+     * interned by the storage and expiration is driven by the storage tick
+     * instead of a per-entry timer.
      */
-    class entry : public std::enable_shared_from_this<entry>
+    class entry
     {
         public:
         
             /**
-             * Constructor
-             * @param ios The boost::asio::io_service.
-             * @param s The storage.
-             * @param query The query.
-             */
-            explicit entry(
-                boost::asio::io_service &, const std::shared_ptr<storage> &,
-                const std::string &
-            );
-            
-            /**
-             * Destrcutor
-             */
-            ~entry();
-            
-            /**
-             * Start
+             * A key/value pair referencing the entry's buffer.
              */
-            void start();
+            typedef struct
+            {
+                std::uint32_t key;
+                std::uint32_t offset;
+                std::uint32_t key_length;
+                std::uint32_t length;
+            } pair_t;
         
             /**
-             * Stop
+             * A search term (interned key id, lowercase value).
              */
-            void stop();
+            typedef std::pair<std::uint32_t, std::string> term_t;
         
             /**
-             * The query.
+             * Constructor
+             * @param query The query.
              */
-            const std::string & query_string() const;
+            explicit entry(const std::string &);
         
             /**
-             * The value.
+             * The query.
              */
-            const std::string & value() const;
+            std::string query_string() const;
         
             /**
              * The lifetime.
@@ -92,9 +87,26 @@ namespace database {
             const std::time_t & timestamp() const;
         
             /**
-             * The key/value pairs.
+             * The number of (public) key/value pairs.
              */
-            std::map<std::string, std::string> & pairs();
+            std::size_t pairs_size() const;
+        
+            /**
+             * The (public) key/value pairs sorted by key id.
+             */
+            const pair_t * pairs() const;
+        
+            /**
+             * The (lowercase) key of a pair.
+             * @param p The pair_t.
+             */
+            std::string key(const pair_t &) const;
+        
+            /**
+             * The (lowercase) value of a pair.
+             * @param p The pair_t.
+             */
+            std::string value(const pair_t &) const;
         
             /**
              * The time remaining until expire.
@@ -104,7 +116,46 @@ namespace database {
             /**
              * If true the entry is expired.
              */
-            const bool & expired() const;
+            bool expired() const;
+        
+            /**
+             * If true every term is found in the entry.
+             * @param terms The terms.
+             */
+            bool matches(const std::vector<term_t> &) const;
+        
+            /**
+             * If true both entries have the same (public) key/value pairs.
+             * @param other The other entry.
+             */
+            bool equals(const entry &) const;
+        
+            /**
+             * A digest of the (public) key/value pairs.
+             */
+            std::uint64_t digest() const;
+        
+            /**
+             * Interns the (lowercase) keys into the storage's key table.
+             * @param s The storage.
+             * @note The caller must hold the storage lock.
+             */
+            void intern_keys(storage &);
+        
+            /**
+             * The number of bytes used by the entry.
+             */
+            std::size_t memory_usage() const;
+        
+            /**
+             * Hashes a term.
+             * @param key The key id.
+             * @param buf The value buffer.
+             * @param len The value length.
+             */
+            static std::uint64_t hash_term(
+                const std::uint32_t &, const char *, const std::size_t &
+            );
         
             /**
              * The minimum lifetime.
@@ -113,46 +164,45 @@ namespace database {
         
             bool operator == (const entry & rhs) const
             {
-                return this->m_query_string == rhs.m_query_string;
+                return query_string() == rhs.query_string();
             }
         
         private:
-
+        
             /**
-             * The expire timer handler
-             * @param ec The boost::system::error_code.
+             * The pair table followed by the query string and the values.
              */
-            void expire_tick(const boost::system::error_code &);
-
+            std::unique_ptr<char[]> m_buffer;
+        
             /**
-             * The query string.
+             * The number of bytes in the buffer.
              */
-            std::string m_query_string;
-
+            std::uint32_t m_buffer_length;
+        
             /**
-             * The lifetime.
+             * The number of pairs.
              */
-            std::uint32_t m_lifetime;
+            std::uint32_t m_pairs_size;
         
             /**
-             * The allocation time.
+             * The query string length.
              */
-            std::time_t m_allocation_time;
+            std::uint32_t m_query_length;
         
             /**
-             * The timestamp.
+             * The lifetime.
              */
-            std::time_t m_timestamp;
+            std::uint32_t m_lifetime;
         
             /**
-             * The key/value pairs.
+             * The allocation time.
              */
-            std::map<std::string, std::string> m_pairs;
+            std::time_t m_allocation_time;
         
             /**
-             * If true the entry is expired.
+             * The timestamp.
              */
-            bool m_expired;
+            std::time_t m_timestamp;
         
             /**
              * The maximum lifetime.
@@ -162,21 +212,9 @@ namespace database {
         protected:
         
             /**
-             * The boost::asio::strand.
-             */
-            boost::asio::strand strand_;
-        
-            /**
-             * The storage.
-             */
-            std::weak_ptr<storage> storage_;
-            
-            /**
-             * The expire timer.
+             * The pairs (mutable).
              */
-            boost::asio::basic_waitable_timer<
-                std::chrono::steady_clock
-            > expire_timer_;
+            pair_t * pairs_mutable();
     };
     
 } // namespace database
@@ -23,6 +23,8 @@
 
 #include <map>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace database {
 
@@ -51,6 +53,15 @@ namespace database {
              */
             std::map<std::string, std::string> & pairs_public();
         
+            /**
+             * Splits a query string into it's (URI decoded) key/value pairs
+             * in a single pass, a later duplicate key replaces an earlier one.
+             * @param val The value.
+             */
+            static std::vector< std::pair<std::string, std::string> > split(
+                const std::string &
+            );
+        
         private:
         
             /**
@@ -22,10 +22,13 @@
 #define DATABASE_DATABASE_HPP
 
 #include <chrono>
+#include <cstdint>
 #include <map>
 #include <set>
 #include <string>
 #include <mutex>
+#include <unordered_map>
+#include <vector>
 
 #include <boost/asio.hpp>
 
@@ -72,9 +75,22 @@ namespace database {
         
             /**
              * The entries.
+             * @note Expired entries are released by the tick and leave an
+             * empty slot until the next compaction.
              */
             const std::vector< std::shared_ptr<entry> > & entries() const;
         
+            /**
+             * The number of live (unexpired) entries.
+             */
+            std::size_t size();
+        
+            /**
+             * Interns a (lowercase) key returning it's id.
+             * @param key The key.
+             */
+            std::uint32_t intern(const std::string &);
+        
             /**
              * Runs the test case.
              */
@@ -88,11 +104,49 @@ namespace database {
              */
             void tick(const boost::system::error_code &);
         
+            /**
+             * Compacts the entries and rebuilds the indexes.
+             */
+            void compact();
+        
+            /**
+             * Indexes the entry at the given position.
+             * @param index The index.
+             */
+            void index(const std::uint32_t &);
+        
             /**
              * The entries.
              */
             std::vector< std::shared_ptr<entry> > m_entries;
         
+            /**
+             * The number of empty (expired) slots in the entries.
+             */
+            std::size_t m_entries_empty;
+        
+            /**
+             * The interned key id's.
+             */
+            std::unordered_map<std::string, std::uint32_t> m_keys;
+        
+            /**
+             * The entry positions by digest.
+             */
+            std::unordered_multimap<std::uint64_t, std::uint32_t> m_digests;
+        
+            /**
+             * The entry positions by term hash.
+             */
+            std::unordered_map<
+                std::uint64_t, std::vector<std::uint32_t>
+            > m_terms;
+        
+            /**
+             * The maximum number of interned keys before they are rebuilt.
+             */
+            enum { max_keys = 65536 };
+        
         protected:
         
             /**
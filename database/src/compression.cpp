@@ -3472,6 +3472,11 @@ mz_bool mz_zip_reader_end(mz_zip_archive *pZip)
 using namespace database;
 
 std::string compression::compress(const std::string & in)
+{
+    return compress(in, MZ_UBER_COMPRESSION);
+}
+
+std::string compression::compress(const std::string & in, const int & level)
 {
     std::string ret;
     
@@ -3482,7 +3487,7 @@ std::string compression::compress(const std::string & in)
     
     int status = mz_compress2(
         (unsigned char *)ret.data(), &cmp_len,
-        (const unsigned char *)in.data(), src_len, MZ_UBER_COMPRESSION
+        (const unsigned char *)in.data(), src_len, level
     );
 
     if (status != MZ_OK)
@@ -3498,10 +3503,17 @@ std::string compression::compress(const std::string & in)
 }
 
 std::string compression::decompress(const std::string & in)
+{
+    return decompress(in, 65535 * 2);
+}
+
+std::string compression::decompress(
+    const std::string & in, const std::size_t & length
+    )
 {
     std::string ret;
     
-    mz_ulong uncomp_len = 65535 * 2;
+    mz_ulong uncomp_len = length;
     mz_ulong cmp_len = in.size();
     
     ret.resize(uncomp_len);
@@ -18,7 +18,8 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <iostream>
+#include <algorithm>
+#include <cstring>
 
 #include <boost/algorithm/string.hpp>
 
@@ -30,33 +31,66 @@
 
 using namespace database;
 
-entry::entry(
-    boost::asio::io_service & ios, const std::shared_ptr<storage> & s,
-    const std::string & query_string
-    )
-    : m_query_string(query_string)
+entry::entry(const std::string & query_string)
+    : m_buffer_length(0)
+    , m_pairs_size(0)
+    , m_query_length(static_cast<std::uint32_t> (query_string.size()))
     , m_lifetime(0)
     , m_allocation_time(std::time(0))
     , m_timestamp(std::time(0))
-    , m_expired(false)
-    , strand_(ios)
-    , storage_(s)
-    , expire_timer_(ios)
 {
     /**
-     * Allocate the query.
+     * The (lowercase key, lowercase value) pairs.
      */
-    query q(query_string);
+    std::vector< std::pair<std::string, std::string> > terms;
     
     /**
-     * Get the lifetime.
+     * Split the query.
      */
-    for (auto & i : q.pairs())
+    auto pairs = query::split(query_string);
+    
+    terms.reserve(pairs.size());
+    
+    for (auto & i : pairs)
     {
+        /**
+         * Get the lifetime.
+         */
         if (boost::iequals("_l", i.first))
         {
             m_lifetime = utility::to_int(i.second);
         }
+        
+        /**
+         * Skip "private" terms.
+         */
+        if (utility::string::starts_with(i.first, "_"))
+        {
+            continue;
+        }
+        
+        auto key = boost::algorithm::to_lower_copy(i.first);
+        
+        auto value = boost::algorithm::to_lower_copy(i.second);
+        
+        bool found = false;
+        
+        for (auto & j : terms)
+        {
+            if (j.first == key)
+            {
+                j.second = value;
+                
+                found = true;
+                
+                break;
+            }
+        }
+        
+        if (found == false)
+        {
+            terms.push_back(std::make_pair(key, value));
+        }
     }
     
     if (m_lifetime > max_lifetime)
@@ -68,53 +102,102 @@ entry::entry(
     {
         m_lifetime = min_lifetime;
     }
+    
+    /**
+     * Calculate the buffer length.
+     */
+    std::size_t len = terms.size() * sizeof(pair_t) + m_query_length;
+    
+    for (auto & i : terms)
+    {
+        len += i.first.size() + i.second.size();
+    }
+    
+    m_buffer.reset(new char[len]);
+    m_buffer_length = static_cast<std::uint32_t> (len);
+    m_pairs_size = static_cast<std::uint32_t> (terms.size());
+    
+    /**
+     * Copy the query string after the pair table.
+     */
+    std::uint32_t offset =
+        static_cast<std::uint32_t> (terms.size() * sizeof(pair_t))
+    ;
+    
+    std::memcpy(m_buffer.get() + offset, query_string.data(), m_query_length);
+    
+    offset += m_query_length;
+    
+    /**
+     * Copy the keys and values and fill in the pair table, the key id's
+     * are assigned when the entry is stored.
+     */
+    auto * p = pairs_mutable();
+    
+    for (auto & i : terms)
+    {
+        p->key = 0;
+        p->offset = offset;
+        p->key_length = static_cast<std::uint32_t> (i.first.size());
+        p->length = static_cast<std::uint32_t> (i.second.size());
+        
+        std::memcpy(m_buffer.get() + offset, i.first.data(), p->key_length);
+        
+        offset += p->key_length;
+        
+        std::memcpy(m_buffer.get() + offset, i.second.data(), p->length);
+        
+        offset += p->length;
+        
+        ++p;
+    }
 }
 
-entry::~entry()
+std::string entry::query_string() const
 {
-    // ...
+    return std::string(
+        m_buffer.get() + m_pairs_size * sizeof(pair_t), m_query_length
+    );
 }
 
-void entry::start()
+const std::uint32_t & entry::lifetime() const
 {
-    /**
-     * Start the expire timer.
-     */
-    expire_timer_.expires_from_now(std::chrono::seconds(m_lifetime));
-    expire_timer_.async_wait(
-        strand_.wrap(std::bind(&entry::expire_tick, shared_from_this(),
-        std::placeholders::_1))
-    );
+    return m_lifetime;
 }
 
-void entry::stop()
+void entry::set_timestamp(const std::time_t & val)
 {
-    expire_timer_.cancel();
+    m_timestamp = val;
 }
 
-const std::string & entry::query_string() const
+const std::time_t & entry::timestamp() const
 {
-    return m_query_string;
+    return m_timestamp;
 }
 
-const std::uint32_t & entry::lifetime() const
+std::size_t entry::pairs_size() const
 {
-    return m_lifetime;
+    return m_pairs_size;
 }
 
-void entry::set_timestamp(const std::time_t & val)
+const entry::pair_t * entry::pairs() const
 {
-    m_timestamp = val;
+    return reinterpret_cast<const pair_t *> (m_buffer.get());
 }
 
-const std::time_t & entry::timestamp() const
+entry::pair_t * entry::pairs_mutable()
 {
-    return m_timestamp;
+    return reinterpret_cast<pair_t *> (m_buffer.get());
 }
 
-std::map<std::string, std::string> & entry::pairs()
+std::string entry::key(const pair_t & p) const
 {
-    return m_pairs;
+    return std::string(m_buffer.get() + p.offset, p.key_length);
+}
+
+std::string entry::value(const pair_t & p) const
+{
+    return std::string(m_buffer.get() + p.offset + p.key_length, p.length);
 }
 
 const std::uint32_t entry::expires() const
@@ -122,25 +205,129 @@ const std::uint32_t entry::expires() const
     return m_lifetime - (std::time(0) - m_allocation_time);
 }
 
-void entry::expire_tick(const boost::system::error_code & ec)
+bool entry::expired() const
 {
-    if (ec)
-    {
-        // ...
-    }
-    else
+    return std::time(0) - m_allocation_time >= m_lifetime;
+}
+
+bool entry::matches(const std::vector<term_t> & terms) const
+{
+    const auto * p = pairs();
+    const auto * end = p + m_pairs_size;
+    
+    for (auto & i : terms)
     {
-        log_debug("Entry " << m_query_string << " expired.");
+        auto it = std::lower_bound(
+            p, end, i.first, [](const pair_t & a, const std::uint32_t & b)
+            {
+                return a.key < b;
+            }
+        );
         
         /**
-         * Set the entry to expired.
+         * Make sure the each key from the query is found in the entry,
+         * otherwise it is a record mismatch.
          */
-        m_expired = true;
+        if (it == end || it->key != i.first)
+        {
+            return false;
+        }
+        
+        if (
+            it->length != i.second.size() || std::memcmp(
+            m_buffer.get() + it->offset + it->key_length, i.second.data(),
+            it->length) != 0
+            )
+        {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+bool entry::equals(const entry & other) const
+{
+    if (m_pairs_size != other.m_pairs_size)
+    {
+        return false;
+    }
+    
+    const auto * p1 = pairs();
+    const auto * p2 = other.pairs();
+    
+    for (std::uint32_t i = 0; i < m_pairs_size; i++)
+    {
+        if (
+            p1[i].key != p2[i].key || p1[i].length != p2[i].length ||
+            std::memcmp(m_buffer.get() + p1[i].offset + p1[i].key_length,
+            other.m_buffer.get() + p2[i].offset + p2[i].key_length,
+            p1[i].length) != 0
+            )
+        {
+            return false;
+        }
     }
+    
+    return true;
+}
+
+std::uint64_t entry::digest() const
+{
+    std::uint64_t ret = 14695981039346656037ULL;
+    
+    const auto * p = pairs();
+    
+    for (std::uint32_t i = 0; i < m_pairs_size; i++)
+    {
+        ret ^= hash_term(
+            p[i].key, m_buffer.get() + p[i].offset + p[i].key_length,
+            p[i].length
+        );
+        ret *= 1099511628211ULL;
+    }
+    
+    return ret;
+}
+
+void entry::intern_keys(storage & s)
+{
+    auto * p = pairs_mutable();
+    
+    for (std::uint32_t i = 0; i < m_pairs_size; i++)
+    {
+        p[i].key = s.intern(
+            std::string(m_buffer.get() + p[i].offset, p[i].key_length)
+        );
+    }
+    
+    std::sort(p, p + m_pairs_size, [](const pair_t & a, const pair_t & b)
+    {
+        return a.key < b.key;
+    });
 }
 
-const bool & entry::expired() const
+std::size_t entry::memory_usage() const
+{
+    return sizeof(entry) + m_buffer_length;
+}
+
+std::uint64_t entry::hash_term(
+    const std::uint32_t & key, const char * buf, const std::size_t & len
+    )
 {
-    return m_expired;
+    /**
+     * FNV-1a seeded with the key id.
+     */
+    std::uint64_t ret = 14695981039346656037ULL ^ key;
+    
+    ret *= 1099511628211ULL;
+    
+    for (std::size_t i = 0; i < len; i++)
+    {
+        ret ^= static_cast<std::uint8_t> (buf[i]);
+        ret *= 1099511628211ULL;
+    }
+    
+    return ret;
 }
-            
\ No newline at end of file
@@ -1276,7 +1276,7 @@ void node_impl::handle_store_message(
             /**
              * Allocate the entry.
              */
-            std::shared_ptr<entry> e(new entry(io_service_, storage_, query));
+            auto e = std::make_shared<entry> (query);
             
             /**
              * Store the entry.
@@ -19,10 +19,9 @@
  */
 
 #include <cstdint>
+#include <memory>
 #include <vector>
 
-#include <boost/algorithm/string.hpp>
-
 #include <database/query.hpp>
 #include <database/utility.hpp>
 
@@ -31,37 +30,9 @@ using namespace database;
 query::query(const std::string & val)
     : m_str(val)
 {
-    auto i = val.find("&");
-    
-    if (i != std::string::npos)
-    {
-        std::vector<std::string> pairs1;
-        boost::split(pairs1, val, boost::is_any_of("&"));
-        
-        for (auto & i : pairs1)
-        {
-            std::vector<std::string> pairs2;
-            
-            boost::split(pairs2, i, boost::is_any_of("="));
-            
-            if (pairs2.size() != 2)
-            {
-                continue;
-            }
-            
-            m_pairs[pairs2[0]] = uri_decode(pairs2[1]);
-        }
-    }
-    else
+    for (auto & i : split(val))
     {
-        std::vector<std::string> pairs2;
-        
-        boost::split(pairs2, val, boost::is_any_of("="));
-        
-        if (pairs2.size() == 2)
-        {
-            m_pairs[pairs2[0]] = uri_decode(pairs2[1]);
-        }
+        m_pairs[i.first] = i.second;
     }
     
     for (auto & i : m_pairs)
@@ -101,6 +72,65 @@ std::map<std::string, std::string> & query::pairs_public()
     return m_pairs_public;
 }
 
+std::vector< std::pair<std::string, std::string> > query::split(
+    const std::string & val
+    )
+{
+    std::vector< std::pair<std::string, std::string> > ret;
+    
+    std::size_t offset = 0;
+    
+    while (offset <= val.size())
+    {
+        auto end = val.find('&', offset);
+        
+        if (end == std::string::npos)
+        {
+            end = val.size();
+        }
+        
+        /**
+         * A pair must contain exactly one '='.
+         */
+        auto equals = val.find('=', offset);
+        
+        if (
+            equals != std::string::npos && equals < end &&
+            val.find('=', equals + 1) >= end
+            )
+        {
+            std::string key(val, offset, equals - offset);
+            
+            std::string value = uri_decode(
+                std::string(val, equals + 1, end - equals - 1)
+            );
+            
+            bool found = false;
+            
+            for (auto & i : ret)
+            {
+                if (i.first == key)
+                {
+                    i.second = value;
+                    
+                    found = true;
+                    
+                    break;
+                }
+            }
+            
+            if (found == false)
+            {
+                ret.push_back(std::make_pair(key, value));
+            }
+        }
+        
+        offset = end + 1;
+    }
+    
+    return ret;
+}
+
 const char HEX2DEC[256] = 
 {
     /*       0  1  2  3   4  5  6  7   8  9  A  B   C  D  E  F */
@@ -18,6 +18,7 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <chrono>
 #include <iostream>
 
 #include <boost/algorithm/string.hpp>
@@ -31,7 +32,8 @@
 using namespace database;
 
 storage::storage(boost::asio::io_service & ios)
-    : io_service_(ios)
+    : m_entries_empty(0)
+    , io_service_(ios)
     , strand_(ios)
     , timer_(ios)
 {
@@ -58,113 +60,44 @@ void storage::stop()
     
     std::lock_guard<std::recursive_mutex> l(mutex_);
     
-    auto it = m_entries.begin();
-    
-    while (it != m_entries.end())
-    {
-        if (*it)
-        {
-            (*it)->stop();
-        }
-        else
-        {
-            // ...
-        }
-        
-        it = m_entries.erase(it);
-    }
+    m_entries.clear();
+    m_entries_empty = 0;
+    m_keys.clear();
+    m_digests.clear();
+    m_terms.clear();
 }
 
 void storage::store(const std::shared_ptr<entry> e)
 {
+    std::lock_guard<std::recursive_mutex> l(mutex_);
+    
     /**
-     * Allocate the query.
+     * Intern the keys.
      */
-    query q(e->query_string());
+    e->intern_keys(*this);
     
-    for (auto & i : q.pairs())
-    {
-        if (utility::string::starts_with(i.first, "_"))
-        {
-            continue;
-        }
-        
-        e->pairs().insert(std::make_pair(i.first, i.second));
-    }
+    auto digest = e->digest();
     
-    std::lock_guard<std::recursive_mutex> l(mutex_);
+    auto range = m_digests.equal_range(digest);
     
-    auto it = m_entries.begin();
-
-    for (; it != m_entries.end();)
+    for (auto it = range.first; it != range.second; ++it)
     {
-        auto index1 = 0, index2 = 0;
-        
-        std::string qs1, qs2;
-    
-        auto it1 = e->pairs().begin();
-        
-        for (; it1 != e->pairs().end(); ++it1)
-        {
-            if (utility::string::starts_with(it1->first, "_"))
-            {
-                index1++;
-                
-                continue;
-            }
-            
-            qs1 += it1->first + "=" + it1->second;
-
-            if (index1++ < (e->pairs().size() - 1))
-            {
-                qs1.append("&", strlen("&"));
-            }
-        }
-        
-        auto it2 = (*it)->pairs().begin();
+        auto & older = m_entries[it->second];
         
-        for (; it2 != (*it)->pairs().end(); ++it2)
-        {
-            if (utility::string::starts_with(it2->first, "_"))
-            {
-                index2++;
-                
-                continue;
-            }
-            
-            qs2 += it2->first + "=" + it2->second;
-            
-            if (index2++ < ((*it)->pairs().size() - 1))
-            {
-                qs2.append("&", strlen("&"));
-            }
-        }
-    
-        if (boost::iequals(qs1, qs2))
+        if (older && older->equals(*e))
         {
             /**
              * Copy the timestamp from the older entry.
              */
-            e->set_timestamp((*it)->timestamp());
+            e->set_timestamp(older->timestamp());
             
             /**
-             * Stop the older entry.
+             * Replace the older entry, it has the same key/value pairs so
+             * the indexes remain valid.
              */
-            (*it)->stop();
+            older = e;
             
-            /**
-             * Erase the older entry.
-             */
-            it = m_entries.erase(it);
-            
-            /**
-             * Because of this logic there shouldn't be any more matches.
-             */
-            break;
-        }
-        else
-        {
-            ++it;
+            return;
         }
     }
 
@@ -174,9 +107,9 @@ void storage::store(const std::shared_ptr<entry> e)
     m_entries.push_back(e);
     
     /**
-     * Start the entry.
+     * Index the entry.
      */
-    e->start();
+    index(static_cast<std::uint32_t> (m_entries.size() - 1));
 }
 
 const std::vector< std::shared_ptr<entry> > storage::find(
@@ -188,85 +121,127 @@ const std::vector< std::shared_ptr<entry> > storage::find(
     std::vector< std::shared_ptr<entry> > ret;
 
     /**
-     * Allocate the query.
+     * Build the (interned key id, lowercase value) terms.
      */
-    query q(query_string);
-
-    for (auto & i : m_entries)
+    std::vector<entry::term_t> terms;
+    
+    for (auto & i : query::split(query_string))
     {
-        bool matches = true;
+        if (utility::string::starts_with(i.first, "_"))
+        {
+            continue;
+        }
         
-        for (auto & j : q.pairs())
+        auto it = m_keys.find(boost::algorithm::to_lower_copy(i.first));
+        
+        /**
+         * If the key is unknown no entry can match.
+         */
+        if (it == m_keys.end())
         {
-            if (utility::string::starts_with(j.first, "_"))
-            {
-                continue;
-            }
-            
-            /**
-             * Make sure the each key from the query is found in the entry, 
-             * otherwise it is a record mismatch.
-             */
-            bool found = false;
-            
-            for (auto & k : i->pairs())
-            {
-                if (boost::iequals(j.first, k.first))
-                {
-                    found = true;
-                    break;
-                }
-            }
-            
-            if (!found)
+            return ret;
+        }
+        
+        auto value = boost::algorithm::to_lower_copy(i.second);
+        
+        bool found = false;
+        
+        for (auto & j : terms)
+        {
+            if (j.first == it->second)
             {
-                matches = false;
+                j.second = value;
+                
+                found = true;
+                
                 break;
             }
-            
-            for (auto & k : i->pairs())
+        }
+        
+        if (found == false)
+        {
+            terms.push_back(std::make_pair(it->second, value));
+        }
+    }
+    
+    if (terms.size() == 0)
+    {
+        for (auto & i : m_entries)
+        {
+            if (i && i->expired() == false)
             {
-                //log_debug(j.first << ":" << k.first);
-                
-                if (utility::string::starts_with(k.first, "_"))
-                {
-                    continue;
-                }
-
-                if (boost::iequals(j.first, k.first))
-                {
-                    log_debug(j.second << ":" << k.second);
-
-                    if (boost::iequals(j.second, k.second))
-                    {
-
-                    }
-                    else
-                    {
-                        matches = false;
-                    }
-                    
-                    log_debug("matches = " << matches);
-                }
-                
-                if (!matches)
-                {
-                    break;
-                }
+                ret.push_back(i);
             }
         }
         
-        if (matches)
+        return ret;
+    }
+    
+    /**
+     * Use the term with the fewest candidates.
+     */
+    const std::vector<std::uint32_t> * candidates = 0;
+    
+    for (auto & i : terms)
+    {
+        auto it = m_terms.find(
+            entry::hash_term(i.first, i.second.data(), i.second.size())
+        );
+        
+        if (it == m_terms.end())
+        {
+            return ret;
+        }
+        
+        if (candidates == 0 || it->second.size() < candidates->size())
+        {
+            candidates = &it->second;
+        }
+    }
+    
+    std::uint32_t previous = static_cast<std::uint32_t> (-1);
+    
+    for (auto & i : *candidates)
+    {
+        /**
+         * Skip duplicates caused by term hash collisions within an entry.
+         */
+        if (i == previous)
+        {
+            continue;
+        }
+        
+        previous = i;
+        
+        auto & e = m_entries[i];
+        
+        if (e && e->expired() == false && e->matches(terms))
         {
-            log_debug("Insert result= " << i->query_string());
+            log_debug("Insert result= " << e->query_string());
             
-            ret.push_back(i);
+            ret.push_back(e);
         }
     }
 
     return ret;
 }
 
+std::uint32_t storage::intern(const std::string & key)
+{
+    std::lock_guard<std::recursive_mutex> l(mutex_);
+    
+    auto it = m_keys.find(key);
+    
+    if (it == m_keys.end())
+    {
+        it = m_keys.insert(
+            std::make_pair(key, static_cast<std::uint32_t> (m_keys.size()))
+        ).first;
+    }
+    
+    return it->second;
+}
+
 void storage::tick(const boost::system::error_code & ec)
 {
     if (ec)
@@ -277,27 +252,32 @@ void storage::tick(const boost::system::error_code & ec)
     {
         std::lock_guard<std::recursive_mutex> l(mutex_);
 
-        auto it = m_entries.begin();
-        
-        while (it != m_entries.end())
+        /**
+         * Release the expired entries.
+         */
+        for (auto & i : m_entries)
         {
-            if (*it && (*it)->expired())
+            if (i && i->expired())
             {
-                log_debug("Entry " << (*it)->query_string() << " expired.");
+                log_debug("Entry " << i->query_string() << " expired.");
                 
-                (*it)->stop();
+                i.reset();
                 
-                it = m_entries.erase(it);
-            }
-            else if (*it)
-            {
-                ++it;
-            }
-            else
-            {
-                it = m_entries.erase(it);
+                m_entries_empty++;
             }
         }
+        
+        /**
+         * Compact once an eighth of the slots are empty or the key table
+         * has grown too large.
+         */
+        if (
+            m_entries_empty > m_entries.size() / 8 ||
+            m_keys.size() > max_keys
+            )
+        {
+            compact();
+        }
     
         /**
          * Start the expire timer.
@@ -310,11 +290,77 @@ void storage::tick(const boost::system::error_code & ec)
     }
 }
 
+void storage::compact()
+{
+    std::lock_guard<std::recursive_mutex> l(mutex_);
+    
+    std::vector< std::shared_ptr<entry> > entries;
+    
+    entries.reserve(m_entries.size() - m_entries_empty);
+    
+    for (auto & i : m_entries)
+    {
+        if (i)
+        {
+            entries.push_back(i);
+        }
+    }
+    
+    m_entries.swap(entries);
+    m_entries_empty = 0;
+    
+    /**
+     * Rebuild the key table from the live entries.
+     */
+    if (m_keys.size() > max_keys)
+    {
+        m_keys.clear();
+        
+        for (auto & i : m_entries)
+        {
+            i->intern_keys(*this);
+        }
+    }
+    
+    m_digests.clear();
+    m_terms.clear();
+    
+    for (std::uint32_t i = 0; i < m_entries.size(); i++)
+    {
+        index(i);
+    }
+}
+
+void storage::index(const std::uint32_t & index)
+{
+    const auto & e = m_entries[index];
+    
+    m_digests.insert(std::make_pair(e->digest(), index));
+    
+    const auto * p = e->pairs();
+    
+    for (std::uint32_t i = 0; i < e->pairs_size(); i++)
+    {
+        auto value = e->value(p[i]);
+        
+        m_terms[
+            entry::hash_term(p[i].key, value.data(), value.size())
+        ].push_back(index);
+    }
+}
+
 const std::vector< std::shared_ptr<entry> > & storage::entries() const
 {
     return m_entries;
 }
 
+std::size_t storage::size()
+{
+    std::lock_guard<std::recursive_mutex> l(mutex_);
+    
+    return m_entries.size() - m_entries_empty;
+}
+
 int storage::run_test()
 {
     std::vector<std::string> pairs1;
@@ -346,5 +392,82 @@ int storage::run_test()
         std::cerr << i.second << std::endl;
     }
 
+    boost::asio::io_service ios;
+    
+    storage s(ios);
+    
+    /**
+     * Duplicate key/value pairs (ignoring case and private terms) replace
+     * the older entry.
+     */
+    s.store(std::make_shared<entry> ("fruit=apple&color=red&_l=60"));
+    s.store(std::make_shared<entry> ("Color=RED&fruit=apple&_l=120"));
+    s.store(std::make_shared<entry> ("fruit=pear&color=green"));
+    
+    assert(s.entries().size() == 2);
+    assert(s.size() == 2);
+    assert(s.find("fruit=apple").size() == 1);
+    assert(s.find("COLOR=green").size() == 1);
+    assert(s.find("fruit=apple&color=green").size() == 0);
+    assert(s.find("shape=round").size() == 0);
+    assert(s.find("_l=60").size() == 2);
+    
+    s.stop();
+    
+    /**
+     * Measure store/find throughput and memory per entry.
+     */
+    enum { entries_count = 1000000 };
+    
+    auto start = std::chrono::steady_clock::now();
+    
+    for (std::size_t i = 0; i < entries_count; i++)
+    {
+        s.store(
+            std::make_shared<entry> ("name=file" + std::to_string(i) +
+            "&type=" + std::to_string(i % 16) + "&_l=3600")
+        );
+    }
+    
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds> (
+        std::chrono::steady_clock::now() - start
+    ).count();
+    
+    std::size_t bytes = 0;
+    
+    for (auto & i : s.entries())
+    {
+        if (i)
+        {
+            bytes += i->memory_usage();
+        }
+    }
+    
+    std::cerr <<
+        "store: " << entries_count * 1000.0 / (elapsed + 1) << " entries/s, " <<
+        bytes / entries_count << " bytes/entry" <<
+    std::endl;
+    
+    start = std::chrono::steady_clock::now();
+    
+    std::size_t found = 0;
+    
+    for (std::size_t i = 0; i < entries_count; i++)
+    {
+        found += s.find("name=file" + std::to_string(i)).size();
+    }
+    
+    elapsed = std::chrono::duration_cast<std::chrono::milliseconds> (
+        std::chrono::steady_clock::now() - start
+    ).count();
+    
+    assert(found == entries_count);
+    
+    std::cerr <<
+        "find: " << entries_count * 1000.0 / (elapsed + 1) << " queries/s" <<
+    std::endl;
+    
+    s.stop();
+    
     return 0;
 }
@@ -707,7 +707,7 @@ void tcp_acceptor::handle_http_message(
                 );
                 pt.put(
                     "stats_storage_entries",
-                    std::to_string(n->storage_->entries().size())
+                    std::to_string(n->storage_->size())
                 );
             }
             
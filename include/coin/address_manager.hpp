@@ -21,10 +21,14 @@
 #ifndef COIN_ADDRESS_MANAGER_HPP
 #define COIN_ADDRESS_MANAGER_HPP
 
+#include <array>
+#include <atomic>
 #include <cstdint>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <set>
+#include <unordered_map>
 #include <vector>
 
 #include <boost/asio.hpp>
@@ -64,7 +68,6 @@ namespace coin {
                     ret.last_attempts = 0;
                     ret.reference_count = 0;
                     ret.tried = false;
-                    ret.random_position = 0;
                     
                     assert(ret.addr.is_valid());
                     
@@ -106,86 +109,108 @@ namespace coin {
                  */
                 bool tried;
                 
-                /**
-                 * The randomized position.
-                 */
-                std::uint32_t random_position;
-                
                 /**
                  * Calculates the tried bucket index.
                  * @param key The key.
                  */
                 std::uint32_t calculate_tried_bucket(
-                    const std::vector<std::uint8_t> & key
-                    )
+                    const std::array<std::uint8_t, 32> & key
+                    ) const
                 {
-                    std::vector<std::uint8_t> buf1, buf2;
-                    
-                    std::vector<std::uint8_t> addr_key = addr.key();
+                    std::array<std::uint8_t, 32 + 18> buf1;
                     
-                    buf1.insert(buf1.end(), key.begin(), key.end());
-                    buf1.insert(buf1.end(), addr_key.begin(), addr_key.end());
+                    std::memcpy(&buf1[0], &key[0], key.size());
+                    std::memcpy(
+                        &buf1[key.size()], &addr.address[0], addr.address.size()
+                    );
+                    buf1[key.size() + 16] = addr.port / 0x100;
+                    buf1[key.size() + 17] = addr.port & 0x0FF;
    
                     auto h1 = hash::sha256d(&buf1[0], buf1.size());
                     
-                    auto hash1 = hash::to_uint64(&h1[0]);
+                    std::uint64_t hash1_m4 = hash::to_uint64(&h1[0]) % 4;
 
-                    std::vector<std::uint8_t> group_key = addr.group();
-
-                    buf2.insert(buf2.end(), key.begin(), key.end());
-                    buf2.insert(
-                        buf2.end(), group_key.begin(), group_key.end()
-                    );
-                    std::uint64_t hash1_m4 = (hash1 % 4);
-                    buf2.insert(
-                        buf2.end(), &hash1_m4, &hash1_m4 + sizeof(hash1_m4)
-                    );
+                    std::array<std::uint8_t, 32 + max_group + 8> buf2;
                     
-                    auto h2 = hash::sha256d(&buf2[0], buf2.size());
+                    auto len = append_group(buf2, key, addr);
                     
-                    auto hash2 = hash::to_uint64(&h2[0]);
-
-                    return hash2 % 64;
+                    std::memcpy(&buf2[len], &hash1_m4, sizeof(hash1_m4));
+                    
+                    auto h2 = hash::sha256d(
+                        &buf2[0], len + sizeof(hash1_m4)
+                    );
+                    
+                    return hash::to_uint64(&h2[0]) % buckets_tried;
                 }
 
                 /**
                  * Calculates the new bucket index.
                  * @param key The key.
+                 * @param addr_src The source address.
                  */
                 std::uint32_t calculate_new_bucket(
-                    const std::vector<std::uint8_t> & key,
+                    const std::array<std::uint8_t, 32> & key,
                     const protocol::network_address_t & addr_src
-                    )
+                    ) const
                 {
-                    std::vector<std::uint8_t> buf1, buf2;
+                    auto group_src = addr_src.group();
+                    
+                    assert(group_src.size() <= max_group);
+                    
+                    std::array<std::uint8_t, 32 + max_group * 2> buf1;
+                    
+                    auto len = append_group(buf1, key, addr);
+                    
+                    std::memcpy(&buf1[len], &group_src[0], group_src.size());
+                    
+                    auto h1 = hash::sha256d(&buf1[0], len + group_src.size());
                     
-                    std::vector<std::uint8_t> group_key = addr.group();
-                    std::vector<std::uint8_t> group_key_src = addr_src.group();
+                    std::uint64_t hash1_m32 = hash::to_uint64(&h1[0]) % 32;
 
-                    buf1.insert(buf1.end(), key.begin(), key.end());
-                    buf1.insert(
-                        buf1.end(), group_key.begin(), group_key.end()
-                    );
-                    buf1.insert(
-                        buf1.end(), group_key_src.begin(), group_key_src.end()
+                    std::array<std::uint8_t, 32 + max_group + 8> buf2;
+                    
+                    std::memcpy(&buf2[0], &key[0], key.size());
+                    std::memcpy(
+                        &buf2[key.size()], &group_src[0], group_src.size()
                     );
-                    auto h1 = hash::sha256d(&buf1[0], buf1.size());
-                    auto hash1 = hash::to_uint64(&h1[0]);
-
-                    buf2.insert(buf2.end(), key.begin(), key.end());
-                    buf2.insert(
-                        buf2.end(), group_key_src.begin(), group_key_src.end()
+                    std::memcpy(
+                        &buf2[key.size() + group_src.size()], &hash1_m32,
+                        sizeof(hash1_m32)
                     );
-                    std::uint64_t hash1_m32 = (hash1 % 32);
-                    buf2.insert(
-                        buf2.end(), &hash1_m32, &hash1_m32 + sizeof(hash1_m32)
+                    
+                    auto h2 = hash::sha256d(
+                        &buf2[0], key.size() + group_src.size() +
+                        sizeof(hash1_m32)
                     );
                     
-                    auto h2 = hash::sha256d(&buf2[0], buf2.size());
+                    return hash::to_uint64(&h2[0]) % buckets_new;
+                }
+                
+                /**
+                 * Writes the key followed by the group of an address into a
+                 * fixed size buffer.
+                 * @param buf The buffer.
+                 * @param key The key.
+                 * @param addr The protocol::network_address_t.
+                 * @return The number of bytes written.
+                 */
+                template <std::size_t N>
+                static std::size_t append_group(
+                    std::array<std::uint8_t, N> & buf,
+                    const std::array<std::uint8_t, 32> & key,
+                    const protocol::network_address_t & addr
+                    )
+                {
+                    static_assert(N >= 32 + max_group, "buffer too small");
                     
-                    auto hash2 = hash::to_uint64(&h2[0]);
-
-                    return hash2 % 256;
+                    auto group = addr.group();
+                    
+                    assert(group.size() <= max_group);
+                    
+                    std::memcpy(&buf[0], &key[0], key.size());
+                    std::memcpy(&buf[key.size()], &group[0], group.size());
+                    
+                    return key.size() + group.size();
                 }
                 
                 /**
@@ -279,6 +304,37 @@ namespace coin {
 
             } address_info_t;
         
+            /**
+             * The peers file header (version 1), followed by the records
+             * and a sha256d checksum. All fields are in host byte order and
+             * the layout is fixed so the file can be mapped directly.
+             */
+            typedef struct peers_header_s
+            {
+                std::uint32_t magic;
+                std::uint32_t version;
+                std::uint32_t record_length;
+                std::uint32_t count;
+                std::uint8_t key[32];
+                std::uint8_t reserved[16];
+            } peers_header_t;
+        
+            /**
+             * A peers file record.
+             */
+            typedef struct peers_record_s
+            {
+                std::uint8_t address[16];
+                std::uint64_t services;
+                std::uint64_t last_success;
+                std::uint32_t timestamp;
+                std::uint32_t last_attempts;
+                std::uint16_t port;
+                std::uint8_t tried;
+                std::uint8_t reserved[5];
+                std::uint8_t addr_src[16];
+            } peers_record_t;
+        
             /**
              * Constructor
              */
@@ -299,23 +355,26 @@ namespace coin {
              */
             bool load();
         
+            /**
+             * Loads the file at the given path.
+             * @param path The path.
+             */
+            bool load(const std::string & path);
+        
             /**
              * Saves the file to disk.
              */
             void save();
- 
+        
             /**
-             * Finds address_info_t from a protocol::network_address_t.
-             * @param addr The protocol::network_address_t.
-             * @param ptr_id The ptr_id.
+             * Saves the file to the given path.
+             * @param path The path.
              */
-            address_manager::address_info_t * find(
-                const protocol::network_address_t & addr,
-                std::uint32_t * ptr_id = 0
-            );
+            void save(const std::string & path);
     
             /**
-             * Selects a protocol::network_address_t from a bucket.
+             * Selects a protocol::network_address_t from a bucket, this does
+             * not lock any of the shards.
              * @param unk_bias How much in percentage to favor new over tried
              * entries.
              */
@@ -348,7 +407,7 @@ namespace coin {
             /**
              * Marks an entry as being good.
              * @param addr The protocol::network_address_t.
-             * @param
+             * @param timestamp The timestamp.
              */
             void mark_good(
                 const protocol::network_address_t & addr,
@@ -356,29 +415,6 @@ namespace coin {
                 time::instance().get_adjusted()
             );
         
-            /**
-             * Moves an entry from the "new" table to the "tried" table.
-             * @param info The address_info_t.
-             * @param nid The nid.
-             * @param bucket_index The bucket index.
-             */
-            void move_to_tried(
-                address_info_t & info, const std::uint32_t & nid,
-                const std::uint32_t & bucket_index
-            );
-        
-            /**
-             * Creates an address_info_t.
-             * @param addr The address.
-             * @param addr_src The source from where the address was learned.
-             * @param ptr_id The ptr_id.
-             */
-            address_info_t & create(
-                const protocol::network_address_t & addr,
-                const protocol::network_address_t  & addr_src,
-                std::uint32_t * ptr_id = 0
-            );
-        
             /**
              * Adds a protocol::network_address_t.
              * @param addr The protocol::network_address_t.
@@ -405,92 +441,260 @@ namespace coin {
              */
             const std::size_t size() const;
         
+            /**
+             * Runs the test case (addr flood benchmark).
+             */
+            static int run_test();
+        
+            /**
+             * The number of shards.
+             */
+            enum { shard_count = 16 };
+        
+            /**
+             * The number of new buckets.
+             */
+            enum { buckets_new = 256 };
+        
+            /**
+             * The number of tried buckets.
+             */
+            enum { buckets_tried = 64 };
+        
+            /**
+             * The maximum number of entries in a bucket.
+             */
+            enum { bucket_size = 64 };
+        
+            /**
+             * The maximum number of entries of a new bucket held by a shard,
+             * every shard holds a slice of each of the (global) new buckets.
+             */
+            enum { bucket_size_shard = bucket_size / shard_count };
+        
+            /**
+             * The maximum length of protocol::network_address_t::group.
+             */
+            enum { max_group = 8 };
+        
+            /**
+             * The peers file version.
+             */
+            enum { peers_file_version = 1 };
+        
         private:
-
+        
             /**
-             * Returns the position in given bucket index to replace.
-             * @param bucket_index The bucket index.
+             * A shard owning the entries of the network groups mapped to it
+             * along with their buckets.
              */
-            std::int32_t select_tried(const std::uint32_t & bucket_index);
+            typedef struct shard_s
+            {
+                /**
+                 * The address_info_t map.
+                 */
+                std::unordered_map<std::uint32_t, address_info_t> address_info_map;
+                
+                /**
+                 * The protocol::network_address_t map.
+                 */
+                std::map<protocol::network_address_t, std::uint32_t>
+                    network_address_map
+                ;
+                
+                /**
+                 * The slices of the (global) new buckets.
+                 */
+                std::vector< std::set<std::uint32_t> > buckets_new;
+                
+                /**
+                 * The tried buckets.
+                 */
+                std::vector< std::vector<std::uint32_t> > buckets_tried;
+                
+                /**
+                 * The last used id.
+                 */
+                std::uint32_t id_count;
+                
+                /**
+                 * The number of tried entries.
+                 */
+                std::uint32_t number_tried;
+                
+                /**
+                 * The number of new entries.
+                 */
+                std::uint32_t number_new;
+                
+                /**
+                 * The std::mutex.
+                 */
+                mutable std::mutex mutex;
+            } shard_t;
         
             /**
-             * Shrinks a new bucket at the given index.
-             * @param index The index.
+             * An immutable copy of the buckets used for selection.
+             */
+            typedef struct snapshot_s
+            {
+                /**
+                 * The entries.
+                 */
+                std::vector<address_info_t> entries;
+                
+                /**
+                 * The non-empty new buckets (indexes into entries).
+                 */
+                std::vector< std::vector<std::uint32_t> > buckets_new;
+                
+                /**
+                 * The non-empty tried buckets (indexes into entries).
+                 */
+                std::vector< std::vector<std::uint32_t> > buckets_tried;
+                
+                /**
+                 * The number of new entries.
+                 */
+                std::size_t number_new;
+                
+                /**
+                 * The number of tried entries.
+                 */
+                std::size_t number_tried;
+            } snapshot_t;
+        
+            /**
+             * The shard an address belongs to.
+             * @param addr The protocol::network_address_t.
              */
-            void shrink_bucket_new(const std::uint32_t & index);
+            shard_t & shard(const protocol::network_address_t & addr);
         
             /**
-             * Swaps random first and second in the random id's.
-             * @param first The first.
-             * @param second The second.
+             * Finds address_info_t from a protocol::network_address_t.
+             * @param s The shard_t (locked).
+             * @param addr The protocol::network_address_t.
+             * @param ptr_id The ptr_id.
              */
-            void swap_random(
-                const std::uint32_t & first, const std::uint32_t & second
+            address_info_t * find(
+                shard_t & s, const protocol::network_address_t & addr,
+                std::uint32_t * ptr_id = 0
             );
         
-        protected:
+            /**
+             * Creates an address_info_t.
+             * @param s The shard_t (locked).
+             * @param addr The address.
+             * @param addr_src The source from where the address was learned.
+             * @param ptr_id The ptr_id.
+             */
+            address_info_t & create(
+                shard_t & s, const protocol::network_address_t & addr,
+                const protocol::network_address_t  & addr_src,
+                std::uint32_t * ptr_id = 0
+            );
         
             /**
-             * The key used to randomize bucket selection.
+             * Erases an address_info_t.
+             * @param s The shard_t (locked).
+             * @param nid The nid.
              */
-            std::vector<std::uint8_t> key_;
-    
+            void erase(shard_t & s, const std::uint32_t & nid);
+        
             /**
-             * The address_info_t map.
+             * Moves an entry from the "new" table to the "tried" table.
+             * @param s The shard_t (locked).
+             * @param info The address_info_t.
+             * @param nid The nid.
+             * @param bucket_index The bucket index.
              */
-            std::map<std::uint32_t, address_info_t> address_info_map_;
+            void move_to_tried(
+                shard_t & s, address_info_t & info, const std::uint32_t & nid,
+                const std::uint32_t & bucket_index
+            );
 
             /**
-             * The protocol::network_address_t map.
+             * Returns the position in given bucket index to replace.
+             * @param s The shard_t (locked).
+             * @param bucket_index The bucket index.
              */
-            std::map<protocol::network_address_t, std::uint32_t>
-                network_address_map_
-            ;
-    
+            std::int32_t select_tried(
+                shard_t & s, const std::uint32_t & bucket_index
+            );
+        
             /**
-             * The randomly ordered id's.
+             * Shrinks a new bucket at the given index.
+             * @param s The shard_t (locked).
+             * @param index The index.
              */
-            std::vector<std::uint32_t> random_ids_;
+            void shrink_bucket_new(shard_t & s, const std::uint32_t & index);
         
             /**
-             * The random_ids_ std::recursive_mutex.
+             * Inserts an entry read from the peers file.
+             * @param info The address_info_t.
              */
-            mutable std::recursive_mutex mutex_random_ids_;
-
+            void insert(address_info_t info);
+        
             /**
-             * The last used id.
+             * Clears all shards.
              */
-            std::uint32_t id_count_;
-            
+            void clear();
+        
             /**
-             * The number of tried entries.
+             * Loads the (version 0) peers file format.
+             * @param buf The buffer.
+             * @param len The length.
              */
-            std::uint32_t number_tried_;
-
+            void load_legacy(const char * buf, const std::size_t & len);
+        
             /**
-             * The number of new entries.
+             * Returns the snapshot rebuilding it if needed.
              */
-            std::uint32_t number_new_;
-    
+            std::shared_ptr<const snapshot_t> snapshot();
+        
+        protected:
+        
+            /**
+             * The key used to randomize bucket selection.
+             */
+            std::array<std::uint8_t, 32> key_;
+        
+            /**
+             * The shards.
+             */
+            std::array<shard_t, shard_count> shards_;
+        
+            /**
+             * The selection snapshot (std::atomic_load/std::atomic_store).
+             */
+            std::shared_ptr<const snapshot_t> snapshot_;
+        
+            /**
+             * The snapshot rebuild std::mutex.
+             */
+            std::mutex mutex_snapshot_;
+        
             /**
-             * The new buckets.
+             * If true an entry changed since the snapshot was taken.
              */
-            std::vector< std::set<std::uint32_t> > buckets_new_;
+            std::atomic<bool> snapshot_dirty_;
         
             /**
-             * The buckets_new_ std::recursive_mutex.
+             * If true the snapshot must be rebuilt before the next selection
+             * (the peers file was loaded or the entries cleared).
              */
-            std::recursive_mutex mutex_buckets_new_;
+            std::atomic<bool> snapshot_stale_;
         
             /**
-             * The tried buckets.
+             * The time (steady clock milliseconds) the snapshot was taken.
              */
-            std::vector< std::vector<std::uint32_t> > buckets_tried_;
+            std::atomic<std::int64_t> time_snapshot_;
         
             /**
-             * The buckets_tried_ std::recursive_mutex.
+             * The minimum interval in milliseconds between snapshots of
+             * changed entries.
              */
-            std::recursive_mutex mutex_buckets_tried_;
+            enum { interval_snapshot = 1000 };
     };
     
 } // namespace coin
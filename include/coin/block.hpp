@@ -22,6 +22,7 @@
 #define COIN_BLOCK_HPP
 
 #include <cstdint>
+#include <string>
 #include <vector>
 
 #include <coin/data_buffer.hpp>
@@ -41,7 +42,7 @@ namespace coin {
     /**
      * Implements a block.
      */
-    class block : public data_buffer
+    class block
     {
         public:
 
@@ -72,18 +73,23 @@ namespace coin {
              * The maximum size.
              */
             enum { size_maximum = 1000000 };
-
+        
             /**
-             * Constructor
+             * The flag set in the size of a compressed block file frame, the
+             * payload is the uncompressed length followed by the compressed
+             * block.
              */
-            block();
+            enum { frame_compressed = 0x80000000 };
         
             /**
-             * Encodes
-             * @param block_header_only If true only the block header will be
-             * encoded.
+             * The compression level (fastest) used for block files.
+             */
+            enum { compression_level = 1 };
+
+            /**
+             * Constructor
              */
-            void encode(const bool & block_header_only = false);
+            block();
         
             /**
              * Encodes
@@ -96,12 +102,14 @@ namespace coin {
             );
         
             /**
-             * Decodes
+             * Encodes
              * @param block_header_only If true only the block header will be
-             * decoded.
+             * encoded.
+             * @note Replaces the overload that encoded into the object itself,
+             * the encoding is returned instead of kept in the object.
              */
-            bool decode(const bool & block_header_only = false);
-
+            data_buffer encode(const bool & block_header_only = false);
+        
             /**
              * Decodes
              * @param buffer The data_buffer.
@@ -112,6 +120,13 @@ namespace coin {
                 data_buffer & buffer, const bool & block_header_only = false
             );
         
+            /**
+             * The encoded size in bytes.
+             * @param block_header_only If true only the block header will be
+             * counted.
+             */
+            std::size_t size(const bool & block_header_only = false) const;
+        
             /**
              * Sets null.
              */
@@ -153,6 +168,11 @@ namespace coin {
              */
             std::vector<transaction> & transactions();
         
+            /**
+             * The transactions.
+             */
+            const std::vector<transaction> & transactions() const;
+        
             /**
              * Updates the time.
              * @param previous The previous block index.
@@ -233,6 +253,19 @@ namespace coin {
                 const bool & check_merkle_root = true
             );
         
+            /**
+             * Sets if the context-free checks have passed.
+             * @param val The value.
+             * @note When true check_block with check_pow and
+             * check_merkle_root does not repeat them.
+             */
+            void set_is_checked(const bool & val);
+        
+            /**
+             * If true the context-free checks have passed.
+             */
+            const bool & is_checked() const;
+        
             /**
              * Accepts a block into the main chain.
              * @param connection_manager The tcp_connection_manager used for
@@ -265,6 +298,33 @@ namespace coin {
                 const bool & read_transactions = true
             );
 
+            /**
+             * Opens a block file frame through a single handle. A compressed
+             * block is read into memory, recently read blocks are cached so
+             * reading several transactions of the same block decompresses
+             * it once.
+             * @param file_index The file index.
+             * @param block_position The block position.
+             * @param buffer The data_buffer (uncompressed) if compressed.
+             * @param f The file positioned at the block if not compressed,
+             * null if compressed.
+             * @note Returns false on error.
+             */
+            static bool open_from_disk(
+                const std::uint32_t & file_index,
+                const std::uint32_t & block_position, data_buffer & buffer,
+                std::shared_ptr<file> & f
+            );
+        
+            /**
+             * Decompresses the payload of a compressed block file frame.
+             * @param payload The payload.
+             * @param buffer The data_buffer (uncompressed).
+             */
+            static bool decompress(
+                const std::string & payload, data_buffer & buffer
+            );
+        
             /**
              * Writes to disk.
              * @param file_number The file number (on disk).
@@ -405,6 +465,11 @@ namespace coin {
              */
             mutable std::vector<sha256> m_merkle_tree;
         
+            /**
+             * If true the context-free checks have passed.
+             */
+            bool m_is_checked;
+        
         protected:
 
             /**
@@ -108,6 +108,43 @@ namespace coin {
              */
             const std::shared_ptr<block_index> & block_index_next() const;
         
+            /**
+             * Builds the skip pointer and the links to the previous
+             * proof-of-work and proof-of-stake block indexes.
+             * @note The previous block index and the height must be set and
+             * the previous block index must already be built.
+             */
+            void build_skip();
+        
+            /**
+             * The skip block index (an ancestor used by get_ancestor).
+             */
+            const std::shared_ptr<block_index> & block_index_skip() const;
+        
+            /**
+             * The closest previous proof-of-work block index.
+             */
+            const std::shared_ptr<block_index> &
+                block_index_previous_pow() const
+            ;
+        
+            /**
+             * The closest previous proof-of-stake block index.
+             */
+            const std::shared_ptr<block_index> &
+                block_index_previous_pos() const
+            ;
+        
+            /**
+             * Gets the ancestor at the given height in logarithmic time.
+             * @param index The block_index.
+             * @param height The height.
+             */
+            static std::shared_ptr<block_index> get_ancestor(
+                const std::shared_ptr<block_index> & index,
+                const std::int32_t & height
+            );
+        
             /**
              * The file.
              */
@@ -294,6 +331,11 @@ namespace coin {
              * IF true the stake modifier has been generated.
              */
             bool generated_stake_modifier() const;
+        
+            /**
+             * Runs test case.
+             */
+            static int run_test();
 
         private:
         
@@ -315,6 +357,21 @@ namespace coin {
              */
             std::shared_ptr<block_index> m_block_index_next;
         
+            /**
+             * The skip block index.
+             */
+            std::shared_ptr<block_index> m_block_index_skip;
+        
+            /**
+             * The closest previous proof-of-work block index.
+             */
+            std::shared_ptr<block_index> m_block_index_previous_pow;
+        
+            /**
+             * The closest previous proof-of-stake block index.
+             */
+            std::shared_ptr<block_index> m_block_index_previous_pos;
+        
             /**
              * The file.
              */
@@ -404,7 +461,11 @@ namespace coin {
 
         protected:
         
-            // ...
+            /**
+             * Gets the height of the skip block index for the given height.
+             * @param height The height.
+             */
+            static std::int32_t get_skip_height(const std::int32_t & height);
     };
     
 } // namespace coin
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2013-2014 John Connor (BM-NC49AxAjcqVcF5jNPu85Rb8MJ2d9JqZt)
+ *
+ * This file is part of coinpp.
+ *
+ * coinpp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License with
+ * additional permissions to the one published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version. For more information see LICENSE.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COIN_CHACHA20_HPP
+#define COIN_CHACHA20_HPP
+
+#include <array>
+#include <cstdint>
+
+namespace coin {
+
+    /**
+     * Implements the ChaCha20 stream cipher (64-bit nonce and 64-bit block
+     * counter).
+     */
+    class chacha20
+    {
+        public:
+        
+            /**
+             * The key length.
+             */
+            enum { key_length = 32 };
+        
+            /**
+             * The block length.
+             */
+            enum { block_length = 64 };
+        
+            /**
+             * Constructor
+             */
+            chacha20();
+        
+            /**
+             * Constructor
+             * @param key The key (key_length bytes).
+             */
+            explicit chacha20(const std::uint8_t * key);
+        
+            /**
+             * Destructor
+             */
+            ~chacha20();
+        
+            /**
+             * Sets the key and resets the nonce and block counter.
+             * @param key The key (key_length bytes).
+             */
+            void set_key(const std::uint8_t * key);
+        
+            /**
+             * Sets the nonce.
+             * @param val The value.
+             */
+            void set_nonce(const std::uint64_t & val);
+        
+            /**
+             * Sets the block counter.
+             * @param val The value.
+             */
+            void seek(const std::uint64_t & val);
+        
+            /**
+             * Generates keystream.
+             * @param buf The buffer.
+             * @param len The length.
+             */
+            void keystream(std::uint8_t * buf, std::size_t len);
+        
+            /**
+             * Runs test case.
+             */
+            static int run_test();
+        
+        private:
+        
+            /**
+             * The state.
+             */
+            std::array<std::uint32_t, 16> m_state;
+        
+        protected:
+        
+            // ...
+    };
+    
+} // namespace coin
+
+#endif // COIN_CHACHA20_HPP
@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2013-2014 John Connor (BM-NC49AxAjcqVcF5jNPu85Rb8MJ2d9JqZt)
+ *
+ * This file is part of coinpp.
+ *
+ * coinpp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License with
+ * additional permissions to the one published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version. For more information see LICENSE.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COIN_CHAIN_REPLAY_HPP
+#define COIN_CHAIN_REPLAY_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <coin/sha256.hpp>
+
+namespace coin {
+
+    class block;
+    
+    /**
+     * Implements an offline chain replay. The blk*.dat files of an existing
+     * data directory are read in order and every block is validated and
+     * connected into an empty data directory through accept_block and
+     * connect_block, rebuilding the block and transaction indexes from
+     * scratch. It is the yardstick validation changes are measured with.
+     * @note It owns the process wide chain state while it runs so it must
+     * not be run alongside a started stack.
+     */
+    class chain_replay
+    {
+        public:
+        
+            /**
+             * The phases that are timed inside of the validation code.
+             */
+            typedef enum
+            {
+                phase_script,
+                phase_db,
+                phase_count
+            } phase_t;
+        
+            /**
+             * The statistics.
+             */
+            typedef struct stats_s
+            {
+                std::uint32_t blocks;
+                std::uint32_t blocks_orphan;
+                std::uint64_t transactions;
+                std::uint64_t sig_ops;
+                std::uint64_t bytes;
+                std::int32_t height;
+                std::uint64_t microseconds_read;
+                std::uint64_t microseconds_decode;
+                std::uint64_t microseconds_hash;
+                std::uint64_t microseconds_check;
+                std::uint64_t microseconds_accept;
+                std::uint64_t microseconds_script;
+                std::uint64_t microseconds_db;
+                std::uint64_t microseconds_total;
+            } stats_t;
+        
+            /**
+             * Constructor
+             * @param path_source The data directory holding the blk*.dat
+             * files.
+             * @param path_target The (empty) data directory to rebuild into.
+             */
+            chain_replay(
+                const std::string & path_source, const std::string & path_target
+            );
+        
+            /**
+             * Replays the chain.
+             * @param height_stop The height to stop at (-1 is the end of the
+             * block files).
+             * @param verify_all_scripts If true the signatures below the
+             * last checkpoint are verified too.
+             */
+            bool run(
+                const std::int32_t & height_stop = -1,
+                const bool & verify_all_scripts = false
+            );
+        
+            /**
+             * The statistics of the last run.
+             */
+            const stats_t & stats() const;
+        
+            /**
+             * A report of the statistics.
+             */
+            std::string to_string() const;
+        
+            /**
+             * If true the signatures below the last checkpoint are verified.
+             */
+            static bool verify_all_scripts();
+        
+            /**
+             * Starts timing a phase, this is a no-op unless a replay is
+             * running.
+             */
+            static std::chrono::steady_clock::time_point profile_start();
+        
+            /**
+             * Stops timing a phase.
+             * @param phase The phase_t.
+             * @param time_start The value returned by profile_start.
+             */
+            static void profile_stop(
+                const phase_t & phase,
+                const std::chrono::steady_clock::time_point & time_start
+            );
+        
+        private:
+        
+            /**
+             * Reads the blocks from a blk*.dat file.
+             * @param path The path.
+             * @param height_stop The height to stop at.
+             */
+            bool read_file(
+                const std::string & path, const std::int32_t & height_stop
+            );
+        
+            /**
+             * Validates and connects a block and any orphans waiting on it.
+             * @param blk The block.
+             */
+            bool process(const std::shared_ptr<block> & blk);
+        
+            /**
+             * Validates and connects a block.
+             * @param blk The block.
+             */
+            bool connect(block & blk);
+        
+            /**
+             * The source data directory.
+             */
+            std::string m_path_source;
+        
+            /**
+             * The target data directory.
+             */
+            std::string m_path_target;
+        
+            /**
+             * The statistics.
+             */
+            stats_t m_stats;
+        
+            /**
+             * The blocks whose previous block has not been seen yet by the
+             * previous block hash.
+             */
+            std::map<sha256, std::vector< std::shared_ptr<block> > > m_orphans;
+        
+            /**
+             * If true a replay is running.
+             */
+            static std::atomic<bool> g_is_running;
+        
+            /**
+             * If true the signatures below the last checkpoint are verified.
+             */
+            static std::atomic<bool> g_verify_all_scripts;
+        
+            /**
+             * The microseconds spent in each phase_t.
+             */
+            static std::atomic<std::uint64_t> g_microseconds[phase_count];
+        
+        protected:
+        
+            // ...
+    };
+    
+} // namespace coin
+
+#endif // COIN_CHAIN_REPLAY_HPP
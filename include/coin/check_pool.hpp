@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2013-2014 John Connor (BM-NC49AxAjcqVcF5jNPu85Rb8MJ2d9JqZt)
+ *
+ * This file is part of coinpp.
+ *
+ * coinpp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License with
+ * additional permissions to the one published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version. For more information see LICENSE.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COIN_CHECK_POOL_HPP
+#define COIN_CHECK_POOL_HPP
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+namespace coin {
+
+    /**
+     * Implements a pool of worker threads that run the context-free checks
+     * of blocks and transactions off of the networking and chain-state
+     * paths.
+     */
+    class check_pool
+    {
+        public:
+        
+            /**
+             * Implements an ordered sequence of checks. The checks run in
+             * parallel on the check_pool but the accept handlers are invoked
+             * on the given strand in the order they were pushed.
+             */
+            class sequence : public std::enable_shared_from_this<sequence>
+            {
+                public:
+                
+                    /**
+                     * The number of checks in flight at which the sequence
+                     * is full.
+                     */
+                    enum { max_checks = 1000 };
+                
+                    /**
+                     * The number of bytes in flight at which the sequence
+                     * is full.
+                     */
+                    enum { max_check_bytes = 16 * 1024 * 1024 };
+                
+                    /**
+                     * Constructor
+                     * @param owner The check_pool.
+                     * @param s The boost::asio::strand.
+                     */
+                    sequence(check_pool & owner, boost::asio::strand & s);
+                
+                    /**
+                     * Pushes a check.
+                     * @param check The (context-free) check, may throw.
+                     * @param accept The (stateful) accept handler.
+                     * @param bytes The size of what is checked.
+                     */
+                    void push(
+                        const std::function<bool ()> & check,
+                        const std::function<void (const bool &)> & accept,
+                        const std::size_t & bytes = 0
+                    );
+                
+                    /**
+                     * The number of checks not yet accepted.
+                     */
+                    std::size_t size() const;
+                
+                    /**
+                     * If true max_checks checks or max_check_bytes bytes
+                     * are not yet accepted, no more should be pushed until
+                     * the sequence drains.
+                     */
+                    bool is_full() const;
+                
+                private:
+                
+                    /**
+                     * Invokes the accept handlers of the completed checks at
+                     * the front of the sequence.
+                     */
+                    void drain();
+                
+                    /**
+                     * A slot.
+                     */
+                    typedef struct
+                    {
+                        bool is_done;
+                        bool success;
+                        std::size_t bytes;
+                        std::function<void (const bool &)> accept;
+                    } slot_t;
+                
+                    /**
+                     * The slots.
+                     */
+                    std::deque< std::shared_ptr<slot_t> > m_slots;
+                
+                    /**
+                     * The number of bytes of the slots.
+                     */
+                    std::size_t m_bytes;
+                
+                protected:
+                
+                    /**
+                     * The check_pool.
+                     */
+                    check_pool & check_pool_;
+                
+                    /**
+                     * The boost::asio::strand.
+                     */
+                    boost::asio::strand & strand_;
+                
+                    /**
+                     * The mutex.
+                     */
+                    mutable std::mutex mutex_;
+            };
+        
+            /**
+             * Constructor
+             */
+            check_pool();
+        
+            /**
+             * Destructor
+             */
+            ~check_pool();
+        
+            /**
+             * The singleton accessor.
+             */
+            static check_pool & instance();
+        
+            /**
+             * Starts
+             * @param threads The number of threads (zero is one per core).
+             */
+            void start(const std::size_t & threads = 0);
+        
+            /**
+             * Stops
+             */
+            void stop();
+        
+            /**
+             * Posts a function to a worker, if not started it is invoked
+             * inline.
+             * @param f The std::function.
+             */
+            void post(const std::function<void ()> & f);
+        
+            /**
+             * Runs test case.
+             */
+            static int run_test();
+        
+        private:
+        
+            /**
+             * The boost::asio::io_service.
+             */
+            boost::asio::io_service m_io_service;
+        
+            /**
+             * The boost::asio::io_service::work.
+             */
+            std::shared_ptr<boost::asio::io_service::work> m_work;
+        
+            /**
+             * The threads.
+             */
+            std::vector< std::shared_ptr<std::thread> > m_threads;
+        
+        protected:
+        
+            /**
+             * The mutex.
+             */
+            std::mutex mutex_;
+    };
+    
+} // namespace coin
+
+#endif // COIN_CHECK_POOL_HPP
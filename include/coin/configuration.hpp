@@ -88,6 +88,43 @@ namespace coin {
              */
             const std::size_t & network_tcp_inbound_maximum() const;
         
+            /**
+             * Sets the upload rate (bytes per second) for serving historical
+             * blocks.
+             * @param val The value.
+             */
+            void set_network_tcp_upload_historical_maximum(
+                const std::size_t & val
+            );
+        
+            /**
+             * The upload rate (bytes per second) for serving historical
+             * blocks.
+             */
+            const std::size_t & network_tcp_upload_historical_maximum() const;
+        
+            /**
+             * Sets the upload rate (bytes per second) for relay traffic.
+             * @param val The value.
+             */
+            void set_network_tcp_upload_relay_maximum(const std::size_t & val);
+        
+            /**
+             * The upload rate (bytes per second) for relay traffic.
+             */
+            const std::size_t & network_tcp_upload_relay_maximum() const;
+        
+            /**
+             * Sets the database backend (bdb or log).
+             * @param val The value.
+             */
+            void set_database_backend(const std::string & val);
+        
+            /**
+             * The database backend (bdb or log).
+             */
+            const std::string & database_backend() const;
+        
             /**
              * Sets the bootstrap nodes.
              * @param val The 
@@ -142,6 +179,22 @@ namespace coin {
              */
             std::size_t m_network_tcp_inbound_maximum;
         
+            /**
+             * The upload rate (bytes per second) for serving historical
+             * blocks.
+             */
+            std::size_t m_network_tcp_upload_historical_maximum;
+        
+            /**
+             * The upload rate (bytes per second) for relay traffic.
+             */
+            std::size_t m_network_tcp_upload_relay_maximum;
+        
+            /**
+             * The database backend.
+             */
+            std::string m_database_backend;
+        
             /**
              * The bootstrap nodes.
              */
@@ -33,6 +33,8 @@
 
 #include <boost/uuid/sha1.hpp>
 
+#include <coin/random.hpp>
+
 namespace coin {
 
     class crypto
@@ -52,8 +54,7 @@ namespace coin {
                     "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789"
                 ;
             
-                static std::random_device rd;
-                static std::mt19937_64 mt(rd());
+                random::secure gen;
                 
                 std::uniform_int_distribution<std::size_t> dist(
                     0, chars.size() - 1
@@ -61,7 +62,7 @@ namespace coin {
 
                 for (auto i = 0 ; i < len; ++i )
                 {
-                    ret += chars[dist(mt)] ;
+                    ret += chars[dist(gen)] ;
                 }
                 
                 return ret;
@@ -304,6 +304,37 @@ namespace coin {
                 }
 			}
 
+            /**
+             * Skips over bytes without reading them.
+             * @param len The length.
+             */
+			void skip(const std::size_t & len)
+			{
+                if (file_)
+                {
+                    file_offset_ += len;
+                    
+                    file_->seek_set(file_offset_);
+                }
+                else
+                {
+                    if (remaining() < len)
+                    {
+                        throw std::runtime_error(
+                            "buffer underrun, len = " + std::to_string(len) +
+                            ", remaining = " + std::to_string(remaining())
+                        );
+                    }
+
+                    if (m_read_ptr == 0)
+                    {
+                        m_read_ptr = &m_data[0];
+                    }
+                    
+                    m_read_ptr += len;
+                }
+			}
+
 			void write(void * data, const std::size_t & len)
 			{
 				m_data.resize(m_data.size() + len);
@@ -21,7 +21,10 @@
 #ifndef COIN_DB_HPP
 #define COIN_DB_HPP
 
+#include <algorithm>
 #include <cstdint>
+#include <cstring>
+#include <memory>
 #include <string>
 
 #include <db_cxx.h>
@@ -29,13 +32,15 @@
 #include <coin/data_buffer.hpp>
 #include <coin/key_pool.hpp>
 #include <coin/key_wallet_master.hpp>
+#include <coin/kv_store.hpp>
 #include <coin/logger.hpp>
 #include <coin/ripemd160.hpp>
 
 namespace coin {
     
     /**
-     * Implements a berkley database Db object wrapper.
+     * Implements a database file wrapper over the kv_store of the backend
+     * selected in the db_env.
      */
     class db
     {
@@ -45,8 +50,14 @@ namespace coin {
              * Constructor
              * @param file_name The file name.
              * @param file_mode The file mode.
+             * @param is_reader If true this is a long-lived read handle
+             * counted in db_env::file_reader_counts instead of
+             * db_env::file_use_counts.
              */
-            db(const std::string & file_name, const std::string & file_mode);
+            db(
+                const std::string & file_name, const std::string & file_mode,
+                const bool & is_reader = false
+            );
         
             /**
              * Destructor
@@ -59,26 +70,20 @@ namespace coin {
             void close();
         
             /**
-             * The Db.
+             * If false this long-lived read handle was dropped by the
+             * db_env and must be reopened.
              */
-            Db & get_Db();
+            bool is_reader_current() const;
         
             /**
-             * Gets the cursor.
+             * The kv_store.
              */
-            Dbc * get_cursor();
+            kv_store & get_kv_store();
         
             /**
-             * read_at_cursor
-             * @param ptr_cursor A pointer to the Dbc object.
-             * @param key The key.
-             * @param value The value.
-             * @param flags The flags.
+             * Allocates an iterator over the committed contents.
              */
-            int read_at_cursor(
-                Dbc * ptr_cursor, data_buffer & key, data_buffer & value,
-                const std::int32_t flags = DB_NEXT
-            );
+            std::shared_ptr<kv_store::iterator> get_iterator();
         
             /**
              * txn_begin
@@ -103,55 +108,17 @@ namespace coin {
             template<typename T>
             bool read(const data_buffer & key, T & value)
             {
-                if (m_Db == 0)
-                {
-                    return false;
-                }
-                
-                Dbt dbt_key(
-                    key.data(), static_cast<std::uint32_t> (key.size())
-                );
-
-                Dbt dbt_value;
-                
-                dbt_value.set_flags(DB_DBT_MALLOC);
+                std::string value_data;
                 
-                auto ret = m_Db->get(m_DbTxn, &dbt_key, &dbt_value, 0);
-                
-                std::memset(dbt_key.get_data(), 0, dbt_key.get_size());
-                
-                if (dbt_value.get_data() == 0)
-                {
-                    return false;
-                }
-                
-                try
-                {
-                    /**
-                     * Allocate the data_buffer.
-                     */
-                    data_buffer buffer(
-                        static_cast<char *>(dbt_value.get_data()),
-                        dbt_value.get_size()
-                    );
-                    
-                    /**
-                     * Decode the value from the buffer.
-                     */
-                    value.decode(buffer);
-                }
-                catch (std::exception & e)
+                if (
+                    read_raw(std::string(key.data(), key.size()),
+                    value_data) == false
+                    )
                 {
-                    log_error("DB read failed, what = " << e.what() << ".");
-                    
                     return false;
                 }
-
-                std::memset(dbt_value.get_data(), 0, dbt_value.get_size());
                 
-                free(dbt_value.get_data());
-                
-                return ret == 0;
+                return decode_value(value_data, value);
             }
         
             /**
@@ -162,56 +129,14 @@ namespace coin {
             template<typename T>
             bool read(const std::string & key, T & value)
             {
-                if (m_Db == 0)
-                {
-                    return false;
-                }
-                
-                Dbt dbt_key(
-                    const_cast<char *> (key.data()),
-                    static_cast<std::uint32_t> (key.size())
-                );
-
-                Dbt dbt_value;
-                
-                dbt_value.set_flags(DB_DBT_MALLOC);
-                
-                auto ret = m_Db->get(m_DbTxn, &dbt_key, &dbt_value, 0);
-                
-                std::memset(dbt_key.get_data(), 0, dbt_key.get_size());
+                std::string value_data;
                 
-                if (dbt_value.get_data() == 0)
+                if (read_raw(key, value_data) == false)
                 {
                     return false;
                 }
                 
-                try
-                {
-                    /**
-                     * Allocate the data_buffer.
-                     */
-                    data_buffer buffer(
-                        static_cast<char *>(dbt_value.get_data()),
-                        dbt_value.get_size()
-                    );
-                    
-                    /**
-                     * Decode the value from the buffer.
-                     */
-                    value.decode(buffer);
-                }
-                catch (std::exception & e)
-                {
-                    log_error("DB read failed, what = " << e.what() << ".");
-                    
-                    return false;
-                }
-
-                std::memset(dbt_value.get_data(), 0, dbt_value.get_size());
-                
-                free(dbt_value.get_data());
-                
-                return ret == 0;
+                return decode_value(value_data, value);
             }
         
             /**
@@ -221,49 +146,18 @@ namespace coin {
              */
             bool read(const std::string & key, std::int32_t & value)
             {
-                if (m_Db == 0)
-                {
-                    return false;
-                }
-                
-                Dbt dbt_key(
-                    const_cast<char *> (key.data()),
-                    static_cast<std::uint32_t> (key.size())
-                );
-
-                Dbt dbt_value;
-                
-                dbt_value.set_flags(DB_DBT_MALLOC);
+                std::string value_data;
                 
-                auto ret = m_Db->get(m_DbTxn, &dbt_key, &dbt_value, 0);
-                
-                std::memset(dbt_key.get_data(), 0, dbt_key.get_size());
-                
-                if (dbt_value.get_data() == 0)
+                if (read_raw(key, value_data) == false)
                 {
                     return false;
                 }
                 
-                try
-                {
-                    assert(dbt_value.get_size() == sizeof(std::int32_t));
-                    
-                    std::memcpy(
-                        &value, dbt_value.get_data(), dbt_value.get_size()
-                    );
-                }
-                catch (std::exception & e)
-                {
-                    log_error("DB read failed, what = " << e.what() << ".");
-                    
-                    return false;
-                }
-
-                std::memset(dbt_value.get_data(), 0, dbt_value.get_size());
+                assert(value_data.size() == sizeof(std::int32_t));
                 
-                free(dbt_value.get_data());
+                std::memcpy(&value, value_data.data(), sizeof(std::int32_t));
                 
-                return ret == 0;
+                return true;
             }
 
             /**
@@ -278,52 +172,21 @@ namespace coin {
                 const bool & overwrite = true
                 )
             {
-                if (m_Db == 0)
-                {
-                    return false;
-                }
-                
-                if (m_is_read_only)
-                {
-                    assert(!"Write called on database in read-only mode!");
-                }
-                
-                auto k1 = key.first;
-                auto k2 = key.second;
-
                 data_buffer key_data;
 
-                key_data.write_var_int(k1.size());
-                key_data.write_bytes(k1.data(), k1.size());
-                key_data.write_var_int(k2.size());
-                key_data.write_bytes(k2.data(), k2.size());
+                key_data.write_var_int(key.first.size());
+                key_data.write_bytes(key.first.data(), key.first.size());
+                key_data.write_var_int(key.second.size());
+                key_data.write_bytes(key.second.data(), key.second.size());
 
-                Dbt dat_key(
-                    (void *)key_data.data(),
-                    static_cast<std::uint32_t> (key_data.size())
-                );
-                
                 data_buffer value_data;
 
                 value_data.write_var_int(value.size());
                 value_data.write_bytes(value.data(), value.size());
 
-                Dbt dat_value(
-                    (void *)value_data.data(),
-                    static_cast<std::uint32_t> (value_data.size())
-                );
-
-                auto ret = m_Db->put(
-                    m_DbTxn, &dat_key, &dat_value, overwrite ?
-                    0 : DB_NOOVERWRITE
-                );
-
-                std::memset(dat_key.get_data(), 0, dat_key.get_size());
-                std::memset(dat_value.get_data(), 0, dat_value.get_size());
-                
-                return ret == 0;
+                return write_buffers(key_data, value_data, overwrite);
             }
-            
+        
             /**
              * Writes a key/value pair.
              * @param key The key.
@@ -336,48 +199,17 @@ namespace coin {
                 const bool & overwrite = true
                 )
             {
-                if (m_Db == 0)
-                {
-                    return false;
-                }
-
-                if (m_is_read_only)
-                {
-                    assert(!"Write called on database in read-only mode!");
-                }
-                
-                auto k1 = key.first;
-                auto k2 = key.second;
-                
                 data_buffer key_data;
 
-                key_data.write_var_int(k1.size());
-                key_data.write_bytes(k1.data(), k1.size());
-                key_data.write_sha256(k2);
-                
-                Dbt dat_key(
-                    (void *)key_data.data(),
-                    static_cast<std::uint32_t> (key_data.size())
-                );
+                key_data.write_var_int(key.first.size());
+                key_data.write_bytes(key.first.data(), key.first.size());
+                key_data.write_sha256(key.second);
                 
                 data_buffer value_data;
 
                 value.encode(value_data);
 
-                Dbt dat_value(
-                    (void *)value_data.data(),
-                    static_cast<std::uint32_t> (value_data.size())
-                );
-
-                auto ret = m_Db->put(
-                    m_DbTxn, &dat_key, &dat_value, overwrite ?
-                    0 : DB_NOOVERWRITE
-                );
-
-                std::memset(dat_key.get_data(), 0, dat_key.get_size());
-                std::memset(dat_value.get_data(), 0, dat_value.get_size());
-                
-                return ret == 0;
+                return write_buffers(key_data, value_data, overwrite);
             }
         
             /**
@@ -392,48 +224,17 @@ namespace coin {
                 const bool & overwrite = true
                 )
             {
-                if (m_Db == 0)
-                {
-                    return false;
-                }
-
-                if (m_is_read_only)
-                {
-                    assert(!"Write called on database in read-only mode!");
-                }
-                
-                auto k1 = key.first;
-                auto k2 = key.second;
-                
                 data_buffer key_data;
 
-                key_data.write_var_int(k1.size());
-                key_data.write_bytes(k1.data(), k1.size());
-                key_data.write_int64(k2);
-                
-                Dbt dat_key(
-                    (void *)key_data.data(),
-                    static_cast<std::uint32_t> (key_data.size())
-                );
+                key_data.write_var_int(key.first.size());
+                key_data.write_bytes(key.first.data(), key.first.size());
+                key_data.write_int64(key.second);
                 
                 data_buffer value_data;
 
                 value.encode(value_data);
 
-                Dbt dat_value(
-                    (void *)value_data.data(),
-                    static_cast<std::uint32_t> (value_data.size())
-                );
-
-                auto ret = m_Db->put(
-                    m_DbTxn, &dat_key, &dat_value, overwrite ?
-                    0 : DB_NOOVERWRITE
-                );
-
-                std::memset(dat_key.get_data(), 0, dat_key.get_size());
-                std::memset(dat_value.get_data(), 0, dat_value.get_size());
-                
-                return ret == 0;
+                return write_buffers(key_data, value_data, overwrite);
             }
 
             /**
@@ -448,48 +249,17 @@ namespace coin {
                 const bool & overwrite = true
                 )
             {
-                if (m_Db == 0)
-                {
-                    return false;
-                }
-
-                if (m_is_read_only)
-                {
-                    assert(!"Write called on database in read-only mode!");
-                }
-                
-                auto k1 = key.first;
-                auto k2 = key.second;
-                
                 data_buffer key_data;
 
-                key_data.write_var_int(k1.size());
-                key_data.write_bytes(k1.data(), k1.size());
-                key_data.write_uint32(k2);
-                
-                Dbt dat_key(
-                    (void *)key_data.data(),
-                    static_cast<std::uint32_t> (key_data.size())
-                );
+                key_data.write_var_int(key.first.size());
+                key_data.write_bytes(key.first.data(), key.first.size());
+                key_data.write_uint32(key.second);
                 
                 data_buffer value_data;
 
                 value.encode(value_data);
 
-                Dbt dat_value(
-                    (void *)value_data.data(),
-                    static_cast<std::uint32_t> (value_data.size())
-                );
-
-                auto ret = m_Db->put(
-                    m_DbTxn, &dat_key, &dat_value, overwrite ?
-                    0 : DB_NOOVERWRITE
-                );
-
-                std::memset(dat_key.get_data(), 0, dat_key.get_size());
-                std::memset(dat_value.get_data(), 0, dat_value.get_size());
-                
-                return ret == 0;
+                return write_buffers(key_data, value_data, overwrite);
             }
         
             /**
@@ -504,33 +274,17 @@ namespace coin {
                 const bool & overwrite = true
                 )
             {
-                if (m_Db == 0)
-                {
-                    return false;
-                }
-
-                if (m_is_read_only)
-                {
-                    assert(!"Write called on database in read-only mode!");
-                }
-                
-                auto k1 = key.first;
                 auto k2 = key.second;
                 
                 data_buffer key_data;
 
-                key_data.write_var_int(k1.size());
-                key_data.write_bytes(k1.data(), k1.size());
+                key_data.write_var_int(key.first.size());
+                key_data.write_bytes(key.first.data(), key.first.size());
                 key_data.write_bytes(
                     reinterpret_cast<char *>(&k2.digest()[0]),
                     ripemd160::digest_length
                 );
                 
-                Dbt dat_key(
-                    (void *)key_data.data(),
-                    static_cast<std::uint32_t> (key_data.size())
-                );
-                
                 data_buffer value_data;
 
                 value_data.write_var_int(value.size());
@@ -538,20 +292,7 @@ namespace coin {
                     reinterpret_cast<const char *>(&value[0]), value.size()
                 );
 
-                Dbt dat_value(
-                    (void *)value_data.data(),
-                    static_cast<std::uint32_t> (value_data.size())
-                );
-
-                auto ret = m_Db->put(
-                    m_DbTxn, &dat_key, &dat_value, overwrite ?
-                    0 : DB_NOOVERWRITE
-                );
-
-                std::memset(dat_key.get_data(), 0, dat_key.get_size());
-                std::memset(dat_value.get_data(), 0, dat_value.get_size());
-                
-                return ret == 0;
+                return write_buffers(key_data, value_data, overwrite);
             }
         
             /**
@@ -566,31 +307,14 @@ namespace coin {
                 const bool & overwrite = true
                 )
             {
-                if (m_Db == 0)
-                {
-                    return false;
-                }
-
-                if (m_is_read_only)
-                {
-                    assert(!"Write called on database in read-only mode!");
-                }
-                
-                auto k1 = key.first;
-                auto k2 = key.second;
-                
                 data_buffer key_data;
 
-                key_data.write_var_int(k1.size());
-                key_data.write_bytes(k1.data(), k1.size());
-                key_data.write_var_int(k2.size());
+                key_data.write_var_int(key.first.size());
+                key_data.write_bytes(key.first.data(), key.first.size());
+                key_data.write_var_int(key.second.size());
                 key_data.write_bytes(
-                    reinterpret_cast<char *>(&k2[0]), k2.size()
-                );
-                
-                Dbt dat_key(
-                    (void *)key_data.data(),
-                    static_cast<std::uint32_t> (key_data.size())
+                    reinterpret_cast<const char *>(&key.second[0]),
+                    key.second.size()
                 );
                 
                 data_buffer value_data;
@@ -600,20 +324,7 @@ namespace coin {
                     reinterpret_cast<const char *>(&value[0]), value.size()
                 );
 
-                Dbt dat_value(
-                    (void *)value_data.data(),
-                    static_cast<std::uint32_t> (value_data.size())
-                );
-
-                auto ret = m_Db->put(
-                    m_DbTxn, &dat_key, &dat_value, overwrite ?
-                    0 : DB_NOOVERWRITE
-                );
-
-                std::memset(dat_key.get_data(), 0, dat_key.get_size());
-                std::memset(dat_value.get_data(), 0, dat_value.get_size());
-                
-                return ret == 0;
+                return write_buffers(key_data, value_data, overwrite);
             }
         
             /**
@@ -627,26 +338,11 @@ namespace coin {
                 const bool & overwrite = true
                 )
             {
-                if (m_Db == 0)
-                {
-                    return false;
-                }
-
-                if (m_is_read_only)
-                {
-                    assert(!"Write called on database in read-only mode!");
-                }
-                
                 data_buffer key_data;
 
                 key_data.write_var_int(key.size());
                 key_data.write((void *)key.data(), key.size());
 
-                Dbt dat_key(
-                    (void *)key_data.data(),
-                    static_cast<std::uint32_t> (key_data.size())
-                );
-                
                 data_buffer value_data;
 
                 value_data.write_var_int(value.size());
@@ -654,20 +350,7 @@ namespace coin {
                     reinterpret_cast<const char *>(&value[0]), value.size()
                 );
 
-                Dbt dat_value(
-                    (void *)value_data.data(),
-                    static_cast<std::uint32_t> (value_data.size())
-                );
-
-                auto ret = m_Db->put(
-                    m_DbTxn, &dat_key, &dat_value, overwrite ?
-                    0 : DB_NOOVERWRITE
-                );
-
-                std::memset(dat_key.get_data(), 0, dat_key.get_size());
-                std::memset(dat_value.get_data(), 0, dat_value.get_size());
-                
-                return ret == 0;
+                return write_buffers(key_data, value_data, overwrite);
             }
             
             /**
@@ -682,26 +365,11 @@ namespace coin {
                 const bool & overwrite = true
                 )
             {
-                if (m_Db == 0)
-                {
-                    return false;
-                }
-
-                if (m_is_read_only)
-                {
-                    assert(!"Write called on database in read-only mode!");
-                }
-                
                 data_buffer key_data;
 
                 key_data.write_var_int(key.size());
                 key_data.write((void *)key.data(), key.size());
 
-                Dbt dat_key(
-                    (void *)key_data.data(),
-                    static_cast<std::uint32_t> (key_data.size())
-                );
-
                 data_buffer value_data;
 
                 value_data.write(
@@ -709,20 +377,7 @@ namespace coin {
                     sizeof(value)
                 );
 
-                Dbt dat_value(
-                    (void *)value_data.data(),
-                    static_cast<std::uint32_t> (value_data.size())
-                );
-
-                auto ret = m_Db->put(
-                    m_DbTxn, &dat_key, &dat_value, overwrite ?
-                    0 : DB_NOOVERWRITE
-                );
-
-                std::memset(dat_key.get_data(), 0, dat_key.get_size());
-                std::memset(dat_value.get_data(), 0, dat_value.get_size());
-                
-                return ret == 0;
+                return write_buffers(key_data, value_data, overwrite);
             }
     
             /**
@@ -731,20 +386,7 @@ namespace coin {
              */
             bool erase(const data_buffer & key) const
             {
-                if (m_Db == 0)
-                {
-                    return false;
-                }
-
-                Dbt dbt_key(
-                    key.data(), static_cast<std::uint32_t> (key.size())
-                );
-
-                auto ret = m_Db->del(m_DbTxn, &dbt_key, 0);
-
-                std::memset(dbt_key.get_data(), 0, dbt_key.get_size());
-                
-                return ret == 0 || ret == DB_NOTFOUND;
+                return erase_raw(std::string(key.data(), key.size()));
             }
         
             /**
@@ -755,32 +397,19 @@ namespace coin {
                 const std::pair<std::string, std::vector<std::uint8_t> > & key
                 ) const
             {
-                if (m_Db == 0)
-                {
-                    return false;
-                }
-
-                auto k1 = key.first;
-                auto k2 = key.second;
-                
                 data_buffer key_data;
 
-                key_data.write_var_int(k1.size());
-                key_data.write_bytes(k1.data(), k1.size());
-                key_data.write_var_int(k2.size());
+                key_data.write_var_int(key.first.size());
+                key_data.write_bytes(key.first.data(), key.first.size());
+                key_data.write_var_int(key.second.size());
                 key_data.write_bytes(
-                    reinterpret_cast<char *>(&k2[0]), k2.size()
+                    reinterpret_cast<const char *>(&key.second[0]),
+                    key.second.size()
                 );
                 
-                Dbt dbt_key(
-                    key_data.data(), static_cast<std::uint32_t> (key_data.size())
+                return erase_raw(
+                    std::string(key_data.data(), key_data.size())
                 );
-
-                auto ret = m_Db->del(m_DbTxn, &dbt_key, 0);
-
-                std::memset(dbt_key.get_data(), 0, dbt_key.get_size());
-                
-                return ret == 0 || ret == DB_NOTFOUND;
             }
     
             /**
@@ -789,20 +418,7 @@ namespace coin {
              */
             bool exists(const data_buffer & key)
             {
-                if (m_Db == 0)
-                {
-                    return false;
-                }
-                
-                Dbt dbt_key(
-                    key.data(), static_cast<std::uint32_t> (key.size())
-                );
-
-                auto ret = m_Db->exists(m_DbTxn, &dbt_key, 0);
-
-                std::memset(dbt_key.get_data(), 0, dbt_key.get_size());
-                
-                return ret == 0;
+                return exists_raw(std::string(key.data(), key.size()));
             }
         
             /**
@@ -811,25 +427,12 @@ namespace coin {
              */
             bool exists(const std::string & key)
             {
-                if (m_Db == 0)
-                {
-                    return false;
-                }
-                
                 data_buffer buffer;
 
                 buffer.write_var_int(key.size());
                 buffer.write_bytes(key.data(), key.size());
     
-                Dbt dbt_key(
-                    buffer.data(), static_cast<std::uint32_t> (buffer.size())
-                );
-
-                auto ret = m_Db->exists(m_DbTxn, &dbt_key, 0);
-
-                std::memset(dbt_key.get_data(), 0, dbt_key.get_size());
-                
-                return ret == 0;
+                return exists_raw(std::string(buffer.data(), buffer.size()));
             }
         
             /**
@@ -857,14 +460,29 @@ namespace coin {
             std::string m_file_name;
         
             /**
-             * The Db.
+             * The Db (berkley database backend only).
              */
             Db * m_Db;
         
             /**
-             * The DbTxn.
+             * The kv_store.
+             */
+            std::shared_ptr<kv_store> m_kv_store;
+        
+            /**
+             * The writes of the open transaction (if any).
+             */
+            std::unique_ptr<kv_store::batch> m_batch;
+        
+            /**
+             * If true this is a long-lived read handle.
              */
-            DbTxn * m_DbTxn;
+            bool m_is_reader;
+        
+            /**
+             * The db_env reader generation this handle was opened in.
+             */
+            std::uint32_t m_reader_generation;
         
         protected:
       
@@ -873,6 +491,108 @@ namespace coin {
              * @param version The version.
              */
             bool write_version(const std::int32_t & version);
+        
+            /**
+             * Rewrites a log-structured store by erasing the skipped keys,
+             * updating the version and compacting.
+             * @param file_name The file name.
+             * @param key_skip The key (if any) to skip.
+             */
+            static bool rewrite_log(
+                const std::string & file_name, const char * key_skip
+            );
+        
+            /**
+             * Reads a value, the open transaction (if any) is seen first.
+             * @param key The key.
+             * @param value The value.
+             */
+            bool read_raw(const std::string & key, std::string & value);
+        
+            /**
+             * Writes a value into the open transaction (if any) or the
+             * kv_store.
+             * @param key The key.
+             * @param value The value.
+             * @param overwrite If true an existing value will be overwritten.
+             */
+            bool write_raw(
+                const std::string & key, const std::string & value,
+                const bool & overwrite
+            );
+        
+            /**
+             * Erases a key in the open transaction (if any) or the kv_store.
+             * @param key The key.
+             */
+            bool erase_raw(const std::string & key) const;
+        
+            /**
+             * Checks if the key exists, the open transaction (if any) is seen
+             * first.
+             * @param key The key.
+             */
+            bool exists_raw(const std::string & key) const;
+        
+            /**
+             * Writes an encoded key/value pair and zeroes the buffers.
+             * @param key The key.
+             * @param value The value.
+             * @param overwrite If true an existing value will be overwritten.
+             */
+            bool write_buffers(
+                data_buffer & key, data_buffer & value, const bool & overwrite
+                )
+            {
+                if (m_is_read_only)
+                {
+                    assert(!"Write called on database in read-only mode!");
+                }
+                
+                auto ret = write_raw(
+                    std::string(key.data(), key.size()),
+                    std::string(value.data(), value.size()), overwrite
+                );
+                
+                std::memset(key.data(), 0, key.size());
+                std::memset(value.data(), 0, value.size());
+                
+                return ret;
+            }
+        
+            /**
+             * Decodes a value and zeroes the encoded copy.
+             * @param value_data The encoded value.
+             * @param value The value.
+             */
+            template<typename T>
+            bool decode_value(std::string & value_data, T & value)
+            {
+                auto ret = true;
+                
+                try
+                {
+                    /**
+                     * Allocate the data_buffer.
+                     */
+                    data_buffer buffer(value_data.data(), value_data.size());
+                    
+                    /**
+                     * Decode the value from the buffer.
+                     */
+                    value.decode(buffer);
+                }
+                catch (std::exception & e)
+                {
+                    log_error("DB read failed, what = " << e.what() << ".");
+                    
+                    ret = false;
+                }
+                
+                std::fill(value_data.begin(), value_data.end(), 0);
+                
+                return ret;
+            }
     };
 }
 
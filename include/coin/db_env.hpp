@@ -23,16 +23,25 @@
 
 #include <db_cxx.h>
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
 #include <map>
 #include <memory>
 #include <mutex>
+#include <set>
 #include <string>
+#include <thread>
 
 #include <coin/filesystem.hpp>
+#include <coin/kv_store.hpp>
 
 namespace coin {
 
+    class db;
+    class kv_store_log;
+    
     /**
      * Implements a berkley database DbEnv object wrapper.
      */
@@ -40,6 +49,33 @@ namespace coin {
     {
         public:
         
+            /**
+             * The maintenance thread budgets.
+             */
+            enum
+            {
+                maintenance_interval = 1,
+                trickle_percent = 10,
+                checkpoint_kbytes = 4096,
+                checkpoint_minutes = 2,
+            };
+        
+            /**
+             * The maintenance statistics.
+             */
+            typedef struct maintenance_stats_s
+            {
+                std::uint64_t checkpoints;
+                std::uint64_t checkpoint_milliseconds_last;
+                std::uint64_t checkpoint_milliseconds_max;
+                std::uint64_t checkpoint_milliseconds_total;
+                std::uint64_t pages_trickled;
+                std::uint64_t log_bytes_since_checkpoint;
+                std::uint64_t log_bytes;
+                std::uint64_t log_files;
+                std::uint64_t log_files_archived;
+            } maintenance_stats_t;
+        
             /**
              * Constructor
              */
@@ -69,6 +105,12 @@ namespace coin {
              */
             void close_Db(const std::string & file_name);
         
+            /**
+             * Closes every long-lived read handle, the threads that borrow
+             * them must have stopped.
+             */
+            void close_readers();
+        
             /**
              * Removes a Db object.
              * @param file_name The file name.
@@ -88,10 +130,23 @@ namespace coin {
             void checkpoint_lsn(const std::string & file_name);
         
             /**
-             * Flushes.
+             * Flushes. Unused Db objects are closed and detached on the
+             * maintenance thread, during shutdown this is done inline and
+             * the environment is closed.
              */
             void flush();
         
+            /**
+             * Asks the maintenance thread for a checkpoint regardless of the
+             * byte and time budgets.
+             */
+            void request_checkpoint();
+        
+            /**
+             * The maintenance statistics.
+             */
+            maintenance_stats_t maintenance_stats();
+        
             /**
              * The DbEnv.
              */
@@ -102,6 +157,23 @@ namespace coin {
              */
             std::map<std::string, std::uint32_t> & file_use_counts();
         
+            /**
+             * The long-lived read handle counts, these keep a Db object
+             * open but do not hold up a flush of other files.
+             */
+            std::map<std::string, std::uint32_t> & file_reader_counts();
+        
+            /**
+             * The open long-lived read handles.
+             */
+            std::set<db *> & readers();
+        
+            /**
+             * The reader generation, bumped whenever the long-lived read
+             * handles are dropped.
+             */
+            std::uint32_t reader_generation() const;
+        
             /**
              * The Db objects.
              */
@@ -113,8 +185,52 @@ namespace coin {
              */
             DbTxn * txn_begin(int flags = DB_TXN_WRITE_NOSYNC);
         
+            /**
+             * Sets the backend new db objects are opened with.
+             * @param val The kv_store::backend_t.
+             */
+            void set_backend(const kv_store::backend_t & val);
+        
+            /**
+             * The backend new db objects are opened with.
+             */
+            const kv_store::backend_t & backend() const;
+        
+            /**
+             * Gets the log-structured store of a file, opening it on first
+             * use. If the store does not exist yet but the berkley database
+             * file does it's contents are migrated first.
+             * @param file_name The file name.
+             */
+            std::shared_ptr<kv_store> get_kv_store_log(
+                const std::string & file_name
+            );
+        
+            /**
+             * Copies the contents of a file from one backend to another, the
+             * file must not be in use.
+             * @param file_name The file name.
+             * @param from The source kv_store::backend_t.
+             * @param to The destination kv_store::backend_t.
+             */
+            bool migrate(
+                const std::string & file_name,
+                const kv_store::backend_t & from,
+                const kv_store::backend_t & to
+            );
+        
         private:
         
+            /**
+             * The backend.
+             */
+            kv_store::backend_t m_backend;
+        
+            /**
+             * The open log-structured stores.
+             */
+            std::map<std::string, std::shared_ptr<kv_store_log> > m_kv_stores;
+        
             /**
              * The DbEnv.
              */
@@ -125,13 +241,84 @@ namespace coin {
              */
             std::map<std::string, std::uint32_t> m_file_use_counts;
         
+            /**
+             * The long-lived read handle counts.
+             */
+            std::map<std::string, std::uint32_t> m_file_reader_counts;
+        
+            /**
+             * The open long-lived read handles.
+             */
+            std::set<db *> m_readers;
+        
+            /**
+             * The reader generation.
+             */
+            std::atomic<std::uint32_t> m_reader_generation;
+        
             /**
              * The Db objects.
              */
             std::map<std::string, Db *> m_Dbs;
+        
+            /**
+             * The maintenance thread.
+             */
+            std::thread m_maintenance_thread;
+        
+            /**
+             * If true the maintenance thread should exit.
+             */
+            bool m_maintenance_stop;
+        
+            /**
+             * If true a flush was requested.
+             */
+            bool m_flush_requested;
+        
+            /**
+             * If true a forced checkpoint was requested.
+             */
+            bool m_checkpoint_requested;
+        
+            /**
+             * The maintenance statistics.
+             */
+            maintenance_stats_t m_maintenance_stats;
     
         protected:
         
+            /**
+             * Starts the maintenance thread.
+             */
+            void start_maintenance();
+        
+            /**
+             * Stops the maintenance thread.
+             */
+            void stop_maintenance();
+        
+            /**
+             * The maintenance thread loop.
+             */
+            void do_maintenance();
+        
+            /**
+             * Closes and detaches every Db object that is no longer in use.
+             */
+            void do_flush();
+        
+            /**
+             * Performs a checkpoint, archives unneeded log files and
+             * records the duration.
+             */
+            void do_checkpoint();
+        
+            /**
+             * Updates the log size statistics.
+             */
+            void update_log_stats();
+        
             /**
              * The state.
              */
@@ -155,6 +342,26 @@ namespace coin {
              * m_Dbs std::recursive_mutex.
              */
             std::recursive_mutex mutex_m_Dbs_;
+        
+            /**
+             * m_kv_stores std::recursive_mutex.
+             */
+            std::recursive_mutex mutex_kv_stores_;
+        
+            /**
+             * The maintenance std::mutex.
+             */
+            std::mutex mutex_maintenance_;
+        
+            /**
+             * The maintenance std::condition_variable.
+             */
+            std::condition_variable condition_maintenance_;
+        
+            /**
+             * m_maintenance_stats std::mutex.
+             */
+            std::mutex mutex_maintenance_stats_;
     };
     
 } // namespace coin
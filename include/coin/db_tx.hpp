@@ -50,6 +50,14 @@ namespace coin {
              */
             db_tx(const std::string & file_mode = "r+");
         
+            /**
+             * Borrows the calling thread's long-lived read handle, opened on
+             * first use and reopened if the db_env dropped it while no
+             * borrow is outstanding. Use it for reads only, never begin a
+             * transaction on it, close it or hand it to another thread.
+             */
+            static std::shared_ptr<db_tx> reader();
+        
             /**
              * Loads the block index.
              * @param impl The stack_impl.
@@ -195,6 +203,13 @@ namespace coin {
         
         protected:
         
+            /**
+             * Constructor
+             * @param file_mode The file mode.
+             * @param is_reader If true this is a long-lived read handle.
+             */
+            db_tx(const std::string & file_mode, const bool & is_reader);
+        
             /**
              * Reads a string.
              * @param key The key.
@@ -45,6 +45,13 @@ namespace coin {
              */
             static std::string data_path();
         
+            /**
+             * Overrides the user data directory (an empty path restores the
+             * default).
+             * @param path The path.
+             */
+            static void set_data_path(const std::string & path);
+        
         private:
         
             /** 
@@ -52,6 +59,11 @@ namespace coin {
              */
             static std::string home_path();
         
+            /**
+             * The user data directory override.
+             */
+            static std::string g_data_path;
+        
         protected:
         
             // ...
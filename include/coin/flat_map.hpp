@@ -0,0 +1,579 @@
+/*
+ * Copyright (c) 2013-2014 John Connor (BM-NC49AxAjcqVcF5jNPu85Rb8MJ2d9JqZt)
+ *
+ * This file is part of coinpp.
+ *
+ * coinpp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License with
+ * additional permissions to the one published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version. For more information see LICENSE.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COIN_FLAT_MAP_HPP
+#define COIN_FLAT_MAP_HPP
+
+#include <cstdint>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include <coin/salted_hasher.hpp>
+
+namespace coin {
+
+    /**
+     * Implements an open addressing (linear probing) hash map for hash keyed
+     * containers whose iteration order does not matter. Each slot has a
+     * control byte holding seven bits of the hash so that most probes never
+     * touch the key. Erased slots are left as tombstones so erasing does not
+     * invalidate iterators, inserting may (like std::unordered_map).
+     */
+    template <typename K, typename V, typename H = salted_hasher>
+    class flat_map
+    {
+        public:
+        
+            typedef K key_type;
+            typedef V mapped_type;
+            typedef std::pair<K, V> value_type;
+            typedef std::size_t size_type;
+        
+            /**
+             * Implements a forward iterator over the occupied slots.
+             */
+            template <typename M, typename T> class iterator_base
+            {
+                public:
+                
+                    typedef std::forward_iterator_tag iterator_category;
+                    typedef typename M::value_type value_type;
+                    typedef std::ptrdiff_t difference_type;
+                    typedef T * pointer;
+                    typedef T & reference;
+                
+                    /**
+                     * Constructor
+                     */
+                    iterator_base()
+                        : m_map(0)
+                        , m_index(0)
+                    {
+                        // ...
+                    }
+                
+                    /**
+                     * Constructor
+                     * @param map The flat_map.
+                     * @param index The slot index.
+                     */
+                    iterator_base(M * map, const size_type & index)
+                        : m_map(map)
+                        , m_index(index)
+                    {
+                        skip();
+                    }
+                
+                    /**
+                     * Constructor (iterator to const_iterator).
+                     * @param other The other iterator_base.
+                     */
+                    template <typename M2, typename T2>
+                    iterator_base(const iterator_base<M2, T2> & other)
+                        : m_map(other.m_map)
+                        , m_index(other.m_index)
+                    {
+                        // ...
+                    }
+                
+                    /**
+                     * operator *
+                     */
+                    T & operator * () const
+                    {
+                        return m_map->m_slots[m_index];
+                    }
+                
+                    /**
+                     * operator ->
+                     */
+                    T * operator -> () const
+                    {
+                        return &m_map->m_slots[m_index];
+                    }
+                
+                    /**
+                     * operator ++
+                     */
+                    iterator_base & operator ++ ()
+                    {
+                        ++m_index;
+                        
+                        skip();
+                        
+                        return *this;
+                    }
+                
+                    /**
+                     * operator ++
+                     */
+                    iterator_base operator ++ (int)
+                    {
+                        auto ret = *this;
+                        
+                        ++*this;
+                        
+                        return ret;
+                    }
+                
+                    /**
+                     * operator ==
+                     */
+                    friend bool operator == (
+                        const iterator_base & a, const iterator_base & b
+                        )
+                    {
+                        return a.m_index == b.m_index;
+                    }
+                
+                    /**
+                     * operator !=
+                     */
+                    friend bool operator != (
+                        const iterator_base & a, const iterator_base & b
+                        )
+                    {
+                        return a.m_index != b.m_index;
+                    }
+                
+                private:
+                
+                    template <typename, typename> friend class iterator_base;
+                
+                    friend class flat_map;
+                
+                    /**
+                     * Advances past empty and erased slots.
+                     */
+                    void skip()
+                    {
+                        while (
+                            m_index < m_map->m_control.size() &&
+                            m_map->m_control[m_index] < control_full
+                            )
+                        {
+                            ++m_index;
+                        }
+                    }
+                
+                    /**
+                     * The flat_map.
+                     */
+                    M * m_map;
+                
+                    /**
+                     * The slot index.
+                     */
+                    size_type m_index;
+                
+                protected:
+                
+                    // ...
+            };
+        
+            typedef iterator_base<flat_map, value_type> iterator;
+            typedef iterator_base<const flat_map, const value_type>
+                const_iterator
+            ;
+        
+            /**
+             * Constructor
+             */
+            flat_map()
+                : m_size(0)
+                , m_deleted(0)
+            {
+                // ...
+            }
+        
+            /**
+             * begin
+             */
+            iterator begin()
+            {
+                return iterator(this, 0);
+            }
+        
+            /**
+             * begin
+             */
+            const_iterator begin() const
+            {
+                return const_iterator(this, 0);
+            }
+        
+            /**
+             * end
+             */
+            iterator end()
+            {
+                return iterator(this, m_control.size());
+            }
+        
+            /**
+             * end
+             */
+            const_iterator end() const
+            {
+                return const_iterator(this, m_control.size());
+            }
+        
+            /**
+             * The number of elements.
+             */
+            size_type size() const
+            {
+                return m_size;
+            }
+        
+            /**
+             * If true there are no elements.
+             */
+            bool empty() const
+            {
+                return m_size == 0;
+            }
+        
+            /**
+             * Finds an element.
+             * @param key The key.
+             */
+            iterator find(const K & key)
+            {
+                return iterator(this, lookup(key));
+            }
+        
+            /**
+             * Finds an element.
+             * @param key The key.
+             */
+            const_iterator find(const K & key) const
+            {
+                return const_iterator(this, lookup(key));
+            }
+        
+            /**
+             * The number of elements matching the key (zero or one).
+             * @param key The key.
+             */
+            size_type count(const K & key) const
+            {
+                return lookup(key) == m_control.size() ? 0 : 1;
+            }
+        
+            /**
+             * Inserts an element if the key is not already present.
+             * @param val The value_type.
+             */
+            std::pair<iterator, bool> insert(const value_type & val)
+            {
+                auto ret = emplace_key(val.first);
+                
+                if (ret.second)
+                {
+                    m_slots[ret.first].second = val.second;
+                }
+                
+                return std::make_pair(iterator(this, ret.first), ret.second);
+            }
+        
+            /**
+             * Inserts an element if the key is not already present.
+             * @param val The value_type.
+             */
+            std::pair<iterator, bool> insert(value_type && val)
+            {
+                auto ret = emplace_key(val.first);
+                
+                if (ret.second)
+                {
+                    m_slots[ret.first].second = std::move(val.second);
+                }
+                
+                return std::make_pair(iterator(this, ret.first), ret.second);
+            }
+        
+            /**
+             * operator []
+             * @param key The key.
+             */
+            V & operator [] (const K & key)
+            {
+                return m_slots[emplace_key(key).first].second;
+            }
+        
+            /**
+             * Erases an element.
+             * @param pos The position.
+             */
+            iterator erase(const_iterator pos)
+            {
+                m_control[pos.m_index] = control_deleted;
+                m_slots[pos.m_index] = value_type();
+                
+                --m_size;
+                ++m_deleted;
+                
+                return iterator(this, pos.m_index + 1);
+            }
+        
+            /**
+             * Erases an element.
+             * @param pos The position.
+             */
+            iterator erase(iterator pos)
+            {
+                return erase(const_iterator(pos));
+            }
+        
+            /**
+             * Erases an element by key.
+             * @param key The key.
+             */
+            size_type erase(const K & key)
+            {
+                auto index = lookup(key);
+                
+                if (index == m_control.size())
+                {
+                    return 0;
+                }
+                
+                erase(const_iterator(this, index));
+                
+                return 1;
+            }
+        
+            /**
+             * Removes all elements and releases the table.
+             */
+            void clear()
+            {
+                std::vector<std::uint8_t>().swap(m_control);
+                std::vector<value_type>().swap(m_slots);
+                
+                m_size = 0;
+                m_deleted = 0;
+            }
+        
+            /**
+             * Makes room for len elements without rehashing.
+             * @param len The number of elements.
+             */
+            void reserve(const size_type & len)
+            {
+                auto capacity = capacity_for(len);
+                
+                if (capacity > m_control.size())
+                {
+                    rehash(capacity);
+                }
+            }
+        
+        private:
+        
+            /**
+             * The control bytes, occupied slots have the high bit set.
+             */
+            enum
+            {
+                control_empty = 0,
+                control_deleted = 1,
+                control_full = 0x80,
+            };
+        
+            /**
+             * The smallest table allocated.
+             */
+            enum { minimum_capacity = 16 };
+        
+            /**
+             * The control byte for a hash.
+             * @param h The hash.
+             */
+            static std::uint8_t tag(const std::size_t & h)
+            {
+                return static_cast<std::uint8_t> (
+                    control_full | (h >> (sizeof(std::size_t) * 8 - 7))
+                );
+            }
+        
+            /**
+             * The power of two capacity holding len elements at no more than
+             * half load.
+             * @param len The number of elements.
+             */
+            static size_type capacity_for(const size_type & len)
+            {
+                size_type ret = minimum_capacity;
+                
+                while (ret < len * 2)
+                {
+                    ret <<= 1;
+                }
+                
+                return ret;
+            }
+        
+            /**
+             * Finds the slot index of a key, m_control.size() if not found.
+             * @param key The key.
+             */
+            size_type lookup(const K & key) const
+            {
+                if (m_size == 0)
+                {
+                    return m_control.size();
+                }
+                
+                auto h = m_hasher(key);
+                auto t = tag(h);
+                auto mask = m_control.size() - 1;
+                
+                for (auto i = h & mask; ; i = (i + 1) & mask)
+                {
+                    if (m_control[i] == control_empty)
+                    {
+                        return m_control.size();
+                    }
+                    else if (m_control[i] == t && m_slots[i].first == key)
+                    {
+                        return i;
+                    }
+                }
+            }
+        
+            /**
+             * Finds or claims the slot for a key.
+             * @param key The key.
+             * @return The slot index and true if it was claimed.
+             */
+            std::pair<size_type, bool> emplace_key(const K & key)
+            {
+                auto index = lookup(key);
+                
+                if (index < m_control.size())
+                {
+                    return std::make_pair(index, false);
+                }
+                
+                /**
+                 * Keep at least one in eight slots empty (counting
+                 * tombstones) so every probe terminates. Only inserting
+                 * rehashes, finding an existing key never moves elements.
+                 */
+                if ((m_size + m_deleted + 1) * 8 > m_control.size() * 7)
+                {
+                    rehash(capacity_for(m_size + 1));
+                }
+                
+                auto h = m_hasher(key);
+                auto mask = m_control.size() - 1;
+                
+                index = h & mask;
+                
+                while (m_control[index] >= control_full)
+                {
+                    index = (index + 1) & mask;
+                }
+                
+                if (m_control[index] == control_deleted)
+                {
+                    --m_deleted;
+                }
+                
+                m_control[index] = tag(h);
+                m_slots[index].first = key;
+                
+                ++m_size;
+                
+                return std::make_pair(index, true);
+            }
+        
+            /**
+             * Moves every element into a table of the given capacity,
+             * dropping the tombstones.
+             * @param capacity The capacity (a power of two).
+             */
+            void rehash(const size_type & capacity)
+            {
+                std::vector<std::uint8_t> control(capacity, control_empty);
+                std::vector<value_type> slots(capacity);
+                
+                auto mask = capacity - 1;
+                
+                for (size_type i = 0; i < m_control.size(); i++)
+                {
+                    if (m_control[i] >= control_full)
+                    {
+                        auto h = m_hasher(m_slots[i].first);
+                        
+                        auto j = h & mask;
+                        
+                        while (control[j] != control_empty)
+                        {
+                            j = (j + 1) & mask;
+                        }
+                        
+                        control[j] = tag(h);
+                        slots[j] = std::move(m_slots[i]);
+                    }
+                }
+                
+                m_control.swap(control);
+                m_slots.swap(slots);
+                
+                m_deleted = 0;
+            }
+        
+            /**
+             * The control bytes.
+             */
+            std::vector<std::uint8_t> m_control;
+        
+            /**
+             * The slots.
+             */
+            std::vector<value_type> m_slots;
+        
+            /**
+             * The number of elements.
+             */
+            size_type m_size;
+        
+            /**
+             * The number of tombstones.
+             */
+            size_type m_deleted;
+        
+            /**
+             * The hasher.
+             */
+            H m_hasher;
+        
+        protected:
+        
+            // ...
+    };
+    
+} // namespace coin
+
+#endif // COIN_FLAT_MAP_HPP
@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2013-2014 John Connor (BM-NC49AxAjcqVcF5jNPu85Rb8MJ2d9JqZt)
+ *
+ * This file is part of coinpp.
+ *
+ * coinpp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License with
+ * additional permissions to the one published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version. For more information see LICENSE.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COIN_FLAT_SET_HPP
+#define COIN_FLAT_SET_HPP
+
+#include <cstdint>
+#include <iterator>
+#include <utility>
+
+#include <coin/flat_map.hpp>
+
+namespace coin {
+
+    /**
+     * Implements an open addressing hash set on top of flat_map for hash
+     * keyed sets whose iteration order does not matter.
+     */
+    template <typename K, typename H = salted_hasher> class flat_set
+    {
+        public:
+        
+            typedef K key_type;
+            typedef K value_type;
+            typedef std::size_t size_type;
+        
+            /**
+             * Implements a forward iterator over the keys.
+             */
+            class const_iterator
+            {
+                public:
+                
+                    typedef std::forward_iterator_tag iterator_category;
+                    typedef K value_type;
+                    typedef std::ptrdiff_t difference_type;
+                    typedef const K * pointer;
+                    typedef const K & reference;
+                
+                    /**
+                     * Constructor
+                     */
+                    const_iterator()
+                    {
+                        // ...
+                    }
+                
+                    /**
+                     * Constructor
+                     * @param it The flat_map iterator.
+                     */
+                    const_iterator(
+                        const typename flat_map<K, std::uint8_t, H>::
+                        const_iterator & it
+                        )
+                        : m_it(it)
+                    {
+                        // ...
+                    }
+                
+                    /**
+                     * operator *
+                     */
+                    const K & operator * () const
+                    {
+                        return m_it->first;
+                    }
+                
+                    /**
+                     * operator ->
+                     */
+                    const K * operator -> () const
+                    {
+                        return &m_it->first;
+                    }
+                
+                    /**
+                     * operator ++
+                     */
+                    const_iterator & operator ++ ()
+                    {
+                        ++m_it;
+                        
+                        return *this;
+                    }
+                
+                    /**
+                     * operator ++
+                     */
+                    const_iterator operator ++ (int)
+                    {
+                        auto ret = *this;
+                        
+                        ++m_it;
+                        
+                        return ret;
+                    }
+                
+                    /**
+                     * operator ==
+                     */
+                    friend bool operator == (
+                        const const_iterator & a, const const_iterator & b
+                        )
+                    {
+                        return a.m_it == b.m_it;
+                    }
+                
+                    /**
+                     * operator !=
+                     */
+                    friend bool operator != (
+                        const const_iterator & a, const const_iterator & b
+                        )
+                    {
+                        return a.m_it != b.m_it;
+                    }
+                
+                private:
+                
+                    friend class flat_set;
+                
+                    /**
+                     * The flat_map iterator.
+                     */
+                    typename flat_map<K, std::uint8_t, H>::const_iterator m_it;
+                
+                protected:
+                
+                    // ...
+            };
+        
+            typedef const_iterator iterator;
+        
+            /**
+             * begin
+             */
+            const_iterator begin() const
+            {
+                return m_map.begin();
+            }
+        
+            /**
+             * end
+             */
+            const_iterator end() const
+            {
+                return m_map.end();
+            }
+        
+            /**
+             * The number of elements.
+             */
+            size_type size() const
+            {
+                return m_map.size();
+            }
+        
+            /**
+             * If true there are no elements.
+             */
+            bool empty() const
+            {
+                return m_map.empty();
+            }
+        
+            /**
+             * Finds an element.
+             * @param key The key.
+             */
+            const_iterator find(const K & key) const
+            {
+                return m_map.find(key);
+            }
+        
+            /**
+             * The number of elements matching the key (zero or one).
+             * @param key The key.
+             */
+            size_type count(const K & key) const
+            {
+                return m_map.count(key);
+            }
+        
+            /**
+             * Inserts an element.
+             * @param key The key.
+             */
+            std::pair<const_iterator, bool> insert(const K & key)
+            {
+                auto ret = m_map.insert(std::make_pair(key, std::uint8_t(0)));
+                
+                return std::make_pair(
+                    const_iterator(ret.first), ret.second
+                );
+            }
+        
+            /**
+             * Erases an element.
+             * @param pos The position.
+             */
+            const_iterator erase(const_iterator pos)
+            {
+                return const_iterator(m_map.erase(pos.m_it));
+            }
+        
+            /**
+             * Erases an element by key.
+             * @param key The key.
+             */
+            size_type erase(const K & key)
+            {
+                return m_map.erase(key);
+            }
+        
+            /**
+             * Removes all elements and releases the table.
+             */
+            void clear()
+            {
+                m_map.clear();
+            }
+        
+            /**
+             * Makes room for len elements without rehashing.
+             * @param len The number of elements.
+             */
+            void reserve(const size_type & len)
+            {
+                m_map.reserve(len);
+            }
+        
+        private:
+        
+            /**
+             * The map.
+             */
+            flat_map<K, std::uint8_t, H> m_map;
+        
+        protected:
+        
+            // ...
+    };
+    
+} // namespace coin
+
+#endif // COIN_FLAT_SET_HPP
@@ -31,6 +31,7 @@
 
 #include <coin/block_index.hpp>
 #include <coin/constants.hpp>
+#include <coin/flat_map.hpp>
 #include <coin/inventory_vector.hpp>
 #include <coin/median_filter.hpp>
 #include <coin/point_out.hpp>
@@ -271,7 +272,7 @@ namespace coin {
             /**
              * The proofs of stake.
              */
-            std::map<sha256, sha256> & proofs_of_stake()
+            flat_map<sha256, sha256> & proofs_of_stake()
             {
                 std::lock_guard<std::mutex> l1(mutex_);
                 
@@ -302,7 +303,7 @@ namespace coin {
             /**
              * The orphan blocks.
              */
-            std::map<sha256, std::shared_ptr<block> > & orphan_blocks()
+            flat_map<sha256, std::shared_ptr<block> > & orphan_blocks()
             {
                 std::lock_guard<std::mutex> l1(mutex_);
                 
@@ -447,6 +448,42 @@ namespace coin {
                 return m_option_rescan;
             }
         
+            /**
+             * Sets the option to write compressed blocks.
+             * @param val The value.
+             */
+            void set_option_compress_blocks(const bool & val)
+            {
+                m_option_compress_blocks = val;
+            }
+        
+            /**
+             * The option to write compressed blocks, blocks already on disk
+             * are read in either format.
+             */
+            const bool & option_compress_blocks() const
+            {
+                return m_option_compress_blocks;
+            }
+        
+            /**
+             * Sets the option to relay transactions by set reconciliation.
+             * @param val The value.
+             */
+            void set_option_tx_reconciliation(const bool & val)
+            {
+                m_option_tx_reconciliation = val;
+            }
+        
+            /**
+             * The option to relay transactions by set reconciliation with
+             * peers that advertise it.
+             */
+            const bool & option_tx_reconciliation() const
+            {
+                return m_option_tx_reconciliation;
+            }
+        
             /**
              * Sets the number of transactions in the last block.
              * @param val The value.
@@ -585,7 +622,7 @@ namespace coin {
             /**
              * The proofs of stake.
              */
-            std::map<sha256, sha256> m_proofs_of_stake;
+            flat_map<sha256, sha256> m_proofs_of_stake;
         
             /**
              * The (main) wallet.
@@ -595,7 +632,7 @@ namespace coin {
             /**
              * The orphan blocks.
              */
-            std::map<sha256, std::shared_ptr<block> > m_orphan_blocks;
+            flat_map<sha256, std::shared_ptr<block> > m_orphan_blocks;
         
             /**
              * The orphan blocks by previous.
@@ -660,6 +697,16 @@ namespace coin {
              */
             bool m_option_rescan;
         
+            /**
+             * The option to write compressed blocks.
+             */
+            bool m_option_compress_blocks;
+        
+            /**
+             * The option to relay transactions by set reconciliation.
+             */
+            bool m_option_tx_reconciliation;
+        
             /**
              * The number of transactions in the last block.
              */
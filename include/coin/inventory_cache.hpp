@@ -23,8 +23,9 @@
 
 #include <deque>
 #include <mutex>
-#include <set>
+#include <utility>
 
+#include <coin/flat_set.hpp>
 #include <coin/inventory_vector.hpp>
 
 namespace coin {
@@ -32,7 +33,7 @@ namespace coin {
     /**
      * Implements an inventory cache.
      */
-    class inventory_cache : public std::set<inventory_vector>
+    class inventory_cache : public flat_set<inventory_vector>
     {
         public:
         
@@ -50,17 +51,17 @@ namespace coin {
              * elements.
              * @param inv The inventory_vector.
              */
-            std::pair<std::set<inventory_vector>::iterator, bool> insert(
+            std::pair<flat_set<inventory_vector>::iterator, bool> insert(
                 const inventory_vector & inv
                 )
             {
-                auto ret = std::set<inventory_vector>::insert(inv);
+                auto ret = flat_set<inventory_vector>::insert(inv);
                 
                 if (ret.second)
                 {
                     if (m_max_size > 0 && queue_.size() >= m_max_size)
                     {
-                        std::set<inventory_vector>::erase(queue_.front());
+                        flat_set<inventory_vector>::erase(queue_.front());
                         
                         queue_.pop_front();
                     }
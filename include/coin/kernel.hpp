@@ -26,6 +26,7 @@
 #include <memory>
 
 #include <coin/sha256.hpp>
+#include <coin/stake_index.hpp>
 
 namespace coin {
     
@@ -83,6 +84,18 @@ namespace coin {
             static std::uint32_t get_stake_modifier_checksum(
                 const std::shared_ptr<block_index> & index
             );
+        
+            /**
+             * Get the stake modifier checksum given the checksum of the
+             * previous block index.
+             * @param index The index.
+             * @param checksum_previous The checksum of the previous block
+             * index (ignored for the genesis block).
+             */
+            static std::uint32_t get_stake_modifier_checksum(
+                const std::shared_ptr<block_index> & index,
+                const std::uint32_t & checksum_previous
+            );
 
             /**
              * Checks the stakemodifier checkspoints.
@@ -185,18 +198,15 @@ namespace coin {
              * generated in vast quantities so as to generate blocks faster,
              * degrading the system back into a proof-of-work situation.
              * @param bits The bits.
-             * @param block_from The block from.
-             * @param tx_previous_offset The offset of the previous transaction.
-             * @param tx_previous The previous transaction.
+             * @param entry_from The stake_index::entry_t of the previous out.
              * @param previous_out The previous out.
              * @param time_tx The transaction time.
              * @param hash_pos The hash of the proof-of-stake.
              * @param print_pos If true prints the proof-of-stake.
              */
             static bool check_stake_kernel_hash(
-                const std::uint32_t & bits, const block & block_from,
-                const std::uint32_t & tx_previous_offset,
-                const transaction & tx_previous,
+                const std::uint32_t & bits,
+                const stake_index::entry_t & entry_from,
                 const point_out & previous_out, const std::uint32_t time_tx,
                 sha256 & hash_pos, const bool & print_pos = false
             );
@@ -0,0 +1,286 @@
+/*
+ * Copyright (c) 2013-2014 John Connor (BM-NC49AxAjcqVcF5jNPu85Rb8MJ2d9JqZt)
+ *
+ * This file is part of coinpp.
+ *
+ * coinpp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License with
+ * additional permissions to the one published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version. For more information see LICENSE.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COIN_KV_STORE_HPP
+#define COIN_KV_STORE_HPP
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace coin {
+
+    /**
+     * Implements the key/value storage interface the db classes code
+     * against. Keys and values are opaque byte strings, keys are ordered
+     * bytewise.
+     */
+    class kv_store
+    {
+        public:
+        
+            /**
+             * The backends.
+             */
+            typedef enum backend_s
+            {
+                backend_bdb,
+                backend_log,
+            } backend_t;
+        
+            /**
+             * A set of writes applied atomically by write. Reads through
+             * the batch see its own writes.
+             */
+            class batch
+            {
+                public:
+                
+                    /**
+                     * The operation types.
+                     */
+                    typedef enum op_type_s
+                    {
+                        op_type_put,
+                        op_type_erase,
+                    } op_type_t;
+                
+                    /**
+                     * An operation.
+                     */
+                    typedef struct op_s
+                    {
+                        op_type_t type;
+                        std::string key;
+                        std::string value;
+                    } op_t;
+                
+                    /**
+                     * Constructor
+                     */
+                    batch();
+                
+                    /**
+                     * Puts a key/value pair.
+                     * @param key The key.
+                     * @param value The value.
+                     */
+                    void put(const std::string & key, const std::string & value);
+                
+                    /**
+                     * Erases a key.
+                     * @param key The key.
+                     */
+                    void erase(const std::string & key);
+                
+                    /**
+                     * Looks up a key written by this batch.
+                     * @param key The key.
+                     * @param value The value.
+                     * @param erased Set to true if the batch erased the key.
+                     * @return True if the batch touched the key.
+                     */
+                    bool get(
+                        const std::string & key, std::string & value,
+                        bool & erased
+                    ) const;
+                
+                    /**
+                     * The operations in order.
+                     */
+                    const std::vector<op_t> & ops() const;
+                
+                    /**
+                     * The number of bytes of keys and values.
+                     */
+                    const std::size_t & bytes() const;
+                
+                    /**
+                     * Clears the batch.
+                     */
+                    void clear();
+                
+                private:
+                
+                    /**
+                     * The operations.
+                     */
+                    std::vector<op_t> m_ops;
+                
+                    /**
+                     * The index of the last operation on each key.
+                     */
+                    std::map<std::string, std::size_t> m_last;
+                
+                    /**
+                     * The number of bytes of keys and values.
+                     */
+                    std::size_t m_bytes;
+            };
+        
+            /**
+             * A point in time view, reads through it do not see later
+             * writes.
+             */
+            class snapshot
+            {
+                public:
+                
+                    /**
+                     * Destructor
+                     */
+                    virtual ~snapshot() {}
+            };
+        
+            /**
+             * An ordered iterator.
+             */
+            class iterator
+            {
+                public:
+                
+                    /**
+                     * Destructor
+                     */
+                    virtual ~iterator() {}
+                
+                    /**
+                     * Positions at the first key.
+                     */
+                    virtual void seek_to_first() = 0;
+                
+                    /**
+                     * Positions at the first key greater than or equal to
+                     * key.
+                     * @param key The key.
+                     */
+                    virtual void seek(const std::string & key) = 0;
+                
+                    /**
+                     * Advances to the next key.
+                     */
+                    virtual void next() = 0;
+                
+                    /**
+                     * If true the iterator is positioned at a key.
+                     */
+                    virtual bool valid() const = 0;
+                
+                    /**
+                     * The current key.
+                     */
+                    virtual const std::string & key() const = 0;
+                
+                    /**
+                     * The current value.
+                     */
+                    virtual const std::string & value() const = 0;
+            };
+        
+            /**
+             * Destructor
+             */
+            virtual ~kv_store() {}
+        
+            /**
+             * Reads a value.
+             * @param key The key.
+             * @param value The value.
+             * @param snap The snapshot (if any) to read from.
+             */
+            virtual bool get(
+                const std::string & key, std::string & value,
+                const snapshot * snap = 0
+            ) = 0;
+        
+            /**
+             * Checks if the key exists.
+             * @param key The key.
+             */
+            virtual bool exists(const std::string & key) = 0;
+        
+            /**
+             * Writes a value.
+             * @param key The key.
+             * @param value The value.
+             * @param overwrite If false an existing key is left alone and
+             * false is returned.
+             */
+            virtual bool put(
+                const std::string & key, const std::string & value,
+                const bool & overwrite = true
+            ) = 0;
+        
+            /**
+             * Erases a key, erasing a missing key succeeds.
+             * @param key The key.
+             */
+            virtual bool erase(const std::string & key) = 0;
+        
+            /**
+             * Applies a batch atomically.
+             * @param b The batch.
+             */
+            virtual bool write(const batch & b) = 0;
+        
+            /**
+             * Allocates an iterator.
+             * @param snap The snapshot (if any) to iterate.
+             */
+            virtual std::shared_ptr<iterator> new_iterator(
+                const snapshot * snap = 0
+            ) = 0;
+        
+            /**
+             * Takes a snapshot, backends that cannot return null and reads
+             * see the latest data.
+             */
+            virtual std::shared_ptr<snapshot> get_snapshot() = 0;
+        
+            /**
+             * Flushes buffered writes to disk.
+             */
+            virtual void flush() = 0;
+        
+            /**
+             * Copies every key/value pair from one store to another.
+             * @param from The source.
+             * @param to The destination.
+             * @param batch_bytes The batch size in bytes.
+             * @return The number of pairs copied or -1 on failure.
+             */
+            static std::int64_t migrate(
+                kv_store & from, kv_store & to,
+                const std::size_t & batch_bytes = 4 * 1024 * 1024
+            );
+        
+            /**
+             * Runs the benchmark suite against a store.
+             * @param store The kv_store.
+             * @param count The number of keys.
+             */
+            static void benchmark(kv_store & store, const std::size_t & count);
+    };
+    
+} // namespace coin
+
+#endif // COIN_KV_STORE_HPP
@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2013-2014 John Connor (BM-NC49AxAjcqVcF5jNPu85Rb8MJ2d9JqZt)
+ *
+ * This file is part of coinpp.
+ *
+ * coinpp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License with
+ * additional permissions to the one published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version. For more information see LICENSE.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COIN_KV_STORE_BDB_HPP
+#define COIN_KV_STORE_BDB_HPP
+
+#include <db_cxx.h>
+
+#include <coin/kv_store.hpp>
+
+namespace coin {
+
+    /**
+     * Implements the kv_store interface on top of a berkley database Db
+     * object owned by the db_env. Snapshots are not supported, reads
+     * always see the latest committed data.
+     */
+    class kv_store_bdb : public kv_store
+    {
+        public:
+        
+            /**
+             * Constructor
+             * @param d The Db.
+             */
+            explicit kv_store_bdb(Db & d);
+        
+            /**
+             * kv_store::get
+             */
+            virtual bool get(
+                const std::string & key, std::string & value,
+                const snapshot * snap = 0
+            );
+        
+            /**
+             * kv_store::exists
+             */
+            virtual bool exists(const std::string & key);
+        
+            /**
+             * kv_store::put
+             */
+            virtual bool put(
+                const std::string & key, const std::string & value,
+                const bool & overwrite = true
+            );
+        
+            /**
+             * kv_store::erase
+             */
+            virtual bool erase(const std::string & key);
+        
+            /**
+             * kv_store::write
+             */
+            virtual bool write(const batch & b);
+        
+            /**
+             * kv_store::new_iterator
+             */
+            virtual std::shared_ptr<iterator> new_iterator(
+                const snapshot * snap = 0
+            );
+        
+            /**
+             * kv_store::get_snapshot
+             */
+            virtual std::shared_ptr<snapshot> get_snapshot();
+        
+            /**
+             * kv_store::flush
+             */
+            virtual void flush();
+        
+        private:
+        
+            /**
+             * The Db.
+             */
+            Db & m_Db;
+        
+        protected:
+        
+            /**
+             * Writes a key/value pair.
+             * @param ptr_DbTxn The DbTxn (if any).
+             * @param key The key.
+             * @param value The value.
+             * @param overwrite If false an existing key is left alone.
+             */
+            bool put(
+                DbTxn * ptr_DbTxn, const std::string & key,
+                const std::string & value, const bool & overwrite
+            );
+        
+            /**
+             * Erases a key.
+             * @param ptr_DbTxn The DbTxn (if any).
+             * @param key The key.
+             */
+            bool erase(DbTxn * ptr_DbTxn, const std::string & key);
+    };
+    
+} // namespace coin
+
+#endif // COIN_KV_STORE_BDB_HPP
@@ -0,0 +1,331 @@
+/*
+ * Copyright (c) 2013-2014 John Connor (BM-NC49AxAjcqVcF5jNPu85Rb8MJ2d9JqZt)
+ *
+ * This file is part of coinpp.
+ *
+ * coinpp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License with
+ * additional permissions to the one published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version. For more information see LICENSE.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COIN_KV_STORE_LOG_HPP
+#define COIN_KV_STORE_LOG_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <coin/kv_store.hpp>
+
+namespace coin {
+
+    /**
+     * Implements a log-structured key/value store. Every write appends a
+     * checksummed batch record to the active segment file and updates an
+     * in-memory ordered index of where each live value is. Segments are
+     * rotated at segment_length and a background thread rewrites the live
+     * records of mostly dead segments into the active one and deletes
+     * them. The index is rebuilt by replaying the segments on open, a torn
+     * record at the tail of the last segment is truncated away.
+     */
+    class kv_store_log : public kv_store
+    {
+        public:
+        
+            /**
+             * The limits.
+             */
+            enum
+            {
+                segment_length = 64 * 1024 * 1024,
+                compaction_interval = 10,
+                compaction_live_percent = 50,
+            };
+        
+            /**
+             * Constructor
+             * @param segment_bytes The size at which segments rotate.
+             */
+            explicit kv_store_log(
+                const std::size_t & segment_bytes = segment_length
+            );
+        
+            /**
+             * Destructor
+             */
+            ~kv_store_log();
+        
+            /**
+             * Opens (or creates) the store.
+             * @param path The directory.
+             */
+            bool open(const std::string & path);
+        
+            /**
+             * Closes the store.
+             */
+            void close();
+        
+            /**
+             * kv_store::get
+             */
+            virtual bool get(
+                const std::string & key, std::string & value,
+                const snapshot * snap = 0
+            );
+        
+            /**
+             * kv_store::exists
+             */
+            virtual bool exists(const std::string & key);
+        
+            /**
+             * kv_store::put
+             */
+            virtual bool put(
+                const std::string & key, const std::string & value,
+                const bool & overwrite = true
+            );
+        
+            /**
+             * kv_store::erase
+             */
+            virtual bool erase(const std::string & key);
+        
+            /**
+             * kv_store::write
+             */
+            virtual bool write(const batch & b);
+        
+            /**
+             * kv_store::new_iterator
+             */
+            virtual std::shared_ptr<iterator> new_iterator(
+                const snapshot * snap = 0
+            );
+        
+            /**
+             * kv_store::get_snapshot
+             */
+            virtual std::shared_ptr<snapshot> get_snapshot();
+        
+            /**
+             * kv_store::flush
+             */
+            virtual void flush();
+        
+            /**
+             * Compacts every sealed segment regardless of how much of it is
+             * live.
+             */
+            void compact();
+        
+            /**
+             * The number of live keys.
+             */
+            std::size_t size();
+        
+            /**
+             * The number of bytes in all segment files.
+             */
+            std::uint64_t bytes_on_disk();
+        
+            /**
+             * Runs test case.
+             */
+            static int run_test();
+        
+        private:
+        
+            friend class kv_store_log_iterator;
+            friend class kv_store_log_snapshot;
+        
+            /**
+             * Where a value lives.
+             */
+            typedef struct location_s
+            {
+                std::uint32_t segment;
+                std::uint64_t offset;
+                std::uint32_t length;
+                std::uint64_t sequence;
+                bool is_erased;
+            } location_t;
+        
+            /**
+             * A segment file.
+             */
+            typedef struct segment_s
+            {
+                std::uint32_t id;
+                std::string path;
+                std::FILE * file;
+                std::uint64_t bytes;
+                std::uint64_t live_bytes;
+                bool is_obsolete;
+                std::mutex mutex;
+                
+                ~segment_s();
+            } segment_t;
+        
+            /**
+             * The size at which segments rotate.
+             */
+            std::size_t m_segment_length;
+        
+            /**
+             * The directory.
+             */
+            std::string m_path;
+        
+            /**
+             * The index.
+             */
+            std::map<std::string, location_t> m_index;
+        
+            /**
+             * Older versions of keys kept while snapshots are live.
+             */
+            std::map<std::string, std::vector<location_t> > m_history;
+        
+            /**
+             * The number of live snapshots.
+             */
+            std::size_t m_snapshots;
+        
+            /**
+             * The segments.
+             */
+            std::map<std::uint32_t, std::shared_ptr<segment_t> > m_segments;
+        
+            /**
+             * The active segment.
+             */
+            std::shared_ptr<segment_t> m_segment_active;
+        
+            /**
+             * The last sequence number.
+             */
+            std::uint64_t m_sequence;
+        
+            /**
+             * The compaction thread.
+             */
+            std::thread m_compaction_thread;
+        
+            /**
+             * If true the compaction thread should exit.
+             */
+            bool m_compaction_stop;
+        
+        protected:
+        
+            /**
+             * Replays a segment into the index.
+             * @param segment The segment_t.
+             * @param is_last If true a torn tail record is truncated.
+             */
+            bool replay(
+                const std::shared_ptr<segment_t> & segment,
+                const bool & is_last
+            );
+        
+            /**
+             * Appends a batch record to the active segment and applies it
+             * to the index, mutex_write_ must be held.
+             * @param b The batch.
+             */
+            bool append(const batch & b);
+        
+            /**
+             * Applies one operation to the index, mutex_ must be held.
+             * @param key The key.
+             * @param loc The location_t.
+             */
+            void apply(const std::string & key, const location_t & loc);
+        
+            /**
+             * Reads the value at a location.
+             * @param segment The segment_t holding it.
+             * @param loc The location_t.
+             * @param value The value.
+             */
+            bool read_value(
+                const std::shared_ptr<segment_t> & segment,
+                const location_t & loc, std::string & value
+            );
+        
+            /**
+             * Finds the location visible at a sequence, mutex_ must be
+             * held.
+             * @param key The key.
+             * @param sequence The sequence.
+             * @param loc The location_t.
+             */
+            bool find(
+                const std::string & key, const std::uint64_t & sequence,
+                location_t & loc
+            );
+        
+            /**
+             * Opens a new active segment, mutex_write_ must be held.
+             */
+            bool rotate();
+        
+            /**
+             * Writes the list of live segments, mutex_ must be held.
+             */
+            bool write_manifest();
+        
+            /**
+             * Rewrites the live records of a sealed segment into the active
+             * one and retires it.
+             * @param id The segment id.
+             */
+            bool compact_segment(const std::uint32_t & id);
+        
+            /**
+             * The compaction thread loop.
+             */
+            void do_compaction();
+        
+            /**
+             * Releases a snapshot.
+             */
+            void release_snapshot();
+        
+            /**
+             * The index, segment and snapshot std::mutex.
+             */
+            std::mutex mutex_;
+        
+            /**
+             * Serializes appends.
+             */
+            std::mutex mutex_write_;
+        
+            /**
+             * The compaction std::condition_variable.
+             */
+            std::condition_variable condition_compaction_;
+    };
+    
+} // namespace coin
+
+#endif // COIN_KV_STORE_LOG_HPP
@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2013-2014 John Connor (BM-NC49AxAjcqVcF5jNPu85Rb8MJ2d9JqZt)
+ *
+ * This file is part of coinpp.
+ *
+ * coinpp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License with
+ * additional permissions to the one published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version. For more information see LICENSE.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COIN_MESSAGE_SCHEDULER_HPP
+#define COIN_MESSAGE_SCHEDULER_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#include <boost/asio.hpp>
+
+namespace coin {
+
+    /**
+     * Implements a fair scheduler for inbound peer messages. Each peer has
+     * its own queue and the queues are serviced round-robin (deficit round
+     * robin) where the cost of a message is the time spent handling it. A
+     * peer whose output queue is congested is skipped until it drains so a
+     * single peer cannot starve the rest.
+     */
+    class message_scheduler
+        : public std::enable_shared_from_this<message_scheduler>
+    {
+        public:
+        
+            /**
+             * The handling time in microseconds each peer is granted per
+             * round.
+             */
+            enum { quantum = 2000 };
+        
+            /**
+             * The number of queued messages per peer above which reading
+             * from the peer is paused, at twice it the peer is flooding.
+             */
+            enum { max_queued = 5000 };
+        
+            /**
+             * The number of queued bytes per peer above which reading from
+             * the peer is paused, at twice it the peer is flooding.
+             */
+            enum { max_queued_bytes = 8 * 1024 * 1024 };
+        
+            /**
+             * The results of a push.
+             */
+            typedef enum
+            {
+                push_queued,
+                push_full,
+                push_unknown,
+            } push_result_t;
+        
+            /**
+             * The interval in milliseconds at which congested peers are
+             * checked again.
+             */
+            enum { interval_congested = 50 };
+        
+            /**
+             * Constructor
+             * @param ios The boost::asio::io_service.
+             */
+            explicit message_scheduler(boost::asio::io_service & ios);
+        
+            /**
+             * Stops, dropping every queued message.
+             */
+            void stop();
+        
+            /**
+             * Adds a peer.
+             * @param peer The peer.
+             * @param is_congested Returns true while the peer can not take
+             * more work (e.g. its output queue is full).
+             * @param set_paused Called with true when reading from the peer
+             * should pause (its queue is over budget) and false once it has
+             * drained to half of it.
+             */
+            void add_peer(
+                const void * peer, const std::function<bool ()> & is_congested,
+                const std::function<void (const bool &)> & set_paused =
+                std::function<void (const bool &)> ()
+            );
+        
+            /**
+             * Removes a peer dropping its queued messages.
+             * @param peer The peer.
+             */
+            void remove_peer(const void * peer);
+        
+            /**
+             * Pushes a message handler for a peer.
+             * @param peer The peer.
+             * @param f The std::function.
+             * @param bytes The size of the message.
+             * @return push_full if the peer kept sending after it was
+             * paused, push_unknown if the peer was removed or we are
+             * stopped.
+             */
+            push_result_t push(
+                const void * peer, const std::function<void ()> & f,
+                const std::size_t & bytes = 0
+            );
+        
+            /**
+             * The number of queued messages of a peer.
+             * @param peer The peer.
+             */
+            std::size_t queued(const void * peer);
+        
+            /**
+             * The number of queued bytes of a peer.
+             * @param peer The peer.
+             */
+            std::size_t queued_bytes(const void * peer);
+        
+            /**
+             * Runs test case.
+             */
+            static int run_test();
+        
+        private:
+        
+            /**
+             * Posts a service pass unless one is pending (the caller must
+             * hold the lock).
+             */
+            void schedule();
+        
+            /**
+             * Services every peer once starting after the last one serviced.
+             */
+            void service();
+        
+            /**
+             * A peer.
+             */
+            typedef struct
+            {
+                std::deque<
+                    std::pair<std::function<void ()>, std::size_t>
+                > messages;
+                std::size_t bytes;
+                std::int64_t deficit;
+                std::function<bool ()> is_congested;
+                std::function<void (const bool &)> set_paused;
+                bool paused;
+            } peer_t;
+        
+            /**
+             * The peers.
+             */
+            std::map<const void *, peer_t> m_peers;
+        
+            /**
+             * The last peer serviced.
+             */
+            const void * m_cursor;
+        
+            /**
+             * If true a service pass has been posted.
+             */
+            bool m_service_posted;
+        
+            /**
+             * If true the congested timer is pending.
+             */
+            bool m_timer_pending;
+        
+            /**
+             * If true we have been stopped.
+             */
+            bool m_stopped;
+        
+        protected:
+        
+            /**
+             * The boost::asio::io_service.
+             */
+            boost::asio::io_service & io_service_;
+        
+            /**
+             * The boost::asio::strand.
+             */
+            boost::asio::strand strand_;
+        
+            /**
+             * The congested timer.
+             */
+            boost::asio::basic_waitable_timer<
+                std::chrono::steady_clock
+            > timer_;
+        
+            /**
+             * The std::mutex.
+             */
+            std::mutex mutex_;
+    };
+    
+} // namespace coin
+
+#endif // COIN_MESSAGE_SCHEDULER_HPP
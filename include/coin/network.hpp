@@ -56,6 +56,18 @@ namespace coin {
              * The maximum number of inbound TCP connections.
              */
             enum { tcp_inbound_maximum = 36 };
+        
+            /**
+             * The default upload rate (bytes per second) for serving
+             * historical blocks.
+             */
+            enum { tcp_upload_historical_maximum = 1024 * 1024 };
+        
+            /**
+             * The default upload rate (bytes per second) for relay traffic
+             * (zero is unlimited).
+             */
+            enum { tcp_upload_relay_maximum = 0 };
     
             /**
              * rfc1123 time.
@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2013-2014 John Connor (BM-NC49AxAjcqVcF5jNPu85Rb8MJ2d9JqZt)
+ *
+ * This file is part of coinpp.
+ *
+ * coinpp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License with
+ * additional permissions to the one published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version. For more information see LICENSE.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COIN_NOTIFICATION_QUEUE_HPP
+#define COIN_NOTIFICATION_QUEUE_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace coin {
+
+    /**
+     * Implements a sequenced notification queue consumed by a single
+     * worker thread. Notifications run one at a time in the order they
+     * were posted and a caller can wait for everything posted before a
+     * point to have run. Notifications must carry the chain data they need
+     * since the chain moves on while they wait.
+     */
+    class notification_queue
+    {
+        public:
+        
+            /**
+             * Constructor
+             */
+            notification_queue();
+        
+            /**
+             * Destructor
+             */
+            ~notification_queue();
+        
+            /**
+             * Starts the worker thread.
+             */
+            void start();
+        
+            /**
+             * Stops the worker thread once every posted notification has
+             * run.
+             */
+            void stop();
+        
+            /**
+             * Posts a notification, if not started it is run inline.
+             * @param f The std::function.
+             * @return The sequence number of the notification.
+             */
+            std::uint64_t post(const std::function<void ()> & f);
+        
+            /**
+             * Waits for the notification with the given sequence number (and
+             * all before it) to have run. On the worker thread it returns
+             * right away.
+             * @param sequence The sequence number.
+             */
+            void wait(const std::uint64_t & sequence);
+        
+            /**
+             * Waits for every notification posted so far to have run.
+             */
+            void wait();
+        
+            /**
+             * The number of notifications that have not run yet.
+             */
+            std::size_t size();
+        
+            /**
+             * Runs test case.
+             */
+            static int run_test();
+        
+        private:
+        
+            /**
+             * The worker thread loop.
+             */
+            void run();
+        
+            /**
+             * The notifications.
+             */
+            std::deque< std::function<void ()> > m_notifications;
+        
+            /**
+             * The sequence number of the last notification posted.
+             */
+            std::uint64_t m_sequence_posted;
+        
+            /**
+             * The sequence number of the last notification that has run.
+             */
+            std::uint64_t m_sequence_done;
+        
+            /**
+             * The worker thread.
+             */
+            std::thread m_thread;
+        
+            /**
+             * The worker thread id.
+             */
+            std::thread::id m_thread_id;
+        
+            /**
+             * If true the worker thread should exit once the queue is empty.
+             */
+            bool m_stop;
+        
+            /**
+             * If true the worker thread is consuming the queue.
+             */
+            bool m_running;
+        
+        protected:
+        
+            /**
+             * The std::mutex.
+             */
+            std::mutex mutex_;
+        
+            /**
+             * Signalled when a notification is posted.
+             */
+            std::condition_variable condition_posted_;
+        
+            /**
+             * Signalled when a notification has run.
+             */
+            std::condition_variable condition_done_;
+    };
+
+} // namespace coin
+
+#endif // COIN_NOTIFICATION_QUEUE_HPP
@@ -0,0 +1,250 @@
+/*
+ * Copyright (c) 2013-2014 John Connor (BM-NC49AxAjcqVcF5jNPu85Rb8MJ2d9JqZt)
+ *
+ * This file is part of coinpp.
+ *
+ * coinpp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License with
+ * additional permissions to the one published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version. For more information see LICENSE.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COIN_PEER_QUALITY_HPP
+#define COIN_PEER_QUALITY_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <map>
+#include <vector>
+
+#include <coin/sha256.hpp>
+
+namespace coin {
+
+    /**
+     * Implements per-connection quality statistics (ping round trip time,
+     * block delivery latency and useful versus wasted bytes) and the
+     * policies that use them to evict inbound and select outbound peers.
+     */
+    class peer_quality
+    {
+        public:
+        
+            /**
+             * An eviction candidate.
+             */
+            struct candidate_t;
+        
+            /**
+             * Constructor
+             */
+            peer_quality();
+        
+            /**
+             * Called when a ping is sent.
+             * @param nonce The nonce.
+             */
+            void on_ping_sent(const std::uint64_t & nonce);
+        
+            /**
+             * Called when a pong is received.
+             * @param nonce The nonce.
+             */
+            void on_pong(const std::uint64_t & nonce);
+        
+            /**
+             * Adds a ping round trip time sample.
+             * @param val The round trip time in milliseconds.
+             */
+            void on_ping_rtt(const std::int64_t & val);
+        
+            /**
+             * Called when a block is requested (getdata).
+             * @param hash The block hash.
+             */
+            void on_block_requested(const sha256 & hash);
+        
+            /**
+             * Called when a block is received.
+             * @param hash The block hash.
+             */
+            void on_block_received(const sha256 & hash);
+        
+            /**
+             * Adds a block delivery latency sample.
+             * @param val The latency in milliseconds.
+             */
+            void on_block_latency(const std::int64_t & val);
+        
+            /**
+             * Called when bytes were useful (new blocks and transactions).
+             * @param len The length.
+             */
+            void on_bytes_useful(const std::size_t & len);
+        
+            /**
+             * Called when bytes were wasted (duplicate or invalid data).
+             * @param len The length.
+             */
+            void on_bytes_wasted(const std::size_t & len);
+        
+            /**
+             * The (smoothed) ping round trip time in milliseconds, -1 if
+             * unknown.
+             */
+            const std::int64_t & ping_rtt() const;
+        
+            /**
+             * The (smoothed) block delivery latency in milliseconds, -1 if
+             * unknown.
+             */
+            const std::int64_t & block_latency() const;
+        
+            /**
+             * The number of useful bytes.
+             */
+            const std::uint64_t & bytes_useful() const;
+        
+            /**
+             * The number of wasted bytes.
+             */
+            const std::uint64_t & bytes_wasted() const;
+        
+            /**
+             * The time of the last useful bytes.
+             */
+            const std::time_t & time_last_useful() const;
+        
+            /**
+             * Selects the inbound peer to evict, peers that are fast, useful
+             * or long lived are protected first and the worst peer of the
+             * most represented network group is selected from the rest.
+             * @param candidates The candidates.
+             * @param id The identifier of the selected candidate.
+             * @return False if every candidate is protected.
+             */
+            static bool select_eviction(
+                std::vector<candidate_t> candidates, std::size_t & id
+            );
+        
+            /**
+             * Selects the outbound candidate to connect to, biased toward
+             * the lowest known round trip time.
+             * @param rtts The round trip times (-1 if unknown).
+             * @return The index of the selected candidate.
+             */
+            static std::size_t select_outbound(
+                const std::vector<std::int64_t> & rtts
+            );
+        
+            /**
+             * Runs the test case.
+             */
+            static int run_test();
+        
+            /**
+             * The number of peers protected by lowest ping round trip time.
+             */
+            enum { protect_by_ping = 4 };
+        
+            /**
+             * The number of peers protected by most recent useful bytes.
+             */
+            enum { protect_by_useful = 4 };
+        
+            /**
+             * The round trip time assumed for peers not yet measured.
+             */
+            enum { unknown_rtt = 500 };
+        
+        private:
+        
+            /**
+             * The outstanding ping nonce.
+             */
+            std::uint64_t m_ping_nonce;
+        
+            /**
+             * The time the outstanding ping was sent.
+             */
+            std::chrono::steady_clock::time_point m_time_ping_sent;
+        
+            /**
+             * The ping round trip time.
+             */
+            std::int64_t m_ping_rtt;
+        
+            /**
+             * The outstanding block requests.
+             */
+            std::map<
+                sha256, std::chrono::steady_clock::time_point
+            > m_blocks_requested;
+        
+            /**
+             * The block delivery latency.
+             */
+            std::int64_t m_block_latency;
+        
+            /**
+             * The number of useful bytes.
+             */
+            std::uint64_t m_bytes_useful;
+        
+            /**
+             * The number of wasted bytes.
+             */
+            std::uint64_t m_bytes_wasted;
+        
+            /**
+             * The time of the last useful bytes.
+             */
+            std::time_t m_time_last_useful;
+        
+        protected:
+        
+            /**
+             * The maximum number of outstanding block requests tracked.
+             */
+            enum { max_blocks_requested = 500 };
+    };
+    
+    /**
+     * An eviction candidate.
+     */
+    struct peer_quality::candidate_t
+    {
+        /**
+         * The caller defined identifier.
+         */
+        std::size_t id;
+        
+        /**
+         * The network group.
+         */
+        std::vector<std::uint8_t> group;
+        
+        /**
+         * The time the connection was established.
+         */
+        std::time_t time_connected;
+        
+        /**
+         * The quality.
+         */
+        peer_quality quality;
+    };
+    
+} // namespace coin
+
+#endif // COIN_PEER_QUALITY_HPP
@@ -29,7 +29,7 @@ namespace coin {
     /**
      * Implements an out point.
      */
-    class point_out : public data_buffer
+    class point_out
     {
         public:
         
@@ -47,13 +47,27 @@ namespace coin {
         
             /**
              * Encodes
+             * @param buffer The data_buffer.
              */
-            void encode();
+            void encode(data_buffer & buffer) const;
+        
+            /**
+             * Encodes
+             * @note Replaces the overload that encoded into the object itself,
+             * the encoding is returned instead of kept in the object.
+             */
+            data_buffer encode() const;
         
             /**
              * Decodes
+             * @param buffer The data_buffer.
+             */
+            void decode(data_buffer & buffer);
+        
+            /**
+             * The encoded size in bytes.
              */
-            void decode();
+            std::size_t size() const;
         
             /**
              * Sets null.
@@ -0,0 +1,607 @@
+/*
+ * Copyright (c) 2013-2014 John Connor (BM-NC49AxAjcqVcF5jNPu85Rb8MJ2d9JqZt)
+ *
+ * This file is part of coinpp.
+ *
+ * coinpp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License with
+ * additional permissions to the one published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version. For more information see LICENSE.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COIN_PREVECTOR_HPP
+#define COIN_PREVECTOR_HPP
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+
+namespace coin {
+
+    /**
+     * Implements a std::vector like container of trivially copyable types
+     * that keeps up to N elements inline and only allocates on the heap
+     * beyond that. Scripts are mostly 25 to 107 bytes so this removes one
+     * heap allocation per script for the common pay-to-pubkey-hash case.
+     */
+    template <unsigned int N, typename T> class prevector
+    {
+        static_assert(
+            std::is_trivially_copyable<T>::value,
+            "prevector requires a trivially copyable type"
+        );
+    
+        public:
+        
+            typedef T value_type;
+            typedef std::size_t size_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef T & reference;
+            typedef const T & const_reference;
+            typedef T * pointer;
+            typedef const T * const_pointer;
+            typedef T * iterator;
+            typedef const T * const_iterator;
+            typedef std::reverse_iterator<iterator> reverse_iterator;
+            typedef std::reverse_iterator<const_iterator>
+                const_reverse_iterator
+            ;
+        
+            /**
+             * Constructor
+             */
+            prevector()
+                : m_size(0)
+                , m_capacity(N)
+            {
+                // ...
+            }
+        
+            /**
+             * Constructor
+             * @param n The number of elements.
+             * @param value The value.
+             */
+            explicit prevector(const size_type & n, const T & value = T())
+                : m_size(0)
+                , m_capacity(N)
+            {
+                assign(n, value);
+            }
+        
+            /**
+             * Constructor
+             * @param first The first iterator.
+             * @param last The last iterator.
+             */
+            template <
+                typename InputIt, typename = typename std::enable_if<
+                std::is_integral<InputIt>::value == false>::type
+            >
+            prevector(InputIt first, InputIt last)
+                : m_size(0)
+                , m_capacity(N)
+            {
+                assign(first, last);
+            }
+        
+            /**
+             * Copy constructor
+             * @param other The other prevector.
+             */
+            prevector(const prevector & other)
+                : m_size(0)
+                , m_capacity(N)
+            {
+                assign(other.begin(), other.end());
+            }
+        
+            /**
+             * Move constructor
+             * @param other The other prevector.
+             */
+            prevector(prevector && other)
+                : m_size(0)
+                , m_capacity(N)
+            {
+                swap(other);
+            }
+        
+            /**
+             * Destructor
+             */
+            ~prevector()
+            {
+                if (is_direct() == false)
+                {
+                    std::free(m_storage.indirect);
+                }
+            }
+        
+            /**
+             * operator =
+             * @param other The other prevector.
+             */
+            prevector & operator = (const prevector & other)
+            {
+                if (&other != this)
+                {
+                    assign(other.begin(), other.end());
+                }
+                
+                return *this;
+            }
+        
+            /**
+             * operator =
+             * @param other The other prevector.
+             */
+            prevector & operator = (prevector && other)
+            {
+                if (&other != this)
+                {
+                    clear();
+                    
+                    swap(other);
+                }
+                
+                return *this;
+            }
+        
+            /**
+             * Assigns n copies of the value.
+             * @param n The number of elements.
+             * @param value The value.
+             */
+            void assign(const size_type & n, const T & value)
+            {
+                clear();
+                
+                reserve(n);
+                
+                std::fill_n(data(), n, value);
+                
+                m_size = static_cast<std::uint32_t> (n);
+            }
+        
+            /**
+             * Assigns a range.
+             * @param first The first iterator.
+             * @param last The last iterator.
+             */
+            template <
+                typename InputIt, typename = typename std::enable_if<
+                std::is_integral<InputIt>::value == false>::type
+            >
+            void assign(InputIt first, InputIt last)
+            {
+                clear();
+                
+                reserve(std::distance(first, last));
+                
+                std::copy(first, last, data());
+                
+                m_size = static_cast<std::uint32_t> (
+                    std::distance(first, last)
+                );
+            }
+        
+            /**
+             * The number of elements.
+             */
+            size_type size() const
+            {
+                return m_size;
+            }
+        
+            /**
+             * If true there are no elements.
+             */
+            bool empty() const
+            {
+                return m_size == 0;
+            }
+        
+            /**
+             * The capacity.
+             */
+            size_type capacity() const
+            {
+                return m_capacity;
+            }
+        
+            /**
+             * The maximum number of elements.
+             */
+            size_type max_size() const
+            {
+                return std::numeric_limits<std::uint32_t>::max() / sizeof(T);
+            }
+        
+            /**
+             * Reserves space for at least n elements.
+             * @param n The number of elements.
+             */
+            void reserve(const size_type & n)
+            {
+                if (n > m_capacity)
+                {
+                    grow(n);
+                }
+            }
+        
+            /**
+             * Releases heap storage that is not needed.
+             */
+            void shrink_to_fit()
+            {
+                if (is_direct() == false && m_size <= N)
+                {
+                    auto * ptr = m_storage.indirect;
+                    
+                    std::memcpy(m_storage.direct, ptr, m_size * sizeof(T));
+                    
+                    std::free(ptr);
+                    
+                    m_capacity = N;
+                }
+            }
+        
+            /**
+             * Resizes to n elements.
+             * @param n The number of elements.
+             * @param value The value of new elements.
+             */
+            void resize(const size_type & n, const T & value = T())
+            {
+                if (n > m_size)
+                {
+                    reserve(n);
+                    
+                    std::fill(data() + m_size, data() + n, value);
+                }
+                
+                m_size = static_cast<std::uint32_t> (n);
+            }
+        
+            /**
+             * Removes all elements, the capacity is retained.
+             */
+            void clear()
+            {
+                m_size = 0;
+            }
+        
+            /**
+             * The data.
+             */
+            T * data()
+            {
+                return is_direct() ? m_storage.direct : m_storage.indirect;
+            }
+        
+            /**
+             * The data.
+             */
+            const T * data() const
+            {
+                return is_direct() ? m_storage.direct : m_storage.indirect;
+            }
+        
+            iterator begin() { return data(); }
+            const_iterator begin() const { return data(); }
+            const_iterator cbegin() const { return data(); }
+            iterator end() { return data() + m_size; }
+            const_iterator end() const { return data() + m_size; }
+            const_iterator cend() const { return data() + m_size; }
+        
+            reverse_iterator rbegin() { return reverse_iterator(end()); }
+            const_reverse_iterator rbegin() const
+            {
+                return const_reverse_iterator(end());
+            }
+            reverse_iterator rend() { return reverse_iterator(begin()); }
+            const_reverse_iterator rend() const
+            {
+                return const_reverse_iterator(begin());
+            }
+        
+            T & operator [] (const size_type & pos) { return data()[pos]; }
+        
+            const T & operator [] (const size_type & pos) const
+            {
+                return data()[pos];
+            }
+        
+            /**
+             * The element at pos with bounds checking.
+             * @param pos The position.
+             */
+            T & at(const size_type & pos)
+            {
+                if (pos >= m_size)
+                {
+                    throw std::out_of_range("prevector");
+                }
+                
+                return data()[pos];
+            }
+        
+            /**
+             * The element at pos with bounds checking.
+             * @param pos The position.
+             */
+            const T & at(const size_type & pos) const
+            {
+                if (pos >= m_size)
+                {
+                    throw std::out_of_range("prevector");
+                }
+                
+                return data()[pos];
+            }
+        
+            T & front() { return data()[0]; }
+            const T & front() const { return data()[0]; }
+            T & back() { return data()[m_size - 1]; }
+            const T & back() const { return data()[m_size - 1]; }
+        
+            /**
+             * Appends a value.
+             * @param value The value.
+             */
+            void push_back(const T & value)
+            {
+                if (m_size == m_capacity)
+                {
+                    grow(m_size + 1);
+                }
+                
+                data()[m_size++] = value;
+            }
+        
+            /**
+             * Removes the last element.
+             */
+            void pop_back()
+            {
+                assert(m_size > 0);
+                
+                m_size--;
+            }
+        
+            /**
+             * Inserts a value.
+             * @param pos The position.
+             * @param value The value.
+             */
+            iterator insert(const_iterator pos, const T & value)
+            {
+                return insert(pos, 1, value);
+            }
+        
+            /**
+             * Inserts n copies of a value.
+             * @param pos The position.
+             * @param n The number of elements.
+             * @param value The value.
+             */
+            iterator insert(
+                const_iterator pos, const size_type & n, const T & value
+                )
+            {
+                /**
+                 * Copy the value, it may live in this container.
+                 */
+                T tmp = value;
+                
+                auto * p = make_room(pos, n);
+                
+                std::fill_n(p, n, tmp);
+                
+                return p;
+            }
+        
+            /**
+             * Inserts a range, it must not be a range of this container.
+             * @param pos The position.
+             * @param first The first iterator.
+             * @param last The last iterator.
+             */
+            template <
+                typename InputIt, typename = typename std::enable_if<
+                std::is_integral<InputIt>::value == false>::type
+            >
+            iterator insert(const_iterator pos, InputIt first, InputIt last)
+            {
+                auto * p = make_room(pos, std::distance(first, last));
+                
+                std::copy(first, last, p);
+                
+                return p;
+            }
+        
+            /**
+             * Erases an element.
+             * @param pos The position.
+             */
+            iterator erase(const_iterator pos)
+            {
+                return erase(pos, pos + 1);
+            }
+        
+            /**
+             * Erases a range.
+             * @param first The first iterator.
+             * @param last The last iterator.
+             */
+            iterator erase(const_iterator first, const_iterator last)
+            {
+                auto offset = first - begin();
+                auto n = last - first;
+                
+                auto * p = data() + offset;
+                
+                std::memmove(p, p + n, (m_size - offset - n) * sizeof(T));
+                
+                m_size -= static_cast<std::uint32_t> (n);
+                
+                return p;
+            }
+        
+            /**
+             * Swaps with another prevector.
+             * @param other The other prevector.
+             */
+            void swap(prevector & other)
+            {
+                std::swap(m_storage, other.m_storage);
+                std::swap(m_size, other.m_size);
+                std::swap(m_capacity, other.m_capacity);
+            }
+        
+            /**
+             * operator ==
+             */
+            friend bool operator == (const prevector & a, const prevector & b)
+            {
+                return
+                    a.size() == b.size() &&
+                    std::equal(a.begin(), a.end(), b.begin())
+                ;
+            }
+        
+            /**
+             * operator !=
+             */
+            friend bool operator != (const prevector & a, const prevector & b)
+            {
+                return !(a == b);
+            }
+        
+            /**
+             * operator <
+             */
+            friend bool operator < (const prevector & a, const prevector & b)
+            {
+                return std::lexicographical_compare(
+                    a.begin(), a.end(), b.begin(), b.end()
+                );
+            }
+        
+        private:
+        
+            /**
+             * If true the elements are stored inline.
+             */
+            bool is_direct() const
+            {
+                return m_capacity <= N;
+            }
+        
+            /**
+             * Grows the heap storage to at least n elements.
+             * @param n The number of elements.
+             */
+            void grow(const size_type & n)
+            {
+                auto capacity = std::max<size_type> (n, m_capacity * 2);
+                
+                if (is_direct())
+                {
+                    auto * ptr = static_cast<T *> (
+                        std::malloc(capacity * sizeof(T))
+                    );
+                    
+                    if (ptr == 0)
+                    {
+                        throw std::bad_alloc();
+                    }
+                    
+                    std::memcpy(ptr, m_storage.direct, m_size * sizeof(T));
+                    
+                    m_storage.indirect = ptr;
+                }
+                else
+                {
+                    auto * ptr = static_cast<T *> (
+                        std::realloc(m_storage.indirect, capacity * sizeof(T))
+                    );
+                    
+                    if (ptr == 0)
+                    {
+                        throw std::bad_alloc();
+                    }
+                    
+                    m_storage.indirect = ptr;
+                }
+                
+                m_capacity = static_cast<std::uint32_t> (capacity);
+            }
+        
+            /**
+             * Opens a gap of n elements at pos.
+             * @param pos The position.
+             * @param n The number of elements.
+             */
+            T * make_room(const_iterator pos, const size_type & n)
+            {
+                auto offset = pos - begin();
+                
+                if (m_size + n > m_capacity)
+                {
+                    grow(m_size + n);
+                }
+                
+                auto * p = data() + offset;
+                
+                std::memmove(p + n, p, (m_size - offset) * sizeof(T));
+                
+                m_size += static_cast<std::uint32_t> (n);
+                
+                return p;
+            }
+        
+            /**
+             * The inline or heap storage.
+             */
+            union
+            {
+                T direct[N];
+                T * indirect;
+            } m_storage;
+        
+            /**
+             * The number of elements.
+             */
+            std::uint32_t m_size;
+        
+            /**
+             * The capacity, greater than N when on the heap.
+             */
+            std::uint32_t m_capacity;
+        
+        protected:
+        
+            // ...
+    };
+    
+} // namespace coin
+
+#endif // COIN_PREVECTOR_HPP
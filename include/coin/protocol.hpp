@@ -60,6 +60,15 @@ namespace protocol {
          */
         enum { default_rpc_port = 9195 };
     
+        /**
+         * The services.
+         */
+        enum
+        {
+            service_network = 1,
+            service_tx_reconciliation = 2,
+        };
+    
         /**
          * Ihe ipv4 mapped prefix.
          */
@@ -22,6 +22,8 @@
 #define COIN_RANDOM_HPP
 
 #include <cstdint>
+#include <cstring>
+#include <limits>
 #include <random>
 
 #include <openssl/rand.h>
@@ -29,12 +31,174 @@
 namespace coin {
 
     /**
-     * Implements random number generation.
+     * Implements random number generation. Every thread has its own fast
+     * (non-cryptographic) generator for shuffles and sampling and its own
+     * buffered ChaCha20 generator, seeded from the OS, for nonces, salts
+     * and keys.
      */
     class random
     {
         public:
         
+            /**
+             * Implements a fast (non-cryptographic) xoshiro256** generator
+             * that can be used with the <random> distributions and
+             * std::shuffle.
+             */
+            class fast
+            {
+                public:
+                
+                    /**
+                     * The result type.
+                     */
+                    typedef std::uint64_t result_type;
+                
+                    /**
+                     * Constructor
+                     * @param seed The seed.
+                     */
+                    explicit fast(const std::uint64_t & seed = 0)
+                    {
+                        /**
+                         * Expand the seed with splitmix64.
+                         */
+                        auto s = seed;
+                        
+                        for (auto & i : m_state)
+                        {
+                            auto z = (s += 0x9e3779b97f4a7c15ULL);
+                            
+                            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+                            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+                            
+                            i = z ^ (z >> 31);
+                        }
+                    }
+                
+                    /**
+                     * The minimum value.
+                     */
+                    static constexpr result_type min()
+                    {
+                        return 0;
+                    }
+                
+                    /**
+                     * The maximum value.
+                     */
+                    static constexpr result_type max()
+                    {
+                        return std::numeric_limits<result_type>::max();
+                    }
+                
+                    /**
+                     * Generates the next value.
+                     */
+                    result_type operator()()
+                    {
+                        auto ret = rotl(m_state[1] * 5, 7) * 9;
+                        
+                        auto t = m_state[1] << 17;
+                        
+                        m_state[2] ^= m_state[0];
+                        m_state[3] ^= m_state[1];
+                        m_state[1] ^= m_state[2];
+                        m_state[0] ^= m_state[3];
+                        m_state[2] ^= t;
+                        m_state[3] = rotl(m_state[3], 45);
+                        
+                        return ret;
+                    }
+                
+                private:
+                
+                    /**
+                     * Rotates left.
+                     * @param x The value.
+                     * @param k The number of bits.
+                     */
+                    static std::uint64_t rotl(
+                        const std::uint64_t & x, const int & k
+                        )
+                    {
+                        return (x << k) | (x >> (64 - k));
+                    }
+                
+                    /**
+                     * The state.
+                     */
+                    std::uint64_t m_state[4];
+                
+                protected:
+                
+                    // ...
+            };
+        
+            /**
+             * Implements a cryptographically secure generator (a view of the
+             * thread's ChaCha20 generator) that can be used with the
+             * <random> distributions and std::shuffle.
+             */
+            class secure
+            {
+                public:
+                
+                    /**
+                     * The result type.
+                     */
+                    typedef std::uint64_t result_type;
+                
+                    /**
+                     * The minimum value.
+                     */
+                    static constexpr result_type min()
+                    {
+                        return 0;
+                    }
+                
+                    /**
+                     * The maximum value.
+                     */
+                    static constexpr result_type max()
+                    {
+                        return std::numeric_limits<result_type>::max();
+                    }
+                
+                    /**
+                     * Generates the next value.
+                     */
+                    result_type operator()()
+                    {
+                        return secure_uint64();
+                    }
+            };
+        
+            /**
+             * The calling thread's fast generator.
+             */
+            static fast & generator();
+        
+            /**
+             * Fills the buffer with cryptographically secure random bytes
+             * from the calling thread's ChaCha20 generator.
+             * @param buf The buffer.
+             * @param len The length.
+             */
+            static void bytes(std::uint8_t * buf, const std::size_t & len);
+        
+            /**
+             * Generates a cryptographically secure std::uint64_t.
+             */
+            static std::uint64_t secure_uint64()
+            {
+                std::uint64_t ret;
+                
+                bytes(reinterpret_cast<std::uint8_t *> (&ret), sizeof(ret));
+                
+                return ret;
+            }
+        
             /**
              * Generates a random std::uint8_t up to max value.
              * @param max The maximum value.
@@ -68,12 +232,9 @@ namespace coin {
                 const std::uint16_t & low, const std::uint16_t & high
                 )
             {
-                static std::random_device rd;
-                static std::mt19937_64 gen(rd());
-
-                std::uniform_int_distribution<> dist(low, high);
+                std::uniform_int_distribution<std::uint16_t> dist(low, high);
                 
-                return dist(gen);
+                return dist(generator());
             }
         
             /**
@@ -85,12 +246,9 @@ namespace coin {
                 const std::uint32_t & low, const std::uint32_t & high
                 )
             {
-                static std::random_device rd;
-                static std::mt19937_64 gen(rd());
-
-                std::uniform_int_distribution<> dist(low, high);
+                std::uniform_int_distribution<std::uint32_t> dist(low, high);
                 
-                return dist(gen);
+                return dist(generator());
             }
         
             /**
@@ -106,7 +264,8 @@ namespace coin {
             }
         
             /**
-             * Generates a random std::uint64_t up to max value.
+             * Generates a random std::uint64_t up to (but not including) max
+             * value.
              * @param max The maximum value.
              */
             static std::uint64_t uint64(
@@ -114,12 +273,14 @@ namespace coin {
                 std::numeric_limits<std::uint64_t>::max()
                 )
             {
-                static std::random_device rd;
-                static std::mt19937_64 gen(rd());
-
-                std::uniform_int_distribution<std::uint64_t> dist;
+                if (max == 0)
+                {
+                    return 0;
+                }
+                
+                std::uniform_int_distribution<std::uint64_t> dist(0, max - 1);
           
-                return dist(gen) % max;
+                return dist(generator());
             }
         
             /**
@@ -127,12 +288,19 @@ namespace coin {
              * output less predictable.
              * @param tmp The seed.
              */
-            static void openssl_RAND_add(const std::uint64_t & tmp = uint64())
+            static void openssl_RAND_add(
+                const std::uint64_t & tmp = secure_uint64()
+                )
             {
                 RAND_add(&tmp, sizeof(tmp), 1.5);
                 
                 std::memset(const_cast<std::uint64_t *> (&tmp), 0, sizeof(tmp));
             }
+        
+            /**
+             * Runs test case.
+             */
+            static int run_test();
 
         private:
         
@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2013-2014 John Connor (BM-NC49AxAjcqVcF5jNPu85Rb8MJ2d9JqZt)
+ *
+ * This file is part of coinpp.
+ *
+ * coinpp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License with
+ * additional permissions to the one published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version. For more information see LICENSE.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COIN_SALTED_HASHER_HPP
+#define COIN_SALTED_HASHER_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+#include <coin/point_out.hpp>
+#include <coin/sha256.hpp>
+
+namespace coin {
+
+    class inventory_vector;
+    
+    /**
+     * Implements a SipHash-2-4 hasher for sha256 keyed hash containers. The
+     * keys are drawn once per process from a secure source so that a peer
+     * cannot feed us hashes that all land in the same bucket.
+     */
+    class salted_hasher
+    {
+        public:
+        
+            /**
+             * Constructor
+             */
+            salted_hasher()
+                : m_k0(salt().first)
+                , m_k1(salt().second)
+            {
+                // ...
+            }
+        
+            /**
+             * Constructor
+             * @param k0 The first key.
+             * @param k1 The second key.
+             * @note Used where both sides of a connection must agree on the
+             * keys, not for hash tables.
+             */
+            salted_hasher(const std::uint64_t & k0, const std::uint64_t & k1)
+                : m_k0(k0)
+                , m_k1(k1)
+            {
+                // ...
+            }
+        
+            /**
+             * operator ()
+             * @param val The sha256.
+             */
+            std::size_t operator () (const sha256 & val) const
+            {
+                return static_cast<std::size_t> (
+                    hash(val, 0, sha256::digest_length)
+                );
+            }
+        
+            /**
+             * operator ()
+             * @param val The point_out.
+             */
+            std::size_t operator () (const point_out & val) const
+            {
+                return static_cast<std::size_t> (
+                    hash(
+                        val.get_hash(), val.n(),
+                        sha256::digest_length + sizeof(std::uint32_t)
+                    )
+                );
+            }
+        
+            /**
+             * operator ()
+             * @param val The inventory_vector.
+             */
+            std::size_t operator () (const inventory_vector & val) const;
+        
+            /**
+             * Hashes the digest followed by extra (len bytes in total).
+             * @param val The sha256.
+             * @param extra The extra word.
+             * @param len The length.
+             */
+            std::uint64_t hash(
+                const sha256 & val, const std::uint32_t & extra,
+                const std::uint64_t & len
+                ) const
+            {
+                std::uint64_t v0 = 0x736f6d6570736575ULL ^ m_k0;
+                std::uint64_t v1 = 0x646f72616e646f6dULL ^ m_k1;
+                std::uint64_t v2 = 0x6c7967656e657261ULL ^ m_k0;
+                std::uint64_t v3 = 0x7465646279746573ULL ^ m_k1;
+                
+                for (auto i = 0; i < sha256::digest_length; i += 8)
+                {
+                    std::uint64_t d;
+                    
+                    std::memcpy(&d, val.digest() + i, sizeof(d));
+                    
+                    v3 ^= d;
+                    round(v0, v1, v2, v3);
+                    round(v0, v1, v2, v3);
+                    v0 ^= d;
+                }
+                
+                std::uint64_t d = (len << 56) | extra;
+                
+                v3 ^= d;
+                round(v0, v1, v2, v3);
+                round(v0, v1, v2, v3);
+                v0 ^= d;
+                
+                v2 ^= 0xff;
+                round(v0, v1, v2, v3);
+                round(v0, v1, v2, v3);
+                round(v0, v1, v2, v3);
+                round(v0, v1, v2, v3);
+                
+                return v0 ^ v1 ^ v2 ^ v3;
+            }
+        
+            /**
+             * Runs test case.
+             */
+            static int run_test();
+        
+        private:
+        
+            /**
+             * A SipHash round.
+             */
+            static void round(
+                std::uint64_t & v0, std::uint64_t & v1, std::uint64_t & v2,
+                std::uint64_t & v3
+                )
+            {
+                v0 += v1; v1 = rotl(v1, 13); v1 ^= v0; v0 = rotl(v0, 32);
+                v2 += v3; v3 = rotl(v3, 16); v3 ^= v2;
+                v0 += v3; v3 = rotl(v3, 21); v3 ^= v0;
+                v2 += v1; v1 = rotl(v1, 17); v1 ^= v2; v2 = rotl(v2, 32);
+            }
+        
+            /**
+             * Rotates left.
+             * @param x The value.
+             * @param b The number of bits.
+             */
+            static std::uint64_t rotl(const std::uint64_t & x, const int & b)
+            {
+                return (x << b) | (x >> (64 - b));
+            }
+        
+            /**
+             * The keys.
+             */
+            std::uint64_t m_k0;
+            std::uint64_t m_k1;
+        
+        protected:
+        
+            /**
+             * The process wide keys, generated on first use.
+             */
+            static const std::pair<std::uint64_t, std::uint64_t> & salt();
+    };
+    
+} // namespace coin
+
+#endif // COIN_SALTED_HASHER_HPP
@@ -32,6 +32,7 @@
 #include <coin/key_public.hpp>
 #include <coin/key_store.hpp>
 #include <coin/logger.hpp>
+#include <coin/prevector.hpp>
 #include <coin/ripemd160.hpp>
 #include <coin/sha256.hpp>
 #include <coin/types.hpp>
@@ -46,7 +47,7 @@ namespace coin {
      * Implements a stack machine (Forth-like) that evaluates a predicate
      * returning a bool indicating valid or not.
      */
-    class script : public std::vector<std::uint8_t>
+    class script : public prevector<28, std::uint8_t>
     {
         public:
         
@@ -254,6 +255,21 @@ namespace coin {
              * Copy Constructor
              */
             script(const script & other);
+        
+            /**
+             * Move Constructor
+             */
+            script(script && other);
+        
+            /**
+             * operator =
+             */
+            script & operator = (const script & other);
+        
+            /**
+             * operator =
+             */
+            script & operator = (script && other);
 
             /**
              * Constructor
@@ -269,7 +285,10 @@ namespace coin {
              * @param it_begin The it_begin.
              * @param it_end The it_end.
              */
-            script(const_iterator it_begin, const_iterator it_end);
+            script(
+                std::vector<std::uint8_t>::const_iterator it_begin,
+                std::vector<std::uint8_t>::const_iterator it_end
+            );
 
             /**
              * Constructor
@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2013-2014 John Connor (BM-NC49AxAjcqVcF5jNPu85Rb8MJ2d9JqZt)
+ *
+ * This file is part of coinpp.
+ *
+ * coinpp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License with
+ * additional permissions to the one published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version. For more information see LICENSE.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COIN_STAKE_INDEX_HPP
+#define COIN_STAKE_INDEX_HPP
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include <coin/point_out.hpp>
+#include <coin/script.hpp>
+#include <coin/sha256.hpp>
+
+namespace coin {
+
+    class block;
+    class db_tx;
+    class transaction;
+    class transaction_index;
+    
+    /**
+     * Implements an in-memory index of the metadata coin age and the stake
+     * kernel need about an unspent output (value, transaction time and the
+     * time, hash and offset within the containing block). It is filled as
+     * blocks connect and on a miss from the transaction database so that
+     * neither needs to read the block files.
+     * It is ok for this to be a singleton even in the presence of multiple
+     * instances in the same memory space.
+     */
+    class stake_index
+    {
+        public:
+        
+            /**
+             * An entry.
+             */
+            typedef struct entry_s
+            {
+                std::int64_t value;
+                std::uint32_t time_tx;
+                std::uint32_t time_block;
+                sha256 hash_block;
+                std::uint32_t tx_offset;
+                script script_public_key;
+            } entry_t;
+        
+            /**
+             * The singleton accessor.
+             */
+            static stake_index & instance();
+        
+            /**
+             * Gets the entry for an output, falls back to the transaction
+             * database and the block header on a miss.
+             * @param tx_db The db_tx.
+             * @param previous_out The point_out.
+             * @param entry The entry_t.
+             */
+            bool get(
+                db_tx & tx_db, const point_out & previous_out, entry_t & entry
+            );
+        
+            /**
+             * Gets the entry for an output of a transaction that is already in
+             * memory, only the containing block is looked up on a miss. An
+             * output the transaction_index marks as spent is returned but not
+             * cached.
+             * @param tx The transaction.
+             * @param n The output index.
+             * @param tx_index The transaction_index.
+             * @param entry The entry_t.
+             */
+            bool get(
+                const transaction & tx, const std::uint32_t & n,
+                const transaction_index & tx_index, entry_t & entry
+            );
+        
+            /**
+             * Called when a block has been connected, indexes the new outputs
+             * and forgets the spent ones.
+             * @param blk The block.
+             * @param block_position The block position.
+             * @param tx_positions The transaction positions in the block file.
+             */
+            void on_block_connected(
+                const block & blk, const std::uint32_t & block_position,
+                const std::vector<std::uint32_t> & tx_positions
+            );
+        
+            /**
+             * Called when a block has been disconnected, forgets every output
+             * it created or spent (they are reindexed on demand).
+             * @param blk The block.
+             */
+            void on_block_disconnected(const block & blk);
+        
+            /**
+             * Forgets every entry, called when a database transaction that
+             * connected blocks is aborted.
+             */
+            void clear();
+        
+            /**
+             * The number of entries.
+             */
+            std::size_t size();
+        
+        private:
+        
+            /**
+             * A key, the transaction hash digest and the output index (a
+             * point_out is 148 bytes).
+             */
+            typedef std::pair<
+                std::array<std::uint8_t, sha256::digest_length>, std::uint32_t
+            > key_t;
+        
+            /**
+             * A stored entry, the block hash is kept as a bare digest (a
+             * sha256 is 144 bytes).
+             */
+            typedef struct record_s
+            {
+                std::int64_t value;
+                std::uint32_t time_tx;
+                std::uint32_t time_block;
+                std::uint32_t tx_offset;
+                std::array<std::uint8_t, sha256::digest_length> hash_block;
+                script script_public_key;
+            } record_t;
+        
+            /**
+             * Makes a key.
+             * @param previous_out The point_out.
+             */
+            static key_t make_key(const point_out & previous_out);
+        
+            /**
+             * Finds an entry.
+             * @param previous_out The point_out.
+             * @param entry The entry_t.
+             */
+            bool find(const point_out & previous_out, entry_t & entry);
+        
+            /**
+             * Inserts an entry evicting a random one when full.
+             * @param previous_out The point_out.
+             * @param entry The entry_t.
+             */
+            void insert(const point_out & previous_out, const entry_t & entry);
+        
+            /**
+             * The maximum number of entries, outputs beyond it fall back to
+             * the transaction database. An entry is a std::map node holding
+             * a key_t and a record_t, ~180 bytes with allocator overhead
+             * for a standard script (~45MB when full).
+             */
+            enum { max_entries = 250000 };
+        
+            /**
+             * The entries.
+             */
+            std::map<key_t, record_t> m_entries;
+        
+        protected:
+        
+            /**
+             * The std::mutex.
+             */
+            std::mutex mutex_;
+    };
+    
+} // namespace coin
+
+#endif // COIN_STAKE_INDEX_HPP
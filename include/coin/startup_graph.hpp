@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2013-2014 John Connor (BM-NC49AxAjcqVcF5jNPu85Rb8MJ2d9JqZt)
+ *
+ * This file is part of coinpp.
+ *
+ * coinpp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License with
+ * additional permissions to the one published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version. For more information see LICENSE.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COIN_STARTUP_GRAPH_HPP
+#define COIN_STARTUP_GRAPH_HPP
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace coin {
+
+    /**
+     * Implements a graph of startup phases. Each phase runs on it's own
+     * thread as soon as the phases it depends on have completed so that
+     * independent phases (the block index, the wallet keys and the peers)
+     * overlap. The duration of each phase is logged.
+     */
+    class startup_graph
+    {
+        public:
+        
+            /**
+             * The timing of a phase.
+             */
+            typedef struct timing_s
+            {
+                std::string name;
+                std::uint32_t milliseconds_start;
+                std::uint32_t milliseconds;
+                bool success;
+            } timing_t;
+        
+            /**
+             * Adds a phase.
+             * @param name The name.
+             * @param f The function, returns false (or throws) on failure.
+             * @param dependencies The names of the phases that must
+             * complete first.
+             */
+            void add(
+                const std::string & name, const std::function<bool ()> & f,
+                const std::vector<std::string> & dependencies =
+                std::vector<std::string> ()
+            );
+        
+            /**
+             * Runs the phases, phases that depend on a failed phase are not
+             * run. The first exception thrown by a phase is rethrown once
+             * every running phase has completed.
+             * @return False if any phase failed or was not run.
+             */
+            bool run();
+        
+            /**
+             * The timings of the last run in completion order.
+             */
+            const std::vector<timing_t> & timings() const;
+        
+            /**
+             * Runs independent jobs on up to one thread per core and waits
+             * for them, used by phases that are parallel internally. The
+             * first exception thrown by a job is rethrown.
+             * @param jobs The jobs.
+             */
+            static void parallel(
+                const std::vector< std::function<void ()> > & jobs
+            );
+        
+            /**
+             * Runs test case.
+             */
+            static int run_test();
+        
+        private:
+        
+            /**
+             * A phase.
+             */
+            typedef struct phase_s
+            {
+                std::string name;
+                std::function<bool ()> f;
+                std::vector<std::string> dependencies;
+            } phase_t;
+        
+            /**
+             * The phases.
+             */
+            std::vector<phase_t> m_phases;
+        
+            /**
+             * The timings.
+             */
+            std::vector<timing_t> m_timings;
+        
+        protected:
+        
+            // ...
+    };
+    
+} // namespace coin
+
+#endif // COIN_STARTUP_GRAPH_HPP
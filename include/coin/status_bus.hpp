@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2013-2014 John Connor (BM-NC49AxAjcqVcF5jNPu85Rb8MJ2d9JqZt)
+ *
+ * This file is part of coinpp.
+ *
+ * coinpp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License with
+ * additional permissions to the one published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version. For more information see LICENSE.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COIN_STATUS_BUS_HPP
+#define COIN_STATUS_BUS_HPP
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace coin {
+
+    /**
+     * Implements a bounded status event bus. Events of the same kind are
+     * coalesced (the last value of each key wins) so that a burst of
+     * block height, balance, hashrate or peer updates costs a single event
+     * and the consumer drains whole batches at a time.
+     */
+    class status_bus
+    {
+        public:
+        
+            /**
+             * The event kinds.
+             */
+            typedef enum
+            {
+                kind_other,
+                kind_block,
+                kind_blockchain,
+                kind_database,
+                kind_mining,
+                kind_network,
+                kind_wallet,
+                kind_wallet_transaction
+            } kind_t;
+        
+            /**
+             * The maximum number of pending events. When full the oldest
+             * event of an unknown kind is dropped, if there are none the
+             * pending wallet transaction events are collapsed into a single
+             * reload event (type = wallet.transaction, value = reload) that
+             * also absorbs the wallet transaction events that follow it
+             * until it is drained.
+             */
+            enum { maximum_events = 1024 };
+        
+            /**
+             * The statistics.
+             */
+            typedef struct stats_s
+            {
+                std::uint64_t inserted;
+                std::uint64_t coalesced;
+                std::uint64_t dropped;
+                std::uint64_t delivered;
+                std::size_t pending_maximum;
+            } stats_t;
+        
+            /**
+             * Constructor
+             */
+            status_bus();
+        
+            /**
+             * Inserts status pairs.
+             * @param pairs The pairs.
+             */
+            void insert(const std::map<std::string, std::string> & pairs);
+        
+            /**
+             * Removes and returns the pending events in insertion order.
+             */
+            std::vector< std::map<std::string, std::string> > drain();
+        
+            /**
+             * Removes the pending events.
+             */
+            void clear();
+        
+            /**
+             * The number of pending events.
+             */
+            std::size_t size();
+        
+            /**
+             * The statistics.
+             */
+            stats_t stats();
+        
+            /**
+             * The kind of the pairs (by the type key).
+             * @param pairs The pairs.
+             */
+            static kind_t kind(const std::map<std::string, std::string> & pairs);
+        
+            /**
+             * Runs test case.
+             */
+            static int run_test();
+        
+        private:
+        
+            /**
+             * The coalescing key.
+             */
+            typedef std::pair<kind_t, std::string> key_t;
+        
+            /**
+             * An event.
+             */
+            typedef struct event_s
+            {
+                std::uint64_t sequence;
+                std::map<std::string, std::string> pairs;
+            } event_t;
+        
+            /**
+             * Makes room for an event, drops the oldest event of an unknown
+             * kind or collapses the wallet transaction events.
+             */
+            void make_room();
+        
+            /**
+             * The wallet transaction reload key.
+             */
+            static const key_t key_reload;
+        
+            /**
+             * The pending events.
+             */
+            std::map<key_t, event_t> m_events;
+        
+            /**
+             * The pending events by sequence.
+             */
+            std::map<std::uint64_t, key_t> m_order;
+        
+            /**
+             * The next sequence.
+             */
+            std::uint64_t m_sequence;
+        
+            /**
+             * The statistics.
+             */
+            stats_t m_stats;
+        
+        protected:
+        
+            /**
+             * The std::mutex.
+             */
+            std::mutex mutex_;
+    };
+
+} // namespace coin
+
+#endif // COIN_STATUS_BUS_HPP
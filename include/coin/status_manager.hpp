@@ -28,12 +28,15 @@
 
 #include <boost/asio.hpp>
 
+#include <coin/status_bus.hpp>
+
 namespace coin {
 
     class stack_impl;
     
     /**
-     * Implements a status manager.
+     * Implements a status manager. Status events are coalesced on a
+     * status_bus and delivered as a batch every tick.
      */
     class status_manager : public std::enable_shared_from_this<status_manager>
     {
@@ -71,7 +74,7 @@ namespace coin {
             /**
              * The timer callback interval in milliseconds.
              */
-            enum { interval_callback = 1 };
+            enum { interval_callback = 100 };
         
         protected:
         
@@ -104,14 +107,9 @@ namespace coin {
             > timer_;
         
             /**
-             * The std::mutex
-             */
-            std::mutex mutex_;
-        
-            /**
-             * The pairs.
+             * The status_bus.
              */
-            std::vector< std::map<std::string, std::string> > pairs_;
+            status_bus status_bus_;
     };
 
 } // namespace coin
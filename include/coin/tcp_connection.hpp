@@ -21,6 +21,7 @@
 #ifndef COIN_TCP_CONNECTION_HPP
 #define COIN_TCP_CONNECTION_HPP
 
+#include <array>
 #include <deque>
 #include <mutex>
 #include <set>
@@ -29,8 +30,10 @@
 
 #include <boost/asio.hpp>
 
+#include <coin/check_pool.hpp>
 #include <coin/inventory_cache.hpp>
 #include <coin/inventory_vector.hpp>
+#include <coin/peer_quality.hpp>
 #include <coin/protocol.hpp>
 #include <coin/sha256.hpp>
 
@@ -41,9 +44,11 @@ namespace coin {
     class block_index;
     class checkpoint_sync;
     class message;
+    class message_scheduler;
     class stack_impl;
     class tcp_transport;
     class transaction;
+    class tx_reconciliation;
     
     /**
      * Implement a tcp connection.
@@ -61,6 +66,19 @@ namespace coin {
                 direction_outgoing,
             } direction_t;
         
+            /**
+             * The traffic classes used for bandwidth accounting.
+             */
+            typedef enum
+            {
+                traffic_class_control,
+                traffic_class_inv,
+                traffic_class_tx,
+                traffic_class_block,
+                traffic_class_block_historical,
+                traffic_class_maximum,
+            } traffic_class_t;
+        
             /**
              * Constructor
              * ios The boost::asio::io_service.
@@ -138,10 +156,13 @@ namespace coin {
              * Sends an inv message.
              * @param type The inventory_vector::type_t.
              * @param block_hashes The hashes of the blocks.
+             * @param historical If true the message follows historical blocks
+             * on the bulk queue so it can't overtake them.
              */
             void send_inv_message(
                 const inventory_vector::type_t & type,
-                const std::vector<sha256> & block_hashes
+                const std::vector<sha256> & block_hashes,
+                const bool & historical = false
             );
         
             /**
@@ -242,6 +263,66 @@ namespace coin {
              */
             bool is_transport_valid();
         
+            /**
+             * The number of bytes sent for the given traffic class.
+             * @param val The traffic_class_t.
+             */
+            const std::uint64_t & bytes_sent(const traffic_class_t & val) const;
+        
+            /**
+             * The number of bytes received for the given traffic class.
+             * @param val The traffic_class_t.
+             */
+            const std::uint64_t & bytes_received(
+                const traffic_class_t & val
+            ) const;
+        
+            /**
+             * The traffic class of a command.
+             * @param command The command.
+             */
+            static traffic_class_t traffic_class(const std::string & command);
+        
+            /**
+             * The name of a traffic class.
+             * @param val The traffic_class_t.
+             */
+            static const char * traffic_class_name(const traffic_class_t & val);
+        
+            /**
+             * A copy of the peer_quality.
+             */
+            peer_quality quality();
+        
+            /**
+             * The time the connection was established.
+             */
+            const std::time_t & time_connected() const;
+        
+            /**
+             * If true transactions are pushed to this peer even though it
+             * reconciles (one of our first few outbound peers).
+             */
+            bool is_tx_reconciliation_flood();
+        
+            /**
+             * Queues a relayed transaction for the next reconciliation with
+             * this peer, an inv is sent if the set is full.
+             * @param hash_tx The transaction hash.
+             * @param is_source If true the transaction came from this peer.
+             * @return False if the peer does not reconcile or is a flood
+             * peer, the transaction should then be pushed to it.
+             */
+            bool relay_tx_reconciled(
+                const sha256 & hash_tx, const bool & is_source
+            );
+        
+            /**
+             * The number of blocks below the best block height at which a
+             * requested block is served as historical (bulk) traffic.
+             */
+            enum { historical_block_depth = 8 };
+        
             /**
              * The on read handler.
              * @param buf The buffer.
@@ -291,8 +372,11 @@ namespace coin {
             /**
              * Sends a block message.
              * @param blk The block.
+             * @param historical If true the block is sent as bulk traffic.
              */
-            void send_block_message(const block & blk);
+            void send_block_message(
+                const block & blk, const bool & historical = false
+            );
         
             /**
              * Sends a tx message.
@@ -317,6 +401,17 @@ namespace coin {
              */
             void relay_alert(const alert & msg);
         
+            /**
+             * Writes a message to the transport accounting for it's bytes.
+             * @param t The tcp_transport.
+             * @param msg The message.
+             * @param historical If true the message is historical (bulk).
+             */
+            void write_message(
+                const std::shared_ptr<tcp_transport> & t, message & msg,
+                const bool & historical = false
+            );
+        
             /**
              * Relays an encoded inv given message command.
              * @param command The command.
@@ -332,6 +427,21 @@ namespace coin {
              */
             bool handle_message(message & msg);
         
+            /**
+             * Accepts a (checked) transaction into the transaction_pool.
+             * @param tx The transaction.
+             */
+            void do_accept_transaction(const std::shared_ptr<transaction> & tx);
+        
+            /**
+             * Processes a (checked) block.
+             * @param blk The block.
+             * @param len The length of the block message.
+             */
+            void do_process_block(
+                const std::shared_ptr<block> & blk, const std::size_t & len
+            );
+        
             /**
              * The ping timer handler.
              * @param ec The boost::system::error_code.
@@ -349,6 +459,24 @@ namespace coin {
              */
             void do_rebroadcast_addr_messages(const std::uint32_t & interval);
         
+            /**
+             * Adds this connection to the message_scheduler, it is paused
+             * while the transport has too many bytes queued.
+             */
+            void add_to_message_scheduler();
+        
+            /**
+             * Starts set reconciliation of transactions if both sides
+             * advertised protocol::service_tx_reconciliation.
+             */
+            void start_tx_reconciliation();
+        
+            /**
+             * The reconciliation timer handler (initiator).
+             * @param ec The boost::system::error_code.
+             */
+            void do_tx_reconciliation(const boost::system::error_code & ec);
+        
             /**
              * The tcp_transport.
              */
@@ -424,6 +552,41 @@ namespace coin {
              */
             std::set<sha256> m_seen_alerts;
         
+            /**
+             * The number of bytes sent by traffic class.
+             */
+            std::array<std::uint64_t, traffic_class_maximum> m_bytes_sent;
+        
+            /**
+             * The number of bytes received by traffic class.
+             */
+            std::array<std::uint64_t, traffic_class_maximum> m_bytes_received;
+        
+            /**
+             * The peer_quality.
+             */
+            peer_quality m_peer_quality;
+        
+            /**
+             * The time the connection was established.
+             */
+            std::time_t m_time_connected;
+        
+            /**
+             * The check_pool::sequence of incoming blocks and transactions.
+             */
+            std::shared_ptr<check_pool::sequence> m_check_sequence;
+        
+            /**
+             * The tx_reconciliation, null if the peer does not reconcile.
+             */
+            std::shared_ptr<tx_reconciliation> m_tx_reconciliation;
+        
+            /**
+             * If true transactions are also pushed to the peer.
+             */
+            bool m_tx_reconciliation_flood;
+        
         protected:
         
             /**
@@ -451,6 +614,17 @@ namespace coin {
              */
             std::mutex mutex_read_queue_;
         
+            /**
+             * The message_scheduler.
+             */
+            std::weak_ptr<message_scheduler> message_scheduler_;
+        
+            /**
+             * The number of bytes queued on the transport at which handling
+             * of our messages is paused.
+             */
+            enum { max_bytes_queued = 4 * 1024 * 1024 };
+        
             /**
              * The ping timer.
              */
@@ -488,6 +662,17 @@ namespace coin {
              */
             std::mutex mutex_inventory_cache_;
         
+            /**
+             * The peer_quality mutex.
+             */
+            std::mutex mutex_peer_quality_;
+        
+            /**
+             * The tx_reconciliation mutex, other connections relaying a
+             * transaction read the reconciliation state.
+             */
+            std::mutex mutex_tx_reconciliation_;
+        
             /**
              * The last getblocks index_begin.
              */
@@ -523,6 +708,13 @@ namespace coin {
             boost::asio::basic_waitable_timer<
                 std::chrono::steady_clock
             > timer_addr_rebroadcast_;
+        
+            /**
+             * The tx_reconciliation timer.
+             */
+            boost::asio::basic_waitable_timer<
+                std::chrono::steady_clock
+            > timer_tx_reconciliation_;
     };
     
 } // namespace coin
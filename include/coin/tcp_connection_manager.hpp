@@ -21,10 +21,15 @@
 #ifndef COIN_TCP_CONNECTION_MANAGER_HPP
 #define COIN_TCP_CONNECTION_MANAGER_HPP
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <set>
+#include <vector>
 
 #include <boost/asio.hpp>
 
@@ -33,9 +38,12 @@
 namespace coin {
 
     class message;
+    class message_scheduler;
     class stack_impl;
     class tcp_connection;
+    class tcp_connection_race;
     class tcp_transport;
+    class token_bucket;
     
     /**
      * Implements a tcp connetion manager.
@@ -77,6 +85,16 @@ namespace coin {
              */
             void broadcast(const char * buf, const std::size_t & len);
         
+            /**
+             * Calls a function for each connected peer while holding the
+             * tcp connections lock.
+             * @param f The function.
+             */
+            void for_each_tcp_connection(
+                const std::function<
+                void (const std::shared_ptr<tcp_connection> &)> & f
+            );
+        
             /**
              * The tcp connections.
              */
@@ -84,6 +102,26 @@ namespace coin {
                 boost::asio::ip::tcp::endpoint, std::weak_ptr<tcp_connection>
             > & tcp_connections();
         
+            /**
+             * The token bucket shared by all connections for relay traffic.
+             */
+            const std::shared_ptr<token_bucket> & token_bucket_relay() const;
+        
+            /**
+             * The token bucket shared by all connections for serving
+             * historical blocks.
+             */
+            const std::shared_ptr<token_bucket> &
+                token_bucket_historical() const
+            ;
+        
+            /**
+             * The scheduler of inbound messages shared by all connections.
+             */
+            const std::shared_ptr<message_scheduler> &
+                get_message_scheduler() const
+            ;
+        
         private:
         
             /**
@@ -98,6 +136,41 @@ namespace coin {
              */
             void tick(const boost::system::error_code & ec);
         
+            /**
+             * Evicts the worst incoming connection to make room for a new
+             * one.
+             * @return False if every incoming connection is protected.
+             */
+            bool evict_incoming();
+        
+            /**
+             * If true the network address is in the same group as an
+             * existing connection.
+             * @param addr The protocol::network_address_t.
+             */
+            bool is_in_same_group(const protocol::network_address_t & addr);
+        
+            /**
+             * Races connections to the given candidates with staggered
+             * starts, the first to complete the handshake are kept.
+             * @param candidates The candidates ordered by preference.
+             */
+            void race(
+                const std::vector<protocol::network_address_t> & candidates
+            );
+        
+            /**
+             * The number of connections that completed the handshake.
+             */
+            std::size_t established_tcp_connections();
+        
+            /**
+             * Records the time it took to reach minimum_tcp_connections
+             * established connections.
+             * @return The number of established connections.
+             */
+            std::size_t update_time_to_connected();
+        
             /**
              * The tcp connections.
              */
@@ -105,12 +178,68 @@ namespace coin {
                 boost::asio::ip::tcp::endpoint, std::weak_ptr<tcp_connection>
             > m_tcp_connections;
         
+            /**
+             * The token bucket for relay traffic.
+             */
+            std::shared_ptr<token_bucket> m_token_bucket_relay;
+        
+            /**
+             * The token bucket for serving historical blocks.
+             */
+            std::shared_ptr<token_bucket> m_token_bucket_historical;
+        
+            /**
+             * The message_scheduler.
+             */
+            std::shared_ptr<message_scheduler> m_message_scheduler;
+        
+            /**
+             * The number of bytes sent as of the last status.
+             */
+            std::uint64_t m_bytes_sent_last;
+        
+            /**
+             * The number of bytes received as of the last status.
+             */
+            std::uint64_t m_bytes_received_last;
+        
+            /**
+             * The time of the last status.
+             */
+            std::chrono::steady_clock::time_point m_time_last_status;
+        
+            /**
+             * The last measured ping round trip time by address.
+             */
+            std::map<boost::asio::ip::address, std::int64_t> m_address_rtts;
+        
+            /**
+             * The time we started.
+             */
+            std::chrono::steady_clock::time_point m_time_started;
+        
+            /**
+             * The milliseconds it took to reach minimum_tcp_connections
+             * established connections, -1 if not yet reached.
+             */
+            std::int64_t m_time_to_connected;
+        
+            /**
+             * The tcp_connection_race.
+             */
+            std::shared_ptr<tcp_connection_race> m_tcp_connection_race;
+        
+            /**
+             * If true we are stopped.
+             */
+            std::atomic<bool> m_stopped;
+        
         protected:
         
             /**
              * Resolves a list of boost::asio::ip::tcp::resolver::query objects
-             * and if succesful adds them to the address_manager.
-             * @param q The boost::asio::ip::tcp::resolver::query.
+             * in parallel and if succesful adds them to the address_manager.
+             * @param queries The boost::asio::ip::tcp::resolver::query's.
              */
             void do_resolve(
                 const std::vector<boost::asio::ip::tcp::resolver::query> &
@@ -122,6 +251,42 @@ namespace coin {
              */
             enum { minimum_tcp_connections = 8 };
         
+            /**
+             * The upload shaping burst in bytes.
+             */
+            enum { upload_burst = 256 * 1024 };
+        
+            /**
+             * The number of addresses drawn from the address_manager per
+             * outgoing slot, the fastest known is connected to.
+             */
+            enum { outgoing_candidates = 4 };
+        
+            /**
+             * The maximum number of remembered round trip times.
+             */
+            enum { max_address_rtts = 8192 };
+        
+            /**
+             * The number of candidates raced per missing connection.
+             */
+            enum { race_factor = 2 };
+        
+            /**
+             * The maximum number of candidates raced at once.
+             */
+            enum { race_maximum = 16 };
+        
+            /**
+             * The delay in milliseconds between racing connection starts.
+             */
+            enum { race_stagger = 250 };
+        
+            /**
+             * The maximum number of host name resolution threads.
+             */
+            enum { resolve_threads = 8 };
+        
             /**
              * The boost::asio::io_service.
              */
@@ -137,18 +302,13 @@ namespace coin {
              */
             stack_impl & stack_impl_;
         
-            /**
-             * The boost::asio::ip::tcp::resolver.
-             */
-            boost::asio::ip::tcp::resolver resolver_;
-        
             /**
              * The timer.
              */
             boost::asio::basic_waitable_timer<
                 std::chrono::steady_clock
             > timer_;
-
+        
             /**
              * The tcp_connections_ std::recursive_mutex.
              */
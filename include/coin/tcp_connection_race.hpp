@@ -0,0 +1,206 @@
+/*
+ * Copyright (c) 2013-2014 John Connor (BM-NC49AxAjcqVcF5jNPu85Rb8MJ2d9JqZt)
+ *
+ * This file is part of coinpp.
+ *
+ * coinpp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License with
+ * additional permissions to the one published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version. For more information see LICENSE.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COIN_TCP_CONNECTION_RACE_HPP
+#define COIN_TCP_CONNECTION_RACE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <set>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+namespace coin {
+
+    /**
+     * Races outgoing connections. The candidates are started a stagger
+     * apart and once enough connections completed the handshake the
+     * attempts still handshaking are cancelled so the fastest peers win.
+     * The connections themselves are made, inspected and cancelled by the
+     * owner through the handlers.
+     */
+    class tcp_connection_race
+        : public std::enable_shared_from_this<tcp_connection_race>
+    {
+        public:
+        
+            /**
+             * The states of a connection attempt.
+             */
+            typedef enum
+            {
+                state_failed,
+                state_handshaking,
+                state_established,
+            } state_t;
+        
+            /**
+             * Constructor
+             * @param ios The boost::asio::io_service.
+             * @param s The boost::asio::strand the handlers are called on.
+             * @param stagger The milliseconds between starts.
+             * @param minimum The number of established connections that
+             * ends the race.
+             */
+            tcp_connection_race(
+                boost::asio::io_service & ios, boost::asio::strand & s,
+                const std::uint32_t & stagger, const std::size_t & minimum
+            );
+        
+            /**
+             * Sets the handlers.
+             * @param f_connect Starts a connection, returns false if it was
+             * not started.
+             * @param f_state The state of a started connection.
+             * @param f_cancel Cancels a connection still handshaking.
+             * @param f_established The number of established connections
+             * (including the ones not raced).
+             */
+            void set_handlers(
+                const std::function<
+                    bool (const boost::asio::ip::tcp::endpoint &)
+                > & f_connect,
+                const std::function<
+                    state_t (const boost::asio::ip::tcp::endpoint &)
+                > & f_state,
+                const std::function<
+                    void (const boost::asio::ip::tcp::endpoint &)
+                > & f_cancel,
+                const std::function<std::size_t ()> & f_established
+            );
+        
+            /**
+             * Races connections to the given candidates.
+             * @param candidates The candidates ordered by preference.
+             */
+            void start(
+                const std::vector<boost::asio::ip::tcp::endpoint> & candidates
+            );
+        
+            /**
+             * Stops, no connections are started or cancelled afterwards.
+             */
+            void stop();
+        
+            /**
+             * The number of connections started and still handshaking.
+             */
+            std::size_t racing();
+        
+            /**
+             * Runs test case.
+             */
+            static int run_test();
+        
+        private:
+        
+            /**
+             * Starts a connection unless enough are established.
+             * @param ep The boost::asio::ip::tcp::endpoint.
+             */
+            void do_connect(const boost::asio::ip::tcp::endpoint & ep);
+        
+            /**
+             * The timer handler, cancels the losing connections once enough
+             * have completed the handshake.
+             * @param ec The boost::system::error_code.
+             */
+            void tick(const boost::system::error_code & ec);
+        
+            /**
+             * The milliseconds between starts.
+             */
+            std::uint32_t m_stagger;
+        
+            /**
+             * The number of established connections that ends the race.
+             */
+            std::size_t m_minimum;
+        
+            /**
+             * The connect handler.
+             */
+            std::function<
+                bool (const boost::asio::ip::tcp::endpoint &)
+            > m_on_connect;
+        
+            /**
+             * The state handler.
+             */
+            std::function<
+                state_t (const boost::asio::ip::tcp::endpoint &)
+            > m_on_state;
+        
+            /**
+             * The cancel handler.
+             */
+            std::function<
+                void (const boost::asio::ip::tcp::endpoint &)
+            > m_on_cancel;
+        
+            /**
+             * The established handler.
+             */
+            std::function<std::size_t ()> m_on_established;
+        
+            /**
+             * The endpoints of the connections still handshaking.
+             */
+            std::set<boost::asio::ip::tcp::endpoint> m_racing;
+        
+            /**
+             * The timers of the starts not yet due.
+             */
+            std::set< std::shared_ptr<
+                boost::asio::basic_waitable_timer<std::chrono::steady_clock>
+            > > m_timers_start;
+        
+            /**
+             * If true we are stopped.
+             */
+            std::atomic<bool> m_stopped;
+        
+        protected:
+        
+            /**
+             * The boost::asio::io_service.
+             */
+            boost::asio::io_service & io_service_;
+        
+            /**
+             * The boost::asio::strand.
+             */
+            boost::asio::strand & strand_;
+        
+            /**
+             * The timer.
+             */
+            boost::asio::basic_waitable_timer<
+                std::chrono::steady_clock
+            > timer_;
+    };
+    
+} // namespace coin
+
+#endif // COIN_TCP_CONNECTION_RACE_HPP
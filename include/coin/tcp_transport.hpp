@@ -22,9 +22,11 @@
 #define COIN_TCP_TRANSPORT_HPP
 
 
+#include <atomic>
 #include <cstdint>
 #include <deque>
 #include <memory>
+#include <mutex>
 
 #if (defined __IPHONE_OS_VERSION_MAX_ALLOWED)
 #import <CFNetwork/CFSocketStream.h>
@@ -35,6 +37,8 @@
 
 namespace coin {
 
+    class token_bucket;
+    
     /**
      * Implements a tcp transport.
      */
@@ -100,8 +104,37 @@ namespace coin {
              * Performs a write operation.
              * @param buf The buffer.
              * @param len The length.
+             * @param bulk If true the write is queued behind all other writes
+             * and shaped by the bulk token bucket (historical blocks).
+             */
+            void write(
+                const char *, const std::size_t &, const bool & bulk = false
+            );
+        
+            /**
+             * Sets the token buckets used to shape writes.
+             * @param relay The token_bucket for (normal) writes.
+             * @param bulk The token_bucket for bulk writes.
+             */
+            void set_token_buckets(
+                const std::shared_ptr<token_bucket> & relay,
+                const std::shared_ptr<token_bucket> & bulk
+            );
+        
+            /**
+             * The number of bytes sent.
+             */
+            std::uint64_t bytes_sent() const;
+        
+            /**
+             * The number of bytes received.
              */
-            void write(const char *, const std::size_t &);
+            std::uint64_t bytes_received() const;
+        
+            /**
+             * The number of bytes queued for writing.
+             */
+            std::size_t bytes_queued() const;
         
             /**
              * The state.
@@ -145,6 +178,13 @@ namespace coin {
              */
             void set_write_timeout(const std::uint32_t &);
         
+            /**
+             * Pauses or resumes reading, a read in progress completes but
+             * the next one waits until reading is resumed.
+             * @param flag The flag.
+             */
+            void set_read_paused(const bool &);
+        
             /**
              * The time of the last read.
              */
@@ -182,6 +222,12 @@ namespace coin {
              */
             void do_write(const char * buf, const std::size_t & len);
         
+            /**
+             * Writes the next queued buffer (normal writes first) if no
+             * write is in progress and the token buckets allow it.
+             */
+            void do_write_next();
+        
             /**
              * The identifier.
              */
@@ -220,6 +266,16 @@ namespace coin {
              */
             std::uint32_t m_write_timeout;
         
+            /**
+             * If true reading is paused.
+             */
+            bool m_read_paused;
+        
+            /**
+             * If true the next read waits for reading to be resumed.
+             */
+            bool m_read_deferred;
+        
             /**
              * The time of the last read.
              */
@@ -229,6 +285,31 @@ namespace coin {
              * The time of the last write.
              */
             std::time_t m_time_last_write;
+        
+            /**
+             * The number of bytes sent.
+             */
+            std::atomic<std::uint64_t> m_bytes_sent;
+        
+            /**
+             * The number of bytes received.
+             */
+            std::atomic<std::uint64_t> m_bytes_received;
+        
+            /**
+             * The number of bytes queued for writing.
+             */
+            std::atomic<std::size_t> m_bytes_queued;
+        
+            /**
+             * The token bucket for (normal) writes.
+             */
+            std::shared_ptr<token_bucket> m_token_bucket_relay;
+        
+            /**
+             * The token bucket for bulk writes.
+             */
+            std::shared_ptr<token_bucket> m_token_bucket_bulk;
     
             /**
              * The completion handler.
@@ -283,11 +364,43 @@ namespace coin {
                 std::chrono::steady_clock
             > write_timeout_timer_;
         
+            /**
+             * The shaping timer.
+             */
+            boost::asio::basic_waitable_timer<
+                std::chrono::steady_clock
+            > shaping_timer_;
+        
             /**
              * The write queue.
              */
             std::deque< std::vector<char> > write_queue_;
         
+            /**
+             * The bulk write queue.
+             */
+            std::deque< std::vector<char> > write_queue_bulk_;
+        
+            /**
+             * If true a write is in progress.
+             */
+            bool write_in_progress_;
+        
+            /**
+             * If true the write in progress is from the bulk write queue.
+             */
+            bool write_in_progress_bulk_;
+        
+            /**
+             * If true the shaping timer is pending.
+             */
+            bool shaping_in_progress_;
+        
+            /**
+             * The read std::mutex.
+             */
+            std::mutex mutex_read_;
+        
             /**
              * The read buffer.
              */
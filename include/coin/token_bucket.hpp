@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2013-2014 John Connor (BM-NC49AxAjcqVcF5jNPu85Rb8MJ2d9JqZt)
+ *
+ * This file is part of coinpp.
+ *
+ * coinpp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License with
+ * additional permissions to the one published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version. For more information see LICENSE.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COIN_TOKEN_BUCKET_HPP
+#define COIN_TOKEN_BUCKET_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+namespace coin {
+
+    /**
+     * Implements a (thread-safe) token bucket used for upload shaping.
+     */
+    class token_bucket
+    {
+        public:
+        
+            /**
+             * Constructor
+             * @param rate The rate in bytes per second (zero is unlimited).
+             * @param burst The maximum number of bytes that may be sent in a
+             * single burst.
+             */
+            token_bucket(const std::size_t & rate, const std::size_t & burst)
+                : m_rate(rate)
+                , m_burst(burst)
+                , m_tokens(static_cast<double> (burst))
+                , m_time_last_refill(std::chrono::steady_clock::now())
+            {
+                // ...
+            }
+        
+            /**
+             * Sets the rate.
+             * @param val The rate in bytes per second (zero is unlimited).
+             */
+            void set_rate(const std::size_t & val)
+            {
+                std::lock_guard<std::mutex> l1(mutex_);
+                
+                m_rate = val;
+            }
+        
+            /**
+             * The rate in bytes per second.
+             */
+            std::size_t rate() const
+            {
+                std::lock_guard<std::mutex> l1(mutex_);
+                
+                return m_rate;
+            }
+        
+            /**
+             * Attempts to consume tokens for the given number of bytes.
+             * @param len The length.
+             * @note Writes larger than the burst only need a full bucket, the
+             * remainder is borrowed from future refills.
+             */
+            bool consume(const std::size_t & len)
+            {
+                std::lock_guard<std::mutex> l1(mutex_);
+                
+                if (m_rate == 0)
+                {
+                    return true;
+                }
+                
+                refill();
+                
+                if (m_tokens >= std::min(len, m_burst))
+                {
+                    m_tokens -= len;
+                    
+                    return true;
+                }
+                
+                return false;
+            }
+        
+            /**
+             * The time until the given number of bytes may be consumed.
+             * @param len The length.
+             */
+            std::chrono::milliseconds delay(const std::size_t & len)
+            {
+                std::lock_guard<std::mutex> l1(mutex_);
+                
+                if (m_rate == 0)
+                {
+                    return std::chrono::milliseconds(0);
+                }
+                
+                refill();
+                
+                auto needed = std::min(len, m_burst) - m_tokens;
+                
+                if (needed <= 0)
+                {
+                    return std::chrono::milliseconds(0);
+                }
+                
+                return std::chrono::milliseconds(
+                    static_cast<std::int64_t> (needed * 1000 / m_rate) + 1
+                );
+            }
+        
+        private:
+        
+            /**
+             * Refills the bucket (the caller must hold the lock).
+             */
+            void refill()
+            {
+                auto now = std::chrono::steady_clock::now();
+                
+                auto elapsed = std::chrono::duration_cast<
+                    std::chrono::microseconds
+                > (now - m_time_last_refill).count();
+                
+                m_time_last_refill = now;
+                
+                m_tokens = std::min(
+                    static_cast<double> (m_burst),
+                    m_tokens + elapsed * static_cast<double> (m_rate) / 1000000
+                );
+            }
+        
+            /**
+             * The rate in bytes per second.
+             */
+            std::size_t m_rate;
+        
+            /**
+             * The burst.
+             */
+            std::size_t m_burst;
+        
+            /**
+             * The tokens (negative when borrowed).
+             */
+            double m_tokens;
+        
+            /**
+             * The time of the last refill.
+             */
+            std::chrono::steady_clock::time_point m_time_last_refill;
+        
+        protected:
+        
+            /**
+             * The mutex.
+             */
+            mutable std::mutex mutex_;
+    };
+    
+} // namespace coin
+
+#endif // COIN_TOKEN_BUCKET_HPP
@@ -39,7 +39,7 @@ namespace coin {
     /**
      * Implements a transaction.
      */
-    class transaction : public data_buffer
+    class transaction
     {
         public:
         
@@ -67,18 +67,20 @@ namespace coin {
         
             /**
              * Encodes
+             * @param buffer The data_buffer.
              * @param encode_version If true the version is encoded.
              */
-            void encode(const bool & encode_version = true);
+            void encode(
+                data_buffer & buffer, const bool & encode_version = true
+            ) const;
         
             /**
              * Encodes
-             * @param buffer The data_buffer.
              * @param encode_version If true the version is encoded.
+             * @note Replaces the overload that encoded into the object itself,
+             * the encoding is returned instead of kept in the object.
              */
-            void encode(
-                data_buffer & buffer, const bool & encode_version = true
-            ) const;
+            data_buffer encode(const bool & encode_version = true) const;
         
             /**
              * Decodes
@@ -86,6 +88,12 @@ namespace coin {
              */
             bool decode(data_buffer & buffer);
         
+            /**
+             * The encoded size in bytes.
+             * @param encode_version If true the version is included.
+             */
+            std::size_t size(const bool & encode_version = true) const;
+        
             /**
              * Sets null.
              */
@@ -333,6 +341,11 @@ namespace coin {
              */
             const std::vector<transaction_out> & transactions_out() const;
         
+            /**
+             * Runs test case.
+             */
+            static int run_test();
+        
             /**
              * operator ==
              */
@@ -35,7 +35,7 @@ namespace coin {
      * previous transaction's output that it claims and a signature that
      * matches the output's public key.
      */
-    class transaction_in : public data_buffer
+    class transaction_in
     {
         public:
         
@@ -72,20 +72,17 @@ namespace coin {
             );
     
             /**
-             * Encodes.
-             */
-            void encode();
-        
-            /**
-             * Decodes
+             * Encodes
              * @param buffer The data_buffer.
              */
             void encode(data_buffer & buffer) const;
         
             /**
-             * Decodes
+             * Encodes
+             * @note Replaces the overload that encoded into the object itself,
+             * the encoding is returned instead of kept in the object.
              */
-            void decode();
+            data_buffer encode() const;
         
             /**
              * Decodes
@@ -93,6 +90,11 @@ namespace coin {
              */
             void decode(data_buffer & buffer);
         
+            /**
+             * The encoded size in bytes.
+             */
+            std::size_t size() const;
+        
             /**
              * The string representation.
              */
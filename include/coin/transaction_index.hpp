@@ -100,6 +100,11 @@ namespace coin {
              */
             std::vector<transaction_position> & spent();
         
+            /**
+             * The spent transaction positions.
+             */
+            const std::vector<transaction_position> & spent() const;
+        
             /**
              * operator ==
              */
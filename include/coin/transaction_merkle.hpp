@@ -50,11 +50,6 @@ namespace coin {
              */
             transaction_merkle(const transaction & tx);
         
-            /**
-             * Encodes
-             */
-            void encode();
-        
             /**
              * Encodes
              * @param buffer The data_buffer.
@@ -62,9 +57,11 @@ namespace coin {
             void encode(data_buffer & buffer);
         
             /**
-             * Decodes
+             * Encodes
+             * @note Replaces the overload that encoded into the object itself,
+             * the encoding is returned instead of kept in the object.
              */
-            void decode();
+            data_buffer encode();
         
             /**
              * Decodes
@@ -189,6 +186,57 @@ namespace coin {
                 return m_block_hash;
             }
         
+            /**
+             * Sets the block hash, index and merkle branch from the block
+             * the transaction is in, no chain state is read.
+             * @param blk The block.
+             */
+            bool locate_in_block(const block & blk)
+            {
+                /**
+                 * Update the transaction's block hash.
+                 */
+                m_block_hash = blk.get_hash();
+
+                /**
+                 * Locate the transaction.
+                 */
+                for (
+                    m_index = 0; m_index < blk.transactions().size();
+                    m_index++
+                    )
+                {
+                    if (
+                        blk.transactions()[m_index] ==
+                        *reinterpret_cast<transaction *>(this)
+                        )
+                    {
+                        break;
+                    }
+                }
+                
+                if (m_index == blk.transactions().size())
+                {
+                    m_merkle_branch.clear();
+                    
+                    m_index = -1;
+                    
+                    log_error(
+                        "Transaction merkle failed to set merkle branch, "
+                        "unable to find transaction in block."
+                    );
+
+                    return false;
+                }
+
+                /**
+                 * Fill in the merkle branch.
+                 */
+                m_merkle_branch = blk.get_merkle_branch(m_index);
+                
+                return true;
+            }
+        
             /**
              * Sets the merkle branch.
              * @param blk The block.
@@ -234,46 +282,10 @@ namespace coin {
                         blk = &blk_tmp;
                     }
 
-                    /**
-                     * Update the transaction's block hash.
-                     */
-                    m_block_hash = blk->get_hash();
-
-                    /**
-                     * Locate the transaction.
-                     */
-                    for (
-                        m_index = 0; m_index < blk->transactions().size();
-                        m_index++
-                        )
+                    if (locate_in_block(*blk) == false)
                     {
-                        if (
-                            blk->transactions()[m_index] ==
-                            *reinterpret_cast<transaction *>(this)
-                            )
-                        {
-                            break;
-                        }
-                    }
-                    
-                    if (m_index == blk->transactions().size())
-                    {
-                        m_merkle_branch.clear();
-                        
-                        m_index = -1;
-                        
-                        log_error(
-                            "Transaction merkle failed to set merkle branch, "
-                            "unable to find transaction in block."
-                        );
-
                         return 0;
                     }
-
-                    /**
-                     * Fill in the merkle branch.
-                     */
-                    m_merkle_branch = blk->get_merkle_branch(m_index);
                 }
 
                 /**
@@ -33,7 +33,7 @@ namespace coin {
      * Implements an output of a transaction. It contains the public key that
      * the next input must be able to sign with to claim it.
      */
-    class transaction_out : public data_buffer
+    class transaction_out
     {
         public:
         
@@ -53,19 +53,16 @@ namespace coin {
         
             /**
              * Encodes
-             */
-            void encode();
-        
-            /**
-             * Decodes
              * @param buffer The data_buffer.
              */
             void encode(data_buffer & buffer) const;
-            
+        
             /**
-             * Decodes
+             * Encodes
+             * @note Replaces the overload that encoded into the object itself,
+             * the encoding is returned instead of kept in the object.
              */
-            void decode();
+            data_buffer encode() const;
 
             /**
              * Decodes
@@ -73,6 +70,11 @@ namespace coin {
              */
             void decode(data_buffer & buffer);
         
+            /**
+             * The encoded size in bytes.
+             */
+            std::size_t size() const;
+        
             /**
              * The string representation.
              */
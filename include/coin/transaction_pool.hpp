@@ -21,10 +21,15 @@
 #ifndef COIN_TRANSACTION_POOL_HPP
 #define COIN_TRANSACTION_POOL_HPP
 
+#include <condition_variable>
+#include <ctime>
 #include <mutex>
+#include <string>
+#include <thread>
 #include <vector>
 
 #include <coin/db_tx.hpp>
+#include <coin/flat_map.hpp>
 #include <coin/point_in.hpp>
 #include <coin/point_out.hpp>
 #include <coin/sha256.hpp>
@@ -41,23 +46,82 @@ namespace coin {
     {
         public:
         
+            /**
+             * The mempool file.
+             */
+            enum
+            {
+                file_version = 1,
+                save_interval = 15 * 60,
+            };
+        
+            /**
+             * A transaction read from the mempool file.
+             */
+            typedef struct entry_s
+            {
+                std::time_t time;
+                transaction tx;
+            } entry_t;
+        
             /**
              * Constructor
              */
             transaction_pool();
         
+            /**
+             * Destructor
+             */
+            ~transaction_pool();
+        
             /**
              * The singleton accessor.
              */
             static transaction_pool & instance();
         
             /**
-             *
+             * Starts, reloads the mempool file against the current tip and
+             * starts saving it periodically.
+             */
+            void start();
+        
+            /**
+             * Stops, saves the mempool file.
+             */
+            void stop();
+        
+            /**
+             * Accepts a transaction into the pool.
+             * @param dbtx The db_tx.
+             * @param tx The transaction.
+             * @param missing_inputs Set to true if an input is missing.
+             * @param is_checked If true the context-free checks have already
+             * passed (and free transactions are not rate limited).
              */
             bool accept(
-                db_tx & dbtx, transaction & tx, bool * missing_inputs
+                db_tx & dbtx, transaction & tx, bool * missing_inputs,
+                const bool & is_checked = false
             );
         
+            /**
+             * Loads the mempool file from disk and accepts the transactions
+             * in arrival order against the current tip.
+             * @param dbtx The db_tx.
+             * @param path The path.
+             */
+            std::size_t load(db_tx & dbtx, const std::string & path);
+        
+            /**
+             * Saves the mempool file to disk.
+             */
+            bool save();
+        
+            /**
+             * Saves the mempool file to disk.
+             * @param path The path.
+             */
+            bool save(const std::string & path);
+        
             /**
              * Removes a transaction.
              * @param tx The transaction.
@@ -99,8 +163,28 @@ namespace coin {
              */
             std::uint32_t & transactions_updated();
         
+            /**
+             * Runs test case.
+             */
+            static int run_test();
+        
         private:
         
+            /**
+             * Reads the mempool file running the context-free checks in
+             * parallel, the transactions that fail them are dropped.
+             * @param path The path.
+             * @param entries The entries (in arrival order).
+             */
+            static bool read(
+                const std::string & path, std::vector<entry_t> & entries
+            );
+        
+            /**
+             * The save thread loop.
+             */
+            void do_save();
+        
             /**
              * Add to pool without checking anything. Call accept to check the
              * transaction first.
@@ -116,6 +200,21 @@ namespace coin {
              * The number of transactons updated.
              */
             std::uint32_t m_transactions_updated;
+        
+            /**
+             * The arrival times of the transactions.
+             */
+            std::map<sha256, std::time_t> m_arrival_times;
+        
+            /**
+             * The save thread.
+             */
+            std::thread m_save_thread;
+        
+            /**
+             * If true the save thread should exit.
+             */
+            bool m_save_stop;
     
         protected:
         
@@ -127,7 +226,17 @@ namespace coin {
             /**
              * The next transactions.
              */
-            std::map<point_out, point_in> transactions_next_;
+            flat_map<point_out, point_in> transactions_next_;
+        
+            /**
+             * The save std::mutex.
+             */
+            std::mutex mutex_save_;
+        
+            /**
+             * The save std::condition_variable.
+             */
+            std::condition_variable condition_save_;
     };
     
 } // namespace coin
@@ -52,11 +52,6 @@ namespace coin {
                 const wallet * ptr_wallet, const transaction & tx_in
             );
         
-            /**
-             * Encodes
-             */
-            void encode();
-        
             /**
              * Encodes
              * @param buffer The data_buffer.
@@ -64,9 +59,11 @@ namespace coin {
             void encode(data_buffer & buffer);
         
             /**
-             * Decodes
+             * Encodes
+             * @note Replaces the overload that encoded into the object itself,
+             * the encoding is returned instead of kept in the object.
              */
-            void decode();
+            data_buffer encode();
         
             /**
              * Decodes
@@ -316,12 +313,36 @@ namespace coin {
              */
             enum { confirmations = 1 };
         
+            /**
+             * Runs test case.
+             */
+            static int run_test();
+        
         private:
         
+            /**
+             * Decodes the previous transactions if they were loaded in their
+             * encoded form.
+             */
+            void load_previous_transactions() const;
+        
+            /**
+             * Skips over encoded previous transactions without decoding them.
+             * @param buffer The data_buffer.
+             */
+            static void skip_previous_transactions(data_buffer & buffer);
+        
             /**
              * The previous transactions.
              */
-            std::vector<transaction_merkle> m_previous_transactions;
+            mutable std::vector<transaction_merkle> m_previous_transactions;
+        
+            /**
+             * The previous transactions as read from the wallet database,
+             * they are only needed to relay or re-accept the transaction so
+             * they are decoded on first use.
+             */
+            mutable std::vector<char> m_previous_transactions_encoded;
         
             /**
              * The values.
@@ -0,0 +1,311 @@
+/*
+ * Copyright (c) 2013-2014 John Connor (BM-NC49AxAjcqVcF5jNPu85Rb8MJ2d9JqZt)
+ *
+ * This file is part of coinpp.
+ *
+ * coinpp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License with
+ * additional permissions to the one published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version. For more information see LICENSE.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COIN_TX_RECONCILIATION_HPP
+#define COIN_TX_RECONCILIATION_HPP
+
+#include <cstdint>
+#include <ctime>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include <coin/flat_set.hpp>
+#include <coin/sha256.hpp>
+
+namespace coin {
+
+    class data_buffer;
+    
+    /**
+     * Implements set reconciliation based transaction relay with a single
+     * peer. Instead of pushing every transaction to the peer, the txids it
+     * has not seen from us are collected and periodically reconciled: the
+     * initiator (the outgoing side of the connection) sends a sketch of its
+     * set, the responder subtracts its own, announces what the initiator
+     * lacks and asks for what it lacks itself. Only the differences are
+     * then exchanged with the existing inv/getdata messages.
+     */
+    class tx_reconciliation
+    {
+        public:
+        
+            /**
+             * The interval in seconds between reconciliations.
+             */
+            enum { interval = 2 };
+        
+            /**
+             * The number of outgoing reconciling peers that transactions are
+             * still pushed to, so they propagate quickly.
+             */
+            enum { max_flood_peers = 2 };
+        
+            /**
+             * The sketch size limits in cells.
+             */
+            enum { minimum_cells = 12, maximum_cells = 8190 };
+        
+            /**
+             * The maximum number of transactions queued for a peer, beyond
+             * this new ones are announced by inv right away.
+             */
+            enum { max_set_size = 4096 };
+        
+            /**
+             * Implements an invertible bloom lookup table of short
+             * transaction ids. Subtracting two sketches leaves only the
+             * symmetric difference which decodes if it is small enough for
+             * the number of cells.
+             */
+            class sketch
+            {
+                public:
+                
+                    /**
+                     * Constructor
+                     * @param cells The number of cells (rounded up to a
+                     * multiple of the number of hashes).
+                     */
+                    explicit sketch(const std::size_t & cells = 0);
+                
+                    /**
+                     * Inserts a short id.
+                     * @param val The value.
+                     */
+                    void insert(const std::uint64_t & val);
+                
+                    /**
+                     * Subtracts another sketch of the same size.
+                     * @param other The other sketch.
+                     */
+                    bool subtract(const sketch & other);
+                
+                    /**
+                     * Decodes the difference.
+                     * @param positive The short ids only on our side.
+                     * @param negative The short ids only on the other side.
+                     * @return False if it could not be fully decoded.
+                     */
+                    bool decode(
+                        std::vector<std::uint64_t> & positive,
+                        std::vector<std::uint64_t> & negative
+                    ) const;
+                
+                    /**
+                     * Encodes
+                     * @param buffer The data_buffer.
+                     */
+                    void encode(data_buffer & buffer) const;
+                
+                    /**
+                     * Decodes
+                     * @param buffer The data_buffer.
+                     */
+                    bool decode(data_buffer & buffer);
+                
+                    /**
+                     * The number of cells.
+                     */
+                    std::size_t size() const;
+                
+                private:
+                
+                    /**
+                     * The number of cells each id is inserted into.
+                     */
+                    enum { hash_count = 3 };
+                
+                    /**
+                     * A cell.
+                     */
+                    typedef struct
+                    {
+                        std::int32_t count;
+                        std::uint64_t key_sum;
+                        std::uint32_t check_sum;
+                    } cell_t;
+                
+                    /**
+                     * Adds (or removes) a short id to the cells.
+                     * @param cells The cells.
+                     * @param val The value.
+                     * @param count The count (1 or -1).
+                     */
+                    static void update(
+                        std::vector<cell_t> & cells, const std::uint64_t & val,
+                        const std::int32_t & count
+                    );
+                
+                    /**
+                     * The cell a short id is inserted into for a hash.
+                     * @param cells The number of cells.
+                     * @param val The value.
+                     * @param index The index of the hash.
+                     */
+                    static std::size_t position(
+                        const std::size_t & cells, const std::uint64_t & val,
+                        const std::uint32_t & index
+                    );
+                
+                    /**
+                     * The check of a short id.
+                     * @param val The value.
+                     */
+                    static std::uint32_t check(const std::uint64_t & val);
+                
+                    /**
+                     * Mixes a short id with a seed.
+                     * @param val The value.
+                     * @param seed The seed.
+                     */
+                    static std::uint64_t mix(
+                        const std::uint64_t & val, const std::uint32_t & seed
+                    );
+                
+                    /**
+                     * The cells.
+                     */
+                    std::vector<cell_t> m_cells;
+                
+                protected:
+                
+                    // ...
+            };
+        
+            /**
+             * Constructor
+             * @param is_initiator If true we initiate reconciliations.
+             */
+            explicit tx_reconciliation(const bool & is_initiator);
+        
+            /**
+             * If true we initiate reconciliations.
+             */
+            const bool & is_initiator() const;
+        
+            /**
+             * Adds a transaction the peer has not seen from us.
+             * @param hash_tx The transaction hash.
+             * @return False if the set is full (announce it by inv).
+             */
+            bool add(const sha256 & hash_tx);
+        
+            /**
+             * Removes a transaction the peer has announced to us.
+             * @param hash_tx The transaction hash.
+             */
+            void remove(const sha256 & hash_tx);
+        
+            /**
+             * The number of transactions waiting to be reconciled.
+             */
+            std::size_t size();
+        
+            /**
+             * Creates the sketch message payload (initiator), the set is
+             * moved aside until the differences arrive.
+             * @param buffer The data_buffer.
+             * @return False if a reconciliation is already in flight.
+             */
+            bool create_sketch(data_buffer & buffer);
+        
+            /**
+             * Reconciles a sketch message payload against our set
+             * (responder) and creates the differences message payload.
+             * @param buffer The sketch message payload.
+             * @param buffer_differences The differences message payload.
+             * @param to_announce The transactions the peer lacks.
+             * @return False if the sketch could not be decoded, every
+             * transaction in our set is then announced.
+             */
+            bool reconcile(
+                data_buffer & buffer, data_buffer & buffer_differences,
+                std::vector<sha256> & to_announce
+            );
+        
+            /**
+             * Handles a differences message payload (initiator).
+             * @param buffer The differences message payload.
+             * @param to_announce The transactions the peer lacks.
+             */
+            bool on_differences(
+                data_buffer & buffer, std::vector<sha256> & to_announce
+            );
+        
+            /**
+             * Runs test case.
+             */
+            static int run_test();
+        
+        private:
+        
+            /**
+             * The short id of a transaction for a reconciliation.
+             * @param hash_tx The transaction hash.
+             * @param salt The salt.
+             */
+            static std::uint64_t short_id(
+                const sha256 & hash_tx, const std::uint64_t & salt
+            );
+        
+            /**
+             * If true we initiate reconciliations.
+             */
+            bool m_is_initiator;
+        
+            /**
+             * The transactions waiting to be reconciled.
+             */
+            flat_set<sha256> m_set;
+        
+            /**
+             * The transactions of the reconciliation in flight by short id
+             * (initiator).
+             */
+            std::map<std::uint64_t, sha256> m_snapshot;
+        
+            /**
+             * If true a reconciliation is in flight (initiator).
+             */
+            bool m_in_flight;
+        
+            /**
+             * The time the reconciliation in flight was started.
+             */
+            std::time_t m_time_in_flight;
+        
+            /**
+             * The size of the last difference, used to size the next
+             * sketch.
+             */
+            std::size_t m_difference;
+        
+        protected:
+        
+            /**
+             * The std::mutex.
+             */
+            std::mutex mutex_;
+    };
+    
+} // namespace coin
+
+#endif // COIN_TX_RECONCILIATION_HPP
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2013-2014 John Connor (BM-NC49AxAjcqVcF5jNPu85Rb8MJ2d9JqZt)
+ *
+ * This file is part of coinpp.
+ *
+ * coinpp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License with
+ * additional permissions to the one published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version. For more information see LICENSE.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COIN_VALIDATION_CACHE_HPP
+#define COIN_VALIDATION_CACHE_HPP
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <utility>
+
+#include <coin/sha256.hpp>
+
+namespace coin {
+
+    /**
+     * Implements a whole transaction validation cache. It remembers the
+     * transactions whose input scripts all verified under a set of flags
+     * (the transaction hash commits to the previous outputs so the result
+     * does not change) so that connecting a block made of transactions
+     * already accepted into the transaction pool skips script execution.
+     * It is ok for this to be a singleton even in the presence of multiple
+     * instances in the same memory space.
+     */
+    class validation_cache
+    {
+        public:
+        
+            /**
+             * The script verification flags.
+             */
+            enum
+            {
+                flag_none = 0,
+                flag_pay_to_script_hash = 1,
+            };
+        
+            /**
+             * The singleton accessor.
+             */
+            static validation_cache & instance();
+        
+            /**
+             * If true every input script of the transaction is known to be
+             * valid under the flags.
+             * @param hash The transaction hash.
+             * @param flags The flags.
+             */
+            bool get(const sha256 & hash, const std::uint32_t & flags);
+        
+            /**
+             * Records that every input script of the transaction is valid
+             * under the flags.
+             * @param hash The transaction hash.
+             * @param flags The flags.
+             */
+            void set(const sha256 & hash, const std::uint32_t & flags);
+        
+            /**
+             * The number of entries.
+             */
+            std::size_t size();
+        
+            /**
+             * Runs test case.
+             */
+            static int run_test();
+        
+        private:
+        
+            /**
+             * The maximum cache size, enough for a full transaction pool.
+             * An entry is a std::set node holding the digest and flags,
+             * ~80 bytes with allocator overhead (~8MB when full).
+             */
+            enum { max_cache_size = 100000 };
+        
+            /**
+             * A cache key (the transaction hash digest and the flags). The
+             * digest is stored bare, a sha256 object is 144 bytes.
+             */
+            typedef std::pair<
+                std::array<std::uint8_t, sha256::digest_length>, std::uint32_t
+            > key_t;
+        
+            /**
+             * Makes a cache key.
+             * @param hash The transaction hash.
+             * @param flags The flags.
+             */
+            static key_t make_key(
+                const sha256 & hash, const std::uint32_t & flags
+            );
+        
+            /**
+             * The valid transactions.
+             */
+            std::set<key_t> m_valid;
+        
+        protected:
+        
+            /**
+             * The std::mutex.
+             */
+            std::mutex mutex_;
+    };
+    
+} // namespace coin
+
+#endif // COIN_VALIDATION_CACHE_HPP
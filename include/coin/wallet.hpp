@@ -29,6 +29,7 @@
 
 #include <coin/destination.hpp>
 #include <coin/db_wallet.hpp>
+#include <coin/flat_map.hpp>
 #include <coin/key_public.hpp>
 #include <coin/key_store_crypto.hpp>
 #include <coin/key_wallet_master.hpp>
@@ -327,9 +328,10 @@ namespace coin {
             void disable_transaction(const transaction & tx) const;
 
             /**
-             * Add a transaction to the wallet, or update it.
+             * Add a transaction to the wallet, or update it. No chain state
+             * is read so this can run off the strand.
              * @param tx The transaction.
-             * @param blk The block.
+             * @param blk The (indexed) block it is in.
              * @param update If true existing transactions will be updated.
              */
             bool add_to_wallet_if_involving_me(
@@ -595,7 +597,7 @@ namespace coin {
             /**
              * The request counts.
              */
-            std::map<sha256, std::int32_t> & request_counts();
+            flat_map<sha256, std::int32_t> & request_counts();
         
             /**
              * The address book.
@@ -680,6 +682,17 @@ namespace coin {
              */
             bool do_encrypt(const std::string & passphrase);
         
+            /**
+             * Adds the transaction to the wallet.
+             * @param wtx_in The transaction_wallet.
+             * @param is_block_indexed If true the block it is in is indexed,
+             * passed in so no chain state is read.
+             */
+            bool add_to_wallet(
+                const transaction_wallet & wtx_in,
+                const bool & is_block_indexed
+            );
+        
             /**
              * The database wallet encryption.
              */
@@ -705,7 +718,7 @@ namespace coin {
             /**
              * The request counts.
              */
-            mutable std::map<sha256, std::int32_t> m_request_counts;
+            mutable flat_map<sha256, std::int32_t> m_request_counts;
         
             /**
              * The address book.
@@ -21,10 +21,11 @@
 #ifndef COIN_WALLET_MANAGER_HPP
 #define COIN_WALLET_MANAGER_HPP
 
+#include <map>
 #include <mutex>
-#include <set>
 
 #include <coin/block_locator.hpp>
+#include <coin/notification_queue.hpp>
 #include <coin/sha256.hpp>
 #include <coin/transaction.hpp>
 #include <coin/wallet.hpp>
@@ -34,7 +35,10 @@ namespace coin {
     class block;
     
     /**
-     * Implements a wallet manager.
+     * Implements a wallet manager. Every wallet has it's own notification
+     * queue so that wallet updates (block connected and disconnected,
+     * transactions added and removed) run in order on a wallet thread
+     * instead of on the chain-state path.
      */
     class wallet_manager
     {
@@ -82,6 +86,26 @@ namespace coin {
                 const bool & update = false, const bool & connect = true
             );
         
+            /**
+             * Called when a block has been connected, the wallets are
+             * updated with every transaction in it.
+             * @param blk The block.
+             */
+            void on_block_connected(const block & blk);
+        
+            /**
+             * Called when a block has been disconnected, the wallets refund
+             * the inputs of it's coinstake (ppcoin).
+             * @param blk The block.
+             */
+            void on_block_disconnected(const block & blk);
+        
+            /**
+             * Waits for every wallet to have processed the notifications
+             * posted so far.
+             */
+            void sync();
+        
             /**
              * Sets the best chain.
              * @param val The value.
@@ -103,9 +127,19 @@ namespace coin {
         private:
         
             /**
-             * The wallets.
+             * Posts a notification to every wallet.
+             * @param f The std::function.
+             */
+            void post(
+                const std::function<void (const std::shared_ptr<wallet> &)> & f
+            ) const;
+        
+            /**
+             * The wallets and their notification queues.
              */
-            std::set< std::shared_ptr<wallet> > m_wallets;
+            std::map<
+                std::shared_ptr<wallet>, std::shared_ptr<notification_queue>
+            > m_wallets;
         
         protected:
         
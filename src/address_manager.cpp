@@ -18,14 +18,16 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
 #include <fstream>
 #include <memory>
 #include <stdexcept>
+#include <thread>
 
 #include <boost/asio.hpp>
 
-#include <openssl/rand.h>
-
 #include <coin/address_manager.hpp>
 #include <coin/data_buffer.hpp>
 #include <coin/hash.hpp>
@@ -36,26 +38,35 @@
 
 using namespace coin;
 
+static_assert(
+    sizeof(address_manager::peers_header_t) == 64, "invalid peers header"
+);
+static_assert(
+    sizeof(address_manager::peers_record_t) == 64, "invalid peers record"
+);
+
+/**
+ * The current time in milliseconds on the steady clock.
+ */
+static std::int64_t steady_milliseconds()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds> (
+        std::chrono::steady_clock::now().time_since_epoch()
+    ).count();
+}
+
 address_manager::address_manager()
-    : id_count_(0)
-    , number_tried_(0)
-    , number_new_(0)
-    , buckets_new_(std::vector< std::set<std::uint32_t> >(
-        256, std::set<std::uint32_t>())
-    )
-    , buckets_tried_(std::vector< std::vector<std::uint32_t> >(
-        64, std::vector<std::uint32_t>(0))
-    )
+    : snapshot_(std::make_shared<snapshot_t> ())
+    , snapshot_dirty_(false)
+    , snapshot_stale_(true)
+    , time_snapshot_(0)
 {
-    /**
-     * Allocate the key.
-     */
-    key_.resize(32);
-    
     /**
      * Randomize the key.
      */
-    RAND_bytes(&key_[0], 32);
+    random::bytes(&key_[0], key_.size());
+    
+    clear();
 }
 
 void address_manager::start()
@@ -90,8 +101,11 @@ void address_manager::stop()
 
 bool address_manager::load()
 {
-    std::string path = filesystem::data_path() + "peers.dat";
-    
+    return load(filesystem::data_path() + "peers.dat");
+}
+
+bool address_manager::load(const std::string & path)
+{
     log_info(
         "Address manager is reading peers file, path = " << path << "."
     );
@@ -112,294 +126,122 @@ bool address_manager::load()
         
         ifs.seekg(0, ifs.beg);
         
+        if (len < sizeof(std::uint32_t) + 1 + sha256::digest_length)
+        {
+            throw std::runtime_error("invalid file length");
+        }
+        
         /**
          * Allocate the buffer.
          */
-        std::unique_ptr<char> buf(new char[len]);
+        std::vector<char> buf(len);
         
         /**
          * Read the file.
          */
-        ifs.read(buf.get(), len);
+        ifs.read(&buf[0], len);
         
         /**
          * Close the file.
          */
         ifs.close();
         
+        len -= sha256::digest_length;
+        
         /**
          * Calculate the sha256d hash of the data portion.
          */
-        auto digest1 = hash::sha256d(
-            reinterpret_cast<std::uint8_t *>(buf.get()),
-            len - sha256::digest_length
+        auto digest = hash::sha256d(
+            reinterpret_cast<std::uint8_t *>(&buf[0]), len
         );
         
         /**
-         * Allocate the temporary digest.
+         * Verify that the digest matches the one at the end of the file.
          */
-        std::array<std::uint8_t, sha256::digest_length> digest2;
+        if (std::memcmp(&digest[0], &buf[len], sha256::digest_length) != 0)
+        {
+            throw std::runtime_error("invalid file checksum");
+        }
         
-        /**
-         * Copy the digest from the file.
-         */
-        std::memcpy(
-            &digest2[0], buf.get() + (len - sha256::digest_length),
-            sha256::digest_length
-        );
+        std::uint32_t magic;
+        
+        std::memcpy(&magic, &buf[0], sizeof(magic));
+        
+        if (magic != message::header_magic())
+        {
+            throw std::runtime_error("invalid file header magic");
+        }
+        
+        clear();
         
         /**
-         * Verify that the two digests match.
+         * The version 0 file has a version byte of zero after the magic.
          */
-        if (
-            std::memcmp(&digest1[0], &digest2[0], sha256::digest_length) == 0
-            )
+        if (buf[sizeof(magic)] == 0)
         {
-            /**
-             * Parse the file.
-             */
-            data_buffer data(buf.get(), len - sha256::digest_length);
-            
-            /**
-             * Decode the file magic from little endian.
-             */
-            auto magic = data.read_uint32();
-            
-            if (magic != message::header_magic())
+            load_legacy(&buf[0], len);
+        }
+        else
+        {
+            if (len < sizeof(peers_header_t))
             {
-                throw std::runtime_error("invalid file header magic");
+                throw std::runtime_error("invalid file length");
             }
             
             /**
-             * Read the version byte.
-             */
-            auto version = data.read_uint8();
-            
-            (void)version;
-            
-            /**
-             * Read the key length.
-             */
-            auto key_length = data.read_uint8();
-            
-            assert(key_length == sha256::digest_length);
-        
-            /**
-             * Read the 32-byte key.
-             */
-            auto key_bytes = data.read_bytes(sha256::digest_length);
-            
-            /**
-             * Set the key.
-             */
-            std::memcpy(&key_[0], &key_bytes[0], key_bytes.size());
-
-            /**
-             * The number of new peers.
-             */
-            number_new_ = data.read_uint32();
-
-            /**
-             * The number of tried peers.
-             */
-            number_tried_ = data.read_uint32();
-
-            /**
-             * The number of buckets.
-             */
-            auto number_buckets = data.read_uint32();
-
-            assert(number_buckets == 256);
-            
-            /**
-             * Set the id count.
+             * The records are fixed size and in host byte order so they are
+             * copied straight out of the buffer.
              */
-            id_count_ = 0;
-            
-            std::lock_guard<std::recursive_mutex> l1(mutex_random_ids_);
+            peers_header_t header;
             
-            /**
-             * Clear the maps.
-             */
-            address_info_map_.clear();
-            network_address_map_.clear();
-            random_ids_.clear();
+            std::memcpy(&header, &buf[0], sizeof(header));
             
-            std::lock_guard<std::recursive_mutex> l2(mutex_buckets_new_);
+            if (
+                header.version != peers_file_version ||
+                header.record_length != sizeof(peers_record_t) ||
+                sizeof(header) + static_cast<std::size_t> (header.count) *
+                sizeof(peers_record_t) != len
+                )
+            {
+                throw std::runtime_error("invalid file version");
+            }
             
-            /**
-             * Allocate the new buckets.
-             */
-            buckets_new_ = std::vector< std::set<std::uint32_t> >(
-                256, std::set<std::uint32_t>()
-            );
+            std::memcpy(&key_[0], header.key, key_.size());
             
-            std::lock_guard<std::recursive_mutex> l3(mutex_buckets_tried_);
+            const auto * records = &buf[sizeof(header)];
             
-            /**
-             * Allocate the tried buckets.
-             */
-            buckets_tried_ = std::vector< std::vector<std::uint32_t> >(
-                64, std::vector<std::uint32_t>(0)
-            );
-
-            for (auto i = 0; i < number_new_; i++)
+            for (std::uint32_t i = 0; i < header.count; i++)
             {
-                /**
-                 * Allocate the address info.
-                 */
-                address_info_t info;
-                
-                /**
-                 * Zero
-                 */
-                std::memset(&info, 0, sizeof(info));
-                
-                /**
-                 * Read the protocol::network_address_t.
-                 */
-                info.addr = data.read_network_address(
-                    true, true
-                );
-                
-                /**
-                 * Read the ip address.
-                 */
-                auto ip = data.read_bytes(16);
-
-                /**
-                 * Copy
-                 */
-                std::memcpy(&info.addr_src[0], &ip[0], ip.size());
+                peers_record_t record;
                 
-                /**
-                 * Read the last success.
-                 */
-                info.last_success = data.read_uint64();
-                
-                /**
-                 * Read the last attempts.
-                 */
-                info.last_attempts = data.read_uint32();
-
-                address_info_map_[i] = info;
-                network_address_map_[info.addr] = i;
-                info.random_position = static_cast<std::uint32_t> (
-                    random_ids_.size()
+                std::memcpy(
+                    &record, records + i * sizeof(peers_record_t),
+                    sizeof(record)
                 );
-                random_ids_.push_back(i);
                 
-                if (number_buckets == 256)
-                {
-                    // ...
-                }
-                else
-                {
-                    buckets_new_[info.calculate_tried_bucket(key_)].insert(i);
-                    
-                    info.reference_count++;
-                }
-            }
-            
-            id_count_ = number_new_;
-            
-            auto number_lost = 0;
-            
-            for (auto i = 0; i < number_tried_; i++)
-            {
-                /**
-                 * Allocate the address info.
-                 */
                 address_info_t info;
                 
-                /**
-                 * Zero
-                 */
                 std::memset(&info, 0, sizeof(info));
                 
-                /**
-                 * Read the protocol::network_address_t.
-                 */
-                info.addr = data.read_network_address(
-                    true, true
+                std::memcpy(
+                    &info.addr.address[0], record.address,
+                    info.addr.address.size()
                 );
-
-                /**
-                 * Read the ip address.
-                 */
-                auto ip = data.read_bytes(16);
-
-                /**
-                 * Copy
-                 */
-                std::memcpy(&info.addr_src[0], &ip[0], ip.size());
-                
-                /**
-                 * Read the last success.
-                 */
-                info.last_success = data.read_uint64();
-                
-                /**
-                 * Read the last attempts.
-                 */
-                info.last_attempts = data.read_uint32();
-                
-                auto & tried = buckets_tried_[info.calculate_tried_bucket(key_)];
-                
-                if (tried.size() < 64)
-                {
-                    info.random_position = static_cast<std::uint32_t> (
-                        random_ids_.size()
-                    );
-                    info.tried = true;
-                    random_ids_.push_back(id_count_);
-                    address_info_map_[id_count_] = info;
-                    network_address_map_[info.addr] = id_count_;
-                    tried.push_back(id_count_);
-                    id_count_++;
-                }
-                else
-                {
-                    number_lost++;
-                }
-            }
-            
-            number_tried_ -= number_lost;
-            
-            for (auto i = 0; i < number_buckets; i++)
-            {
-                /**
-                 * Get the new bucket.
-                 */
-                auto & bucket_new = buckets_new_[i];
+                info.addr.services = record.services;
+                info.addr.timestamp = record.timestamp;
+                info.addr.port = record.port;
+                std::memcpy(
+                    &info.addr_src[0], record.addr_src, info.addr_src.size()
+                );
+                info.last_success = record.last_success;
+                info.last_attempts = record.last_attempts;
+                info.tried = record.tried != 0;
                 
-                /**
-                 * Read the size.
-                 */
-                auto size = data.read_uint32();
-
-                for (auto j = 0; j < size; j++)
-                {
-                    /**
-                     * Read the index.
-                     */
-                    auto index = data.read_uint32();
-                    
-                    auto & addr_info = address_info_map_[index];
-                    
-                    if (number_buckets == 256 && addr_info.reference_count < 4)
-                    {
-                        addr_info.reference_count++;
-                        
-                        bucket_new.insert(index);
-                    }
-                }
+                insert(info);
             }
         }
-        else
-        {
-            throw std::runtime_error("invalid file checksum");
-        }
+        
+        snapshot_stale_ = true;
     }
     else
     {
@@ -414,331 +256,220 @@ bool address_manager::load()
     return true;
 }
 
-void address_manager::save()
+void address_manager::load_legacy(const char * buf, const std::size_t & len)
 {
     /**
-     * Allocate the data_buffer.
+     * Parse the file.
      */
-    data_buffer data;
+    data_buffer data(buf, len);
     
     /**
-     * Write the file magic.
+     * Skip the magic and version byte.
      */
-    data.write_uint32(message::header_magic());
+    data.read_uint32();
+    data.read_uint8();
     
     /**
-     * Write the version byte.
+     * Read the key length.
      */
-    data.write_uint8(0);
+    auto key_length = data.read_uint8();
     
-    /**
-     * Write the key length.
-     */
-    data.write_uint8(sha256::digest_length);
+    if (key_length != sha256::digest_length)
+    {
+        throw std::runtime_error("invalid key length");
+    }
 
     /**
-     * Write the 32-byte key.
+     * Read the 32-byte key.
      */
-    data.write_bytes(reinterpret_cast<const char *>(&key_[0]), key_.size());
+    auto key_bytes = data.read_bytes(sha256::digest_length);
     
-    /**
-     * Write the number of new peers.
-     */
-    data.write_uint32(number_new_);
+    std::memcpy(&key_[0], &key_bytes[0], key_bytes.size());
 
-    /**
-     * Write the number of tried peers.
-     */
-    data.write_uint32(number_tried_);
-
-    /**
-     * Write the number of buckets.
-     */
-    data.write_uint32(256);
-    
-    auto nids = 0;
-    
-    std::map<std::uint32_t, std::uint32_t> unk_ids;
+    auto number_new = data.read_uint32();
+    auto number_tried = data.read_uint32();
     
     /**
-     * Write the new.
+     * The number of buckets, the bucket positions that follow the entries
+     * are recalculated so they are not read.
      */
-    for (
-        auto it = address_info_map_.begin(); it != address_info_map_.end(); ++it
-        )
+    data.read_uint32();
+
+    for (std::uint32_t i = 0; i < number_new + number_tried; i++)
     {
-        if (nids == number_new_)
-        {
-            break;
-        }
-    
-        unk_ids[it->first] = nids;
-    
-        auto & info = it->second;
+        address_info_t info;
         
-        if (info.reference_count > 0)
-        {
-            assert(info.addr.is_valid());
-            
-            /**
-             * Write the network address.
-             */
-            data.write_network_address(info.addr, true, true);
-            
-            /**
-             * Write the source ip address.
-             */
-            data.write_bytes(
-                reinterpret_cast<const char *>(&info.addr_src[0]),
-                info.addr_src.size()
-            );
-
-            /**
-             * Write the last success.
-             */
-            data.write_uint64(info.last_success);
+        std::memset(&info, 0, sizeof(info));
+        
+        /**
+         * Read the protocol::network_address_t.
+         */
+        info.addr = data.read_network_address(true, true);
+        
+        /**
+         * Read the source ip address.
+         */
+        auto ip = data.read_bytes(16);
 
-            /**
-             * Read the last attempts.
-             */
-            data.write_uint32(info.last_attempts);
-            
-            nids++;
-        }
+        std::memcpy(&info.addr_src[0], &ip[0], ip.size());
+        
+        /**
+         * Read the last success.
+         */
+        info.last_success = data.read_uint64();
+        
+        /**
+         * Read the last attempts.
+         */
+        info.last_attempts = data.read_uint32();
+        
+        info.tried = i >= number_new;
+        
+        insert(info);
     }
+}
+
+void address_manager::save()
+{
+    save(filesystem::data_path() + "peers.dat");
+}
+
+void address_manager::save(const std::string & path)
+{
+    std::vector<peers_record_t> records;
     
-    nids = 0;
-    
-    /**
-     * Write the tried.
-     */
-    for (
-        auto it = address_info_map_.begin(); it != address_info_map_.end(); ++it
-        )
+    for (auto & i : shards_)
     {
-        if (nids == number_tried_)
-        {
-            break;
-        }
+        std::lock_guard<std::mutex> l1(i.mutex);
         
-        auto & info = it->second;
-
-        if (info.tried)
+        for (auto & j : i.address_info_map)
         {
+            const auto & info = j.second;
+            
+            if (info.reference_count == 0 && info.tried == false)
+            {
+                continue;
+            }
+            
             assert(info.addr.is_valid());
             
-            /**
-             * Write the network address.
-             */
-            data.write_network_address(info.addr, true, true);
+            peers_record_t record;
             
-            /**
-             * Write the source ip address.
-             */
-            data.write_bytes(
-                reinterpret_cast<const char *>(&info.addr_src[0]),
-                info.addr_src.size()
+            std::memset(&record, 0, sizeof(record));
+            
+            std::memcpy(
+                record.address, &info.addr.address[0],
+                info.addr.address.size()
+            );
+            record.services = info.addr.services;
+            record.last_success = info.last_success;
+            record.timestamp = info.addr.timestamp;
+            record.last_attempts = info.last_attempts;
+            record.port = info.addr.port;
+            record.tried = info.tried ? 1 : 0;
+            std::memcpy(
+                record.addr_src, &info.addr_src[0], info.addr_src.size()
             );
-
-            /**
-             * Write the last success.
-             */
-            data.write_uint64(info.last_success);
-
-            /**
-             * Read the last attempts.
-             */
-            data.write_uint32(info.last_attempts);
             
-            nids++;
+            records.push_back(record);
         }
     }
-
-    std::lock_guard<std::recursive_mutex> l1(mutex_buckets_new_);
     
-    /**
-     * Write the bucket's.
-     */
-    for (auto it1 = buckets_new_.begin(); it1 != buckets_new_.end(); ++it1)
+    peers_header_t header;
+    
+    std::memset(&header, 0, sizeof(header));
+    
+    header.magic = message::header_magic();
+    header.version = peers_file_version;
+    header.record_length = sizeof(peers_record_t);
+    header.count = static_cast<std::uint32_t> (records.size());
+    std::memcpy(header.key, &key_[0], key_.size());
+    
+    std::vector<std::uint8_t> buf(
+        sizeof(header) + records.size() * sizeof(peers_record_t)
+    );
+    
+    std::memcpy(&buf[0], &header, sizeof(header));
+    
+    if (records.size() > 0)
     {
-        const auto & bucket_new = *it1;
-
-        std::uint32_t size = static_cast<std::uint32_t> (bucket_new.size());
-
-        /**
-         * Write the size.
-         */
-        data.write_uint32(size);
-        
-        for (auto it2 = bucket_new.begin(); it2 != bucket_new.end(); ++it2)
-        {
-            std::uint32_t index = unk_ids[*it2];
-
-            /**
-             * Write the index.
-             */
-            data.write_uint32(index);
-        }
+        std::memcpy(
+            &buf[sizeof(header)], &records[0],
+            records.size() * sizeof(peers_record_t)
+        );
     }
     
     /**
      * Calculate the sha256d hash of the data portion.
      */
-    auto digest1 = hash::sha256d(
-        reinterpret_cast<std::uint8_t *>(data.data()),
-        data.size()
-    );
-    
-    /**
-     * Write the checksum.
-     */
-    data.write_bytes(
-        reinterpret_cast<const char *> (&digest1[0]), digest1.size()
-    );
-    
-    std::string path = filesystem::data_path() + "peers.dat";
+    auto digest = hash::sha256d(&buf[0], buf.size());
     
     log_info(
         "Address manager is writing peers file, path = " << path << "."
     );
 
     /**
-     * Allocate the std::ofstream.
+     * Write to a temporary file and rename it over the old one so a crash
+     * never leaves a partially written file.
      */
-    std::ofstream ofs(path, std::ifstream::out | std::ifstream::binary);
+    std::ofstream ofs(
+        path + ".tmp", std::ifstream::out | std::ifstream::binary
+    );
+    
+    ofs.write(reinterpret_cast<const char *> (&buf[0]), buf.size());
+    ofs.write(reinterpret_cast<const char *> (&digest[0]), digest.size());
     
-    /**
-     * Write to disk.
-     */
-    ofs.write(data.data(), data.size());
-
-    /**
-     * Close the file.
-     */
     ofs.close();
+    
+    if (ofs.fail() || std::rename((path + ".tmp").c_str(), path.c_str()) != 0)
+    {
+        log_error(
+            "Address manager failed writing peers file, path = " << path <<
+            "."
+        );
+    }
 }
 
-address_manager::address_info_t * address_manager::find(
-    const protocol::network_address_t & addr, std::uint32_t * ptr_id
+protocol::network_address_t address_manager::select(
+    const std::uint8_t & unk_bias
     )
 {
-    auto it1 = network_address_map_.find(addr);
+    assert(unk_bias <= 100);
     
-    if (it1 != network_address_map_.end())
-    {
-        if (ptr_id)
-        {
-            *ptr_id = it1->second;
-        }
-        
-        auto it2 = address_info_map_.find(it1->second);
-        
-        if (it2 != address_info_map_.end())
-        {
-            return &it2->second;
-        }
-    }
-    
-    return 0;
-}
-
-protocol::network_address_t address_manager::select(
-    const std::uint8_t & unk_bias
-    )
-{
-    assert(unk_bias <= 100);
+    auto snap = snapshot();
     
-    std::lock_guard<std::recursive_mutex> l1(mutex_random_ids_);
-    
-    if (random_ids_.size() == 0)
+    if (snap->entries.size() == 0)
     {
         // ...
     }
     else
     {
-        double cor_tried = sqrt(number_tried_) * (100.0 - unk_bias);
+        double cor_tried = sqrt(snap->number_tried) * (100.0 - unk_bias);
         
-        double cor_new = sqrt(number_new_) * unk_bias;
+        double cor_new = sqrt(snap->number_new) * unk_bias;
         
-        if (
-            (cor_tried + cor_new) *
-            random::uint32(1 << 30) / (1 << 30) < cor_tried
-            )
+        /**
+         * Use an already tried peer or a new peer.
+         */
+        const auto & buckets =
+            (cor_tried + cor_new) * random::uint32(1 << 30) / (1 << 30) <
+            cor_tried ? snap->buckets_tried : snap->buckets_new
+        ;
+        
+        if (buckets.size() > 0)
         {
-            /**
-             * Use an already tried peer.
-             */
             double factor_chance = 1.0;
             
-            std::lock_guard<std::recursive_mutex> l2(mutex_buckets_new_);
-            std::lock_guard<std::recursive_mutex> l3(mutex_buckets_tried_);
-            
             while (1)
             {
-                auto bucket_index = random::uint32(
-                    static_cast<std::uint32_t> (buckets_tried_.size())
-                );
-                
-                auto & bucket_tried = buckets_tried_[bucket_index];
+                const auto & bucket = buckets[
+                    random::uint32(static_cast<std::uint32_t> (buckets.size()))
+                ];
                 
-                if (bucket_tried.size() == 0)
-                {
-                    continue;
-                }
-                
-                auto position = random::uint32(
-                    static_cast<std::uint32_t> (bucket_tried.size())
-                );
-
-                assert(address_info_map_.count(bucket_tried[position]) == 1);
-                
-                auto & info = address_info_map_[bucket_tried[position]];
-                
-                if (
-                    random::uint32(1 << 30) < factor_chance *
-                    info.get_chance() * (1 << 30)
-                    )
-                {
-                    return info.addr;
-                }
-                
-                factor_chance *= 1.2;
-            }
-        }
-        else
-        {
-            /**
-             * Use a new peer.
-             */
-            double factor_chance = 1.0;
-            
-            while (1)
-            {
-                auto bucket_index = random::uint32(
-                    static_cast<std::uint32_t> (buckets_new_.size())
-                );
-                
-                auto & bucket_new = buckets_new_[bucket_index];
-                
-                if (bucket_new.size() == 0)
-                {
-                    continue;
-                }
-                
-                auto position = random::uint32(
-                    static_cast<std::uint32_t> (bucket_new.size())
-                );
-                
-                auto it = bucket_new.begin();
-                
-                while (position--)
-                {
-                    it++;
-                }
-                
-                assert(address_info_map_.count(*it) == 1);
-                
-                auto & info = address_info_map_[*it];
+                const auto & info = snap->entries[
+                    bucket[random::uint32(
+                    static_cast<std::uint32_t> (bucket.size()))]
+                ];
                 
                 if (
                     random::uint32(1 << 30) < factor_chance *
@@ -760,7 +491,11 @@ void address_manager::on_connection_attempt(
     const protocol::network_address_t & addr, const std::uint64_t & timestamp
     )
 {
-    if (auto * ptr_info = find(addr))
+    auto & s = shard(addr);
+    
+    std::lock_guard<std::mutex> l1(s.mutex);
+    
+    if (auto * ptr_info = find(s, addr))
     {
         auto & info = *ptr_info;
 
@@ -771,6 +506,8 @@ void address_manager::on_connection_attempt(
         {
             info.addr.last_try = timestamp;
             info.last_attempts++;
+            
+            snapshot_dirty_ = true;
         }
     }
 }
@@ -779,9 +516,13 @@ void address_manager::mark_good(
     const protocol::network_address_t & addr, const std::uint64_t &  timestamp
     )
 {
+    auto & s = shard(addr);
+    
+    std::lock_guard<std::mutex> l1(s.mutex);
+    
     std::uint32_t nid;
     
-    if (auto * ptr_info = find(addr, &nid))
+    if (auto * ptr_info = find(s, addr, &nid))
     {
         auto & info = *ptr_info;
 
@@ -797,6 +538,8 @@ void address_manager::mark_good(
             info.addr.last_try = timestamp;
             info.addr.timestamp = static_cast<std::uint32_t> (timestamp);
             info.last_attempts = 0;
+            
+            snapshot_dirty_ = true;
 
             if (info.tried)
             {
@@ -804,28 +547,23 @@ void address_manager::mark_good(
             }
             else
             {
-                std::lock_guard<std::recursive_mutex> l1(mutex_buckets_new_);
-                
                 auto rnd = random::uint32(
-                    static_cast<std::uint32_t> (buckets_new_.size())
+                    static_cast<std::uint32_t> (s.buckets_new.size())
                 );
                 
                 auto bucket_index = -1;
                 
-                for (auto n = 0; n < buckets_new_.size(); n++)
+                for (std::size_t n = 0; n < s.buckets_new.size(); n++)
                 {
-                    int b = (n + rnd) % buckets_new_.size();
+                    int b = (n + rnd) % s.buckets_new.size();
                     
-                    auto & bucket = buckets_new_[b];
-                    
-                    if (bucket.count(nid))
+                    if (s.buckets_new[b].count(nid))
                     {
                         bucket_index = b;
                         
                         break;
                     }
                 }
-
                 
                 if (bucket_index == -1)
                 {
@@ -839,120 +577,22 @@ void address_manager::mark_good(
                     /**
                      * Move nid to the tried table.
                      */
-                    move_to_tried(info, nid, bucket_index);
+                    move_to_tried(s, info, nid, bucket_index);
                 }
             }
         }
     }
 }
 
-void address_manager::move_to_tried(
-    address_info_t & info, const std::uint32_t & nid,
-    const std::uint32_t & bucket_index
-    )
-{
-    std::lock_guard<std::recursive_mutex> l1(mutex_buckets_new_);
-    
-    assert(buckets_new_[bucket_index].count(nid) == 1);
-
-    /**
-     * Remove the entry from all new buckets.
-     */
-    for (auto it = buckets_new_.begin(); it != buckets_new_.end(); ++it)
-    {
-        if (it->erase(nid))
-        {
-            info.reference_count--;
-        }
-    }
-    
-    number_new_--;
-
-    assert(info.reference_count == 0);
-
-    /**
-     * Calculate the tried bucket to move the entry into.
-     */
-    auto bucket_tried_index = info.calculate_tried_bucket(key_);
-    
-    std::lock_guard<std::recursive_mutex> l2(mutex_buckets_tried_);
-    
-    auto & bucket_tried = buckets_tried_[bucket_tried_index];
-
-    /**
-     * Check if we can just add it.
-     */
-    if (bucket_tried.size() < 64)
-    {
-        bucket_tried.push_back(nid);
-        
-        number_tried_++;
-        
-        info.tried = true;
-    }
-    else
-    {
-        /**
-         * Try to find an entry to evict.
-         */
-        auto position = select_tried(bucket_tried_index);
-
-        /**
-         * Find which new bucket it belongs to.
-         */
-        assert(address_info_map_.count(bucket_tried[position]) == 1);
-        
-        auto bucket_new_index = address_info_map_[
-            bucket_tried[position]].calculate_new_bucket(
-            key_, protocol::network_address_t::from_array(info.addr_src)
-        );
-        
-        auto & bucket_new = buckets_new_[bucket_new_index];
-
-        /**
-         * Remove the to-be-replaced tried entry from the tried.
-         */
-        auto & info_old = address_info_map_[bucket_tried[position]];
-        
-        info_old.tried = false;
-        
-        info_old.reference_count = 1;
-
-        /**
-         * Check whether there is place in that one.
-         */
-        if (bucket_new.size() < 64)
-        {
-            /**
-             * If so, move it back there.
-             */
-            bucket_new.insert(bucket_tried[position]);
-        }
-        else
-        {
-            /**
-             * Otherwise, move it to the new bucket that nid came from
-             * (there is certainly place there).
-             */
-            buckets_new_[bucket_index].insert(bucket_tried[position]);
-        }
-        
-        number_new_++;
-
-        bucket_tried[position] = nid;
-
-        /**
-         * Set the entry to tried.
-         */
-        info.tried = true;
-    }
-}
-
 void address_manager::on_connected(
     const protocol::network_address_t & addr, const std::uint64_t & timestamp
     )
 {
-    if (auto * ptr_info = find(addr))
+    auto & s = shard(addr);
+    
+    std::lock_guard<std::mutex> l1(s.mutex);
+    
+    if (auto * ptr_info = find(s, addr))
     {
         auto & info = *ptr_info;
 
@@ -966,35 +606,13 @@ void address_manager::on_connected(
             if (timestamp - info.addr.timestamp > interval_update)
             {
                 info.addr.timestamp = static_cast<std::uint32_t> (timestamp);
+                
+                snapshot_dirty_ = true;
             }
         }
     }
 }
 
-address_manager::address_info_t & address_manager::create(
-    const protocol::network_address_t & addr,
-    const protocol::network_address_t  & addr_src, std::uint32_t  * ptr_id
-    )
-{
-    auto nid = id_count_++;
-    address_info_map_[nid] = address_info_t::init(addr, addr_src);
-    network_address_map_[addr] = nid;
-    address_info_map_[nid].random_position =
-        static_cast<std::uint32_t> (random_ids_.size())
-    ;
-    
-    std::lock_guard<std::recursive_mutex> l1(mutex_random_ids_);
-    
-    random_ids_.push_back(nid);
-    
-    if (ptr_id)
-    {
-        *ptr_id = nid;
-    }
-    
-    return address_info_map_[nid];
-}
-
 bool address_manager::add(
     const protocol::network_address_t & addr,
     const protocol::network_address_t & addr_src,
@@ -1019,6 +637,20 @@ bool address_manager::add(
     }
     else
     {
+        auto & s = shard(addr);
+        
+        /**
+         * Calculated before taking the lock, it is the expensive part. The
+         * index is global so a source group still reaches only 32 of the
+         * new buckets (in every shard).
+         */
+        auto index_bucket =
+            address_info_t::init(addr, addr_src).calculate_new_bucket(
+            key_, addr_src)
+        ;
+        
+        std::lock_guard<std::mutex> l1(s.mutex);
+        
         /**
          * The nid.
          */
@@ -1027,7 +659,7 @@ bool address_manager::add(
         /**
          * Try to find an existing address_info_t for the address.
          */
-        auto * ptr_addr_info = find(addr, &nid);
+        auto * ptr_addr_info = find(s, addr, &nid);
 
         if (ptr_addr_info)
         {
@@ -1086,7 +718,7 @@ bool address_manager::add(
             
             auto n_factor = 1;
             
-            for (auto n = 0; n < ptr_addr_info->reference_count; n++)
+            for (std::uint32_t n = 0; n < ptr_addr_info->reference_count; n++)
             {
                 n_factor *= 2;
             }
@@ -1098,7 +730,7 @@ bool address_manager::add(
         }
         else
         {
-            ptr_addr_info = &create(addr, addr_src, &nid);
+            ptr_addr_info = &create(s, addr, addr_src, &nid);
             
             ptr_addr_info->addr.timestamp = std::max(
                 static_cast<std::uint32_t> (0),
@@ -1114,30 +746,26 @@ bool address_manager::add(
                 ptr_addr_info->addr.timestamp) / 3600.0 << "."
             );
 
-            number_new_++;
+            s.number_new++;
             
             ret = true;
         }
         
-        auto index_bucket = ptr_addr_info->calculate_new_bucket(
-            key_, addr_src
-        );
-        
-        std::lock_guard<std::recursive_mutex> l1(mutex_buckets_new_);
-        
-        auto & bucket = buckets_new_[index_bucket];
+        auto & bucket = s.buckets_new[index_bucket];
         
         if (bucket.count(nid) == 0)
         {
             ptr_addr_info->reference_count++;
             
-            if (bucket.size() == 64)
+            if (bucket.size() >= bucket_size_shard)
             {
-                shrink_bucket_new(index_bucket);
+                shrink_bucket_new(s, index_bucket);
             }
             
-            buckets_new_[index_bucket].insert(nid);
+            bucket.insert(nid);
         }
+        
+        snapshot_dirty_ = true;
     }
     
     return ret;
@@ -1149,12 +777,12 @@ std::vector<protocol::network_address_t> address_manager::get_addr(
 {
     std::vector<protocol::network_address_t> ret;
     
-    std::lock_guard<std::recursive_mutex> l1(mutex_random_ids_);
+    auto snap = snapshot();
     
     /**
      * Return at most 23% of the addresses.
      */
-    auto number_addresses = 23 * random_ids_.size() / 100;
+    auto number_addresses = 23 * snap->entries.size() / 100;
     
     if (number_addresses > count)
     {
@@ -1162,20 +790,25 @@ std::vector<protocol::network_address_t> address_manager::get_addr(
     }
     
     /**
-     * Perform a random shuffle over the first number_addresses elements of
-     * random_ids_ (selecting from all).
+     * Perform a partial random shuffle selecting number_addresses from
+     * all of the entries.
      */
-    for (auto n = 0; n < number_addresses; n++)
+    std::vector<std::uint32_t> positions(snap->entries.size());
+    
+    for (std::size_t i = 0; i < positions.size(); i++)
+    {
+        positions[i] = i;
+    }
+    
+    for (std::size_t n = 0; n < number_addresses; n++)
     {
         auto position = random::uint32(
-            static_cast<std::uint32_t> (random_ids_.size()) - n) + n
+            static_cast<std::uint32_t> (positions.size()) - n) + n
         ;
         
-        swap_random(n, position);
-        
-        assert(address_info_map_.count(random_ids_[n]) == 1);
+        std::swap(positions[n], positions[position]);
         
-        ret.push_back(address_info_map_[random_ids_[n]].addr);
+        ret.push_back(snap->entries[positions[n]].addr);
     }
     
     return ret;
@@ -1183,80 +816,262 @@ std::vector<protocol::network_address_t> address_manager::get_addr(
 
 const std::size_t address_manager::size() const
 {
-    std::lock_guard<std::recursive_mutex> l1(mutex_random_ids_);
+    std::size_t ret = 0;
+    
+    for (auto & i : shards_)
+    {
+        std::lock_guard<std::mutex> l1(i.mutex);
+        
+        ret += i.address_info_map.size();
+    }
+    
+    return ret;
+}
+
+address_manager::shard_t & address_manager::shard(
+    const protocol::network_address_t & addr
+    )
+{
+    /**
+     * Keyed FNV-1a of the network group so every address of a group lands
+     * in the same shard (the bucket limits per group still hold).
+     */
+    auto group = addr.group();
+    
+    std::uint64_t h = 14695981039346656037ULL;
+    
+    for (auto i = 0; i < 8; i++)
+    {
+        h = (h ^ key_[i]) * 1099511628211ULL;
+    }
+    
+    for (auto & i : group)
+    {
+        h = (h ^ i) * 1099511628211ULL;
+    }
+    
+    return shards_[h % shard_count];
+}
+
+address_manager::address_info_t * address_manager::find(
+    shard_t & s, const protocol::network_address_t & addr,
+    std::uint32_t * ptr_id
+    )
+{
+    auto it1 = s.network_address_map.find(addr);
+    
+    if (it1 != s.network_address_map.end())
+    {
+        if (ptr_id)
+        {
+            *ptr_id = it1->second;
+        }
+        
+        auto it2 = s.address_info_map.find(it1->second);
+        
+        if (it2 != s.address_info_map.end())
+        {
+            return &it2->second;
+        }
+    }
+    
+    return 0;
+}
+
+address_manager::address_info_t & address_manager::create(
+    shard_t & s, const protocol::network_address_t & addr,
+    const protocol::network_address_t  & addr_src, std::uint32_t  * ptr_id
+    )
+{
+    auto nid = s.id_count++;
+    
+    s.network_address_map[addr] = nid;
+    
+    auto & ret = s.address_info_map[nid];
+    
+    ret = address_info_t::init(addr, addr_src);
+    
+    if (ptr_id)
+    {
+        *ptr_id = nid;
+    }
+    
+    return ret;
+}
+
+void address_manager::erase(shard_t & s, const std::uint32_t & nid)
+{
+    auto it = s.address_info_map.find(nid);
     
-    return random_ids_.size();
+    if (it != s.address_info_map.end())
+    {
+        s.network_address_map.erase(it->second.addr);
+        s.address_info_map.erase(it);
+    }
 }
 
-std::int32_t address_manager::select_tried(const std::uint32_t & bucket_index)
+void address_manager::move_to_tried(
+    shard_t & s, address_info_t & info, const std::uint32_t & nid,
+    const std::uint32_t & bucket_index
+    )
 {
-    std::lock_guard<std::recursive_mutex> l1(mutex_buckets_tried_);
+    assert(s.buckets_new[bucket_index].count(nid) == 1);
+
+    /**
+     * Remove the entry from all new buckets.
+     */
+    for (auto it = s.buckets_new.begin(); it != s.buckets_new.end(); ++it)
+    {
+        if (it->erase(nid))
+        {
+            info.reference_count--;
+        }
+    }
     
-    auto & bucket_tried = buckets_tried_[bucket_index];
+    s.number_new--;
+
+    assert(info.reference_count == 0);
+
+    /**
+     * Calculate the tried bucket to move the entry into.
+     */
+    auto bucket_tried_index =
+        info.calculate_tried_bucket(key_) % s.buckets_tried.size()
+    ;
+    
+    auto & bucket_tried = s.buckets_tried[bucket_tried_index];
+
+    /**
+     * Check if we can just add it.
+     */
+    if (bucket_tried.size() < bucket_size)
+    {
+        bucket_tried.push_back(nid);
+        
+        s.number_tried++;
+        
+        info.tried = true;
+    }
+    else
+    {
+        /**
+         * Try to find an entry to evict.
+         */
+        auto position = select_tried(s, bucket_tried_index);
+
+        assert(s.address_info_map.count(bucket_tried[position]) == 1);
+        
+        auto & info_old = s.address_info_map[bucket_tried[position]];
+        
+        /**
+         * Find which new bucket it belongs to.
+         */
+        auto bucket_new_index = info_old.calculate_new_bucket(
+            key_, protocol::network_address_t::from_array(info_old.addr_src)
+        ) % s.buckets_new.size();
+        
+        auto & bucket_new = s.buckets_new[bucket_new_index];
+
+        /**
+         * Remove the to-be-replaced tried entry from the tried.
+         */
+        info_old.tried = false;
+        
+        info_old.reference_count = 1;
+
+        /**
+         * Check whether there is place in that one.
+         */
+        if (bucket_new.size() < bucket_size_shard)
+        {
+            /**
+             * If so, move it back there.
+             */
+            bucket_new.insert(bucket_tried[position]);
+        }
+        else
+        {
+            /**
+             * Otherwise, move it to the new bucket that nid came from
+             * (there is certainly place there).
+             */
+            s.buckets_new[bucket_index].insert(bucket_tried[position]);
+        }
+        
+        s.number_new++;
+
+        bucket_tried[position] = nid;
+
+        /**
+         * Set the entry to tried.
+         */
+        info.tried = true;
+    }
+}
+
+std::int32_t address_manager::select_tried(
+    shard_t & s, const std::uint32_t & bucket_index
+    )
+{
+    auto & bucket_tried = s.buckets_tried[bucket_index];
 
     std::int64_t oldest = -1;
     
     std::int32_t oldest_position = -1;
     
-    for (auto i = 0; i < 4 && i < bucket_tried.size(); i++)
+    for (std::uint32_t i = 0; i < 4 && i < bucket_tried.size(); i++)
     {
         auto position = random::uint32(
             static_cast<std::uint32_t> (bucket_tried.size()) - i) + i
         ;
         
-        auto & tmp = bucket_tried[position];
+        std::swap(bucket_tried[position], bucket_tried[i]);
         
-        bucket_tried[position] = bucket_tried[i];
-        bucket_tried[i] = tmp;
+        auto tmp = bucket_tried[i];
         
-        assert(oldest == -1 || address_info_map_.count(tmp) == 1);
+        assert(s.address_info_map.count(tmp) == 1);
         
         if (
             oldest == -1 ||
-            address_info_map_[tmp].last_success <
-            address_info_map_[static_cast<std::uint32_t> (oldest)].last_success
+            s.address_info_map[tmp].last_success <
+            s.address_info_map[
+            static_cast<std::uint32_t> (oldest)].last_success
             )
         {
            oldest = tmp;
-           oldest_position = position;
+           oldest_position = i;
         }
     }
 
     return oldest_position;
 }
 
-void address_manager::shrink_bucket_new(const std::uint32_t & index)
+void address_manager::shrink_bucket_new(
+    shard_t & s, const std::uint32_t & index
+    )
 {
-    std::lock_guard<std::recursive_mutex> l1(mutex_buckets_new_);
+    assert(index < s.buckets_new.size());
     
-    assert(index >= 0 && index < buckets_new_.size());
+    auto & bucket_new = s.buckets_new[index];
     
-    auto & bucket_new = buckets_new_[index];
+    auto now = time::instance().get_adjusted();
 
     /**
      * Try to find an entry that can be erased.
      */
     for (auto it = bucket_new.begin(); it != bucket_new.end(); ++it)
     {
-        assert(address_info_map_.count(*it));
+        assert(s.address_info_map.count(*it));
         
-        auto & info = address_info_map_[*it];
+        auto & info = s.address_info_map[*it];
         
-        if (info.is_terrible())
+        if (info.is_terrible(now))
         {
             if (--info.reference_count == 0)
             {
-                std::lock_guard<std::recursive_mutex> l1(mutex_random_ids_);
+                erase(s, *it);
                 
-                swap_random(
-                    info.random_position,
-                    static_cast<std::uint32_t> (random_ids_.size() - 1)
-                );
-                
-                random_ids_.pop_back();
-                network_address_map_.erase(info.addr);
-                address_info_map_.erase(*it);
-                number_new_--;
+                s.number_new--;
             }
             
             bucket_new.erase(it);
@@ -1278,18 +1093,19 @@ void address_manager::shrink_bucket_new(const std::uint32_t & index)
     
     auto i = 0;
     
-    auto oldest = -1;
+    std::int64_t oldest = -1;
     
     for (auto it = bucket_new.begin(); it != bucket_new.end(); ++it)
     {
         if (i == n[0] || i == n[1] || i == n[2] || i == n[3])
         {
-            assert(oldest == -1 || address_info_map_.count(*it) == 1);
+            assert(s.address_info_map.count(*it) == 1);
             
             if (
                 oldest == -1 ||
-                address_info_map_[*it].addr.timestamp <
-                address_info_map_[oldest].addr.timestamp
+                s.address_info_map[*it].addr.timestamp <
+                s.address_info_map[
+                static_cast<std::uint32_t> (oldest)].addr.timestamp
                 )
             {
                 oldest = *it;
@@ -1299,51 +1115,357 @@ void address_manager::shrink_bucket_new(const std::uint32_t & index)
         i++;
     }
     
-    assert(address_info_map_.count(oldest) == 1);
+    auto nid = static_cast<std::uint32_t> (oldest);
+    
+    assert(s.address_info_map.count(nid) == 1);
     
-    auto & info = address_info_map_[oldest];
+    auto & info = s.address_info_map[nid];
     
     if (--info.reference_count == 0)
     {
-        std::lock_guard<std::recursive_mutex> l1(mutex_random_ids_);
+        erase(s, nid);
         
-        swap_random(
-            info.random_position,
-            static_cast<std::uint32_t> (random_ids_.size() - 1)
-        );
-        random_ids_.pop_back();
-        network_address_map_.erase(info.addr);
-        address_info_map_.erase(oldest);
-        number_new_--;
+        s.number_new--;
     }
     
-    bucket_new.erase(oldest);
+    bucket_new.erase(nid);
 }
 
-void address_manager::swap_random(
-    const std::uint32_t & first, const std::uint32_t & second
-    )
+void address_manager::insert(address_info_t info)
 {
-    if (first == second)
+    if (info.addr.is_valid() == false)
     {
-        // ...
+        return;
     }
-    else
+    
+    auto & s = shard(info.addr);
+    
+    std::lock_guard<std::mutex> l1(s.mutex);
+    
+    if (find(s, info.addr))
     {
-        std::lock_guard<std::recursive_mutex> l1(mutex_random_ids_);
+        return;
+    }
+    
+    auto addr_src = protocol::network_address_t::from_array(info.addr_src);
+    
+    if (info.tried)
+    {
+        auto & tried = s.buckets_tried[
+            info.calculate_tried_bucket(key_) % s.buckets_tried.size()
+        ];
         
-        assert(first < random_ids_.size() && second < random_ids_.size());
-
-        int nid1 = random_ids_[first];
-        int nid2 = random_ids_[second];
+        if (tried.size() < bucket_size)
+        {
+            std::uint32_t nid;
+            
+            auto & entry = create(s, info.addr, addr_src, &nid);
+            
+            entry = info;
+            entry.reference_count = 0;
+            
+            tried.push_back(nid);
+            
+            s.number_tried++;
+            
+            return;
+        }
+        
+        /**
+         * The tried bucket is full, keep it as a new entry.
+         */
+        info.tried = false;
+    }
+    
+    auto & bucket = s.buckets_new[
+        info.calculate_new_bucket(key_, addr_src) % s.buckets_new.size()
+    ];
+    
+    if (bucket.size() < bucket_size_shard)
+    {
+        std::uint32_t nid;
+        
+        auto & entry = create(s, info.addr, addr_src, &nid);
+        
+        entry = info;
+        entry.reference_count = 1;
+        
+        bucket.insert(nid);
+        
+        s.number_new++;
+    }
+}
 
-        assert(address_info_map_.count(nid1) == 1);
-        assert(address_info_map_.count(nid2) == 1);
+void address_manager::clear()
+{
+    for (auto & i : shards_)
+    {
+        std::lock_guard<std::mutex> l1(i.mutex);
+        
+        i.address_info_map.clear();
+        i.network_address_map.clear();
+        i.buckets_new = std::vector< std::set<std::uint32_t> > (buckets_new);
+        i.buckets_tried = std::vector< std::vector<std::uint32_t> > (
+            buckets_tried / shard_count
+        );
+        i.id_count = 0;
+        i.number_new = 0;
+        i.number_tried = 0;
+    }
+    
+    snapshot_stale_ = true;
+}
 
-        address_info_map_[nid1].random_position = second;
-        address_info_map_[nid2].random_position = first;
+std::shared_ptr<const address_manager::snapshot_t>
+    address_manager::snapshot()
+{
+    auto now = steady_milliseconds();
+    
+    if (
+        (snapshot_stale_ || (snapshot_dirty_ &&
+        now - time_snapshot_ >= interval_snapshot)) &&
+        mutex_snapshot_.try_lock()
+        )
+    {
+        std::lock_guard<std::mutex> l1(mutex_snapshot_, std::adopt_lock);
+        
+        snapshot_stale_ = false;
+        snapshot_dirty_ = false;
+        
+        auto ret = std::make_shared<snapshot_t> ();
+        
+        ret->number_new = 0;
+        ret->number_tried = 0;
+        
+        for (auto & i : shards_)
+        {
+            std::lock_guard<std::mutex> l2(i.mutex);
+            
+            std::map<std::uint32_t, std::uint32_t> positions;
+            
+            for (auto & j : i.address_info_map)
+            {
+                positions[j.first] = static_cast<std::uint32_t> (
+                    ret->entries.size()
+                );
+                
+                ret->entries.push_back(j.second);
+            }
+            
+            for (auto & j : i.buckets_new)
+            {
+                if (j.size() > 0)
+                {
+                    ret->buckets_new.push_back(std::vector<std::uint32_t> ());
+                    
+                    for (auto & k : j)
+                    {
+                        ret->buckets_new.back().push_back(positions[k]);
+                    }
+                }
+            }
+            
+            for (auto & j : i.buckets_tried)
+            {
+                if (j.size() > 0)
+                {
+                    ret->buckets_tried.push_back(
+                        std::vector<std::uint32_t> ()
+                    );
+                    
+                    for (auto & k : j)
+                    {
+                        ret->buckets_tried.back().push_back(positions[k]);
+                    }
+                }
+            }
+            
+            ret->number_new += i.number_new;
+            ret->number_tried += i.number_tried;
+        }
+        
+        time_snapshot_ = now;
+        
+        std::atomic_store(
+            &snapshot_, std::shared_ptr<const snapshot_t> (ret)
+        );
+        
+        return ret;
+    }
+    
+    return std::atomic_load(&snapshot_);
+}
 
-        random_ids_[first] = nid2;
-        random_ids_[second] = nid1;
+int address_manager::run_test()
+{
+    address_manager manager;
+    
+    auto random_address = []()
+    {
+        protocol::network_address_t ret;
+        
+        std::memset(&ret, 0, sizeof(ret));
+        
+        std::memcpy(
+            &ret.address[0], &protocol::v4_mapped_prefix[0],
+            protocol::v4_mapped_prefix.size()
+        );
+        
+        auto ip = random::uint32();
+        
+        /**
+         * Avoid the private and reserved ranges.
+         */
+        ip = (ip & 0x00FFFFFF) | (static_cast<std::uint32_t> (
+            1 + random::uint32(100)) << 24
+        );
+        
+        std::memcpy(&ret.address[12], &ip, sizeof(ip));
+        
+        ret.port = 9195;
+        ret.services = 1;
+        ret.timestamp = static_cast<std::uint32_t> (
+            time::instance().get_adjusted() - random::uint32(3600)
+        );
+        
+        return ret;
+    };
+    
+    enum { threads = 4, adds_per_thread = 50000 };
+    
+    /**
+     * Flood the manager with addr messages from several connections while
+     * the connection manager keeps selecting.
+     */
+    std::atomic<bool> done(false);
+    
+    std::atomic<std::size_t> selects(0);
+    
+    std::thread selector([&]()
+    {
+        while (done == false)
+        {
+            manager.select();
+            
+            selects++;
+        }
+    });
+    
+    auto start = std::chrono::steady_clock::now();
+    
+    std::vector<std::thread> flooders;
+    
+    for (auto i = 0; i < threads; i++)
+    {
+        flooders.push_back(std::thread([&]()
+        {
+            auto src = random_address();
+            
+            for (auto j = 0; j < adds_per_thread; j++)
+            {
+                if (j % 1000 == 0)
+                {
+                    src = random_address();
+                }
+                
+                manager.add(random_address(), src);
+            }
+        }));
+    }
+    
+    for (auto & i : flooders)
+    {
+        i.join();
     }
+    
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds> (
+        std::chrono::steady_clock::now() - start
+    ).count();
+    
+    done = true;
+    
+    selector.join();
+    
+    printf(
+        "Test address_manager: %d adds in %lld ms (%.0f/s), %zu selects, "
+        "%zu entries.\n", threads * adds_per_thread,
+        static_cast<long long> (elapsed),
+        threads * adds_per_thread * 1000.0 / (elapsed + 1),
+        selects.load(), manager.size()
+    );
+    
+    /**
+     * The buckets bound the number of entries.
+     */
+    assert(manager.size() <= buckets_new * bucket_size);
+    assert(manager.select().is_valid());
+    
+    /**
+     * Round trip through the peers file.
+     */
+    std::string path = "peers.dat.test";
+    
+    manager.save(path);
+    
+    start = std::chrono::steady_clock::now();
+    
+    address_manager loaded;
+    
+    auto success = loaded.load(path);
+    
+    elapsed = std::chrono::duration_cast<std::chrono::milliseconds> (
+        std::chrono::steady_clock::now() - start
+    ).count();
+    
+    printf(
+        "Test address_manager: loaded %zu entries in %lld ms.\n",
+        loaded.size(), static_cast<long long> (elapsed)
+    );
+    
+    assert(success);
+    assert(loaded.size() == manager.size());
+    assert(
+        loaded.get_addr().size() ==
+        std::min<std::size_t> (2500, 23 * manager.size() / 100)
+    );
+    
+    std::remove(path.c_str());
+    
+    /**
+     * Addresses learned from a single source group must stay in the 32
+     * new buckets it maps to.
+     */
+    address_manager single;
+    
+    auto src = random_address();
+    
+    for (auto i = 0; i < 20000; i++)
+    {
+        single.add(random_address(), src);
+    }
+    
+    std::set<std::size_t> indexes;
+    
+    for (auto & i : single.shards_)
+    {
+        std::lock_guard<std::mutex> l1(i.mutex);
+        
+        for (std::size_t j = 0; j < i.buckets_new.size(); j++)
+        {
+            if (i.buckets_new[j].size() > 0)
+            {
+                indexes.insert(j);
+            }
+        }
+    }
+    
+    printf(
+        "Test address_manager: one source group, %zu entries in %zu new "
+        "buckets.\n", single.size(), indexes.size()
+    );
+    
+    assert(indexes.size() <= 32);
+    assert(single.size() <= 32 * bucket_size);
+    
+    return 0;
 }
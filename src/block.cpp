@@ -19,11 +19,16 @@
  */
 
 #include <algorithm>
-#include <set>
+#include <chrono>
+#include <cstdio>
+#include <list>
+#include <mutex>
 #include <sstream>
 
 #include <boost/format.hpp>
 
+#include <database/compression.hpp>
+
 #include <coin/big_number.hpp>
 #include <coin/block.hpp>
 #include <coin/block_orphan.hpp>
@@ -34,6 +39,7 @@
 #include <coin/db_tx.hpp>
 #include <coin/file.hpp>
 #include <coin/filesystem.hpp>
+#include <coin/flat_set.hpp>
 #include <coin/globals.hpp>
 #include <coin/hash.hpp>
 #include <coin/kernel.hpp>
@@ -44,6 +50,7 @@
 #include <coin/point_out.hpp>
 #include <coin/reward.hpp>
 #include <coin/stack_impl.hpp>
+#include <coin/stake_index.hpp>
 #include <coin/tcp_connection.hpp>
 #include <coin/tcp_connection_manager.hpp>
 #include <coin/time.hpp>
@@ -56,16 +63,11 @@
 using namespace coin;
 
 block::block()
-    : data_buffer()
+    : m_is_checked(false)
 {
     set_null();
 }
 
-void block::encode(const bool & block_header_only)
-{
-    encode(*this, block_header_only);
-}
-
 void block::encode(data_buffer & buffer, const bool & block_header_only)
 {
     buffer.write_uint32(m_header.version);
@@ -104,9 +106,13 @@ void block::encode(data_buffer & buffer, const bool & block_header_only)
     }
 }
 
-bool block::decode(const bool & block_header_only)
+data_buffer block::encode(const bool & block_header_only)
 {
-    return decode(*this, block_header_only);
+    data_buffer ret;
+    
+    encode(ret, block_header_only);
+    
+    return ret;
 }
 
 bool block::decode(data_buffer & buffer, const bool & block_header_only)
@@ -171,6 +177,30 @@ bool block::decode(data_buffer & buffer, const bool & block_header_only)
     return true;
 }
 
+std::size_t block::size(const bool & block_header_only) const
+{
+    std::size_t ret =
+        sizeof(m_header.version) + sha256::digest_length +
+        sha256::digest_length + sizeof(m_header.timestamp) +
+        sizeof(m_header.bits) + sizeof(m_header.nonce)
+    ;
+    
+    if (block_header_only == false)
+    {
+        ret += utility::get_var_int_size(m_transactions.size());
+        
+        for (auto & i : m_transactions)
+        {
+            ret += i.size();
+        }
+        
+        ret += utility::get_var_int_size(m_signature.size());
+        ret += m_signature.size();
+    }
+    
+    return ret;
+}
+
 void block::set_null()
 {
     m_header.version = current_version;
@@ -182,6 +212,7 @@ void block::set_null()
     m_transactions.clear();
     m_signature.clear();
     m_merkle_tree.clear();
+    m_is_checked = false;
 }
 
 bool block::is_null() const
@@ -248,6 +279,11 @@ std::vector<transaction> & block::transactions()
     return m_transactions;
 }
 
+const std::vector<transaction> & block::transactions() const
+{
+    return m_transactions;
+}
+
 void block::update_time(block_index & previous)
 {
     m_header.timestamp = std::max(
@@ -388,7 +424,9 @@ std::shared_ptr<block> block::create_new(
 
     index_previous = stack_impl::get_block_index_best();
     
-    db_tx tx_db("r");
+    auto reader = db_tx::reader();
+    
+    auto & tx_db = *reader;
 
     /**
      * The priority of order in which to process transactions.
@@ -555,10 +593,6 @@ std::shared_ptr<block> block::create_new(
         
         priorities.pop_back();
 
-        data_buffer buffer;
-        
-        tx.encode(buffer);
-        
         auto tx_size = tx.size();
 
         if (block_size + tx_size >= constants::max_block_size)
@@ -785,13 +819,15 @@ bool block::disconnect_block(
         }
     }
 
+    /**
+     * Forget the outputs this block created or spent.
+     */
+    stake_index::instance().on_block_disconnected(*this);
+    
     /**
      * Clean up wallet after disconnecting coinstake (ppcoin).
      */
-    for (auto & i : m_transactions)
-    {
-        wallet_manager::instance().sync_with_wallets(i, this, false, false);
-    }
+    wallet_manager::instance().on_block_disconnected(*this);
     
     return true;
 }
@@ -839,8 +875,6 @@ bool block::connect_block(
     {
         block tmp;
         
-        tmp.encode();
-        
         tx_pos = static_cast<std::uint32_t> (
             pindex->block_position() + tmp.size() -
             (2 * utility::get_var_int_size(0)) +
@@ -856,6 +890,8 @@ bool block::connect_block(
     
     std::uint32_t sig_ops = 0;
     
+    std::vector<std::uint32_t> tx_positions;
+    
     for (auto & i : m_transactions)
     {
         auto hash_tx = i.get_hash();
@@ -889,6 +925,8 @@ bool block::connect_block(
             pindex->file(), pindex->block_position(), tx_pos
         );
         
+        tx_positions.push_back(tx_pos);
+        
         if (check_only == false)
         {
             data_buffer tmp;
@@ -1046,12 +1084,17 @@ bool block::connect_block(
     }
     
     /**
-     * Watch for transactions paying to me.
+     * Index the new outputs for coin age and the stake kernel.
      */
-    for (auto & i : m_transactions)
-    {
-        wallet_manager::instance().sync_with_wallets(i, this, true);
-    }
+    stake_index::instance().on_block_connected(
+        *this, pindex->block_position(), tx_positions
+    );
+    
+    /**
+     * Watch for transactions paying to me, the wallets catch up on their
+     * own threads from a copy of the block.
+     */
+    wallet_manager::instance().on_block_connected(*this);
 
     return true;
 }
@@ -1139,6 +1182,14 @@ bool block::check_block(
      * before saving an orphan block.
      */
     
+    /**
+     * Skip them if they already passed on the check_pool.
+     */
+    if (m_is_checked && check_pow && check_merkle_root)
+    {
+        return true;
+    }
+    
     /**
      * Check size limits.
      */
@@ -1356,7 +1407,9 @@ bool block::check_block(
      * Check for duplicate tx id's. This is caught by connect_inputs, but
      * catching it earlier avoids a potential DoS attack.
      */
-    std::set<sha256> unique_tx;
+    flat_set<sha256> unique_tx;
+    
+    unique_tx.reserve(m_transactions.size());
 
     for (auto & i : m_transactions)
     {
@@ -1445,6 +1498,16 @@ bool block::check_block(
     return true;
 }
 
+void block::set_is_checked(const bool & val)
+{
+    m_is_checked = val;
+}
+
+const bool & block::is_checked() const
+{
+    return m_is_checked;
+}
+
 bool block::read_from_disk(
     const std::shared_ptr<block_index> & index, const bool & read_transactions
     )
@@ -1466,7 +1529,7 @@ bool block::read_from_disk(
     
     if (get_hash() != index->get_block_hash())
     {
-        throw std::runtime_error("get_hash doesn't match index");
+        log_error("Block read from disk failed, hash doesn't match index.");
         
         return false;
     }
@@ -1711,9 +1774,12 @@ bool block::accept_block(
     }
 
     /**
-     * Relay inventory.
+     * Relay inventory (there is no connection manager when replaying).
      */
-    if (globals::instance().hash_best_chain() == hash_block)
+    if (
+        connection_manager &&
+        globals::instance().hash_best_chain() == hash_block
+        )
     {
         auto connections = connection_manager->tcp_connections();
         
@@ -1743,9 +1809,47 @@ bool block::read_from_disk(
 {
     set_null();
 
-    auto f = file_open(file_index, block_position, "rb");
+    /**
+     * Compressed blocks are decoded from memory.
+     */
+    data_buffer buffer_compressed;
     
-    if (f)
+    std::shared_ptr<file> f;
+    
+    if (
+        open_from_disk(file_index, block_position, buffer_compressed,
+        f) == false
+        )
+    {
+        log_error("Block failed to open block file.");
+        
+        return false;
+    }
+    
+    if (f == nullptr)
+    {
+        if (decode(buffer_compressed, read_transactions == false) == false)
+        {
+            return false;
+        }
+        
+        /**
+         * Check the header.
+         */
+        if (read_transactions && is_proof_of_work())
+        {
+            if (check_proof_of_work(get_hash(), m_header.bits) == false)
+            {
+                log_error(
+                    "Block check proof of work failed, errors in "
+                    "block header."
+                );
+                
+                return false;
+            }
+        }
+    }
+    else
     {
         bool block_header_only = false;
         
@@ -1755,31 +1859,31 @@ bool block::read_from_disk(
         }
         
         /**
-         * Clear the buffer.
+         * Allocate the buffer.
          */
-        clear();
+        data_buffer buffer;
 
         /**
          * Set the file for decoding.
          */
-        set_file(f);
+        buffer.set_file(f);
 
         /**
          * Attempt to decode.
          */
-        if (decode(block_header_only))
+        if (decode(buffer, block_header_only))
         {
             /**
              * Set the file to null.
              */
-            set_file(0);
+            buffer.set_file(0);
         }
         else
         {
             /**
              * Set the file to null.
              */
-            set_file(0);
+            buffer.set_file(0);
         
             return false;
         }
@@ -1803,13 +1907,165 @@ bool block::read_from_disk(
             }
         }
     }
-    else
+
+    return true;
+}
+
+bool block::open_from_disk(
+    const std::uint32_t & file_index, const std::uint32_t & block_position,
+    data_buffer & buffer, std::shared_ptr<file> & f
+    )
+{
+    /**
+     * The number of decompressed blocks to cache.
+     */
+    enum { cache_size = 8 };
+    
+    static std::mutex g_mutex_cache;
+    
+    static std::list<
+        std::pair<std::uint64_t, std::shared_ptr<data_buffer> >
+    > g_cache;
+    
+    f.reset();
+    
+    /**
+     * A position without room for a frame header can't be compressed.
+     */
+    if (block_position < sizeof(std::uint32_t) * 2)
     {
-        throw std::runtime_error("failed to open block file");
+        f = file_open(file_index, block_position, "rb");
         
+        return f != nullptr;
+    }
+    
+    auto key =
+        static_cast<std::uint64_t> (file_index) << 32 | block_position
+    ;
+    
+    std::unique_lock<std::mutex> l1(g_mutex_cache);
+    
+    for (auto it = g_cache.begin(); it != g_cache.end(); ++it)
+    {
+        if (it->first == key)
+        {
+            g_cache.splice(g_cache.begin(), g_cache, it);
+            
+            buffer.write_bytes(it->second->data(), it->second->size());
+            
+            return true;
+        }
+    }
+    
+    l1.unlock();
+    
+    /**
+     * Read the magic (message start) and size in front of the block, the
+     * same handle then reads the block.
+     */
+    f = file_open(
+        file_index, block_position - sizeof(std::uint32_t) * 2, "rb"
+    );
+    
+    if (f == nullptr)
+    {
         return false;
     }
+    
+    data_buffer buffer_index(sizeof(std::uint32_t) * 2);
+    
+    if (f->read(buffer_index.data(), buffer_index.size()) == false)
+    {
+        f.reset();
+        
+        return false;
+    }
+    
+    auto magic = buffer_index.read_uint32();
+    auto size = buffer_index.read_uint32();
+    
+    /**
+     * Not compressed, the file is now positioned at the block.
+     */
+    if (magic != message::header_magic() || (size & frame_compressed) == 0)
+    {
+        return true;
+    }
+    
+    size &= ~static_cast<std::uint32_t> (frame_compressed);
+    
+    if (size <= sizeof(std::uint32_t) || size > size_maximum)
+    {
+        log_error("Block has invalid compressed size " << size << ".");
+        
+        f.reset();
+        
+        return false;
+    }
+    
+    std::string payload(size, 0);
+    
+    auto success = f->read(&payload[0], payload.size());
+    
+    f.reset();
+    
+    if (success == false)
+    {
+        log_error("Block failed to read compressed block.");
+        
+        return false;
+    }
+    
+    auto decompressed = std::make_shared<data_buffer> ();
+    
+    if (decompress(payload, *decompressed) == false)
+    {
+        log_error("Block failed to decompress block.");
+        
+        return false;
+    }
+    
+    buffer.write_bytes(decompressed->data(), decompressed->size());
+    
+    l1.lock();
+    
+    g_cache.push_front(std::make_pair(key, decompressed));
+    
+    if (g_cache.size() > cache_size)
+    {
+        g_cache.pop_back();
+    }
+    
+    return true;
+}
 
+bool block::decompress(const std::string & payload, data_buffer & buffer)
+{
+    if (payload.size() <= sizeof(std::uint32_t))
+    {
+        return false;
+    }
+    
+    data_buffer buffer_length(payload.data(), sizeof(std::uint32_t));
+    
+    auto length = buffer_length.read_uint32();
+    
+    if (length > size_maximum)
+    {
+        return false;
+    }
+    
+    auto decompressed = database::compression::decompress(
+        payload.substr(sizeof(std::uint32_t)), length
+    );
+    
+    if (decompressed.size() != length)
+    {
+        return false;
+    }
+    
+    buffer.write_bytes(decompressed.data(), decompressed.size());
+    
     return true;
 }
 
@@ -1834,10 +2090,52 @@ bool block::write_to_disk(
          */
         encode(buffer_block);
         
+        /**
+         * Compress the block if enabled, it is only kept if it is smaller.
+         */
+        std::string compressed;
+        
+        if (globals::instance().option_compress_blocks())
+        {
+            compressed = database::compression::compress(
+                std::string(buffer_block.data(), buffer_block.size()),
+                compression_level
+            );
+            
+            if (
+                compressed.size() + sizeof(std::uint32_t) >=
+                buffer_block.size()
+                )
+            {
+                compressed.clear();
+            }
+        }
+        
+        data_buffer buffer_compressed;
+        
+        if (compressed.size() > 0)
+        {
+            buffer_compressed.write_uint32(
+                static_cast<std::uint32_t> (buffer_block.size())
+            );
+            buffer_compressed.write_bytes(
+                compressed.data(), compressed.size()
+            );
+        }
+        
+        auto & buffer_out =
+            compressed.size() > 0 ? buffer_compressed : buffer_block
+        ;
+        
         /**
          * Get the size of the buffer.
          */
-        std::uint32_t size = static_cast<std::uint32_t> (buffer_block.size());
+        std::uint32_t size = static_cast<std::uint32_t> (buffer_out.size());
+        
+        if (compressed.size() > 0)
+        {
+            size |= frame_compressed;
+        }
         
         /**
          * Get the magic (message start).
@@ -1884,7 +2182,7 @@ bool block::write_to_disk(
         /**
          * Write the block buffer.
          */
-        f->write(buffer_block.data(), buffer_block.size());
+        f->write(buffer_out.data(), buffer_out.size());
 
         /**
          * Flush
@@ -1999,6 +2297,11 @@ bool block::set_best_chain(
         {
             tx_db.txn_abort();
             
+            /**
+             * The stake index may hold outputs of the aborted blocks.
+             */
+            stake_index::instance().clear();
+            
             block::invalid_chain_found(index_new);
 
             log_error("Block set best chain failed, reorganize failed.");
@@ -2152,6 +2455,11 @@ bool block::add_to_block_index(
         index_new->set_height(it1->second->height() + 1);
     }
     
+    /**
+     * Build the skip pointer and previous proof-of-work/stake links.
+     */
+    index_new->build_skip();
+    
     /**
      * Compute chain trust score (ppcoin).
      */
@@ -2324,6 +2632,8 @@ bool block::set_best_chain_inner(
     {
         tx_db.txn_abort();
         
+        stake_index::instance().clear();
+        
         invalid_chain_found(index_new);
         
         return false;
@@ -2803,3 +3113,138 @@ void block::print()
         ", merkle tree = " << ss_merkle_tree.str() << "."
     );
 }
+
+int block::run_test()
+{
+    enum { blocks = 200, transactions = 500 };
+    
+    /**
+     * Synthetic blocks of single input, two output pay-to-pubkey-hash
+     * transactions. Signatures and previous outputs are random, public keys
+     * and destinations are drawn from small pools as they are on a real
+     * chain.
+     */
+    std::vector< std::vector<std::uint8_t> > public_keys, destinations;
+    
+    for (auto i = 0; i < 1000; i++)
+    {
+        auto h = hash::sha256_random();
+        
+        if (i < 100)
+        {
+            public_keys.push_back(
+                std::vector<std::uint8_t> (h.digest(), h.digest() + 32)
+            );
+            public_keys.back().insert(public_keys.back().begin(), 0x02);
+        }
+        
+        destinations.push_back(
+            std::vector<std::uint8_t> (h.digest(), h.digest() + 20)
+        );
+    }
+    
+    std::vector<block> blks(blocks);
+    
+    for (auto i = 0; i < blocks; i++)
+    {
+        blks[i].header().version = current_version;
+        blks[i].header().timestamp = static_cast<std::uint32_t> (i);
+        
+        for (auto j = 0; j < transactions; j++)
+        {
+            transaction tx;
+            
+            script script_signature;
+            
+            auto r = hash::sha256_random(), s = hash::sha256_random();
+            
+            script_signature << std::vector<std::uint8_t> (
+                r.digest(), r.digest() + 32
+            );
+            script_signature << std::vector<std::uint8_t> (
+                s.digest(), s.digest() + 32
+            );
+            script_signature << public_keys[(i + j) % public_keys.size()];
+            
+            tx.transactions_in().push_back(
+                transaction_in(hash::sha256_random(), j % 4, script_signature)
+            );
+            
+            for (auto k = 0; k < 2; k++)
+            {
+                script script_public_key;
+                
+                script_public_key <<
+                    script::op_dup << script::op_hash160 <<
+                    destinations[(i * 7 + j * 3 + k) % destinations.size()] <<
+                    script::op_equalverify << script::op_checksig
+                ;
+                
+                tx.transactions_out().push_back(
+                    transaction_out((j + 1) * 1000000, script_public_key)
+                );
+            }
+            
+            blks[i].transactions().push_back(tx);
+        }
+    }
+    
+    auto compress_blocks = globals::instance().option_compress_blocks();
+    
+    for (auto compressed : { false, true })
+    {
+        globals::instance().set_option_compress_blocks(compressed);
+        
+        std::vector< std::pair<std::uint32_t, std::uint32_t> > positions;
+        
+        std::size_t bytes = 0;
+        
+        for (auto & i : blks)
+        {
+            std::uint32_t file_index = 0, block_position = 0;
+            
+            if (i.write_to_disk(file_index, block_position) == false)
+            {
+                return -1;
+            }
+            
+            if (positions.size() > 0 && positions.back().first == file_index)
+            {
+                bytes += block_position - positions.back().second;
+            }
+            
+            positions.push_back(std::make_pair(file_index, block_position));
+        }
+        
+        auto time_start = std::chrono::steady_clock::now();
+        
+        for (std::size_t i = 0; i < positions.size(); i++)
+        {
+            block blk;
+            
+            if (
+                blk.read_from_disk(positions[i].first, positions[i].second) ==
+                false || blk.get_hash() != blks[i].get_hash()
+                )
+            {
+                return -1;
+            }
+        }
+        
+        auto elapsed = std::chrono::duration_cast<
+            std::chrono::microseconds> (
+            std::chrono::steady_clock::now() - time_start).count()
+        ;
+        
+        printf(
+            "Test block: %s, %zu bytes per block on disk, read %lld us "
+            "per block.\n", compressed ? "compressed" : "uncompressed",
+            bytes / (positions.size() - 1),
+            static_cast<long long> (elapsed / positions.size())
+        );
+    }
+    
+    globals::instance().set_option_compress_blocks(compress_blocks);
+    
+    return 0;
+}
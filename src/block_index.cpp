@@ -18,6 +18,10 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
  
+#include <cassert>
+#include <chrono>
+#include <vector>
+
 #include <coin/block.hpp>
 #include <coin/block_index.hpp>
 #include <coin/constants.hpp>
@@ -29,6 +33,9 @@ block_index::block_index()
     : m_hash_block()
     , m_block_index_previous(0)
     , m_block_index_next(0)
+    , m_block_index_skip(0)
+    , m_block_index_previous_pow(0)
+    , m_block_index_previous_pos(0)
     , m_file(0)
     , m_block_position(0)
     , m_chain_trust(0)
@@ -57,6 +64,9 @@ block_index::block_index(
     : m_hash_block()
     , m_block_index_previous(0)
     , m_block_index_next(0)
+    , m_block_index_skip(0)
+    , m_block_index_previous_pow(0)
+    , m_block_index_previous_pos(0)
     , m_file(file)
     , m_block_position(block_position)
     , m_chain_trust(0)
@@ -148,6 +158,117 @@ const std::shared_ptr<block_index> & block_index::block_index_next() const
     return m_block_index_next;
 }
 
+void block_index::build_skip()
+{
+    if (m_block_index_previous)
+    {
+        m_block_index_skip = get_ancestor(
+            m_block_index_previous, get_skip_height(m_height)
+        );
+        
+        if (m_block_index_previous->is_proof_of_stake())
+        {
+            m_block_index_previous_pos = m_block_index_previous;
+            m_block_index_previous_pow =
+                m_block_index_previous->m_block_index_previous_pow
+            ;
+        }
+        else
+        {
+            m_block_index_previous_pow = m_block_index_previous;
+            m_block_index_previous_pos =
+                m_block_index_previous->m_block_index_previous_pos
+            ;
+        }
+    }
+    else
+    {
+        m_block_index_skip = 0;
+        m_block_index_previous_pow = 0;
+        m_block_index_previous_pos = 0;
+    }
+}
+
+const std::shared_ptr<block_index> & block_index::block_index_skip() const
+{
+    return m_block_index_skip;
+}
+
+const std::shared_ptr<block_index> &
+    block_index::block_index_previous_pow() const
+{
+    return m_block_index_previous_pow;
+}
+
+const std::shared_ptr<block_index> &
+    block_index::block_index_previous_pos() const
+{
+    return m_block_index_previous_pos;
+}
+
+std::shared_ptr<block_index> block_index::get_ancestor(
+    const std::shared_ptr<block_index> & index, const std::int32_t & height
+    )
+{
+    if (index == 0 || height > index->m_height || height < 0)
+    {
+        return std::shared_ptr<block_index> ();
+    }
+    
+    auto walk = index;
+    
+    auto height_walk = index->m_height;
+    
+    while (walk && height_walk > height)
+    {
+        auto height_skip = get_skip_height(height_walk);
+        auto height_skip_previous = get_skip_height(height_walk - 1);
+        
+        /**
+         * Only follow the skip pointer if the previous block's skip pointer
+         * is not a better choice.
+         */
+        if (
+            walk->m_block_index_skip && (height_skip == height ||
+            (height_skip > height && !(height_skip_previous <
+            height_skip - 2 && height_skip_previous >= height)))
+            )
+        {
+            walk = walk->m_block_index_skip;
+            height_walk = height_skip;
+        }
+        else
+        {
+            walk = walk->m_block_index_previous;
+            height_walk--;
+        }
+    }
+    
+    return walk;
+}
+
+std::int32_t block_index::get_skip_height(const std::int32_t & height)
+{
+    if (height < 2)
+    {
+        return 0;
+    }
+    
+    /**
+     * Clear the lowest set bit (twice for odd heights) so that any height
+     * is reachable in a logarithmic number of hops.
+     */
+    auto invert_lowest_one = [](const std::int32_t & n)
+    {
+        return n & (n - 1);
+    };
+    
+    return
+        (height & 1) ? invert_lowest_one(invert_lowest_one(height - 1)) + 1 :
+        invert_lowest_one(height)
+    ;
+}
+
 const std::uint32_t & block_index::file() const
 {
     return m_file;
@@ -383,3 +504,245 @@ bool block_index::generated_stake_modifier() const
 {
     return m_flags & block_index::block_flag_stake_modifier;
 }
+
+int block_index::run_test()
+{
+    /**
+     * Build a chain with long proof-of-stake runs (one proof-of-work block
+     * every 5000 blocks) and a 100 block fork at the tip.
+     */
+    enum { length = 500000, pow_interval = 5000, fork_length = 100 };
+    
+    std::vector< std::shared_ptr<block_index> > chain;
+    
+    chain.reserve(length);
+    
+    for (auto i = 0; i < length; i++)
+    {
+        auto index = std::make_shared<block_index> ();
+        
+        index->set_height(i);
+        
+        if (i > 0)
+        {
+            index->set_block_index_previous(chain.back());
+        }
+        
+        if (i % pow_interval != 0)
+        {
+            index->set_is_proof_of_stake();
+        }
+        
+        index->build_skip();
+        
+        chain.push_back(index);
+    }
+    
+    auto tip_fork = chain[length - fork_length - 1];
+    
+    for (auto i = 0; i < fork_length; i++)
+    {
+        auto index = std::make_shared<block_index> ();
+        
+        index->set_height(tip_fork->height() + 1);
+        index->set_block_index_previous(tip_fork);
+        index->set_is_proof_of_stake();
+        index->build_skip();
+        
+        tip_fork = index;
+    }
+    
+    /**
+     * The ancestors and links must match a linear walk.
+     */
+    for (auto i = 0; i < 1000; i++)
+    {
+        auto & index = chain[(i * 7919) % length];
+        auto height = (i * 104729) % (index->height() + 1);
+        
+        assert(get_ancestor(index, height) == chain[height]);
+        
+        auto walk = index->block_index_previous();
+        
+        while (walk && walk->is_proof_of_stake())
+        {
+            walk = walk->block_index_previous();
+        }
+        
+        assert(index->block_index_previous_pow() == walk);
+    }
+    
+    assert(get_ancestor(chain.back(), length) == 0);
+    assert(get_ancestor(tip_fork, 0) == chain[0]);
+    
+    /**
+     * The last proof-of-work block by walking (as in a retarget).
+     */
+    auto walk_last_pow = [](std::shared_ptr<block_index> index)
+    {
+        while (
+            index && index->block_index_previous() &&
+            index->is_proof_of_stake()
+            )
+        {
+            index = index->block_index_previous();
+        }
+        
+        return index;
+    };
+    
+    enum { rounds = 1000 };
+    
+    auto start = std::chrono::steady_clock::now();
+    
+    std::shared_ptr<block_index> found_walk;
+    
+    for (auto i = 0; i < rounds; i++)
+    {
+        found_walk = walk_last_pow(chain[length - 1 - (i % 100)]);
+    }
+    
+    auto elapsed_walk = std::chrono::duration_cast<
+        std::chrono::microseconds
+    > (std::chrono::steady_clock::now() - start).count();
+    
+    start = std::chrono::steady_clock::now();
+    
+    std::shared_ptr<block_index> found_link;
+    
+    for (auto i = 0; i < rounds; i++)
+    {
+        found_link = chain[length - 1 - (i % 100)]->block_index_previous_pow();
+    }
+    
+    auto elapsed_link = std::chrono::duration_cast<
+        std::chrono::microseconds
+    > (std::chrono::steady_clock::now() - start).count();
+    
+    assert(found_walk == found_link);
+    
+    printf(
+        "Test block_index: last pow, walk %lld us, link %lld us "
+        "(%d lookups).\n", static_cast<long long> (elapsed_walk),
+        static_cast<long long> (elapsed_link), rounds
+    );
+    
+    /**
+     * The fork point of the main chain and the fork.
+     */
+    start = std::chrono::steady_clock::now();
+    
+    std::shared_ptr<block_index> fork_walk;
+    
+    for (auto i = 0; i < rounds; i++)
+    {
+        auto fork = chain.back();
+        auto longer = tip_fork;
+        
+        while (fork != longer)
+        {
+            while (longer->height() > fork->height())
+            {
+                longer = longer->block_index_previous();
+            }
+            
+            if (fork == longer)
+            {
+                break;
+            }
+            
+            fork = fork->block_index_previous();
+        }
+        
+        fork_walk = fork;
+    }
+    
+    elapsed_walk = std::chrono::duration_cast<
+        std::chrono::microseconds
+    > (std::chrono::steady_clock::now() - start).count();
+    
+    start = std::chrono::steady_clock::now();
+    
+    std::shared_ptr<block_index> fork_skip;
+    
+    for (auto i = 0; i < rounds; i++)
+    {
+        auto fork = chain.back();
+        auto longer = get_ancestor(tip_fork, fork->height());
+        
+        while (fork != longer)
+        {
+            fork = fork->block_index_previous();
+            longer = longer->block_index_previous();
+        }
+        
+        fork_skip = fork;
+    }
+    
+    elapsed_link = std::chrono::duration_cast<
+        std::chrono::microseconds
+    > (std::chrono::steady_clock::now() - start).count();
+    
+    assert(fork_walk == fork_skip);
+    assert(fork_skip == chain[length - fork_length - 1]);
+    
+    /**
+     * An ancestor deep in the chain (as in a checkpoint trace back).
+     */
+    start = std::chrono::steady_clock::now();
+    
+    enum { deep_rounds = 20 };
+    
+    auto matches = 0;
+    
+    for (auto i = 0; i < deep_rounds; i++)
+    {
+        auto index = chain.back();
+        
+        while (index->height() > i)
+        {
+            index = index->block_index_previous();
+        }
+        
+        matches += index == chain[i];
+    }
+    
+    auto elapsed_deep_walk = std::chrono::duration_cast<
+        std::chrono::microseconds
+    > (std::chrono::steady_clock::now() - start).count();
+    
+    start = std::chrono::steady_clock::now();
+    
+    for (auto i = 0; i < deep_rounds; i++)
+    {
+        matches += get_ancestor(chain.back(), i) == chain[i];
+    }
+    
+    auto elapsed_ancestor = std::chrono::duration_cast<
+        std::chrono::microseconds
+    > (std::chrono::steady_clock::now() - start).count();
+    
+    assert(matches == 2 * deep_rounds);
+    
+    printf(
+        "Test block_index: fork point, walk %lld us, skip %lld us, "
+        "deep ancestor, walk %lld us, skip %lld us (%d/%d lookups).\n",
+        static_cast<long long> (elapsed_walk),
+        static_cast<long long> (elapsed_link),
+        static_cast<long long> (elapsed_deep_walk),
+        static_cast<long long> (elapsed_ancestor), rounds, deep_rounds
+    );
+    
+    /**
+     * Release from the tip so destruction does not recurse down the chain.
+     */
+    tip_fork.reset(), fork_walk.reset(), fork_skip.reset();
+    found_walk.reset(), found_link.reset();
+    
+    while (chain.size() > 0)
+    {
+        chain.pop_back();
+    }
+    
+    return 0;
+}
@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2013-2014 John Connor (BM-NC49AxAjcqVcF5jNPu85Rb8MJ2d9JqZt)
+ *
+ * This file is part of coinpp.
+ *
+ * coinpp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License with
+ * additional permissions to the one published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version. For more information see LICENSE.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+#include <coin/chacha20.hpp>
+
+using namespace coin;
+
+/**
+ * Reads a little-endian std::uint32_t.
+ * @param buf The buffer.
+ */
+static std::uint32_t read_le32(const std::uint8_t * buf)
+{
+    return
+        static_cast<std::uint32_t> (buf[0]) |
+        static_cast<std::uint32_t> (buf[1]) << 8 |
+        static_cast<std::uint32_t> (buf[2]) << 16 |
+        static_cast<std::uint32_t> (buf[3]) << 24
+    ;
+}
+
+/**
+ * Writes a little-endian std::uint32_t.
+ * @param buf The buffer.
+ * @param val The value.
+ */
+static void write_le32(std::uint8_t * buf, const std::uint32_t & val)
+{
+    buf[0] = static_cast<std::uint8_t> (val);
+    buf[1] = static_cast<std::uint8_t> (val >> 8);
+    buf[2] = static_cast<std::uint8_t> (val >> 16);
+    buf[3] = static_cast<std::uint8_t> (val >> 24);
+}
+
+#define chacha20_rotl(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+
+#define chacha20_quarter_round(a, b, c, d) \
+    a += b; d = chacha20_rotl(d ^ a, 16); \
+    c += d; b = chacha20_rotl(b ^ c, 12); \
+    a += b; d = chacha20_rotl(d ^ a, 8); \
+    c += d; b = chacha20_rotl(b ^ c, 7);
+
+chacha20::chacha20()
+{
+    m_state.fill(0);
+}
+
+chacha20::chacha20(const std::uint8_t * key)
+{
+    set_key(key);
+}
+
+chacha20::~chacha20()
+{
+    /**
+     * Do not leave the key in memory.
+     */
+    std::memset(&m_state[0], 0, sizeof(m_state));
+}
+
+void chacha20::set_key(const std::uint8_t * key)
+{
+    /**
+     * The constant "expand 32-byte k".
+     */
+    m_state[0] = 0x61707865;
+    m_state[1] = 0x3320646e;
+    m_state[2] = 0x79622d32;
+    m_state[3] = 0x6b206574;
+    
+    for (auto i = 0; i < 8; i++)
+    {
+        m_state[4 + i] = read_le32(key + i * 4);
+    }
+    
+    m_state[12] = 0;
+    m_state[13] = 0;
+    m_state[14] = 0;
+    m_state[15] = 0;
+}
+
+void chacha20::set_nonce(const std::uint64_t & val)
+{
+    m_state[14] = static_cast<std::uint32_t> (val);
+    m_state[15] = static_cast<std::uint32_t> (val >> 32);
+}
+
+void chacha20::seek(const std::uint64_t & val)
+{
+    m_state[12] = static_cast<std::uint32_t> (val);
+    m_state[13] = static_cast<std::uint32_t> (val >> 32);
+}
+
+void chacha20::keystream(std::uint8_t * buf, std::size_t len)
+{
+    std::uint32_t x[16];
+    
+    std::uint8_t block[block_length];
+    
+    while (len > 0)
+    {
+        std::memcpy(x, &m_state[0], sizeof(x));
+        
+        for (auto i = 0; i < 10; i++)
+        {
+            chacha20_quarter_round(x[0], x[4], x[8], x[12])
+            chacha20_quarter_round(x[1], x[5], x[9], x[13])
+            chacha20_quarter_round(x[2], x[6], x[10], x[14])
+            chacha20_quarter_round(x[3], x[7], x[11], x[15])
+            chacha20_quarter_round(x[0], x[5], x[10], x[15])
+            chacha20_quarter_round(x[1], x[6], x[11], x[12])
+            chacha20_quarter_round(x[2], x[7], x[8], x[13])
+            chacha20_quarter_round(x[3], x[4], x[9], x[14])
+        }
+        
+        for (auto i = 0; i < 16; i++)
+        {
+            write_le32(block + i * 4, x[i] + m_state[i]);
+        }
+        
+        /**
+         * Increment the 64-bit block counter.
+         */
+        if (++m_state[12] == 0)
+        {
+            ++m_state[13];
+        }
+        
+        auto n = std::min(len, static_cast<std::size_t> (block_length));
+        
+        std::memcpy(buf, block, n);
+        
+        buf += n;
+        len -= n;
+    }
+    
+    std::memset(x, 0, sizeof(x));
+    std::memset(block, 0, sizeof(block));
+}
+
+int chacha20::run_test()
+{
+    /**
+     * The all zero key and nonce test vector.
+     */
+    static const std::uint8_t expected[block_length] =
+    {
+        0x76, 0xb8, 0xe0, 0xad, 0xa0, 0xf1, 0x3d, 0x90,
+        0x40, 0x5d, 0x6a, 0xe5, 0x53, 0x86, 0xbd, 0x28,
+        0xbd, 0xd2, 0x19, 0xb8, 0xa0, 0x8d, 0xed, 0x1a,
+        0xa8, 0x36, 0xef, 0xcc, 0x8b, 0x77, 0x0d, 0xc7,
+        0xda, 0x41, 0x59, 0x7c, 0x51, 0x57, 0x48, 0x8d,
+        0x77, 0x24, 0xe0, 0x3f, 0xb8, 0xd8, 0x4a, 0x37,
+        0x6a, 0x43, 0xb8, 0xf4, 0x15, 0x18, 0xa1, 0x1c,
+        0xc3, 0x87, 0xb6, 0x69, 0xb2, 0xee, 0x65, 0x86
+    };
+    
+    std::uint8_t key[key_length] = { 0 };
+    
+    chacha20 c(key);
+    
+    std::uint8_t out[block_length];
+    
+    c.keystream(out, sizeof(out));
+    
+    assert(std::memcmp(out, expected, sizeof(out)) == 0);
+    
+    /**
+     * Generating in pieces must match generating in one call.
+     */
+    std::uint8_t whole[3 * block_length], pieces[3 * block_length];
+    
+    c.set_key(key);
+    c.keystream(whole, sizeof(whole));
+    
+    c.set_key(key);
+    c.keystream(pieces, block_length);
+    c.keystream(pieces + block_length, 2 * block_length);
+    
+    assert(std::memcmp(whole, pieces, sizeof(whole)) == 0);
+    assert(std::memcmp(whole, expected, block_length) == 0);
+    
+    printf("Test chacha20: passed.\n");
+    
+    return 0;
+}
@@ -0,0 +1,539 @@
+/*
+ * Copyright (c) 2013-2014 John Connor (BM-NC49AxAjcqVcF5jNPu85Rb8MJ2d9JqZt)
+ *
+ * This file is part of coinpp.
+ *
+ * coinpp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License with
+ * additional permissions to the one published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version. For more information see LICENSE.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <boost/format.hpp>
+
+#include <coin/block.hpp>
+#include <coin/block_index.hpp>
+#include <coin/chain_replay.hpp>
+#include <coin/constants.hpp>
+#include <coin/data_buffer.hpp>
+#include <coin/db_env.hpp>
+#include <coin/db_tx.hpp>
+#include <coin/filesystem.hpp>
+#include <coin/globals.hpp>
+#include <coin/logger.hpp>
+#include <coin/message.hpp>
+#include <coin/stack_impl.hpp>
+
+using namespace coin;
+
+std::atomic<bool> chain_replay::g_is_running(false);
+std::atomic<bool> chain_replay::g_verify_all_scripts(false);
+std::atomic<std::uint64_t> chain_replay::g_microseconds[phase_count];
+
+chain_replay::chain_replay(
+    const std::string & path_source, const std::string & path_target
+    )
+    : m_path_source(path_source)
+    , m_path_target(path_target)
+    , m_stats()
+{
+    // ...
+}
+
+bool chain_replay::run(
+    const std::int32_t & height_stop, const bool & verify_all_scripts
+    )
+{
+    if (g_is_running.exchange(true))
+    {
+        log_error("Chain replay is already running.");
+        
+        return false;
+    }
+    
+    m_stats = stats_t();
+    m_stats.height = -1;
+    m_orphans.clear();
+    
+    for (auto & i : g_microseconds)
+    {
+        i = 0;
+    }
+    
+    g_verify_all_scripts = verify_all_scripts;
+    
+    /**
+     * Everything (block files, indexes and logs) is written into the
+     * target data directory.
+     */
+    filesystem::create_path(m_path_target);
+    
+    filesystem::set_data_path(m_path_target);
+    
+    stack_impl::get_db_env() = std::make_shared<db_env> ();
+    
+    if (stack_impl::get_db_env()->open(m_path_target) == false)
+    {
+        log_error(
+            "Chain replay failed to open database environment, path = " <<
+            m_path_target << "."
+        );
+        
+        g_is_running = false;
+        
+        return false;
+    }
+    
+    log_info(
+        "Chain replay is replaying " << m_path_source << " into " <<
+        m_path_target << "."
+    );
+    
+    auto time_start = std::chrono::steady_clock::now();
+    
+    auto success = true;
+    
+    try
+    {
+        for (std::uint32_t i = 1; ; i++)
+        {
+            auto path =
+                m_path_source + (boost::format("blk%04u.dat") % i).str()
+            ;
+            
+            std::ifstream ifs(path, std::ifstream::in | std::ifstream::binary);
+            
+            if (ifs.good() == false)
+            {
+                break;
+            }
+            
+            ifs.close();
+            
+            if (read_file(path, height_stop) == false)
+            {
+                break;
+            }
+        }
+    }
+    catch (std::exception & e)
+    {
+        log_error("Chain replay failed, what = " << e.what() << ".");
+        
+        success = false;
+    }
+    
+    m_stats.microseconds_total =
+        std::chrono::duration_cast<std::chrono::microseconds> (
+        std::chrono::steady_clock::now() - time_start).count()
+    ;
+    m_stats.microseconds_script = g_microseconds[phase_script];
+    m_stats.microseconds_db = g_microseconds[phase_db];
+    
+    for (auto & i : m_orphans)
+    {
+        m_stats.blocks_orphan += static_cast<std::uint32_t> (i.second.size());
+    }
+    
+    m_orphans.clear();
+    
+    /**
+     * Flush and close the rebuilt databases.
+     */
+    stack_impl::get_db_env()->flush();
+    stack_impl::get_db_env()->close_DbEnv();
+    
+    log_info("Chain replay finished, " << to_string());
+    
+    g_is_running = false;
+    
+    return success;
+}
+
+const chain_replay::stats_t & chain_replay::stats() const
+{
+    return m_stats;
+}
+
+std::string chain_replay::to_string() const
+{
+    std::stringstream ss;
+    
+    auto seconds = std::max<std::uint64_t> (m_stats.microseconds_total, 1) / 1000000.0;
+    
+    auto milliseconds = [](const std::uint64_t & microseconds)
+    {
+        return microseconds / 1000;
+    };
+    
+    ss <<
+        "height = " << m_stats.height << ", blocks = " << m_stats.blocks <<
+        ", transactions = " << m_stats.transactions << ", sig ops = " <<
+        m_stats.sig_ops << ", bytes = " << m_stats.bytes << ", orphans = " <<
+        m_stats.blocks_orphan << ", seconds = " << seconds <<
+        ", blocks/sec = " << m_stats.blocks / seconds <<
+        ", tx/sec = " << m_stats.transactions / seconds <<
+        ", sigops/sec = " << m_stats.sig_ops / seconds <<
+        ", read = " << milliseconds(m_stats.microseconds_read) <<
+        "ms, decode = " << milliseconds(m_stats.microseconds_decode) <<
+        "ms, hash = " << milliseconds(m_stats.microseconds_hash) <<
+        "ms, check = " << milliseconds(m_stats.microseconds_check) <<
+        "ms, accept = " << milliseconds(m_stats.microseconds_accept) <<
+        "ms (script = " << milliseconds(m_stats.microseconds_script) <<
+        "ms, db = " << milliseconds(m_stats.microseconds_db) << "ms)"
+    ;
+    
+    return ss.str();
+}
+
+bool chain_replay::verify_all_scripts()
+{
+    return g_is_running && g_verify_all_scripts;
+}
+
+std::chrono::steady_clock::time_point chain_replay::profile_start()
+{
+    if (g_is_running)
+    {
+        return std::chrono::steady_clock::now();
+    }
+    
+    return std::chrono::steady_clock::time_point();
+}
+
+void chain_replay::profile_stop(
+    const phase_t & phase,
+    const std::chrono::steady_clock::time_point & time_start
+    )
+{
+    if (time_start != std::chrono::steady_clock::time_point())
+    {
+        g_microseconds[phase] +=
+            std::chrono::duration_cast<std::chrono::microseconds> (
+            std::chrono::steady_clock::now() - time_start).count()
+        ;
+    }
+}
+
+bool chain_replay::read_file(
+    const std::string & path, const std::int32_t & height_stop
+    )
+{
+    log_info("Chain replay is reading " << path << ".");
+    
+    std::ifstream ifs(path, std::ifstream::in | std::ifstream::binary);
+    
+    auto magic = message::header_magic();
+    
+    for (;;)
+    {
+        if (height_stop >= 0 && m_stats.height >= height_stop)
+        {
+            return false;
+        }
+        
+        auto time_start = std::chrono::steady_clock::now();
+        
+        /**
+         * Find the magic (message start), the space between blocks may be
+         * zero filled.
+         */
+        std::uint32_t value = 0;
+        
+        char c;
+        
+        auto found = false;
+        
+        std::size_t bytes = 0;
+        
+        while (ifs.get(c))
+        {
+            value = (value >> 8) | (static_cast<std::uint32_t> (
+                static_cast<std::uint8_t> (c)) << 24
+            );
+            
+            if (++bytes >= sizeof(value) && value == magic)
+            {
+                found = true;
+                
+                break;
+            }
+        }
+        
+        if (found == false)
+        {
+            break;
+        }
+        
+        std::uint32_t len = 0;
+        
+        ifs.read(reinterpret_cast<char *> (&len), sizeof(len));
+        
+        if (ifs.good() == false)
+        {
+            break;
+        }
+        
+        auto is_compressed = (len & block::frame_compressed) != 0;
+        
+        len &= ~static_cast<std::uint32_t> (block::frame_compressed);
+        
+        if (
+            (is_compressed == false && len < block::header_length) ||
+            len > block::size_maximum
+            )
+        {
+            log_error("Chain replay skipping invalid block length " << len);
+            
+            continue;
+        }
+        
+        std::string buf(len, 0);
+        
+        ifs.read(&buf[0], len);
+        
+        if (ifs.good() == false)
+        {
+            break;
+        }
+        
+        auto time_read = std::chrono::steady_clock::now();
+        
+        m_stats.microseconds_read +=
+            std::chrono::duration_cast<std::chrono::microseconds> (
+            time_read - time_start).count()
+        ;
+        
+        auto blk = std::make_shared<block> ();
+        
+        data_buffer buffer;
+        
+        if (is_compressed)
+        {
+            if (block::decompress(buf, buffer) == false)
+            {
+                throw std::runtime_error("failed to decompress block");
+            }
+        }
+        else
+        {
+            buffer.write_bytes(buf.data(), buf.size());
+        }
+        
+        if (blk->decode(buffer) == false)
+        {
+            throw std::runtime_error("failed to decode block");
+        }
+        
+        m_stats.microseconds_decode +=
+            std::chrono::duration_cast<std::chrono::microseconds> (
+            std::chrono::steady_clock::now() - time_read).count()
+        ;
+        
+        m_stats.bytes += len;
+        
+        if (process(blk) == false)
+        {
+            throw std::runtime_error("failed to connect block");
+        }
+    }
+    
+    return true;
+}
+
+bool chain_replay::process(const std::shared_ptr<block> & blk)
+{
+    auto hash_genesis =
+        constants::test_net ?
+        block::get_hash_genesis_test_net() : block::get_hash_genesis()
+    ;
+    
+    /**
+     * A block may have been written more than once.
+     */
+    if (globals::instance().block_indexes().count(blk->get_hash()) > 0)
+    {
+        return true;
+    }
+    
+    if (
+        blk->get_hash() != hash_genesis &&
+        globals::instance().block_indexes().count(
+        blk->header().hash_previous_block) == 0
+        )
+    {
+        /**
+         * The block files hold side chains and blocks written out of order,
+         * hold on to them until their previous block is connected.
+         */
+        m_orphans[blk->header().hash_previous_block].push_back(blk);
+        
+        return true;
+    }
+    
+    if (connect(*blk) == false)
+    {
+        return false;
+    }
+    
+    /**
+     * Connect the orphans that were waiting on this block.
+     */
+    std::vector<sha256> hashes;
+    
+    hashes.push_back(blk->get_hash());
+    
+    while (hashes.size() > 0)
+    {
+        auto hash = hashes.back();
+        
+        hashes.pop_back();
+        
+        auto it = m_orphans.find(hash);
+        
+        if (it == m_orphans.end())
+        {
+            continue;
+        }
+        
+        auto orphans = it->second;
+        
+        m_orphans.erase(it);
+        
+        for (auto & i : orphans)
+        {
+            if (connect(*i) == false)
+            {
+                return false;
+            }
+            
+            hashes.push_back(i->get_hash());
+        }
+    }
+    
+    return true;
+}
+
+bool chain_replay::connect(block & blk)
+{
+    auto time_start = std::chrono::steady_clock::now();
+    
+    /**
+     * Hash the header and the transactions.
+     */
+    auto hash_block = blk.get_hash();
+    
+    if (blk.build_merkle_tree() != blk.header().hash_merkle_root)
+    {
+        log_error(
+            "Chain replay found merkle root mismatch in " <<
+            hash_block.to_string().substr(0, 20) << "."
+        );
+        
+        return false;
+    }
+    
+    auto time_hash = std::chrono::steady_clock::now();
+    
+    m_stats.microseconds_hash +=
+        std::chrono::duration_cast<std::chrono::microseconds> (
+        time_hash - time_start).count()
+    ;
+    
+    /**
+     * Run the context-free checks, the merkle root was checked above.
+     */
+    if (
+        blk.check_block(std::shared_ptr<tcp_connection> (), true,
+        false) == false
+        )
+    {
+        log_error(
+            "Chain replay, check block failed for " <<
+            hash_block.to_string().substr(0, 20) << "."
+        );
+        
+        return false;
+    }
+    
+    auto time_check = std::chrono::steady_clock::now();
+    
+    m_stats.microseconds_check +=
+        std::chrono::duration_cast<std::chrono::microseconds> (
+        time_check - time_hash).count()
+    ;
+    
+    auto success = false;
+    
+    if (globals::instance().block_indexes().size() == 0)
+    {
+        /**
+         * The genesis block has no previous block to accept against, it is
+         * written and indexed directly.
+         */
+        std::uint32_t file = 0;
+        
+        std::uint32_t block_position = 0;
+        
+        success =
+            blk.write_to_disk(file, block_position) &&
+            blk.add_to_block_index(file, block_position)
+        ;
+    }
+    else
+    {
+        success = blk.accept_block(
+            std::shared_ptr<tcp_connection_manager> ()
+        );
+    }
+    
+    m_stats.microseconds_accept +=
+        std::chrono::duration_cast<std::chrono::microseconds> (
+        std::chrono::steady_clock::now() - time_check).count()
+    ;
+    
+    if (success == false)
+    {
+        log_error(
+            "Chain replay, accept block failed for " <<
+            hash_block.to_string().substr(0, 20) << "."
+        );
+        
+        return false;
+    }
+    
+    m_stats.blocks++;
+    m_stats.transactions += blk.transactions().size();
+    
+    for (auto & i : blk.transactions())
+    {
+        m_stats.sig_ops += i.get_legacy_sig_op_count();
+    }
+    
+    m_stats.height = globals::instance().best_block_height();
+    
+    if (m_stats.blocks % 1000 == 0)
+    {
+        log_info(
+            "Chain replay connected " << m_stats.blocks << " blocks, "
+            "height = " << m_stats.height << "."
+        );
+    }
+    
+    return true;
+}
@@ -0,0 +1,405 @@
+/*
+ * Copyright (c) 2013-2014 John Connor (BM-NC49AxAjcqVcF5jNPu85Rb8MJ2d9JqZt)
+ *
+ * This file is part of coinpp.
+ *
+ * coinpp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License with
+ * additional permissions to the one published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version. For more information see LICENSE.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+
+#include <coin/check_pool.hpp>
+#include <coin/logger.hpp>
+#include <coin/sha256.hpp>
+
+using namespace coin;
+
+check_pool::sequence::sequence(check_pool & owner, boost::asio::strand & s)
+    : m_bytes(0)
+    , check_pool_(owner)
+    , strand_(s)
+{
+    // ...
+}
+
+void check_pool::sequence::push(
+    const std::function<bool ()> & check,
+    const std::function<void (const bool &)> & accept,
+    const std::size_t & bytes
+    )
+{
+    auto slot = std::make_shared<slot_t> ();
+    
+    slot->is_done = false;
+    slot->success = false;
+    slot->bytes = bytes;
+    slot->accept = accept;
+    
+    std::unique_lock<std::mutex> l1(mutex_);
+    
+    m_slots.push_back(slot);
+    
+    m_bytes += bytes;
+    
+    l1.unlock();
+    
+    auto self(shared_from_this());
+    
+    check_pool_.post([this, self, slot, check]()
+    {
+        auto success = false;
+        
+        try
+        {
+            success = check();
+        }
+        catch (std::exception & e)
+        {
+            log_debug("Check pool check failed, what = " << e.what() << ".");
+        }
+        
+        std::unique_lock<std::mutex> l1(mutex_);
+        
+        slot->success = success;
+        slot->is_done = true;
+        
+        l1.unlock();
+        
+        /**
+         * Accept (in order) on the strand.
+         */
+        strand_.post(std::bind(&sequence::drain, self));
+    });
+}
+
+std::size_t check_pool::sequence::size() const
+{
+    std::lock_guard<std::mutex> l1(mutex_);
+    
+    return m_slots.size();
+}
+
+bool check_pool::sequence::is_full() const
+{
+    std::lock_guard<std::mutex> l1(mutex_);
+    
+    return m_slots.size() >= max_checks || m_bytes >= max_check_bytes;
+}
+
+void check_pool::sequence::drain()
+{
+    for (;;)
+    {
+        std::unique_lock<std::mutex> l1(mutex_);
+        
+        if (m_slots.size() == 0 || m_slots.front()->is_done == false)
+        {
+            break;
+        }
+        
+        auto slot = m_slots.front();
+        
+        m_slots.pop_front();
+        
+        m_bytes -= slot->bytes;
+        
+        l1.unlock();
+        
+        try
+        {
+            slot->accept(slot->success);
+        }
+        catch (std::exception & e)
+        {
+            log_error(
+                "Check pool accept failed, what = " << e.what() << "."
+            );
+        }
+    }
+}
+
+check_pool::check_pool()
+{
+    // ...
+}
+
+check_pool::~check_pool()
+{
+    stop();
+}
+
+check_pool & check_pool::instance()
+{
+    static check_pool g_check_pool;
+    
+    return g_check_pool;
+}
+
+void check_pool::start(const std::size_t & threads)
+{
+    std::lock_guard<std::mutex> l1(mutex_);
+    
+    if (m_work)
+    {
+        return;
+    }
+    
+    auto count = threads;
+    
+    if (count == 0)
+    {
+        count = std::max(1u, std::thread::hardware_concurrency());
+    }
+    
+    m_io_service.reset();
+    
+    m_work.reset(new boost::asio::io_service::work(m_io_service));
+    
+    for (std::size_t i = 0; i < count; i++)
+    {
+        auto thread = std::make_shared<std::thread> ([this]()
+        {
+            m_io_service.run();
+        });
+        
+        m_threads.push_back(thread);
+    }
+    
+    log_debug("Check pool started " << count << " threads.");
+}
+
+void check_pool::stop()
+{
+    std::lock_guard<std::mutex> l1(mutex_);
+    
+    /**
+     * Let the queued checks finish.
+     */
+    m_work.reset();
+    
+    for (auto & i : m_threads)
+    {
+        try
+        {
+            if (i->joinable())
+            {
+                i->join();
+            }
+        }
+        catch (std::exception & e)
+        {
+            // ...
+        }
+    }
+    
+    m_threads.clear();
+}
+
+void check_pool::post(const std::function<void ()> & f)
+{
+    std::unique_lock<std::mutex> l1(mutex_);
+    
+    if (m_work)
+    {
+        m_io_service.post(f);
+    }
+    else
+    {
+        l1.unlock();
+        
+        f();
+    }
+}
+
+int check_pool::run_test()
+{
+    /**
+     * Simulate a flood of blocks where each one costs a few milliseconds of
+     * context-free checking (stand-in: hashing the block payload) and
+     * measure how long the networking path is blocked per message.
+     */
+    enum { blocks = 200, block_size = 256 * 1024 };
+    
+    std::vector<std::uint8_t> payload(block_size, 0x5a);
+    
+    auto check = [&payload]()
+    {
+        auto digest = sha256::hash(&payload[0], payload.size());
+        
+        for (auto i = 0; i < 16; i++)
+        {
+            digest = sha256::hash(&payload[0], payload.size());
+        }
+        
+        return digest[0] != 0xff || digest[1] != 0xff;
+    };
+    
+    boost::asio::io_service ios;
+    boost::asio::strand s(ios);
+    
+    std::shared_ptr<boost::asio::io_service::work> work(
+        new boost::asio::io_service::work(ios)
+    );
+    
+    std::thread chain_thread([&ios]() { ios.run(); });
+
+    /**
+     * Inline: check and accept on the networking path.
+     */
+    auto accepted = 0;
+    
+    std::int64_t inline_worst = 0;
+    
+    auto start = std::chrono::steady_clock::now();
+    
+    for (auto i = 0; i < blocks; i++)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        
+        if (check())
+        {
+            accepted++;
+        }
+        
+        inline_worst = std::max(
+            inline_worst, static_cast<std::int64_t> (
+            std::chrono::duration_cast<std::chrono::microseconds> (
+            std::chrono::steady_clock::now() - t0).count())
+        );
+    }
+    
+    auto inline_total = std::chrono::duration_cast<
+        std::chrono::milliseconds
+    > (std::chrono::steady_clock::now() - start).count();
+    
+    assert(accepted == blocks);
+    
+    /**
+     * Pooled: the networking path only queues the check.
+     */
+    check_pool pool;
+    
+    pool.start();
+    
+    auto seq = std::make_shared<sequence> (pool, s);
+    
+    std::vector<int> order;
+    
+    std::int64_t pooled_worst = 0;
+    
+    start = std::chrono::steady_clock::now();
+    
+    for (auto i = 0; i < blocks; i++)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        
+        seq->push(check, [i, &order](const bool & success)
+        {
+            assert(success);
+            
+            order.push_back(i);
+        });
+        
+        pooled_worst = std::max(
+            pooled_worst, static_cast<std::int64_t> (
+            std::chrono::duration_cast<std::chrono::microseconds> (
+            std::chrono::steady_clock::now() - t0).count())
+        );
+    }
+    
+    pool.stop();
+    
+    while (seq->size() > 0)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    
+    auto pooled_total = std::chrono::duration_cast<
+        std::chrono::milliseconds
+    > (std::chrono::steady_clock::now() - start).count();
+    
+    work.reset();
+    
+    chain_thread.join();
+    
+    /**
+     * The accept handlers must run in the order the blocks arrived.
+     */
+    assert(order.size() == blocks);
+    
+    for (std::size_t i = 0; i < order.size(); i++)
+    {
+        assert(order[i] == static_cast<int> (i));
+    }
+    
+    printf(
+        "Test check_pool: %d blocks, inline worst %lld us (total %lld ms), "
+        "pooled worst %lld us (total %lld ms).\n", blocks,
+        static_cast<long long> (inline_worst),
+        static_cast<long long> (inline_total),
+        static_cast<long long> (pooled_worst),
+        static_cast<long long> (pooled_total)
+    );
+    
+    /**
+     * A connection has its own sequence, it is full at max_checks checks
+     * or max_check_bytes bytes not yet accepted and empties as they are.
+     * The pool is stopped so the checks run inline and the accepts wait
+     * for the strand.
+     */
+    boost::asio::io_service ios_cap;
+    boost::asio::strand s_cap(ios_cap);
+    
+    auto seq_txs = std::make_shared<sequence> (pool, s_cap);
+    
+    for (auto i = 0; i < sequence::max_checks - 1; i++)
+    {
+        seq_txs->push([]() { return true; }, [](const bool &) {}, 250);
+    }
+    
+    assert(seq_txs->is_full() == false);
+    
+    seq_txs->push([]() { return true; }, [](const bool &) {}, 250);
+    
+    assert(seq_txs->is_full());
+    
+    auto seq_blocks = std::make_shared<sequence> (pool, s_cap);
+    
+    auto blocks_full = 0;
+    
+    while (seq_blocks->is_full() == false)
+    {
+        seq_blocks->push([]() { return false; }, [](const bool &) {}, 1000000);
+        
+        blocks_full++;
+    }
+    
+    assert(blocks_full == sequence::max_check_bytes / 1000000 + 1);
+    
+    ios_cap.run();
+    
+    assert(seq_txs->size() == 0 && seq_txs->is_full() == false);
+    assert(seq_blocks->size() == 0 && seq_blocks->is_full() == false);
+    
+    printf(
+        "Test check_pool: sequence full at %d transactions or %d blocks "
+        "of 1 MB, empty once accepted.\n",
+        static_cast<int> (sequence::max_checks), blocks_full
+    );
+    
+    return 0;
+}
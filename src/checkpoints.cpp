@@ -113,19 +113,18 @@ bool checkpoints::check_sync(
         /**
          * Trace back to same height as sync-checkpoint.
          */
-        auto index = index_previous;
+        auto index = block_index::get_ancestor(
+            index_previous, index_sync->height()
+        );
         
-        while (index->height() > index_sync->height())
+        if (index == 0)
         {
-            if ((index = index->block_index_previous()) == 0)
-            {
-                log_error(
-                    "Checkpoints, check sync failed, previous block "
-                    "index is null (block index structure failure)."
-                );
-                
-                return false;
-            }
+            log_error(
+                "Checkpoints, check sync failed, previous block "
+                "index is null (block index structure failure)."
+            );
+            
+            return false;
         }
         
         /**
@@ -201,19 +200,18 @@ bool checkpoints::validate_sync_checkpoint(const sha256 & hash_checkpoint)
          * to the same height of the received checkpoint to verify
          * that current checkpoint should be a descendant block.
         */
-        auto pindex = index_sync_checkpoint;
+        auto pindex = block_index::get_ancestor(
+            index_sync_checkpoint, index_checkpointRecv->height()
+        );
         
-        while (pindex->height() > index_checkpointRecv->height())
+        if (pindex == 0)
         {
-            if (!(pindex = pindex->block_index_previous()))
-            {
-                 log_error(
-                    "Checkpoints, validate sync checkpoint failed, "
-                    "previous index is null - block index structure failure."
-                );
-                
-                return false;
-            }
+             log_error(
+                "Checkpoints, validate sync checkpoint failed, "
+                "previous index is null - block index structure failure."
+            );
+            
+            return false;
         }
         
         if (pindex->get_block_hash() != hash_checkpoint)
@@ -241,19 +239,18 @@ bool checkpoints::validate_sync_checkpoint(const sha256 & hash_checkpoint)
      * checkpoint. Trace back to the same height of current checkpoint
      * to verify.
      */
-    auto index = index_checkpointRecv;
+    auto index = block_index::get_ancestor(
+        index_checkpointRecv, index_sync_checkpoint->height()
+    );
     
-    while (index->height() > index_sync_checkpoint->height())
+    if (index == 0)
     {
-        if (!(index = index->block_index_previous()))
-        {
-            log_error(
-                "Checkpoints, validate sync checkpoint failed, previous "
-                "index is null - block index structure failure"
-            );
-            
-            return false;
-        }
+        log_error(
+            "Checkpoints, validate sync checkpoint failed, previous "
+            "index is null - block index structure failure"
+        );
+        
+        return false;
     }
     
     if (index->get_block_hash() != m_hash_sync_checkpoint)
@@ -656,7 +653,7 @@ bool checkpoints::accept_pending_sync_checkpoint(
         /**
          * Broadcast the checkpoint to connected peers.
          */
-        if (m_checkpoint_message.is_null() == false)
+        if (connection_manager && m_checkpoint_message.is_null() == false)
         {
             for (auto & i : connection_manager->tcp_connections())
             {
@@ -37,6 +37,10 @@ using namespace coin;
 configuration::configuration()
     : m_network_port_tcp(protocol::default_tcp_port)
     , m_network_tcp_inbound_maximum(network::tcp_inbound_maximum)
+    , m_network_tcp_upload_historical_maximum(
+        network::tcp_upload_historical_maximum)
+    , m_network_tcp_upload_relay_maximum(network::tcp_upload_relay_maximum)
+    , m_database_backend("bdb")
 {
     // ...
 }
@@ -102,6 +106,52 @@ bool configuration::load()
         {
             m_network_tcp_inbound_maximum = network::tcp_inbound_minimum;
         }
+        
+        /**
+         * Get the network.tcp.upload.historical.maximum.
+         */
+        m_network_tcp_upload_historical_maximum = std::stoul(pt.get(
+            "network.tcp.upload.historical.maximum",
+            std::to_string(network::tcp_upload_historical_maximum))
+        );
+        
+        log_debug(
+            "Configuration read network.tcp.upload.historical.maximum = " <<
+            m_network_tcp_upload_historical_maximum << "."
+        );
+        
+        /**
+         * Get the network.tcp.upload.relay.maximum.
+         */
+        m_network_tcp_upload_relay_maximum = std::stoul(pt.get(
+            "network.tcp.upload.relay.maximum",
+            std::to_string(network::tcp_upload_relay_maximum))
+        );
+        
+        log_debug(
+            "Configuration read network.tcp.upload.relay.maximum = " <<
+            m_network_tcp_upload_relay_maximum << "."
+        );
+        
+        /**
+         * Get the database.backend.
+         */
+        m_database_backend = pt.get("database.backend", std::string("bdb"));
+        
+        if (m_database_backend != "bdb" && m_database_backend != "log")
+        {
+            log_error(
+                "Configuration got unknown database.backend " <<
+                m_database_backend << ", using bdb."
+            );
+            
+            m_database_backend = "bdb";
+        }
+        
+        log_debug(
+            "Configuration read database.backend = " <<
+            m_database_backend << "."
+        );
     }
     catch (std::exception & e)
     {
@@ -146,6 +196,27 @@ bool configuration::save()
             std::to_string(m_network_tcp_inbound_maximum)
         );
         
+        /**
+         * Put the network.tcp.upload.historical.maximum into property tree.
+         */
+        pt.put(
+            "network.tcp.upload.historical.maximum",
+            std::to_string(m_network_tcp_upload_historical_maximum)
+        );
+        
+        /**
+         * Put the network.tcp.upload.relay.maximum into property tree.
+         */
+        pt.put(
+            "network.tcp.upload.relay.maximum",
+            std::to_string(m_network_tcp_upload_relay_maximum)
+        );
+        
+        /**
+         * Put the database.backend into property tree.
+         */
+        pt.put("database.backend", m_database_backend);
+        
         /**
          * The std::stringstream.
          */
@@ -219,3 +290,38 @@ const std::size_t & configuration::network_tcp_inbound_maximum() const
 {
     return m_network_tcp_inbound_maximum;
 }
+
+void configuration::set_network_tcp_upload_historical_maximum(
+    const std::size_t & val
+    )
+{
+    m_network_tcp_upload_historical_maximum = val;
+}
+
+const std::size_t &
+    configuration::network_tcp_upload_historical_maximum() const
+{
+    return m_network_tcp_upload_historical_maximum;
+}
+
+void configuration::set_network_tcp_upload_relay_maximum(
+    const std::size_t & val
+    )
+{
+    m_network_tcp_upload_relay_maximum = val;
+}
+
+const std::size_t & configuration::network_tcp_upload_relay_maximum() const
+{
+    return m_network_tcp_upload_relay_maximum;
+}
+
+void configuration::set_database_backend(const std::string & val)
+{
+    m_database_backend = val;
+}
+
+const std::string & configuration::database_backend() const
+{
+    return m_database_backend;
+}
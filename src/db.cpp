@@ -25,21 +25,28 @@
 #define _GLIBCXX_USE_NANOSLEEP 1
 #endif // __linux__
 
+#include <cassert>
 #include <thread>
 
+#include <coin/chain_replay.hpp>
 #include <coin/db.hpp>
 #include <coin/db_env.hpp>
+#include <coin/kv_store_bdb.hpp>
+#include <coin/kv_store_log.hpp>
 #include <coin/stack_impl.hpp>
 #include <coin/utility.hpp>
 
 using namespace coin;
 
-db::db(const std::string & file_name, const std::string & file_mode
+db::db(
+    const std::string & file_name, const std::string & file_mode,
+    const bool & is_reader
     )
     : m_is_read_only(false)
     , m_file_name(file_name)
     , m_Db(0)
-    , m_DbTxn(0)
+    , m_is_reader(is_reader)
+    , m_reader_generation(0)
 {
     int ret;
 
@@ -61,7 +68,58 @@ db::db(const std::string & file_name, const std::string & file_mode
         throw std::runtime_error("database environment failed to open");
     }
 
-    ++stack_impl::get_db_env()->file_use_counts()[m_file_name];
+    assert(m_is_reader == false || m_is_read_only);
+    
+    if (m_is_reader)
+    {
+        m_reader_generation = stack_impl::get_db_env()->reader_generation();
+        
+        ++stack_impl::get_db_env()->file_reader_counts()[m_file_name];
+        
+        stack_impl::get_db_env()->readers().insert(this);
+    }
+    else
+    {
+        ++stack_impl::get_db_env()->file_use_counts()[m_file_name];
+    }
+    
+    if (stack_impl::get_db_env()->backend() == kv_store::backend_log)
+    {
+        m_kv_store = stack_impl::get_db_env()->get_kv_store_log(m_file_name);
+        
+        if (m_kv_store == nullptr)
+        {
+            if (m_is_reader)
+            {
+                --stack_impl::get_db_env()->file_reader_counts()[m_file_name];
+                
+                stack_impl::get_db_env()->readers().erase(this);
+            }
+            else
+            {
+                --stack_impl::get_db_env()->file_use_counts()[m_file_name];
+            }
+            
+            m_file_name = "";
+
+            throw std::runtime_error(
+                "failed to open log store for " + file_name
+            );
+        }
+        
+        if (db_create && exists("version") == false)
+        {
+            bool tmp = m_is_read_only;
+            
+            m_is_read_only = false;
+            
+            write_version(constants::version_client);
+            
+            m_is_read_only = tmp;
+        }
+        
+        return;
+    }
     
     m_Db = stack_impl::get_db_env()->Dbs()[m_file_name];
     
@@ -77,7 +135,16 @@ db::db(const std::string & file_name, const std::string & file_mode
         {
             delete m_Db, m_Db = 0;
             
-            --stack_impl::get_db_env()->file_use_counts()[m_file_name];
+            if (m_is_reader)
+            {
+                --stack_impl::get_db_env()->file_reader_counts()[m_file_name];
+                
+                stack_impl::get_db_env()->readers().erase(this);
+            }
+            else
+            {
+                --stack_impl::get_db_env()->file_use_counts()[m_file_name];
+            }
             
             m_file_name = "";
 
@@ -87,6 +154,8 @@ db::db(const std::string & file_name, const std::string & file_mode
             );
         }
         
+        m_kv_store = std::make_shared<kv_store_bdb> (*m_Db);
+        
         if (db_create && exists("version") == false)
         {
             bool tmp = m_is_read_only;
@@ -100,6 +169,10 @@ db::db(const std::string & file_name, const std::string & file_mode
 
         stack_impl::get_db_env()->Dbs()[file_name] = m_Db;
     }
+    else
+    {
+        m_kv_store = std::make_shared<kv_store_bdb> (*m_Db);
+    }
 }
 
 db::~db()
@@ -107,9 +180,15 @@ db::~db()
     /**
      * If the application state is stopping the destructor should not close
      * the database as the owner should have done so cleanly This is used for
-     * RAII.
+     * RAII. A long-lived read handle is always closed (it is a no-op once
+     * the db_env closed the readers) so it never outlives it's entry in
+     * db_env::readers.
      */
-    if (globals::instance().state() >= globals::state_stopping)
+    if (m_is_reader)
+    {
+        close();
+    }
+    else if (globals::instance().state() >= globals::state_stopping)
     {
         // ...
     }
@@ -121,14 +200,12 @@ db::~db()
 
 void db::close()
 {
-    if (m_Db)
+    if (m_kv_store)
     {
-        if (m_DbTxn)
-        {
-            m_DbTxn->abort();
-        
-            m_DbTxn = 0;
-        }
+        /**
+         * Drop the writes of an open transaction.
+         */
+        m_batch.reset();
         
         /**
          * The reference implementation sets this to null but does not delete
@@ -136,161 +213,106 @@ void db::close()
          */
         m_Db = 0;
         
-        /**
-         * Flush database activity from memory pool to disk log.
-         */
-        std::uint32_t minutes = 0;
-
-        if (m_is_read_only)
-        {
-            minutes = 1;
-        }
+        m_kv_store.reset();
         
-        if (utility::is_chain_file(m_file_name))
+        if (m_is_reader)
         {
-            minutes = 2;
+            stack_impl::get_db_env()->readers().erase(this);
+            
+            /**
+             * If the db_env dropped the readers our count is already gone.
+             */
+            if (
+                m_reader_generation ==
+                stack_impl::get_db_env()->reader_generation()
+                )
+            {
+                --stack_impl::get_db_env()->file_reader_counts()[m_file_name];
+            }
+            
+            return;
         }
         
+        /**
+         * Writes to non-chain files (wallet.dat) are checkpointed right
+         * away, everything else is left to the byte and time budgets of
+         * the maintenance thread so we never checkpoint on the caller.
+         */
         if (
-            utility::is_chain_file(m_file_name) &&
-            utility::is_initial_block_download()
+            m_is_read_only == false &&
+            utility::is_chain_file(m_file_name) == false
             )
         {
-            minutes = 5;
+            stack_impl::get_db_env()->request_checkpoint();
         }
         
-        stack_impl::get_db_env()->get_DbEnv().txn_checkpoint(
-            minutes ? 100 * 1024 : 0, minutes, 0
-        );
-
         --stack_impl::get_db_env()->file_use_counts()[m_file_name];
     }
 }
 
-Db & db::get_Db()
+bool db::is_reader_current() const
 {
-    return *m_Db;
+    return
+        m_kv_store && m_reader_generation ==
+        stack_impl::get_db_env()->reader_generation()
+    ;
 }
 
-Dbc * db::get_cursor()
+kv_store & db::get_kv_store()
 {
-    if (m_Db)
-    {
-        Dbc * ptr_cursor = 0;
-        
-        auto ret = m_Db->cursor(0, &ptr_cursor, 0);
-        
-        if (ret != 0)
-        {
-            return 0;
-        }
-        
-        return ptr_cursor;
-    }
-
-    return 0;
+    return *m_kv_store;
 }
 
-int db::read_at_cursor(
-    Dbc * ptr_cursor, data_buffer & key, data_buffer & value,
-    const std::int32_t flags
-    )
+std::shared_ptr<kv_store::iterator> db::get_iterator()
 {
-    Dbt datKey;
-    
-    if (
-        flags == DB_SET || flags == DB_SET_RANGE || flags == DB_GET_BOTH ||
-        flags == DB_GET_BOTH_RANGE
-        )
-    {
-        datKey.set_data(key.data());
-        datKey.set_size(static_cast<std::uint32_t> (key.size()));
-    }
-    
-    Dbt datValue;
-    
-    if (flags == DB_GET_BOTH || flags == DB_GET_BOTH_RANGE)
+    if (m_kv_store)
     {
-        datValue.set_data(value.data());
-        datValue.set_size(static_cast<std::uint32_t> (value.size()));
-    }
-    
-    datKey.set_flags(DB_DBT_MALLOC);
-    datValue.set_flags(DB_DBT_MALLOC);
-    
-    int ret = ptr_cursor->get(&datKey, &datValue, flags);
-    
-    if (ret != 0)
-    {
-        return ret;
-    }
-    else if (datKey.get_data() == 0 || datValue.get_data() == 0)
-    {
-        return 99999;
+        return m_kv_store->new_iterator();
     }
 
-    key.clear();
-    key.write(reinterpret_cast<char *>(datKey.get_data()), datKey.get_size());
-    
-    value.clear();
-    value.write(
-        reinterpret_cast<char *>(datValue.get_data()), datValue.get_size()
-    );
-
-    std::memset(datKey.get_data(), 0, datKey.get_size());
-    std::memset(datValue.get_data(), 0, datValue.get_size());
-    
-    free(datKey.get_data());
-    free(datValue.get_data());
-    
-    return 0;
+    return std::shared_ptr<kv_store::iterator> ();
 }
 
 bool db::txn_begin()
 {
-    if (m_Db == 0 || m_DbTxn)
+    if (m_kv_store == nullptr || m_batch)
     {
         return false;
     }
     
-    auto ptxn = stack_impl::get_db_env()->txn_begin();
-    
-    if (ptxn == 0)
-    {
-        return false;
-    }
-    
-    m_DbTxn = ptxn;
+    m_batch.reset(new kv_store::batch());
     
     return true;
 }
 
 bool db::txn_commit()
 {
-    if (m_Db == 0 || m_DbTxn == 0)
+    if (m_kv_store == nullptr || m_batch == nullptr)
     {
         return false;
     }
     
-    auto ret = m_DbTxn->commit(0);
+    auto time_start = chain_replay::profile_start();
+    
+    auto ret = m_kv_store->write(*m_batch);
     
-    m_DbTxn = 0;
+    chain_replay::profile_stop(chain_replay::phase_db, time_start);
     
-    return ret == 0;
+    m_batch.reset();
+    
+    return ret;
 }
 
 bool db::txn_abort()
 {
-    if (m_Db == 0 || m_DbTxn == 0)
+    if (m_kv_store == nullptr || m_batch == nullptr)
     {
         return false;
     }
     
-    auto ret = m_DbTxn->abort();
-    
-    m_DbTxn = 0;
+    m_batch.reset();
     
-    return ret == 0;
+    return true;
 }
 
 bool db::rewrite(const std::string & file_name, const char * key_skip)
@@ -302,6 +324,11 @@ bool db::rewrite(const std::string & file_name, const char * key_skip)
             stack_impl::get_db_env()->file_use_counts()[file_name] == 0
             )
         {
+            if (stack_impl::get_db_env()->backend() == kv_store::backend_log)
+            {
+                return rewrite_log(file_name, key_skip);
+            }
+            
             stack_impl::get_db_env()->close_Db(file_name);
             stack_impl::get_db_env()->checkpoint_lsn(file_name);
             stack_impl::get_db_env()->file_use_counts().erase(file_name);
@@ -331,35 +358,14 @@ bool db::rewrite(const std::string & file_name, const char * key_skip)
                 success = false;
             }
 
-            auto ptr_cursor = d.get_cursor();
+            auto it = d.get_iterator();
            
-            if (ptr_cursor)
+            if (it)
             {
-                while (success)
+                for (it->seek_to_first(); success && it->valid(); it->next())
                 {
-                    /**
-                     * Read the next record.
-                     */
-                    data_buffer key, value;
+                    auto key = it->key();
                     
-                    auto ret = d.read_at_cursor(
-                        ptr_cursor, key, value, DB_NEXT
-                    );
-
-                    if (ret == DB_NOTFOUND)
-                    {
-                        ptr_cursor->close();
-                        
-                        break;
-                    }
-                    else if (ret != 0)
-                    {
-                        ptr_cursor->close();
-                        
-                        success = false;
-                        
-                        break;
-                    }
                     if (
                         key_skip && std::strncmp(key.data(), key_skip,
                         std::min(key.size(), std::strlen(key_skip))) == 0
@@ -368,6 +374,8 @@ bool db::rewrite(const std::string & file_name, const char * key_skip)
                         continue;
                     }
                     
+                    data_buffer value(it->value().data(), it->value().size());
+                    
                     /**
                      * Check if the version needs to be updated.
                      */
@@ -382,7 +390,8 @@ bool db::rewrite(const std::string & file_name, const char * key_skip)
                     }
                     
                     Dbt dbt_key(
-                        key.data(), static_cast<std::uint32_t> (key.size())
+                        const_cast<char *> (key.data()),
+                        static_cast<std::uint32_t> (key.size())
                     );
                     
                     Dbt dbt_value(
@@ -398,6 +407,8 @@ bool db::rewrite(const std::string & file_name, const char * key_skip)
                         success = false;
                     }
                 }
+                
+                it.reset();
             }
             
             if (success)
@@ -451,3 +462,167 @@ bool db::write_version(const std::int32_t & version)
 {
     return write(std::string("version"), version);
 }
+
+bool db::read_raw(const std::string & key, std::string & value)
+{
+    if (m_kv_store == nullptr)
+    {
+        return false;
+    }
+    
+    if (m_batch)
+    {
+        auto erased = false;
+        
+        if (m_batch->get(key, value, erased))
+        {
+            return erased == false;
+        }
+    }
+    
+    auto time_start = chain_replay::profile_start();
+    
+    auto ret = m_kv_store->get(key, value);
+    
+    chain_replay::profile_stop(chain_replay::phase_db, time_start);
+    
+    return ret;
+}
+
+bool db::write_raw(
+    const std::string & key, const std::string & value, const bool & overwrite
+    )
+{
+    if (m_kv_store == nullptr)
+    {
+        return false;
+    }
+    
+    if (m_batch)
+    {
+        if (overwrite == false && exists_raw(key))
+        {
+            return false;
+        }
+        
+        m_batch->put(key, value);
+        
+        return true;
+    }
+    
+    auto time_start = chain_replay::profile_start();
+    
+    auto ret = m_kv_store->put(key, value, overwrite);
+    
+    chain_replay::profile_stop(chain_replay::phase_db, time_start);
+    
+    return ret;
+}
+
+bool db::erase_raw(const std::string & key) const
+{
+    if (m_kv_store == nullptr)
+    {
+        return false;
+    }
+    
+    if (m_batch)
+    {
+        m_batch->erase(key);
+        
+        return true;
+    }
+    
+    auto time_start = chain_replay::profile_start();
+    
+    auto ret = m_kv_store->erase(key);
+    
+    chain_replay::profile_stop(chain_replay::phase_db, time_start);
+    
+    return ret;
+}
+
+bool db::exists_raw(const std::string & key) const
+{
+    if (m_kv_store == nullptr)
+    {
+        return false;
+    }
+    
+    if (m_batch)
+    {
+        std::string value;
+        
+        auto erased = false;
+        
+        if (m_batch->get(key, value, erased))
+        {
+            return erased == false;
+        }
+    }
+    
+    auto time_start = chain_replay::profile_start();
+    
+    auto ret = m_kv_store->exists(key);
+    
+    chain_replay::profile_stop(chain_replay::phase_db, time_start);
+    
+    return ret;
+}
+
+bool db::rewrite_log(const std::string & file_name, const char * key_skip)
+{
+    log_debug("DB is compacting " << file_name << ".");
+    
+    auto success = true;
+    
+    db d(file_name, "r+");
+    
+    /**
+     * Apply the key skip and the version update as a single batch, the
+     * compaction then drops the dead records.
+     */
+    kv_store::batch b;
+    
+    auto it = d.get_iterator();
+    
+    for (it->seek_to_first(); it->valid(); it->next())
+    {
+        auto & key = it->key();
+        
+        if (
+            key_skip && std::strncmp(key.data(), key_skip,
+            std::min(key.size(), std::strlen(key_skip))) == 0
+            )
+        {
+            b.erase(key);
+        }
+        else if (std::strncmp(key.data(), "\x07version", 8) == 0)
+        {
+            data_buffer value;
+            
+            value.write_uint32(constants::version_client);
+            
+            b.put(key, std::string(value.data(), value.size()));
+        }
+    }
+    
+    it.reset();
+    
+    success = d.get_kv_store().write(b);
+    
+    auto store = std::static_pointer_cast<kv_store_log> (d.m_kv_store);
+    
+    d.close();
+    
+    if (success)
+    {
+        store->compact();
+    }
+    else
+    {
+        log_error("DB rewrite " << file_name << " failed.");
+    }
+    
+    return success;
+}
@@ -27,17 +27,30 @@
 #include <sys/stat.h>
 #endif // _MSC_VER
 
+#include <algorithm>
 #include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
 
+#include <coin/db.hpp>
 #include <coin/db_env.hpp>
 #include <coin/globals.hpp>
+#include <coin/kv_store_bdb.hpp>
+#include <coin/kv_store_log.hpp>
 #include <coin/logger.hpp>
 #include <coin/utility.hpp>
 
 using namespace coin;
 
 db_env::db_env()
-    : m_DbEnv(DB_CXX_NO_EXCEPTIONS)
+    : m_backend(kv_store::backend_bdb)
+    , m_DbEnv(DB_CXX_NO_EXCEPTIONS)
+    , m_reader_generation(0)
+    , m_maintenance_stop(false)
+    , m_flush_requested(false)
+    , m_checkpoint_requested(false)
+    , m_maintenance_stats()
     , state_(state_closed)
 {
     // ...
@@ -91,6 +104,8 @@ bool db_env::open(const std::string & data_path)
         else
         {
             state_ = state_opened;
+            
+            start_maintenance();
         }
 
         return ret == 0;
@@ -109,7 +124,28 @@ void db_env::close_DbEnv()
     {
         state_ = state_closed;
         
-        std::lock_guard<std::recursive_mutex> l1(mutex_DbEnv_);
+        /**
+         * The maintenance thread must not touch the DbEnv once closed.
+         */
+        stop_maintenance();
+        
+        /**
+         * No thread may read through a Db or store closed below.
+         */
+        close_readers();
+        
+        std::unique_lock<std::recursive_mutex> l1(mutex_kv_stores_);
+        
+        for (auto & i : m_kv_stores)
+        {
+            i.second->close();
+        }
+        
+        m_kv_stores.clear();
+        
+        l1.unlock();
+        
+        std::lock_guard<std::recursive_mutex> l2(mutex_DbEnv_);
         
         auto ret = m_DbEnv.close(0);
         
@@ -129,16 +165,85 @@ void db_env::close_DbEnv()
 
 void db_env::close_Db(const std::string & file_name)
 {
-    std::lock_guard<std::recursive_mutex> l1(mutex_m_Dbs_);
+    /**
+     * Same lock order as do_flush, m_Dbs and m_kv_stores are never held
+     * together here since get_kv_store_log takes them the other way.
+     */
+    std::lock_guard<std::recursive_mutex> l1(mutex_file_use_counts_);
+    
+    std::unique_lock<std::recursive_mutex> l2(mutex_m_Dbs_);
     
     auto & ptr_Db = m_Dbs[file_name];
     
+    auto is_open = ptr_Db != 0;
+    
+    l2.unlock();
+    
+    std::unique_lock<std::recursive_mutex> l3(mutex_kv_stores_);
+    
+    auto it = m_kv_stores.find(file_name);
+    
+    is_open = is_open || it != m_kv_stores.end();
+    
+    l3.unlock();
+    
+    /**
+     * Any long-lived read handles on this file must reopen.
+     */
+    auto it_readers = m_file_reader_counts.find(file_name);
+    
+    if (is_open && it_readers != m_file_reader_counts.end())
+    {
+        if (it_readers->second > 0)
+        {
+            ++m_reader_generation;
+        }
+        
+        m_file_reader_counts.erase(it_readers);
+    }
+    
+    l2.lock();
+    
     if (ptr_Db)
     {
         ptr_Db->close(0);
         
         delete ptr_Db, ptr_Db = 0;
     }
+    
+    l2.unlock();
+    
+    l3.lock();
+    
+    it = m_kv_stores.find(file_name);
+    
+    if (it != m_kv_stores.end())
+    {
+        /**
+         * A stale reader may still hold the store, closing it stops it's
+         * compaction before the file can be opened again.
+         */
+        it->second->close();
+        
+        m_kv_stores.erase(it);
+    }
+}
+
+void db_env::close_readers()
+{
+    std::lock_guard<std::recursive_mutex> l1(mutex_file_use_counts_);
+    
+    /**
+     * Closing a reader removes it from the set.
+     */
+    auto readers = m_readers;
+    
+    for (auto & i : readers)
+    {
+        i->close();
+    }
+    
+    m_readers.clear();
 }
 
 bool db_env::remove_Db(const std::string & file_name)
@@ -180,72 +285,65 @@ void db_env::flush()
 {
     if (state_ == state_opened)
     {
-        globals::instance().io_service().post(globals::instance().strand().wrap(
-            [this]()
+        if (globals::instance().state() > globals::state_started)
         {
-            std::lock_guard<std::recursive_mutex> l1(mutex_file_use_counts_);
+            /**
+             * We are shutting down, nothing is queued behind us so detach
+             * the files, remove the logs and close the environment inline.
+             */
+            stop_maintenance();
+            
+            close_readers();
             
-            auto it = m_file_use_counts.begin();
+            do_flush();
+            
+            std::lock_guard<std::recursive_mutex> l1(mutex_file_use_counts_);
             
-            while (it != m_file_use_counts.end())
+            if (m_file_use_counts.empty())
             {
-                auto file_name = it->first;
+                char ** list = 0;
                 
-                auto reference_count = it->second;
+                std::lock_guard<std::recursive_mutex> l2(mutex_DbEnv_);
                 
-                log_debug(
-                    "Db Env " << file_name << ", reference count = " <<
-                    reference_count << "."
-                );
-
-                if (reference_count == 0)
-                {
-                    close_Db(file_name);
-
-                    log_debug("Db Env checkpoint " << file_name << ".");
-                    
-                    std::lock_guard<std::recursive_mutex> l2(mutex_DbEnv_);
-                    
-                    m_DbEnv.txn_checkpoint(0, 0, 0);
-                    
-                    static bool detach_db = true;
-                    
-                    if (
-                        utility::is_chain_file(file_name) == false || detach_db
-                        )
-                    {
-                        log_debug("Db Env detach " << file_name << ".");
-
-                        m_DbEnv.lsn_reset(file_name.c_str(), 0);
-                    }
-
-                    log_debug("Db Env closed " << file_name << ".");
-                    
-                    m_file_use_counts.erase(it++);
-                }
-                else
+                if (m_DbEnv.log_archive(&list, DB_ARCH_REMOVE) == 0)
                 {
-                    it++;
+                    std::free(list);
                 }
+                
+                close_DbEnv();
             }
-            
-            if (globals::instance().state() > globals::state_started)
+            else
             {
-                if (m_file_use_counts.empty())
-                {
-                    char ** list;
-                    
-                    std::lock_guard<std::recursive_mutex> l3(mutex_DbEnv_);
-                    
-                    m_DbEnv.log_archive(&list, DB_ARCH_REMOVE);
-                    
-                    close_DbEnv();
-                }
+                start_maintenance();
             }
-        }));
+        }
+        else
+        {
+            std::lock_guard<std::mutex> l1(mutex_maintenance_);
+            
+            m_flush_requested = true;
+            
+            condition_maintenance_.notify_one();
+        }
     }
 }
 
+void db_env::request_checkpoint()
+{
+    std::lock_guard<std::mutex> l1(mutex_maintenance_);
+    
+    m_checkpoint_requested = true;
+
+    condition_maintenance_.notify_one();
+}
+
+db_env::maintenance_stats_t db_env::maintenance_stats()
+{
+    std::lock_guard<std::mutex> l1(mutex_maintenance_stats_);
+    
+    return m_maintenance_stats;
+}
+
 DbEnv & db_env::get_DbEnv()
 {
     std::lock_guard<std::recursive_mutex> l1(mutex_DbEnv_);
@@ -260,6 +358,25 @@ std::map<std::string, std::uint32_t> & db_env::file_use_counts()
     return m_file_use_counts;
 }
 
+std::map<std::string, std::uint32_t> & db_env::file_reader_counts()
+{
+    std::lock_guard<std::recursive_mutex> l1(mutex_file_use_counts_);
+    
+    return m_file_reader_counts;
+}
+
+std::set<db *> & db_env::readers()
+{
+    std::lock_guard<std::recursive_mutex> l1(mutex_file_use_counts_);
+    
+    return m_readers;
+}
+
+std::uint32_t db_env::reader_generation() const
+{
+    return m_reader_generation;
+}
+
 std::map<std::string, Db *> & db_env::Dbs()
 {
     std::lock_guard<std::recursive_mutex> l1(mutex_m_Dbs_);
@@ -288,3 +405,416 @@ DbTxn * db_env::txn_begin(int flags)
     
     return ptr;
 }
+
+void db_env::set_backend(const kv_store::backend_t & val)
+{
+    m_backend = val;
+}
+
+const kv_store::backend_t & db_env::backend() const
+{
+    return m_backend;
+}
+
+std::shared_ptr<kv_store> db_env::get_kv_store_log(
+    const std::string & file_name
+    )
+{
+    std::lock_guard<std::recursive_mutex> l1(mutex_kv_stores_);
+    
+    auto it = m_kv_stores.find(file_name);
+    
+    if (it != m_kv_stores.end())
+    {
+        return it->second;
+    }
+    
+    auto path = filesystem::data_path() + file_name;
+    
+    /**
+     * The first time a file is opened with this backend bring over the
+     * contents of the berkley database file if there is one. Copying is
+     * idempotent so an interrupted migration is simply run again until the
+     * marker is written.
+     */
+    if (
+        std::ifstream(path + ".log/MIGRATED").good() == false &&
+        std::ifstream(path).good()
+        )
+    {
+        log_info("Db Env is migrating " << file_name << " to the log store.");
+        
+        if (migrate(file_name, kv_store::backend_bdb, kv_store::backend_log))
+        {
+            std::ofstream(path + ".log/MIGRATED") << file_name << std::endl;
+            
+            log_info("Db Env migrated " << file_name << ".");
+        }
+        else
+        {
+            log_error("Db Env failed to migrate " << file_name << ".");
+            
+            return std::shared_ptr<kv_store> ();
+        }
+    }
+    
+    auto ret = std::make_shared<kv_store_log> ();
+    
+    if (ret->open(path + ".log") == false)
+    {
+        return std::shared_ptr<kv_store> ();
+    }
+    
+    m_kv_stores[file_name] = ret;
+    
+    return ret;
+}
+
+bool db_env::migrate(
+    const std::string & file_name, const kv_store::backend_t & from,
+    const kv_store::backend_t & to
+    )
+{
+    if (from == to)
+    {
+        return true;
+    }
+    
+    std::lock_guard<std::recursive_mutex> l1(mutex_kv_stores_);
+    
+    if (m_kv_stores.count(file_name) > 0 || Dbs()[file_name] != 0)
+    {
+        log_error("Db Env cannot migrate " << file_name << ", it is open.");
+        
+        return false;
+    }
+    
+    auto path = filesystem::data_path() + file_name + ".log";
+    
+    Db d(&m_DbEnv, 0);
+    
+    auto ret = d.open(
+        0, file_name.c_str(), "main", DB_BTREE,
+        DB_THREAD | (to == kv_store::backend_bdb ? DB_CREATE : 0), 0
+    );
+    
+    if (ret != 0)
+    {
+        log_error(
+            "Db Env failed to open " << file_name << ", error = " <<
+            DbEnv::strerror(ret) << "."
+        );
+        
+        return false;
+    }
+    
+    kv_store_bdb store_bdb(d);
+    
+    kv_store_log store_log;
+    
+    std::int64_t count = -1;
+    
+    if (store_log.open(path))
+    {
+        count = from == kv_store::backend_bdb ?
+            kv_store::migrate(store_bdb, store_log) :
+            kv_store::migrate(store_log, store_bdb)
+        ;
+    }
+    
+    store_log.close();
+    
+    d.close(0);
+    
+    if (to == kv_store::backend_bdb && count >= 0)
+    {
+        checkpoint_lsn(file_name);
+        
+        /**
+         * The berkley database file is authoritative again.
+         */
+        std::remove((path + "/MIGRATED").c_str());
+    }
+    
+    log_debug("Db Env migrated " << count << " records of " << file_name << ".");
+    
+    return count >= 0;
+}
+
+void db_env::start_maintenance()
+{
+    std::lock_guard<std::mutex> l1(mutex_maintenance_);
+    
+    if (m_maintenance_thread.joinable() == false)
+    {
+        m_maintenance_stop = false;
+        
+        m_maintenance_thread = std::thread(&db_env::do_maintenance, this);
+    }
+}
+
+void db_env::stop_maintenance()
+{
+    std::unique_lock<std::mutex> l1(mutex_maintenance_);
+    
+    m_maintenance_stop = true;
+    
+    condition_maintenance_.notify_one();
+    
+    l1.unlock();
+    
+    if (
+        m_maintenance_thread.joinable() &&
+        m_maintenance_thread.get_id() != std::this_thread::get_id()
+        )
+    {
+        m_maintenance_thread.join();
+    }
+}
+
+void db_env::do_maintenance()
+{
+    auto time_last_checkpoint = std::chrono::steady_clock::now();
+    
+    std::unique_lock<std::mutex> l1(mutex_maintenance_);
+    
+    while (m_maintenance_stop == false)
+    {
+        condition_maintenance_.wait_for(
+            l1, std::chrono::seconds(maintenance_interval), [this]()
+        {
+            return
+                m_maintenance_stop || m_flush_requested ||
+                m_checkpoint_requested
+            ;
+        });
+        
+        if (m_maintenance_stop)
+        {
+            break;
+        }
+        
+        auto flush_requested = m_flush_requested;
+        
+        auto checkpoint_requested = m_checkpoint_requested;
+        
+        m_flush_requested = m_checkpoint_requested = false;
+        
+        /**
+         * Nothing below may run while holding the maintenance lock since
+         * callers on the network strand only ever wait for it briefly.
+         */
+        l1.unlock();
+        
+        if (flush_requested)
+        {
+            do_flush();
+        }
+        
+        /**
+         * Write out a slice of the dirty pages so the next checkpoint has
+         * less to do.
+         */
+        int pages = 0;
+        
+        m_DbEnv.memp_trickle(trickle_percent, &pages);
+        
+        update_log_stats();
+        
+        auto elapsed = std::chrono::steady_clock::now() - time_last_checkpoint;
+        
+        auto log_bytes_since_checkpoint =
+            maintenance_stats().log_bytes_since_checkpoint
+        ;
+        
+        if (
+            checkpoint_requested ||
+            log_bytes_since_checkpoint >= checkpoint_kbytes * 1024 ||
+            elapsed >= std::chrono::minutes(checkpoint_minutes)
+            )
+        {
+            do_checkpoint();
+            
+            update_log_stats();
+            
+            time_last_checkpoint = std::chrono::steady_clock::now();
+        }
+        
+        std::unique_lock<std::mutex> l2(mutex_maintenance_stats_);
+        
+        m_maintenance_stats.pages_trickled += pages;
+        
+        l2.unlock();
+        
+        l1.lock();
+    }
+}
+
+void db_env::do_flush()
+{
+    std::lock_guard<std::recursive_mutex> l1(mutex_file_use_counts_);
+    
+    auto it = m_file_use_counts.begin();
+    
+    while (it != m_file_use_counts.end())
+    {
+        auto file_name = it->first;
+        
+        auto reference_count = it->second;
+        
+        log_debug(
+            "Db Env " << file_name << ", reference count = " <<
+            reference_count << "."
+        );
+
+        /**
+         * Files with long-lived read handles stay open until shutdown.
+         */
+        auto is_shutting_down =
+            globals::instance().state() > globals::state_started
+        ;
+        
+        if (
+            reference_count == 0 && (is_shutting_down ||
+            m_file_reader_counts.count(file_name) == 0 ||
+            m_file_reader_counts[file_name] == 0)
+            )
+        {
+            close_Db(file_name);
+
+            log_debug("Db Env checkpoint " << file_name << ".");
+            
+            do_checkpoint();
+            
+            static bool detach_db = true;
+            
+            if (
+                m_backend == kv_store::backend_bdb &&
+                (utility::is_chain_file(file_name) == false || detach_db)
+                )
+            {
+                log_debug("Db Env detach " << file_name << ".");
+
+                m_DbEnv.lsn_reset(file_name.c_str(), 0);
+            }
+
+            log_debug("Db Env closed " << file_name << ".");
+            
+            m_file_use_counts.erase(it++);
+        }
+        else
+        {
+            it++;
+        }
+    }
+}
+
+void db_env::do_checkpoint()
+{
+    auto start = std::chrono::steady_clock::now();
+    
+    /**
+     * The DbEnv is opened with DB_THREAD so we do not take mutex_DbEnv_
+     * here, transactions may continue while the pages are written.
+     */
+    auto ret = m_DbEnv.txn_checkpoint(0, 0, 0);
+    
+    if (ret != 0)
+    {
+        log_error(
+            "Database environment checkpoint failed, error = " <<
+            DbEnv::strerror(ret) << "."
+        );
+        
+        return;
+    }
+    
+    auto milliseconds = static_cast<std::uint64_t> (
+        std::chrono::duration_cast<std::chrono::milliseconds> (
+        std::chrono::steady_clock::now() - start).count()
+    );
+    
+    /**
+     * Remove the log files that are no longer needed for recovery.
+     */
+    std::uint64_t archived = 0;
+    
+    char ** list = 0;
+    
+    if (m_DbEnv.log_archive(&list, DB_ARCH_ABS) == 0 && list)
+    {
+        for (auto i = list; *i; ++i)
+        {
+            if (std::remove(*i) == 0)
+            {
+                ++archived;
+            }
+        }
+        
+        std::free(list);
+    }
+    
+    std::lock_guard<std::mutex> l1(mutex_maintenance_stats_);
+    
+    m_maintenance_stats.checkpoints++;
+    m_maintenance_stats.checkpoint_milliseconds_last = milliseconds;
+    m_maintenance_stats.checkpoint_milliseconds_max = std::max(
+        m_maintenance_stats.checkpoint_milliseconds_max, milliseconds
+    );
+    m_maintenance_stats.checkpoint_milliseconds_total += milliseconds;
+    m_maintenance_stats.log_files_archived += archived;
+    
+    log_debug(
+        "Db Env checkpoint took " << milliseconds << " ms, archived " <<
+        archived << " log files, " << m_maintenance_stats.log_bytes <<
+        " log bytes in " << m_maintenance_stats.log_files << " files."
+    );
+}
+
+void db_env::update_log_stats()
+{
+    std::uint64_t log_bytes_since_checkpoint = 0;
+    
+    DB_LOG_STAT * stat = 0;
+    
+    if (m_DbEnv.log_stat(&stat, 0) == 0 && stat)
+    {
+        log_bytes_since_checkpoint =
+            static_cast<std::uint64_t> (stat->st_wc_mbytes) * 1048576 +
+            stat->st_wc_bytes
+        ;
+        
+        std::free(stat);
+    }
+    
+    std::uint64_t log_bytes = 0;
+    
+    std::uint64_t log_files = 0;
+    
+    char ** list = 0;
+    
+    if (m_DbEnv.log_archive(&list, DB_ARCH_ABS | DB_ARCH_LOG) == 0 && list)
+    {
+        for (auto i = list; *i; ++i)
+        {
+            std::ifstream ifs(*i, std::ios::binary | std::ios::ate);
+            
+            if (ifs.is_open())
+            {
+                log_bytes += static_cast<std::uint64_t> (ifs.tellg());
+            }
+            
+            ++log_files;
+        }
+        
+        std::free(list);
+    }
+    
+    std::lock_guard<std::mutex> l1(mutex_maintenance_stats_);
+    
+    m_maintenance_stats.log_bytes_since_checkpoint =
+        log_bytes_since_checkpoint
+    ;
+    m_maintenance_stats.log_bytes = log_bytes;
+    m_maintenance_stats.log_files = log_files;
+}
@@ -17,7 +17,11 @@
  * You should have received a copy of the GNU Affero General Public License
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
+#include <atomic>
+#include <chrono>
+#include <functional>
 #include <iomanip>
+#include <memory>
 #include <sstream>
 #include <vector>
 
@@ -33,6 +37,7 @@
 #include <coin/point_out.hpp>
 #include <coin/sha256.hpp>
 #include <coin/stack_impl.hpp>
+#include <coin/startup_graph.hpp>
 #include <coin/status_manager.hpp>
 #include <coin/transaction.hpp>
 #include <coin/transaction_pool.hpp>
@@ -45,6 +50,37 @@ db_tx::db_tx(const std::string & file_mode)
     // ...
 }
 
+db_tx::db_tx(const std::string & file_mode, const bool & is_reader)
+    : db("blkindex.dat", file_mode, is_reader)
+{
+    // ...
+}
+
+std::shared_ptr<db_tx> db_tx::reader()
+{
+    /**
+     * One handle per thread, no locks or file use count updates after the
+     * first call.
+     */
+    static thread_local std::shared_ptr<db_tx> g_reader;
+    
+    /**
+     * The borrow depth is the use count less our own reference, a handle
+     * still borrowed further up the stack is never replaced under it.
+     */
+    if (
+        g_reader == nullptr || (g_reader.use_count() == 1 &&
+        g_reader->is_reader_current() == false)
+        )
+    {
+        g_reader.reset();
+        
+        g_reader.reset(new db_tx("r", true));
+    }
+    
+    return g_reader;
+}
+
 bool db_tx::load_block_index(stack_impl & impl)
 {
     if (load_block_index_guts())
@@ -69,50 +105,193 @@ bool db_tx::load_block_index(stack_impl & impl)
         
         std::sort(sorted_by_height.begin(), sorted_by_height.end());
         
-        for (auto & i : sorted_by_height)
+        auto time_start = std::chrono::steady_clock::now();
+        
+        /**
+         * The block trust of each block index is independent of the others
+         * so it is computed in height ordered chunks on every core.
+         */
+        enum { chunk_length = 4096 };
+        
+        std::vector<big_number> trusts(sorted_by_height.size());
+        
+        std::vector<std::uint8_t> is_trusted(sorted_by_height.size(), 0);
+        
+        std::vector< std::function<void ()> > jobs;
+        
+        for (std::size_t i = 0; i < sorted_by_height.size(); i += chunk_length)
         {
-            try
+            auto end = std::min<std::size_t> (
+                i + chunk_length, sorted_by_height.size()
+            );
+            
+            jobs.push_back([i, end, &sorted_by_height, &trusts, &is_trusted]()
             {
-                i.second->m_chain_trust =
-                    (i.second->block_index_previous() ?
-                    i.second->block_index_previous()->m_chain_trust : 0) +
-                    i.second->get_block_trust()
-                ;
-            }
-            catch (std::exception & e)
+                for (auto j = i; j < end; j++)
+                {
+                    try
+                    {
+                        trusts[j] = sorted_by_height[j].second->get_block_trust();
+                        
+                        is_trusted[j] = 1;
+                    }
+                    catch (std::exception & e)
+                    {
+                        log_error("DB TX, what = " << e.what() << ".");
+                    }
+                }
+            });
+        }
+        
+        startup_graph::parallel(jobs);
+        
+        for (std::size_t i = 0; i < sorted_by_height.size(); i++)
+        {
+            const auto & index = sorted_by_height[i].second;
+            
+            /**
+             * Build the skip pointer and previous proof-of-work/stake links
+             * (in height order so the previous block index is built).
+             */
+            index->build_skip();
+            
+            if (is_trusted[i] == 0)
             {
-                log_error("DB TX, what = " << e.what() << ".");
-                
                 continue;
             }
-
-            /**
-             * Calculate the stake modifier checksum.
-             */
-            i.second->set_stake_modifier_checksum(
-                kernel::get_stake_modifier_checksum(i.second)
+            
+            index->m_chain_trust =
+                (index->block_index_previous() ?
+                index->block_index_previous()->m_chain_trust : 0) + trusts[i]
+            ;
+        }
+        
+        auto time_trust = std::chrono::steady_clock::now();
+        
+        /**
+         * The stake modifier checksums form a chain but the checkpoints pin
+         * it at known heights. The runs of heights between checkpoints are
+         * verified in parallel, each seeded with the checkpoint before it,
+         * if every checkpoint matches the result is the same as verifying
+         * the whole chain in order.
+         */
+        auto stake_modifier_checkpoints =
+            kernel::get_stake_modifier_checkpoints()
+        ;
+        
+        /**
+         * The genesis checksum is not checked so it can not seed a run.
+         */
+        stake_modifier_checkpoints.erase(0);
+        
+        std::atomic<bool> checkpoints_passed(true);
+        
+        jobs.clear();
+        
+        std::size_t begin = 0;
+        
+        std::uint32_t seed_height = 0;
+        
+        std::uint32_t seed_checksum = 0;
+        
+        while (begin < sorted_by_height.size())
+        {
+            auto it = stake_modifier_checkpoints.lower_bound(
+                sorted_by_height[begin].first
             );
-
-            if (i.second->height() > 0)
+            
+            auto end = begin;
+            
+            while (
+                end < sorted_by_height.size() &&
+                (it == stake_modifier_checkpoints.end() ||
+                sorted_by_height[end].first <= it->first)
+                )
+            {
+                end++;
+            }
+            
+            auto is_seeded = begin > 0;
+            
+            jobs.push_back(
+                [begin, end, is_seeded, seed_height, seed_checksum,
+                &sorted_by_height, &is_trusted, &checkpoints_passed]()
             {
-                if (
-                    kernel::check_stake_modifier_checkpoints(
-                    i.second->m_height, i.second->m_stake_modifier_checksum
-                    ) == false)
+                for (auto i = begin; i < end; i++)
                 {
-                    throw std::runtime_error(
-                        "failed stake modifier checkpoint"
-                    );
+                    if (is_trusted[i] == 0)
+                    {
+                        continue;
+                    }
+                    
+                    const auto & index = sorted_by_height[i].second;
+                    
+                    const auto & index_previous =
+                        index->block_index_previous()
+                    ;
                     
-                    return false;
+                    /**
+                     * Calculate the stake modifier checksum.
+                     */
+                    index->set_stake_modifier_checksum(
+                        kernel::get_stake_modifier_checksum(index,
+                        index_previous == 0 ? 0 : is_seeded &&
+                        index_previous->height() == seed_height ?
+                        seed_checksum :
+                        index_previous->stake_modifier_checksum())
+                    );
+
+                    if (
+                        index->height() > 0 &&
+                        kernel::check_stake_modifier_checkpoints(
+                        index->m_height, index->m_stake_modifier_checksum
+                        ) == false
+                        )
+                    {
+                        log_error(
+                            "DB TX failed stake modifier checkpoint at " <<
+                            index->height() << "."
+                        );
+                        
+                        checkpoints_passed = false;
+                    }
                 }
+            });
+            
+            if (it != stake_modifier_checkpoints.end())
+            {
+                seed_height = it->first;
+                seed_checksum = it->second;
             }
+            
+            begin = end;
         }
         
+        startup_graph::parallel(jobs);
+        
+        if (checkpoints_passed == false)
+        {
+            throw std::runtime_error("failed stake modifier checkpoint");
+            
+            return false;
+        }
+        
+        auto time_checksum = std::chrono::steady_clock::now();
+        
+        log_info(
+            "DB TX computed the chain trust of " << sorted_by_height.size() <<
+            " block indexes in " <<
+            std::chrono::duration_cast<std::chrono::milliseconds> (
+            time_trust - time_start).count() << " ms, verified the stake "
+            "modifier checksums in " << jobs.size() << " runs in " <<
+            std::chrono::duration_cast<std::chrono::milliseconds> (
+            time_checksum - time_trust).count() << " ms."
+        );
+        
         /**
-         * Set m_DbTxn.
+         * Begin the transaction.
          */
-        m_DbTxn = stack_impl::get_db_env()->txn_begin();
+        txn_begin();
 
         /**
          * Load the best hash chain to the end of the best chain.
@@ -604,18 +783,26 @@ bool db_tx::write_best_invalid_trust(big_number & bn)
 bool db_tx::load_block_index_guts()
 {
     /**
-     * Get database cursor.
+     * Get database iterator.
      */
-    auto * ptr_cursor = get_cursor();
+    auto it = get_iterator();
 
-    if (ptr_cursor)
+    if (it)
     {
         /**
          * Load the block index.
          */
-        std::int32_t flags = DB_SET_RANGE;
+        data_buffer key_start;
+        
+        key_start.write_var_int(strlen("blockindex"));
+        key_start.write((void *)"blockindex", strlen("blockindex"));
+        char null_digest[32] = { '\0' };
+        key_start.write(null_digest, sizeof(null_digest));
         
-        for (;;)
+        for (
+            it->seek(std::string(key_start.data(), key_start.size()));
+            it->valid(); it->next()
+            )
         {
             if (globals::instance().state() >= globals::state_stopping)
             {
@@ -625,28 +812,9 @@ bool db_tx::load_block_index_guts()
             /**
              * Read the next record.
              */
-            data_buffer key, value;
-            
-            if (flags == DB_SET_RANGE)
-            {
-                key.write_var_int(strlen("blockindex"));
-                key.write((void *)"blockindex", strlen("blockindex"));
-                char null_digest[32] = { '\0' };
-                key.write(null_digest, sizeof(null_digest));
-            }
-
-            auto ret = read_at_cursor(ptr_cursor, key, value, flags);
+            data_buffer key(it->key().data(), it->key().size());
             
-            flags = DB_NEXT;
-            
-            if (ret == DB_NOTFOUND)
-            {
-                break;
-            }
-            else if (ret != 0)
-            {
-                return false;
-            }
+            data_buffer value(it->value().data(), it->value().size());
             
             try
             {
@@ -751,8 +919,6 @@ bool db_tx::load_block_index_guts()
                 return false;
             }
         }
-        
-        ptr_cursor->close();
 
         return true;
     }
@@ -798,25 +964,32 @@ bool db_tx::reorganize(
     
     auto longer = index_new;
     
+    /**
+     * Skip both to the same height.
+     */
+    if (fork->height() > longer->height())
+    {
+        fork = block_index::get_ancestor(fork, longer->height());
+    }
+    else
+    {
+        longer = block_index::get_ancestor(longer, fork->height());
+    }
+    
     while (fork != longer)
     {
-        while (longer->height() > fork->height())
-        {
-            if (!(longer = longer->block_index_previous()))
-            {
-                return false;
-            }
-        }
-        
-        if (fork == longer)
-        {
-            break;
-        }
-        
-        if (!(fork = fork->block_index_previous()))
+        if (fork == 0 || longer == 0)
         {
             return false;
         }
+        
+        fork = fork->block_index_previous();
+        longer = longer->block_index_previous();
+    }
+    
+    if (fork == 0)
+    {
+        return false;
     }
 
     /**
@@ -978,89 +1151,25 @@ bool db_tx::read_best_invalid_trust(big_number & bn)
 
 bool db_tx::read_string(const std::string & key, std::string & val)
 {
-    if (m_Db == 0)
-    {
-        return false;
-    }
-    
-    Dbt dbt_key(
-        (void *)key.data(), static_cast<std::uint32_t> (key.size())
-    );
-    
-    Dbt dbt_value;
-    
-    dbt_value.set_flags(DB_DBT_MALLOC);
-    
-    auto ret = m_Db->get(m_DbTxn, &dbt_key, &dbt_value, 0);
-    
-    std::memset(dbt_key.get_data(), 0, dbt_key.get_size());
-    
-    if (dbt_value.get_data() == 0)
-    {
-        return false;
-    }
-    
-    try
-    {
-        /**
-         * Assign the string value.
-         */
-        val = std::string(
-            reinterpret_cast<char *>(dbt_value.get_data()),
-            dbt_value.get_size()
-        );
-    }
-    catch (std::exception & e)
-    {
-        return false;
-    }
-
-    std::memset(dbt_value.get_data(), 0, dbt_value.get_size());
-    
-    free(dbt_value.get_data());
-    
-    return ret == 0;
+    return read_raw(key, val);
 }
 
 bool db_tx::write_string(
     const std::string & key, const std::string & value, const bool & overwrite
     )
 {
-    if (m_Db == 0)
-    {
-        return false;
-    }
-
     data_buffer key_data;
 
     key_data.write_var_int(key.size());
     key_data.write((void *)key.data(), key.size());
 
-    Dbt dat_key(
-        (void *)key_data.data(), static_cast<std::uint32_t> (key_data.size())
-    );
-
-    Dbt dat_value(
-        (void *)value.data(), static_cast<std::uint32_t> (value.size())
-    );
-
-    auto ret = m_Db->put(
-        m_DbTxn, &dat_key, &dat_value, overwrite ? 0 : DB_NOOVERWRITE
-    );
+    data_buffer value_data(value.data(), value.size());
 
-    std::memset(dat_key.get_data(), 0, dat_key.get_size());
-    std::memset(dat_value.get_data(), 0, dat_value.get_size());
-    
-    return ret == 0;
+    return write_buffers(key_data, value_data, overwrite);
 }
 
 bool db_tx::read_sha256(const std::string & key, sha256 & value)
 {
-    if (m_Db == 0)
-    {
-        return false;
-    }
-    
     /**
      * Read the next record.
      */
@@ -1069,78 +1178,47 @@ bool db_tx::read_sha256(const std::string & key, sha256 & value)
     key_data.write_var_int(key.size());
     key_data.write((void *)key.c_str(), key.size());
 
-    Dbt dat_key(
-        (void *)key_data.data(), static_cast<std::uint32_t> (key_data.size())
-    );
-
-    Dbt dat_value;
-    
-    dat_value.set_flags(DB_DBT_MALLOC);
+    std::string value_data;
     
-    int ret = m_Db->get(m_DbTxn, &dat_key, &dat_value, 0);
+    auto ret = read_raw(
+        std::string(key_data.data(), key_data.size()), value_data
+    );
     
-    std::memset(dat_key.get_data(), 0, dat_key.get_size());
+    std::memset(key_data.data(), 0, key_data.size());
     
-    if (dat_value.get_data() == 0)
+    if (ret == false)
     {
         return false;
     }
     
     std::memcpy(
-        (void *)value.digest(), dat_value.get_data(), dat_value.get_size()
+        (void *)value.digest(), value_data.data(),
+        std::min<std::size_t> (value_data.size(), sha256::digest_length)
     );
 
-    std::memset(dat_value.get_data(), 0, dat_value.get_size());
-    
-    free(dat_value.get_data());
+    std::fill(value_data.begin(), value_data.end(), 0);
     
-    return ret == 0;
+    return true;
 }
 
 bool db_tx::write_sha256(
     const std::string & key, const sha256 & value, const bool & overwrite
     )
 {
-    if (m_Db == 0)
-    {
-        return false;
-    }
-
     data_buffer key_data;
 
     key_data.write_var_int(key.size());
     key_data.write((void *)key.c_str(), key.size());
 
-    Dbt dat_key(
-        (void *)key_data.data(), static_cast<std::uint32_t> (key_data.size())
-    );
-
     data_buffer value_data;
 
     value_data.write_sha256(value);
 
-    Dbt dat_value(
-        (void *)value_data.data(),
-        static_cast<std::uint32_t> (value_data.size())
-    );
-
-    auto ret = m_Db->put(
-        m_DbTxn, &dat_key, &dat_value, overwrite ? 0 : DB_NOOVERWRITE
-    );
-
-    std::memset(dat_key.get_data(), 0, dat_key.get_size());
-    std::memset(dat_value.get_data(), 0, dat_value.get_size());
-    
-    return ret == 0;
+    return write_buffers(key_data, value_data, overwrite);
 }
 
 bool db_tx::read_big_number(const std::string & key, big_number & value)
 {
-    if (m_Db == 0)
-    {
-        return false;
-    }
-    
     /**
      * Read the next record.
      */
@@ -1149,116 +1227,57 @@ bool db_tx::read_big_number(const std::string & key, big_number & value)
     key_data.write_var_int(key.size());
     key_data.write((void *)key.c_str(), key.size());
 
-    Dbt dat_key(
-        (void *)key_data.data(), static_cast<std::uint32_t> (key_data.size())
-    );
-
-    Dbt dat_value;
-    
-    dat_value.set_flags(DB_DBT_MALLOC);
+    std::string value_data;
     
-    int ret = m_Db->get(m_DbTxn, &dat_key, &dat_value, 0);
+    auto ret = read_raw(
+        std::string(key_data.data(), key_data.size()), value_data
+    );
     
-    std::memset(dat_key.get_data(), 0, dat_key.get_size());
+    std::memset(key_data.data(), 0, key_data.size());
     
-    if (dat_value.get_data() == 0)
+    if (ret == false)
+    {
         return false;
+    }
 
     value.set_vector(
-        {(std::uint8_t *)dat_value.get_data(),
-        (std::uint8_t *)dat_value.get_data() + dat_value.get_size()}
+        {(std::uint8_t *)value_data.data(),
+        (std::uint8_t *)value_data.data() + value_data.size()}
     );
 
-    std::memset(dat_value.get_data(), 0, dat_value.get_size());
-    
-    free(dat_value.get_data());
+    std::fill(value_data.begin(), value_data.end(), 0);
     
-    return ret == 0;
+    return true;
 }
 
 template<typename T>
 bool db_tx::read(const data_buffer & key, T & value)
 {
-    if (m_Db == 0)
-    {
-        return false;
-    }
-    
-    Dbt dbt_key(key.data(), static_cast<std::uint32_t> (key.size()));
-
-    Dbt dbt_value;
-    
-    dbt_value.set_flags(DB_DBT_MALLOC);
-    
-    auto ret = m_Db->get(m_DbTxn, &dbt_key, &dbt_value, 0);
+    std::string value_data;
     
-    std::memset(dbt_key.get_data(), 0, dbt_key.get_size());
-    
-    if (dbt_value.get_data() == 0)
-    {
-        return false;
-    }
-    
-    try
-    {
-        /**
-         * Allocate the data_buffer.
-         */
-        data_buffer buffer(
-            static_cast<char *>(dbt_value.get_data()), dbt_value.get_size()
-        );
-        
-        /**
-         * Decode the value from the buffer.
-         */
-        value.decode(buffer);
-    }
-    catch (std::exception & e)
+    if (
+        read_raw(std::string(key.data(), key.size()), value_data) == false
+        )
     {
         return false;
     }
-
-    std::memset(dbt_value.get_data(), 0, dbt_value.get_size());
-    
-    free(dbt_value.get_data());
     
-    return ret == 0;
+    return decode_value(value_data, value);
 }
 
 template<typename T1, typename T2>
 bool db_tx::write(const T1 & key, T2 & value, const bool & overwrite)
 {
-    if (m_Db == 0)
-    {
-        return false;
-    }
-
     data_buffer key_data;
 
     key_data.write_var_int(key.size());
     key_data.write((void *)key.data(), key.size());
 
-    Dbt dat_key(
-        (void *)key_data.data(), static_cast<std::uint32_t> (key_data.size())
-    );
-    
     data_buffer value_data;
 
     value.encode(value_data);
 
-    Dbt dat_value(
-        (void *)value_data.data(),
-        static_cast<std::uint32_t> (value_data.size())
-    );
-
-    auto ret = m_Db->put(
-        m_DbTxn, &dat_key, &dat_value, overwrite ? 0 : DB_NOOVERWRITE
-    );
-
-    std::memset(dat_key.get_data(), 0, dat_key.get_size());
-    std::memset(dat_value.get_data(), 0, dat_value.get_size());
-    
-    return ret == 0;
+    return write_buffers(key_data, value_data, overwrite);
 }
 
 template<typename T1>
@@ -1267,39 +1286,15 @@ bool db_tx::write(
     const bool & overwrite
     )
 {
-    if (m_Db == 0)
-    {
-        return false;
-    }
-
-    auto k1 = key.first;
-    auto k2 = key.second;
-    
     data_buffer key_data;
 
-    key_data.write_var_int(k1.size());
-    key_data.write_bytes(k1.data(), k1.size());
-    key_data.write_sha256(k2);
-    
-    Dbt dat_key(
-        (void *)key_data.data(), static_cast<std::uint32_t> (key_data.size())
-    );
+    key_data.write_var_int(key.first.size());
+    key_data.write_bytes(key.first.data(), key.first.size());
+    key_data.write_sha256(key.second);
     
     data_buffer value_data;
 
     value.encode(value_data);
 
-    Dbt dat_value(
-        (void *)value_data.data(),
-        static_cast<std::uint32_t> (value_data.size())
-    );
-
-    auto ret = m_Db->put(
-        m_DbTxn, &dat_key, &dat_value, overwrite ? 0 : DB_NOOVERWRITE
-    );
-
-    std::memset(dat_key.get_data(), 0, dat_key.get_size());
-    std::memset(dat_value.get_data(), 0, dat_value.get_size());
-    
-    return ret == 0;
+    return write_buffers(key_data, value_data, overwrite);
 }
@@ -73,16 +73,16 @@ db_wallet::error_t db_wallet::load(wallet & w)
             w.load_minimum_version(min_version);
         }
 
-        auto cursor = get_cursor();
+        auto it = get_iterator();
         
-        if (cursor == 0)
+        if (it == nullptr)
         {
-            log_error("Database wallet load failed to get cursor.");
+            log_error("Database wallet load failed to get iterator.");
             
             return db_wallet::error_corrupt;
         }
 
-        for (;;)
+        for (it->seek_to_first(); it->valid(); it->next())
         {
             if (globals::instance().state() >= globals::state_stopping)
             {
@@ -96,20 +96,9 @@ db_wallet::error_t db_wallet::load(wallet & w)
             /**
              * Read the next record.
              */
-            data_buffer buffer_key, buffer_value;
-
-            auto ret = read_at_cursor(cursor, buffer_key, buffer_value);
+            data_buffer buffer_key(it->key().data(), it->key().size());
             
-            if (ret == DB_NOTFOUND)
-            {
-                break;
-            }
-            else if (ret != 0)
-            {
-                log_error("Database wallet load failed to read next record.");
-                
-                return db_wallet::error_corrupt;
-            }
+            data_buffer buffer_value(it->value().data(), it->value().size());
 
             std::string type, err;
             
@@ -150,8 +139,6 @@ db_wallet::error_t db_wallet::load(wallet & w)
                 );
             }
         }
-        
-        cursor->close();
     }
     catch (std::exception & e)
     {
@@ -775,7 +762,9 @@ bool db_wallet::write_c_script(const ripemd160 & h, const script & script_redeem
     m_wallet_updated++;
     
     return write(
-        std::make_pair(std::string("cscript"), h), script_redeem, false
+        std::make_pair(std::string("cscript"), h),
+        std::vector<std::uint8_t> (script_redeem.begin(), script_redeem.end()),
+        false
     );
 }
 
@@ -836,16 +825,6 @@ bool db_wallet::write_accounting_entry(
     const bool & overwrite
     )
 {
-    if (m_Db == 0)
-    {
-        return false;
-    }
-
-    if (m_is_read_only)
-    {
-        assert(!"Write called on database in read-only mode!");
-    }
-
     data_buffer key_data;
     
     std::string key_prefix = "acentry";
@@ -856,27 +835,11 @@ bool db_wallet::write_accounting_entry(
     key_data.write((void *)entry.account().data(), entry.account().size());
     key_data.write_uint64(entry_number);
     
-    Dbt dat_key(
-        (void *)key_data.data(), static_cast<std::uint32_t> (key_data.size())
-    );
-    
     data_buffer value_data;
 
     entry.encode(value_data);
 
-    Dbt dat_value(
-        (void *)value_data.data(),
-        static_cast<std::uint32_t> (value_data.size())
-    );
-
-    auto ret = m_Db->put(
-        m_DbTxn, &dat_key, &dat_value, overwrite ? 0 : DB_NOOVERWRITE
-    );
-
-    std::memset(dat_key.get_data(), 0, dat_key.get_size());
-    std::memset(dat_value.get_data(), 0, dat_value.get_size());
-    
-    return ret == 0;
+    return write_buffers(key_data, value_data, overwrite);
 }
 
 bool db_wallet::write_accounting_entry(accounting_entry & entry)
@@ -906,69 +869,47 @@ void db_wallet::list_account_credit_debit(
 {
     bool all_accounts = account == "*";
 
-    auto ptr_cursor = get_cursor();
+    auto it = get_iterator();
     
-    if (ptr_cursor == 0)
+    if (it == nullptr)
     {
         throw std::runtime_error(
-            "db_wallet::list_account_credit_debit() : cannot create DB cursor"
+            "db_wallet::list_account_credit_debit() : cannot create DB iterator"
         );
     }
     else
     {
-        std::uint32_t flags = DB_SET_RANGE;
+        data_buffer buffer_start;
+        
+        buffer_start.write_var_int(strlen("acentry"));
+        buffer_start.write_bytes("acentry", strlen("acentry"));
+        
+        if (all_accounts)
+        {
+            buffer_start.write_var_int(0);
+        }
+        else
+        {
+            buffer_start.write_var_int(account.size());
+            buffer_start.write_bytes(account.data(), account.size());
+        }
+        
+        buffer_start.write_uint64(0);
         
-        for (;;)
+        for (
+            it->seek(std::string(buffer_start.data(), buffer_start.size()));
+            it->valid(); it->next()
+            )
         {
             /**
              * Read next key.
              */
-            data_buffer buffer_key;
-            
-            if (flags == DB_SET_RANGE)
-            {
-                buffer_key.write_var_int(strlen("acentry"));
-                buffer_key.write_bytes("acentry", strlen("acentry"));
-                
-                if (all_accounts)
-                {
-                    buffer_key.write_var_int(0);
-                }
-                else
-                {
-                    buffer_key.write_var_int(account.size());
-                    buffer_key.write_bytes(account.data(), account.size());
-                }
-                
-                buffer_key.write_uint64(0);
-            }
+            data_buffer buffer_key(it->key().data(), it->key().size());
             
             /**
              * Read the value.
              */
-            data_buffer buffer_value;
-            
-            /**
-             * Read the next record.
-             */
-            auto ret = read_at_cursor(
-                ptr_cursor, buffer_key, buffer_value, flags
-            );
-            
-            flags = DB_NEXT;
-            
-            if (ret == DB_NOTFOUND)
-            {
-                break;
-            }
-            else if (ret != 0)
-            {
-                ptr_cursor->close();
-            
-                throw std::runtime_error(
-                    "db_wallet::list_account_credit_debit() : error scanning DB"
-                );
-            }
+            data_buffer buffer_value(it->value().data(), it->value().size());
 
             /**
              * Read the type.
@@ -1016,8 +957,6 @@ void db_wallet::list_account_credit_debit(
              */
             entries.push_back(acentry);
         }
-
-        ptr_cursor->close();
     }
 }
 
@@ -77,6 +77,8 @@ static int _mkdir(const char * dir)
 
 int filesystem::error_already_exists = ERROR_ALREADY_EXISTS;
 
+std::string filesystem::g_data_path;
+
 int filesystem::create_path(const std::string & path)
 {
     if (CREATE_DIRECTORY(path.c_str()) == 0)
@@ -89,6 +91,11 @@ int filesystem::create_path(const std::string & path)
 
 std::string filesystem::data_path()
 {
+    if (g_data_path.size() > 0)
+    {
+        return g_data_path;
+    }
+    
     static const std::string bundle_id = constants::client_name;
     std::string ret;
 #if (defined _MSC_VER)
@@ -108,6 +115,19 @@ std::string filesystem::data_path()
     return ret;
 }
 
+void filesystem::set_data_path(const std::string & path)
+{
+    g_data_path = path;
+    
+    if (
+        g_data_path.size() > 0 && g_data_path.back() != '/' &&
+        g_data_path.back() != '\\'
+        )
+    {
+        g_data_path += "/";
+    }
+}
+
 std::string filesystem::home_path()
 {
     std::string ret;
@@ -37,6 +37,8 @@ globals::globals()
     , m_wallet_unlocked_mint_only(false)
     , m_last_coin_stake_search_interval(0)
     , m_option_rescan(false)
+    , m_option_compress_blocks(false)
+    , m_option_tx_reconciliation(false)
     , m_last_block_transactions(0)
     , m_last_block_size(0)
     , m_money_supply(0)
@@ -18,10 +18,9 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <openssl/rand.h>
-
 #include <coin/endian.hpp>
 #include <coin/hash.hpp>
+#include <coin/random.hpp>
 #include <coin/ripemd160.hpp>
 
 using namespace coin;
@@ -114,7 +113,7 @@ sha256 hash::sha256_random()
 {
     sha256 ret;
     
-    RAND_bytes(ret.digest(), sha256::digest_length);
+    random::bytes(ret.digest(), sha256::digest_length);
     
     return ret;
 }
@@ -63,6 +63,17 @@ const std::uint32_t & kernel::get_modifier_interval() const
 std::uint32_t kernel::get_stake_modifier_checksum(
     const std::shared_ptr<block_index> & index
     )
+{
+    return get_stake_modifier_checksum(
+        index, index->block_index_previous() ?
+        index->block_index_previous()->stake_modifier_checksum() : 0
+    );
+}
+
+std::uint32_t kernel::get_stake_modifier_checksum(
+    const std::shared_ptr<block_index> & index,
+    const std::uint32_t & checksum_previous
+    )
 {
     assert(
         index->block_index_previous() ||
@@ -75,9 +86,7 @@ std::uint32_t kernel::get_stake_modifier_checksum(
     
     if (index->block_index_previous())
     {
-        buffer.write_uint32(
-            index->block_index_previous()->stake_modifier_checksum()
-        );
+        buffer.write_uint32(checksum_previous);
     }
     
     buffer.write_uint32(index->flags());
@@ -158,7 +167,7 @@ bool kernel::compute_next_stake_modifier(
         m_modifier_interval - selection_interval
     ;
     
-    auto index_tmp = std::make_shared<block_index> (*index_previous);
+    auto index_tmp = index_previous;
     
     while (index_tmp && index_tmp->time() >= selection_intervalStart)
     {
@@ -245,7 +254,7 @@ bool kernel::compute_next_stake_modifier(
             0, index_previous->height() - height_first_candidate + 1, '-'
         );
         
-        index_tmp = std::make_shared<block_index> (*index_previous);
+        index_tmp = index_previous;
         
         while (index_tmp && index_tmp->height() >= height_first_candidate)
         {
@@ -314,7 +323,7 @@ bool kernel::get_last_stake_modifier(
         return false;
     }
     
-    auto index_tmp = std::make_shared<block_index> (*index);
+    auto index_tmp = index;
     
     while (
         index_tmp && index_tmp->block_index_previous() &&
@@ -489,17 +498,18 @@ bool kernel::check_proof_of_stake(
     auto tx_in = tx.transactions_in()[0];
     
     /**
-     * First try to find the previous transaction in database.
+     * First try to find the previous output in the stake index, it only
+     * falls back to the database when the output is not indexed.
      */
-    db_tx tx_db("r");
+    auto reader = db_tx::reader();
     
-    transaction tx_previous;
+    auto & tx_db = *reader;
     
-    transaction_index tx_index;
+    stake_index::entry_t entry_from;
     
     if (
-        tx_previous.read_from_disk(tx_db, tx_in.previous_out(),
-        tx_index) == false
+        stake_index::instance().get(tx_db, tx_in.previous_out(),
+        entry_from) == false
         )
     {
         log_debug(
@@ -521,12 +531,13 @@ bool kernel::check_proof_of_stake(
         return false;
     }
     
-    tx_db.close();
-
     /**
      * Verify the signature.
      */
-    if (script::verify_signature(tx_previous, tx, 0, true, 0) == false)
+    if (
+        script::verify_script(tx_in.script_signature(),
+        entry_from.script_public_key, tx, 0, true, 0) == false
+        )
     {
         log_error(
             "Kernel, check proof of stake failed, verify_signature"
@@ -544,31 +555,11 @@ bool kernel::check_proof_of_stake(
         return false;
     }
     
-    /**
-     * Read block header.
-     */
-    block blk;
-    
-    if (
-        blk.read_from_disk(tx_index.get_transaction_position().file_index(),
-        tx_index.get_transaction_position().block_position(), false) == false
-        )
-    {
-        log_error("Kernel, check proof of stake failed, read block failed.");
-        
-        /**
-         * Unable to read the block of the previous transaction.
-         */
-        return false;
-    }
-    
     bool print_pos = false;
     
     if (
-        check_stake_kernel_hash(bits, blk,
-        tx_index.get_transaction_position().tx_position() -
-        tx_index.get_transaction_position().block_position(), tx_previous,
-        tx_in.previous_out(), tx.time(), hash_pos, print_pos) == false
+        check_stake_kernel_hash(bits, entry_from, tx_in.previous_out(),
+        tx.time(), hash_pos, print_pos) == false
         )
     {
         log_debug(
@@ -595,8 +586,7 @@ bool kernel::check_proof_of_stake(
 }
 
 bool kernel::check_stake_kernel_hash(
-    const std::uint32_t & bits, const block & block_from,
-    const std::uint32_t & tx_previous_offset, const transaction & tx_previous,
+    const std::uint32_t & bits, const stake_index::entry_t & entry_from,
     const point_out & previous_out, const std::uint32_t time_tx,
     sha256 & hash_pos, const bool & print_pos
     )
@@ -604,14 +594,14 @@ bool kernel::check_stake_kernel_hash(
     /**
      * Check for a transaction timestamp violation.
      */
-    if (time_tx < tx_previous.time())
+    if (time_tx < entry_from.time_tx)
     {
         log_error("Kernel, check stake kernel hash failed, time violation.");
         
         return false;
     }
     
-    std::uint32_t time_block_from = block_from.header().timestamp;
+    std::uint32_t time_block_from = entry_from.time_block;
     
     /**
      * Check the minimum age requirement.
@@ -629,7 +619,7 @@ bool kernel::check_stake_kernel_hash(
     
     target_per_coin_day.set_compact(bits);
     
-    auto value_in = tx_previous.transactions_out()[previous_out.n()].value();
+    auto value_in = entry_from.value;
 
     /**
      * The weight starts from 0 at the minimum age, this increases active
@@ -637,7 +627,7 @@ bool kernel::check_stake_kernel_hash(
      * proof-of-stake difficulty is low.
      */
     std::int64_t time_weight = std::min(
-        (std::int64_t)time_tx - tx_previous.time(),
+        (std::int64_t)time_tx - entry_from.time_tx,
         (std::int64_t)constants::max_stake_age) - constants::min_stake_age
     ;
     
@@ -652,7 +642,7 @@ bool kernel::check_stake_kernel_hash(
     std::int64_t stake_modifier_time = 0;
 
     if (
-        get_kernel_stake_modifier(block_from.get_hash(), stake_modifier,
+        get_kernel_stake_modifier(entry_from.hash_block, stake_modifier,
         stake_modifier_height, stake_modifier_time, print_pos) == false
         )
 	{
@@ -661,8 +651,8 @@ bool kernel::check_stake_kernel_hash(
 
     buffer.write_uint64(stake_modifier);
     buffer.write_uint32(time_block_from);
-    buffer.write_uint32(tx_previous_offset);
-    buffer.write_uint32(tx_previous.time());
+    buffer.write_uint32(entry_from.tx_offset);
+    buffer.write_uint32(entry_from.time_tx);
     buffer.write_uint32(previous_out.n());
     buffer.write_uint32(time_tx);
     
@@ -678,16 +668,16 @@ bool kernel::check_stake_kernel_hash(
             stake_modifier << " at height = " << stake_modifier_height <<
             ", timestamp = " << stake_modifier_time <<
             " for block from height = " <<
-            globals::instance().block_indexes()[block_from.get_hash()]->height()
-            << ", timestamp = " << block_from.header().timestamp << "."
+            globals::instance().block_indexes()[entry_from.hash_block]->height()
+            << ", timestamp = " << entry_from.time_block << "."
         );
         
         log_debug(
             "Kernel, check stake kernel hash, check protocol = " <<
             "0.3" << ", modifier = " << stake_modifier <<
             ", time_block_from = " << time_block_from <<
-            ", tx_previous_offset = " << tx_previous_offset <<
-            ", time_tx_previous = " << tx_previous.time() <<
+            ", tx_previous_offset = " << entry_from.tx_offset <<
+            ", time_tx_previous = " << entry_from.time_tx <<
             ", previous_out.n = " << previous_out.n() <<
             ", time_tx = " << time_tx << ", hash_pos = " <<
             hash_pos.to_string() << "."
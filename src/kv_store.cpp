@@ -0,0 +1,321 @@
+/*
+ * Copyright (c) 2013-2014 John Connor (BM-NC49AxAjcqVcF5jNPu85Rb8MJ2d9JqZt)
+ *
+ * This file is part of coinpp.
+ *
+ * coinpp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License with
+ * additional permissions to the one published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version. For more information see LICENSE.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <coin/kv_store.hpp>
+#include <coin/logger.hpp>
+#include <coin/random.hpp>
+
+using namespace coin;
+
+kv_store::batch::batch()
+    : m_bytes(0)
+{
+    // ...
+}
+
+void kv_store::batch::put(const std::string & key, const std::string & value)
+{
+    m_last[key] = m_ops.size();
+    
+    m_ops.push_back({ op_type_put, key, value });
+    
+    m_bytes += key.size() + value.size();
+}
+
+void kv_store::batch::erase(const std::string & key)
+{
+    m_last[key] = m_ops.size();
+    
+    m_ops.push_back({ op_type_erase, key, std::string() });
+    
+    m_bytes += key.size();
+}
+
+bool kv_store::batch::get(
+    const std::string & key, std::string & value, bool & erased
+    ) const
+{
+    auto it = m_last.find(key);
+    
+    if (it != m_last.end())
+    {
+        const auto & op = m_ops[it->second];
+        
+        erased = op.type == op_type_erase;
+        
+        if (erased == false)
+        {
+            value = op.value;
+        }
+        
+        return true;
+    }
+    
+    return false;
+}
+
+const std::vector<kv_store::batch::op_t> & kv_store::batch::ops() const
+{
+    return m_ops;
+}
+
+const std::size_t & kv_store::batch::bytes() const
+{
+    return m_bytes;
+}
+
+void kv_store::batch::clear()
+{
+    m_ops.clear();
+    m_last.clear();
+    m_bytes = 0;
+}
+
+std::int64_t kv_store::migrate(
+    kv_store & from, kv_store & to, const std::size_t & batch_bytes
+    )
+{
+    std::int64_t ret = 0;
+    
+    /**
+     * Copy from a snapshot (if the backend has them) so writes that race
+     * the migration do not tear it.
+     */
+    auto snap = from.get_snapshot();
+    
+    auto it = from.new_iterator(snap.get());
+    
+    batch b;
+    
+    for (it->seek_to_first(); it->valid(); it->next())
+    {
+        b.put(it->key(), it->value());
+        
+        ++ret;
+        
+        if (b.bytes() >= batch_bytes)
+        {
+            if (to.write(b) == false)
+            {
+                log_error("KV store migrate failed after " << ret << " keys.");
+                
+                return -1;
+            }
+            
+            b.clear();
+        }
+    }
+    
+    if (b.ops().size() > 0 && to.write(b) == false)
+    {
+        log_error("KV store migrate failed after " << ret << " keys.");
+        
+        return -1;
+    }
+    
+    to.flush();
+    
+    return ret;
+}
+
+void kv_store::benchmark(kv_store & store, const std::size_t & count)
+{
+    enum { value_length = 128, batch_length = 1000 };
+    
+    random::fast gen(0x6b7673746f7265);
+    
+    std::vector<std::string> keys;
+    
+    keys.reserve(count);
+    
+    /**
+     * Hash-like keys, the chain workload is keyed by sha256 digests.
+     */
+    for (std::size_t i = 0; i < count; i++)
+    {
+        std::string key(32, 0);
+        
+        for (std::size_t j = 0; j < key.size(); j += 8)
+        {
+            auto r = gen();
+            
+            std::memcpy(&key[j], &r, 8);
+        }
+        
+        keys.push_back(key);
+    }
+    
+    std::string value(value_length, 'v');
+    
+    auto report = [&count](
+        const char * name, const std::chrono::steady_clock::time_point & start
+        )
+    {
+        auto elapsed = std::chrono::duration<double> (
+            std::chrono::steady_clock::now() - start
+        ).count();
+        
+        printf(
+            "Test kv_store benchmark: %-16s %10.0f ops/s (%.3f s)\n", name,
+            count / elapsed, elapsed
+        );
+    };
+    
+    /**
+     * Single puts.
+     */
+    auto start = std::chrono::steady_clock::now();
+    
+    for (std::size_t i = 0; i < count / 2; i++)
+    {
+        store.put(keys[i], value);
+    }
+    
+    store.flush();
+    
+    auto elapsed = std::chrono::duration<double> (
+        std::chrono::steady_clock::now() - start
+    ).count();
+    
+    printf(
+        "Test kv_store benchmark: %-16s %10.0f ops/s (%.3f s)\n", "put",
+        (count / 2) / elapsed, elapsed
+    );
+    
+    /**
+     * Batched puts.
+     */
+    start = std::chrono::steady_clock::now();
+    
+    batch b;
+    
+    for (auto i = count / 2; i < count; i++)
+    {
+        b.put(keys[i], value);
+        
+        if (b.ops().size() == batch_length)
+        {
+            store.write(b);
+            
+            b.clear();
+        }
+    }
+    
+    if (b.ops().size() > 0)
+    {
+        store.write(b);
+    }
+    
+    store.flush();
+    
+    elapsed = std::chrono::duration<double> (
+        std::chrono::steady_clock::now() - start
+    ).count();
+    
+    printf(
+        "Test kv_store benchmark: %-16s %10.0f ops/s (%.3f s)\n", "batch put",
+        (count - count / 2) / elapsed, elapsed
+    );
+    
+    /**
+     * Random reads of present keys.
+     */
+    std::size_t found = 0;
+    
+    start = std::chrono::steady_clock::now();
+    
+    for (std::size_t i = 0; i < count; i++)
+    {
+        std::string v;
+        
+        if (store.get(keys[gen() % count], v))
+        {
+            ++found;
+        }
+    }
+    
+    report("get", start);
+    
+    /**
+     * Lookups of missing keys, the common case for already_have.
+     */
+    start = std::chrono::steady_clock::now();
+    
+    for (std::size_t i = 0; i < count; i++)
+    {
+        auto key = keys[i];
+        
+        key[0] ^= 0x5a, key[31] ^= 0xa5;
+        
+        if (store.exists(key))
+        {
+            ++found;
+        }
+    }
+    
+    report("exists (miss)", start);
+    
+    /**
+     * A full ordered scan.
+     */
+    std::size_t scanned = 0;
+    
+    start = std::chrono::steady_clock::now();
+    
+    auto it = store.new_iterator();
+    
+    for (it->seek_to_first(); it->valid(); it->next())
+    {
+        ++scanned;
+    }
+    
+    report("iterate", start);
+    
+    /**
+     * Overwrite and erase, the spent/unspent flip of transaction indexes.
+     */
+    start = std::chrono::steady_clock::now();
+    
+    for (std::size_t i = 0; i < count; i++)
+    {
+        if (i % 2)
+        {
+            store.erase(keys[i]);
+        }
+        else
+        {
+            store.put(keys[i], value);
+        }
+    }
+    
+    store.flush();
+    
+    report("overwrite/erase", start);
+    
+    printf(
+        "Test kv_store benchmark: found = %zu, scanned = %zu.\n", found,
+        scanned
+    );
+}
@@ -0,0 +1,367 @@
+/*
+ * Copyright (c) 2013-2014 John Connor (BM-NC49AxAjcqVcF5jNPu85Rb8MJ2d9JqZt)
+ *
+ * This file is part of coinpp.
+ *
+ * coinpp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License with
+ * additional permissions to the one published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version. For more information see LICENSE.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include <coin/db_env.hpp>
+#include <coin/kv_store_bdb.hpp>
+#include <coin/logger.hpp>
+#include <coin/stack_impl.hpp>
+
+using namespace coin;
+
+namespace coin {
+
+    /**
+     * Implements a kv_store::iterator over a Dbc.
+     */
+    class kv_store_bdb_iterator : public kv_store::iterator
+    {
+        public:
+        
+            /**
+             * Constructor
+             * @param d The Db.
+             */
+            explicit kv_store_bdb_iterator(Db & d)
+                : m_Dbc(0)
+                , m_valid(false)
+            {
+                if (d.cursor(0, &m_Dbc, 0) != 0)
+                {
+                    m_Dbc = 0;
+                }
+            }
+        
+            /**
+             * Destructor
+             */
+            ~kv_store_bdb_iterator()
+            {
+                if (m_Dbc)
+                {
+                    m_Dbc->close();
+                }
+                
+                wipe();
+            }
+        
+            /**
+             * kv_store::iterator::seek_to_first
+             */
+            virtual void seek_to_first()
+            {
+                read(DB_FIRST);
+            }
+        
+            /**
+             * kv_store::iterator::seek
+             */
+            virtual void seek(const std::string & key)
+            {
+                m_key = key;
+                
+                read(DB_SET_RANGE);
+            }
+        
+            /**
+             * kv_store::iterator::next
+             */
+            virtual void next()
+            {
+                read(DB_NEXT);
+            }
+        
+            /**
+             * kv_store::iterator::valid
+             */
+            virtual bool valid() const
+            {
+                return m_valid;
+            }
+        
+            /**
+             * kv_store::iterator::key
+             */
+            virtual const std::string & key() const
+            {
+                return m_key;
+            }
+        
+            /**
+             * kv_store::iterator::value
+             */
+            virtual const std::string & value() const
+            {
+                return m_value;
+            }
+        
+        private:
+        
+            /**
+             * Reads at the cursor.
+             * @param flags The flags.
+             */
+            void read(const std::uint32_t & flags)
+            {
+                m_valid = false;
+                
+                if (m_Dbc == 0)
+                {
+                    return;
+                }
+                
+                Dbt dbt_key;
+                
+                std::string seek_key;
+                
+                if (flags == DB_SET_RANGE)
+                {
+                    seek_key = m_key;
+                    
+                    dbt_key.set_data(const_cast<char *> (seek_key.data()));
+                    dbt_key.set_size(
+                        static_cast<std::uint32_t> (seek_key.size())
+                    );
+                }
+                
+                auto ptr_seek_key = dbt_key.get_data();
+                
+                Dbt dbt_value;
+                
+                dbt_key.set_flags(DB_DBT_MALLOC);
+                dbt_value.set_flags(DB_DBT_MALLOC);
+                
+                auto ret = m_Dbc->get(&dbt_key, &dbt_value, flags);
+                
+                wipe();
+                
+                if (ret == 0 && dbt_key.get_data() && dbt_value.get_data())
+                {
+                    m_key.assign(
+                        static_cast<char *> (dbt_key.get_data()),
+                        dbt_key.get_size()
+                    );
+                    m_value.assign(
+                        static_cast<char *> (dbt_value.get_data()),
+                        dbt_value.get_size()
+                    );
+                    
+                    m_valid = true;
+                }
+                else if (ret != 0 && ret != DB_NOTFOUND)
+                {
+                    log_error(
+                        "KV store bdb cursor failed, error = " <<
+                        DbEnv::strerror(ret) << "."
+                    );
+                }
+                
+                if (dbt_key.get_data() && dbt_key.get_data() != ptr_seek_key)
+                {
+                    std::memset(dbt_key.get_data(), 0, dbt_key.get_size());
+                    
+                    free(dbt_key.get_data());
+                }
+                
+                if (dbt_value.get_data())
+                {
+                    std::memset(dbt_value.get_data(), 0, dbt_value.get_size());
+                    
+                    free(dbt_value.get_data());
+                }
+                
+                std::fill(seek_key.begin(), seek_key.end(), 0);
+            }
+        
+            /**
+             * Zeroes the copies of the last key/value pair.
+             */
+            void wipe()
+            {
+                std::fill(m_key.begin(), m_key.end(), 0);
+                std::fill(m_value.begin(), m_value.end(), 0);
+                
+                m_key.clear();
+                m_value.clear();
+            }
+        
+            /**
+             * The Dbc.
+             */
+            Dbc * m_Dbc;
+        
+            /**
+             * If true the cursor is positioned at a key.
+             */
+            bool m_valid;
+        
+            /**
+             * The key.
+             */
+            std::string m_key;
+        
+            /**
+             * The value.
+             */
+            std::string m_value;
+    };
+    
+} // namespace coin
+
+kv_store_bdb::kv_store_bdb(Db & d)
+    : m_Db(d)
+{
+    // ...
+}
+
+bool kv_store_bdb::get(
+    const std::string & key, std::string & value, const snapshot * snap
+    )
+{
+    Dbt dbt_key(
+        const_cast<char *> (key.data()), static_cast<std::uint32_t> (key.size())
+    );
+
+    Dbt dbt_value;
+    
+    dbt_value.set_flags(DB_DBT_MALLOC);
+    
+    auto ret = m_Db.get(0, &dbt_key, &dbt_value, 0);
+    
+    if (dbt_value.get_data() == 0)
+    {
+        return false;
+    }
+    
+    value.assign(
+        static_cast<char *> (dbt_value.get_data()), dbt_value.get_size()
+    );
+    
+    std::memset(dbt_value.get_data(), 0, dbt_value.get_size());
+    
+    free(dbt_value.get_data());
+    
+    return ret == 0;
+}
+
+bool kv_store_bdb::exists(const std::string & key)
+{
+    Dbt dbt_key(
+        const_cast<char *> (key.data()), static_cast<std::uint32_t> (key.size())
+    );
+
+    return m_Db.exists(0, &dbt_key, 0) == 0;
+}
+
+bool kv_store_bdb::put(
+    const std::string & key, const std::string & value, const bool & overwrite
+    )
+{
+    return put(0, key, value, overwrite);
+}
+
+bool kv_store_bdb::erase(const std::string & key)
+{
+    return erase(0, key);
+}
+
+bool kv_store_bdb::write(const batch & b)
+{
+    if (b.ops().size() == 0)
+    {
+        return true;
+    }
+    
+    auto ptr_DbTxn = stack_impl::get_db_env()->txn_begin();
+    
+    if (ptr_DbTxn == 0)
+    {
+        return false;
+    }
+    
+    for (auto & i : b.ops())
+    {
+        auto success =
+            i.type == batch::op_type_put ?
+            put(ptr_DbTxn, i.key, i.value, true) : erase(ptr_DbTxn, i.key)
+        ;
+        
+        if (success == false)
+        {
+            ptr_DbTxn->abort();
+            
+            return false;
+        }
+    }
+    
+    return ptr_DbTxn->commit(0) == 0;
+}
+
+std::shared_ptr<kv_store::iterator> kv_store_bdb::new_iterator(
+    const snapshot * snap
+    )
+{
+    return std::make_shared<kv_store_bdb_iterator> (m_Db);
+}
+
+std::shared_ptr<kv_store::snapshot> kv_store_bdb::get_snapshot()
+{
+    return std::shared_ptr<snapshot> ();
+}
+
+void kv_store_bdb::flush()
+{
+    stack_impl::get_db_env()->request_checkpoint();
+}
+
+bool kv_store_bdb::put(
+    DbTxn * ptr_DbTxn, const std::string & key, const std::string & value,
+    const bool & overwrite
+    )
+{
+    Dbt dbt_key(
+        const_cast<char *> (key.data()), static_cast<std::uint32_t> (key.size())
+    );
+    
+    Dbt dbt_value(
+        const_cast<char *> (value.data()),
+        static_cast<std::uint32_t> (value.size())
+    );
+
+    auto ret = m_Db.put(
+        ptr_DbTxn, &dbt_key, &dbt_value, overwrite ? 0 : DB_NOOVERWRITE
+    );
+    
+    return ret == 0;
+}
+
+bool kv_store_bdb::erase(DbTxn * ptr_DbTxn, const std::string & key)
+{
+    Dbt dbt_key(
+        const_cast<char *> (key.data()), static_cast<std::uint32_t> (key.size())
+    );
+
+    auto ret = m_Db.del(ptr_DbTxn, &dbt_key, 0);
+    
+    return ret == 0 || ret == DB_NOTFOUND;
+}
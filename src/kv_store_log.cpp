@@ -0,0 +1,1590 @@
+/*
+ * Copyright (c) 2013-2014 John Connor (BM-NC49AxAjcqVcF5jNPu85Rb8MJ2d9JqZt)
+ *
+ * This file is part of coinpp.
+ *
+ * coinpp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License with
+ * additional permissions to the one published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version. For more information see LICENSE.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if (defined _MSC_VER)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif // _MSC_VER
+
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+#include <boost/crc.hpp>
+
+#include <coin/filesystem.hpp>
+#include <coin/kv_store_log.hpp>
+#include <coin/logger.hpp>
+
+using namespace coin;
+
+/**
+ * The record header is the magic, the payload length and the CRC-32 of
+ * the payload. The payload is the sequence, the operation count and then
+ * for each operation its type, key length, value length, key and value.
+ * Integers are stored in host byte order.
+ */
+enum
+{
+    record_magic = 0x6b766c67,
+    record_header_length = 12,
+    record_length_maximum = 256 * 1024 * 1024,
+};
+
+static bool sync_file(std::FILE * f)
+{
+    if (std::fflush(f) != 0)
+    {
+        return false;
+    }
+#if (defined _MSC_VER)
+    return _commit(_fileno(f)) == 0;
+#else
+    return fsync(fileno(f)) == 0;
+#endif // _MSC_VER
+}
+
+static bool truncate_file(std::FILE * f, const std::uint64_t & length)
+{
+    std::fflush(f);
+#if (defined _MSC_VER)
+    return _chsize_s(_fileno(f), length) == 0;
+#else
+    return ftruncate(fileno(f), static_cast<off_t> (length)) == 0;
+#endif // _MSC_VER
+}
+
+template<typename T>
+static void put_integer(std::string & buf, const T & val)
+{
+    buf.append(reinterpret_cast<const char *> (&val), sizeof(val));
+}
+
+template<typename T>
+static bool get_integer(
+    const std::string & buf, std::size_t & pos, T & val
+    )
+{
+    if (pos + sizeof(val) > buf.size())
+    {
+        return false;
+    }
+    
+    std::memcpy(&val, buf.data() + pos, sizeof(val));
+    
+    pos += sizeof(val);
+    
+    return true;
+}
+
+static std::uint32_t checksum(const std::string & buf)
+{
+    boost::crc_32_type crc;
+    
+    crc.process_bytes(buf.data(), buf.size());
+    
+    return crc.checksum();
+}
+
+/**
+ * A decoded record operation.
+ */
+typedef struct record_op_s
+{
+    std::uint8_t type;
+    std::string key;
+    std::size_t value_position;
+    std::uint32_t value_length;
+} record_op_t;
+
+/**
+ * Decodes a record payload.
+ */
+static bool decode_payload(
+    const std::string & payload, std::uint64_t & sequence,
+    std::vector<record_op_t> & ops
+    )
+{
+    std::size_t pos = 0;
+    
+    std::uint32_t count = 0;
+    
+    if (
+        get_integer(payload, pos, sequence) == false ||
+        get_integer(payload, pos, count) == false
+        )
+    {
+        return false;
+    }
+    
+    ops.clear();
+    
+    for (std::uint32_t i = 0; i < count; i++)
+    {
+        record_op_t op;
+        
+        std::uint32_t key_length = 0;
+        
+        if (
+            get_integer(payload, pos, op.type) == false ||
+            get_integer(payload, pos, key_length) == false ||
+            get_integer(payload, pos, op.value_length) == false ||
+            pos + key_length + op.value_length > payload.size()
+            )
+        {
+            return false;
+        }
+        
+        op.key.assign(payload.data() + pos, key_length);
+        
+        pos += key_length;
+        
+        op.value_position = pos;
+        
+        pos += op.value_length;
+        
+        ops.push_back(op);
+    }
+    
+    return pos == payload.size();
+}
+
+/**
+ * Reads the record at the file position.
+ * @return 1 on success, 0 at a clean end of file and -1 on a torn or
+ * corrupt record.
+ */
+static int read_record(std::FILE * f, std::string & payload)
+{
+    char header[record_header_length];
+    
+    auto len = std::fread(header, 1, sizeof(header), f);
+    
+    if (len == 0)
+    {
+        return 0;
+    }
+    else if (len != sizeof(header))
+    {
+        return -1;
+    }
+    
+    std::uint32_t magic, length, crc;
+    
+    std::memcpy(&magic, header, 4);
+    std::memcpy(&length, header + 4, 4);
+    std::memcpy(&crc, header + 8, 4);
+    
+    if (magic != record_magic || length > record_length_maximum)
+    {
+        return -1;
+    }
+    
+    payload.resize(length);
+    
+    if (
+        length > 0 && std::fread(&payload[0], 1, length, f) != length
+        )
+    {
+        return -1;
+    }
+    
+    return checksum(payload) == crc ? 1 : -1;
+}
+
+namespace coin {
+
+    /**
+     * A kv_store_log snapshot, a sequence number plus a hold on the
+     * version history.
+     */
+    class kv_store_log_snapshot : public kv_store::snapshot
+    {
+        public:
+        
+            /**
+             * Constructor
+             * @param owner The kv_store_log.
+             * @param sequence The sequence.
+             */
+            kv_store_log_snapshot(
+                kv_store_log & owner, const std::uint64_t & sequence
+                )
+                : m_owner(owner)
+                , m_sequence(sequence)
+            {
+                // ...
+            }
+        
+            /**
+             * Destructor
+             */
+            ~kv_store_log_snapshot()
+            {
+                m_owner.release_snapshot();
+            }
+        
+            /**
+             * The sequence.
+             */
+            const std::uint64_t & sequence() const
+            {
+                return m_sequence;
+            }
+        
+        private:
+        
+            /**
+             * The kv_store_log.
+             */
+            kv_store_log & m_owner;
+        
+            /**
+             * The sequence.
+             */
+            std::uint64_t m_sequence;
+    };
+    
+    /**
+     * A kv_store_log iterator. It keeps only the current key and looks up
+     * the successor in the index on every step so concurrent writes never
+     * invalidate it.
+     */
+    class kv_store_log_iterator : public kv_store::iterator
+    {
+        public:
+        
+            /**
+             * Constructor
+             * @param owner The kv_store_log.
+             * @param snap The kv_store_log_snapshot (if any).
+             */
+            kv_store_log_iterator(
+                kv_store_log & owner, const kv_store_log_snapshot * snap
+                )
+                : m_owner(owner)
+                , m_sequence(
+                    snap ? snap->sequence() :
+                    std::numeric_limits<std::uint64_t>::max()
+                )
+                , m_has_snapshot(snap != 0)
+                , m_is_valid(false)
+            {
+                // ...
+            }
+        
+            virtual void seek_to_first()
+            {
+                position(std::string(), true);
+            }
+        
+            virtual void seek(const std::string & key)
+            {
+                position(key, true);
+            }
+        
+            virtual void next()
+            {
+                if (m_is_valid)
+                {
+                    position(m_key, false);
+                }
+            }
+        
+            virtual bool valid() const
+            {
+                return m_is_valid;
+            }
+        
+            virtual const std::string & key() const
+            {
+                return m_key;
+            }
+        
+            virtual const std::string & value() const
+            {
+                return m_value;
+            }
+        
+        private:
+        
+            /**
+             * Positions at the first visible key at or after key.
+             * @param key The key.
+             * @param inclusive If false key itself is skipped.
+             */
+            void position(std::string key, bool inclusive)
+            {
+                m_is_valid = false;
+                
+                kv_store_log::location_t loc;
+                
+                std::shared_ptr<kv_store_log::segment_t> segment;
+                
+                {
+                    std::lock_guard<std::mutex> l1(m_owner.mutex_);
+                    
+                    for (;;)
+                    {
+                        const std::string * candidate = 0;
+                        
+                        auto it = inclusive ?
+                            m_owner.m_index.lower_bound(key) :
+                            m_owner.m_index.upper_bound(key)
+                        ;
+                        
+                        if (it != m_owner.m_index.end())
+                        {
+                            candidate = &it->first;
+                        }
+                        
+                        /**
+                         * Keys erased after the snapshot only live in the
+                         * history.
+                         */
+                        if (m_has_snapshot)
+                        {
+                            auto it2 = inclusive ?
+                                m_owner.m_history.lower_bound(key) :
+                                m_owner.m_history.upper_bound(key)
+                            ;
+                            
+                            if (
+                                it2 != m_owner.m_history.end() &&
+                                (candidate == 0 || it2->first < *candidate)
+                                )
+                            {
+                                candidate = &it2->first;
+                            }
+                        }
+                        
+                        if (candidate == 0)
+                        {
+                            return;
+                        }
+                        
+                        key = *candidate;
+                        
+                        inclusive = false;
+                        
+                        if (m_owner.find(key, m_sequence, loc))
+                        {
+                            auto it3 = m_owner.m_segments.find(loc.segment);
+                            
+                            if (it3 != m_owner.m_segments.end())
+                            {
+                                segment = it3->second;
+                            }
+                            
+                            break;
+                        }
+                    }
+                }
+                
+                m_key = key;
+                
+                m_is_valid = m_owner.read_value(segment, loc, m_value);
+            }
+        
+            /**
+             * The kv_store_log.
+             */
+            kv_store_log & m_owner;
+        
+            /**
+             * The sequence.
+             */
+            std::uint64_t m_sequence;
+        
+            /**
+             * If true we iterate a snapshot.
+             */
+            bool m_has_snapshot;
+        
+            /**
+             * If true we are positioned at a key.
+             */
+            bool m_is_valid;
+        
+            /**
+             * The key.
+             */
+            std::string m_key;
+        
+            /**
+             * The value.
+             */
+            std::string m_value;
+    };
+    
+} // namespace coin
+
+kv_store_log::segment_s::~segment_s()
+{
+    if (file)
+    {
+        std::fclose(file);
+    }
+    
+    /**
+     * Retired segments are removed once the last reader lets go of them.
+     */
+    if (is_obsolete)
+    {
+        std::remove(path.c_str());
+    }
+}
+
+kv_store_log::kv_store_log(const std::size_t & segment_bytes)
+    : m_segment_length(segment_bytes)
+    , m_snapshots(0)
+    , m_sequence(0)
+    , m_compaction_stop(false)
+{
+    // ...
+}
+
+kv_store_log::~kv_store_log()
+{
+    close();
+}
+
+bool kv_store_log::open(const std::string & path)
+{
+    close();
+    
+    m_path = path;
+    
+    filesystem::create_path(m_path);
+    
+    std::vector<std::uint32_t> ids;
+    
+    std::ifstream ifs(m_path + "/MANIFEST");
+    
+    std::uint32_t id;
+    
+    while (ifs >> id)
+    {
+        ids.push_back(id);
+    }
+    
+    std::lock_guard<std::mutex> l1(mutex_write_);
+    
+    for (std::size_t i = 0; i < ids.size(); i++)
+    {
+        auto segment = std::make_shared<segment_t> ();
+        
+        segment->id = ids[i];
+        segment->path = m_path + "/" + std::to_string(ids[i]) + ".seg";
+        segment->bytes = segment->live_bytes = 0;
+        segment->is_obsolete = false;
+        segment->file = std::fopen(
+            segment->path.c_str(), i + 1 == ids.size() ? "a+b" : "rb"
+        );
+        
+        if (segment->file == 0)
+        {
+            log_error("KV store log failed to open " << segment->path << ".");
+            
+            return false;
+        }
+        
+        {
+            std::lock_guard<std::mutex> l2(mutex_);
+            
+            m_segments[segment->id] = segment;
+        }
+        
+        if (replay(segment, i + 1 == ids.size()) == false)
+        {
+            log_error("KV store log segment " << segment->path << " is corrupt.");
+            
+            return false;
+        }
+        
+        m_segment_active = segment;
+    }
+    
+    if (m_segment_active == nullptr && rotate() == false)
+    {
+        return false;
+    }
+    
+    log_debug(
+        "KV store log opened " << m_path << ", " << m_index.size() <<
+        " keys in " << m_segments.size() << " segments."
+    );
+    
+    m_compaction_stop = false;
+    
+    m_compaction_thread = std::thread(&kv_store_log::do_compaction, this);
+    
+    return true;
+}
+
+void kv_store_log::close()
+{
+    {
+        std::lock_guard<std::mutex> l1(mutex_);
+        
+        m_compaction_stop = true;
+        
+        condition_compaction_.notify_all();
+    }
+    
+    if (m_compaction_thread.joinable())
+    {
+        m_compaction_thread.join();
+    }
+    
+    std::lock_guard<std::mutex> l1(mutex_write_);
+    
+    if (m_segment_active)
+    {
+        std::lock_guard<std::mutex> l2(m_segment_active->mutex);
+        
+        sync_file(m_segment_active->file);
+    }
+    
+    std::lock_guard<std::mutex> l2(mutex_);
+    
+    m_segment_active.reset();
+    m_segments.clear();
+    m_index.clear();
+    m_history.clear();
+    m_sequence = 0;
+}
+
+bool kv_store_log::get(
+    const std::string & key, std::string & value, const snapshot * snap
+    )
+{
+    location_t loc;
+    
+    std::shared_ptr<segment_t> segment;
+    
+    {
+        std::lock_guard<std::mutex> l1(mutex_);
+        
+        auto sequence =
+            snap ? static_cast<const kv_store_log_snapshot *> (
+            snap)->sequence() : std::numeric_limits<std::uint64_t>::max()
+        ;
+        
+        if (find(key, sequence, loc) == false)
+        {
+            return false;
+        }
+        
+        auto it = m_segments.find(loc.segment);
+        
+        if (it == m_segments.end())
+        {
+            return false;
+        }
+        
+        segment = it->second;
+    }
+    
+    return read_value(segment, loc, value);
+}
+
+bool kv_store_log::exists(const std::string & key)
+{
+    std::lock_guard<std::mutex> l1(mutex_);
+    
+    return m_index.count(key) > 0;
+}
+
+bool kv_store_log::put(
+    const std::string & key, const std::string & value, const bool & overwrite
+    )
+{
+    std::lock_guard<std::mutex> l1(mutex_write_);
+    
+    if (overwrite == false && exists(key))
+    {
+        return false;
+    }
+    
+    batch b;
+    
+    b.put(key, value);
+    
+    return append(b);
+}
+
+bool kv_store_log::erase(const std::string & key)
+{
+    std::lock_guard<std::mutex> l1(mutex_write_);
+    
+    if (exists(key) == false)
+    {
+        return true;
+    }
+    
+    batch b;
+    
+    b.erase(key);
+    
+    return append(b);
+}
+
+bool kv_store_log::write(const batch & b)
+{
+    if (b.ops().size() == 0)
+    {
+        return true;
+    }
+    
+    std::lock_guard<std::mutex> l1(mutex_write_);
+    
+    return append(b);
+}
+
+std::shared_ptr<kv_store::iterator> kv_store_log::new_iterator(
+    const snapshot * snap
+    )
+{
+    return std::make_shared<kv_store_log_iterator> (
+        *this, static_cast<const kv_store_log_snapshot *> (snap)
+    );
+}
+
+std::shared_ptr<kv_store::snapshot> kv_store_log::get_snapshot()
+{
+    std::lock_guard<std::mutex> l1(mutex_);
+    
+    ++m_snapshots;
+    
+    return std::make_shared<kv_store_log_snapshot> (*this, m_sequence);
+}
+
+void kv_store_log::flush()
+{
+    std::lock_guard<std::mutex> l1(mutex_write_);
+    
+    if (m_segment_active)
+    {
+        std::lock_guard<std::mutex> l2(m_segment_active->mutex);
+        
+        sync_file(m_segment_active->file);
+    }
+}
+
+void kv_store_log::compact()
+{
+    std::vector<std::uint32_t> ids;
+    
+    {
+        std::lock_guard<std::mutex> l1(mutex_);
+        
+        for (auto & i : m_segments)
+        {
+            if (i.second != m_segment_active)
+            {
+                ids.push_back(i.first);
+            }
+        }
+    }
+    
+    for (auto & i : ids)
+    {
+        compact_segment(i);
+    }
+}
+
+std::size_t kv_store_log::size()
+{
+    std::lock_guard<std::mutex> l1(mutex_);
+    
+    return m_index.size();
+}
+
+std::uint64_t kv_store_log::bytes_on_disk()
+{
+    std::lock_guard<std::mutex> l1(mutex_);
+    
+    std::uint64_t ret = 0;
+    
+    for (auto & i : m_segments)
+    {
+        ret += i.second->bytes;
+    }
+    
+    return ret;
+}
+
+bool kv_store_log::replay(
+    const std::shared_ptr<segment_t> & segment, const bool & is_last
+    )
+{
+    std::string payload;
+    
+    std::vector<record_op_t> ops;
+    
+    std::uint64_t offset = 0;
+    
+    std::fseek(segment->file, 0, SEEK_SET);
+    
+    for (;;)
+    {
+        auto ret = read_record(segment->file, payload);
+        
+        std::uint64_t sequence = 0;
+        
+        if (ret == 1 && decode_payload(payload, sequence, ops) == false)
+        {
+            ret = -1;
+        }
+        
+        if (ret == 0)
+        {
+            break;
+        }
+        else if (ret < 0)
+        {
+            if (is_last == false)
+            {
+                return false;
+            }
+            
+            /**
+             * A write torn by a crash, everything before it is intact.
+             */
+            log_info(
+                "KV store log truncating torn record at " << offset <<
+                " in " << segment->path << "."
+            );
+            
+            if (truncate_file(segment->file, offset) == false)
+            {
+                return false;
+            }
+            
+            break;
+        }
+        
+        std::lock_guard<std::mutex> l1(mutex_);
+        
+        for (auto & i : ops)
+        {
+            location_t loc;
+            
+            loc.segment = segment->id;
+            loc.offset = offset + record_header_length + i.value_position;
+            loc.length = i.value_length;
+            loc.sequence = sequence;
+            loc.is_erased = i.type == batch::op_type_erase;
+            
+            apply(i.key, loc);
+        }
+        
+        m_sequence = std::max(m_sequence, sequence);
+        
+        offset += record_header_length + payload.size();
+    }
+    
+    segment->bytes = offset;
+    
+    std::fseek(segment->file, 0, SEEK_END);
+    
+    return true;
+}
+
+bool kv_store_log::append(const batch & b)
+{
+    if (m_segment_active == nullptr)
+    {
+        return false;
+    }
+    
+    auto sequence = m_sequence + 1;
+    
+    std::string payload;
+    
+    payload.reserve(12 + b.bytes() + b.ops().size() * 9);
+    
+    put_integer(payload, sequence);
+    put_integer(payload, static_cast<std::uint32_t> (b.ops().size()));
+    
+    std::vector<std::size_t> value_positions;
+    
+    value_positions.reserve(b.ops().size());
+    
+    for (auto & i : b.ops())
+    {
+        put_integer(payload, static_cast<std::uint8_t> (i.type));
+        put_integer(payload, static_cast<std::uint32_t> (i.key.size()));
+        put_integer(payload, static_cast<std::uint32_t> (i.value.size()));
+        
+        payload.append(i.key);
+        
+        value_positions.push_back(payload.size());
+        
+        payload.append(i.value);
+    }
+    
+    std::string header;
+    
+    put_integer(header, static_cast<std::uint32_t> (record_magic));
+    put_integer(header, static_cast<std::uint32_t> (payload.size()));
+    put_integer(header, checksum(payload));
+    
+    if (
+        m_segment_active->bytes > 0 && m_segment_active->bytes +
+        header.size() + payload.size() > m_segment_length
+        )
+    {
+        if (rotate() == false)
+        {
+            return false;
+        }
+    }
+    
+    auto segment = m_segment_active;
+    
+    std::uint64_t offset = 0;
+    
+    {
+        std::lock_guard<std::mutex> l1(segment->mutex);
+        
+        offset = segment->bytes;
+        
+        std::fseek(segment->file, 0, SEEK_END);
+        
+        if (
+            std::fwrite(header.data(), 1, header.size(), segment->file) !=
+            header.size() || std::fwrite(payload.data(), 1, payload.size(),
+            segment->file) != payload.size() || std::fflush(segment->file) != 0
+            )
+        {
+            log_error("KV store log write to " << segment->path << " failed.");
+            
+            /**
+             * Cut off whatever part of the record made it out.
+             */
+            truncate_file(segment->file, offset);
+            
+            return false;
+        }
+        
+        segment->bytes += header.size() + payload.size();
+    }
+    
+    std::lock_guard<std::mutex> l2(mutex_);
+    
+    for (std::size_t i = 0; i < b.ops().size(); i++)
+    {
+        const auto & op = b.ops()[i];
+        
+        location_t loc;
+        
+        loc.segment = segment->id;
+        loc.offset = offset + record_header_length + value_positions[i];
+        loc.length = static_cast<std::uint32_t> (op.value.size());
+        loc.sequence = sequence;
+        loc.is_erased = op.type == batch::op_type_erase;
+        
+        apply(op.key, loc);
+    }
+    
+    m_sequence = sequence;
+    
+    return true;
+}
+
+void kv_store_log::apply(const std::string & key, const location_t & loc)
+{
+    auto it = m_index.find(key);
+    
+    if (it != m_index.end())
+    {
+        auto it2 = m_segments.find(it->second.segment);
+        
+        if (it2 != m_segments.end())
+        {
+            it2->second->live_bytes -= key.size() + it->second.length;
+        }
+        
+        if (m_snapshots > 0)
+        {
+            m_history[key].push_back(it->second);
+        }
+        
+        if (loc.is_erased)
+        {
+            if (m_snapshots > 0)
+            {
+                m_history[key].push_back(loc);
+            }
+            
+            m_index.erase(it);
+        }
+        else
+        {
+            it->second = loc;
+        }
+    }
+    else if (loc.is_erased == false)
+    {
+        m_index[key] = loc;
+    }
+    
+    if (loc.is_erased == false)
+    {
+        auto it2 = m_segments.find(loc.segment);
+        
+        if (it2 != m_segments.end())
+        {
+            it2->second->live_bytes += key.size() + loc.length;
+        }
+    }
+}
+
+bool kv_store_log::read_value(
+    const std::shared_ptr<segment_t> & segment, const location_t & loc,
+    std::string & value
+    )
+{
+    if (segment == nullptr)
+    {
+        return false;
+    }
+    
+    value.resize(loc.length);
+    
+    if (loc.length == 0)
+    {
+        return true;
+    }
+    
+    std::lock_guard<std::mutex> l1(segment->mutex);
+    
+    if (
+        std::fseek(segment->file, static_cast<long> (loc.offset),
+        SEEK_SET) != 0 ||
+        std::fread(&value[0], 1, loc.length, segment->file) != loc.length
+        )
+    {
+        log_error("KV store log read from " << segment->path << " failed.");
+        
+        return false;
+    }
+    
+    return true;
+}
+
+bool kv_store_log::find(
+    const std::string & key, const std::uint64_t & sequence, location_t & loc
+    )
+{
+    auto it = m_index.find(key);
+    
+    if (it != m_index.end() && it->second.sequence <= sequence)
+    {
+        loc = it->second;
+        
+        return true;
+    }
+    
+    auto it2 = m_history.find(key);
+    
+    if (it2 != m_history.end())
+    {
+        for (
+            auto it3 = it2->second.rbegin(); it3 != it2->second.rend(); ++it3
+            )
+        {
+            if (it3->sequence <= sequence)
+            {
+                if (it3->is_erased)
+                {
+                    return false;
+                }
+                
+                loc = *it3;
+                
+                return true;
+            }
+        }
+    }
+    
+    return false;
+}
+
+bool kv_store_log::rotate()
+{
+    auto segment = std::make_shared<segment_t> ();
+    
+    {
+        std::lock_guard<std::mutex> l1(mutex_);
+        
+        segment->id = m_segments.size() > 0 ? m_segments.rbegin()->first + 1 : 1;
+    }
+    
+    segment->path = m_path + "/" + std::to_string(segment->id) + ".seg";
+    segment->bytes = segment->live_bytes = 0;
+    segment->is_obsolete = false;
+    segment->file = std::fopen(segment->path.c_str(), "w+b");
+    
+    if (segment->file == 0)
+    {
+        log_error("KV store log failed to create " << segment->path << ".");
+        
+        return false;
+    }
+    
+    if (m_segment_active)
+    {
+        std::lock_guard<std::mutex> l1(m_segment_active->mutex);
+        
+        sync_file(m_segment_active->file);
+    }
+    
+    std::lock_guard<std::mutex> l1(mutex_);
+    
+    m_segments[segment->id] = segment;
+    
+    m_segment_active = segment;
+    
+    return write_manifest();
+}
+
+bool kv_store_log::write_manifest()
+{
+    auto path = m_path + "/MANIFEST";
+    
+    auto path_tmp = path + ".tmp";
+    
+    auto f = std::fopen(path_tmp.c_str(), "wb");
+    
+    if (f == 0)
+    {
+        return false;
+    }
+    
+    std::stringstream ss;
+    
+    for (auto & i : m_segments)
+    {
+        ss << i.first << "\n";
+    }
+    
+    auto manifest = ss.str();
+    
+    auto success =
+        std::fwrite(manifest.data(), 1, manifest.size(), f) ==
+        manifest.size() && sync_file(f)
+    ;
+    
+    std::fclose(f);
+    
+#if (defined _MSC_VER)
+    std::remove(path.c_str());
+#endif // _MSC_VER
+
+    if (success == false || std::rename(path_tmp.c_str(), path.c_str()) != 0)
+    {
+        log_error("KV store log failed to write " << path << ".");
+        
+        return false;
+    }
+    
+    return true;
+}
+
+bool kv_store_log::compact_segment(const std::uint32_t & id)
+{
+    std::shared_ptr<segment_t> segment;
+    
+    auto is_oldest = false;
+    
+    {
+        std::lock_guard<std::mutex> l1(mutex_);
+        
+        auto it = m_segments.find(id);
+        
+        /**
+         * Snapshots may still need the old versions.
+         */
+        if (
+            m_snapshots > 0 || it == m_segments.end() ||
+            it->second == m_segment_active
+            )
+        {
+            return false;
+        }
+        
+        segment = it->second;
+        
+        is_oldest = m_segments.begin()->first == id;
+    }
+    
+    /**
+     * Read the segment without holding up writers, a private handle keeps
+     * readers of the shared one unaffected.
+     */
+    auto f = std::fopen(segment->path.c_str(), "rb");
+    
+    if (f == 0)
+    {
+        return false;
+    }
+    
+    std::vector< std::pair<std::string, std::string> > live;
+    
+    std::vector<std::string> erased;
+    
+    std::string payload;
+    
+    std::vector<record_op_t> ops;
+    
+    std::uint64_t offset = 0;
+    
+    while (read_record(f, payload) == 1)
+    {
+        std::uint64_t sequence;
+        
+        if (decode_payload(payload, sequence, ops) == false)
+        {
+            break;
+        }
+        
+        std::lock_guard<std::mutex> l1(mutex_);
+        
+        for (auto & i : ops)
+        {
+            auto it = m_index.find(i.key);
+            
+            if (i.type == batch::op_type_put)
+            {
+                if (
+                    it != m_index.end() && it->second.segment == id &&
+                    it->second.offset ==
+                    offset + record_header_length + i.value_position
+                    )
+                {
+                    live.push_back(std::make_pair(i.key, payload.substr(
+                        i.value_position, i.value_length))
+                    );
+                }
+            }
+            else if (is_oldest == false && it == m_index.end())
+            {
+                /**
+                 * An older segment may still hold a put this erase hides.
+                 */
+                erased.push_back(i.key);
+            }
+        }
+        
+        offset += record_header_length + payload.size();
+    }
+    
+    std::fclose(f);
+    
+    /**
+     * Move the records that are still current while no writer can slip a
+     * newer version in between the check and the append.
+     */
+    std::lock_guard<std::mutex> l1(mutex_write_);
+    
+    batch b;
+    
+    auto moved = 0;
+    
+    for (auto & i : live)
+    {
+        {
+            std::lock_guard<std::mutex> l2(mutex_);
+            
+            auto it = m_index.find(i.first);
+            
+            if (it == m_index.end() || it->second.segment != id)
+            {
+                continue;
+            }
+        }
+        
+        b.put(i.first, i.second);
+        
+        ++moved;
+        
+        if (b.bytes() >= 4 * 1024 * 1024)
+        {
+            if (append(b) == false)
+            {
+                return false;
+            }
+            
+            b.clear();
+        }
+    }
+    
+    for (auto & i : erased)
+    {
+        std::lock_guard<std::mutex> l2(mutex_);
+        
+        if (m_index.count(i) == 0)
+        {
+            b.erase(i);
+        }
+    }
+    
+    if (b.ops().size() > 0 && append(b) == false)
+    {
+        return false;
+    }
+    
+    {
+        std::lock_guard<std::mutex> l2(m_segment_active->mutex);
+        
+        if (sync_file(m_segment_active->file) == false)
+        {
+            return false;
+        }
+    }
+    
+    std::lock_guard<std::mutex> l2(mutex_);
+    
+    /**
+     * A snapshot taken while we copied may still point into the segment,
+     * leave it for a later pass.
+     */
+    if (m_snapshots > 0)
+    {
+        return false;
+    }
+    
+    segment->is_obsolete = true;
+    
+    m_segments.erase(id);
+    
+    log_debug(
+        "KV store log compacted segment " << id << ", moved " << moved <<
+        " live keys, " << erased.size() << " erases."
+    );
+    
+    return write_manifest();
+}
+
+void kv_store_log::do_compaction()
+{
+    std::unique_lock<std::mutex> l1(mutex_);
+    
+    while (m_compaction_stop == false)
+    {
+        condition_compaction_.wait_for(
+            l1, std::chrono::seconds(compaction_interval)
+        );
+        
+        if (m_compaction_stop)
+        {
+            break;
+        }
+        
+        std::vector<std::uint32_t> ids;
+        
+        if (m_snapshots == 0)
+        {
+            for (auto & i : m_segments)
+            {
+                if (
+                    i.second != m_segment_active &&
+                    i.second->live_bytes * 100 <
+                    i.second->bytes * compaction_live_percent
+                    )
+                {
+                    ids.push_back(i.first);
+                }
+            }
+        }
+        
+        l1.unlock();
+        
+        for (auto & i : ids)
+        {
+            compact_segment(i);
+        }
+        
+        l1.lock();
+    }
+}
+
+void kv_store_log::release_snapshot()
+{
+    std::lock_guard<std::mutex> l1(mutex_);
+    
+    assert(m_snapshots > 0);
+    
+    if (--m_snapshots == 0)
+    {
+        m_history.clear();
+    }
+}
+
+int kv_store_log::run_test()
+{
+    auto path = filesystem::data_path() + "kv_store_log_test";
+    
+    auto remove_all = [&path]()
+    {
+        std::ifstream ifs(path + "/MANIFEST");
+        
+        std::uint32_t id;
+        
+        while (ifs >> id)
+        {
+            std::remove((path + "/" + std::to_string(id) + ".seg").c_str());
+        }
+        
+        for (auto i = 1; i < 4096; i++)
+        {
+            std::remove((path + "/" + std::to_string(i) + ".seg").c_str());
+        }
+        
+        std::remove((path + "/MANIFEST").c_str());
+    };
+    
+    remove_all();
+    
+    {
+        kv_store_log store(64 * 1024);
+        
+        assert(store.open(path));
+        
+        /**
+         * Basic operations.
+         */
+        std::string value;
+        
+        assert(store.put("a", "1"));
+        assert(store.put("b", "2"));
+        assert(store.put("a", "3", false) == false);
+        assert(store.get("a", value) && value == "1");
+        assert(store.put("a", "4"));
+        assert(store.get("a", value) && value == "4");
+        assert(store.erase("b"));
+        assert(store.exists("b") == false);
+        assert(store.erase("missing"));
+        assert(store.put("empty", ""));
+        assert(store.get("empty", value) && value.empty());
+        
+        printf("Test kv_store_log: basic operations passed.\n");
+        
+        /**
+         * Batches are applied in order.
+         */
+        batch b;
+        
+        b.put("c", "5");
+        b.put("d", "6");
+        b.erase("c");
+        b.put("e", "7");
+        
+        bool erased = false;
+        
+        assert(b.get("c", value, erased) && erased);
+        assert(b.get("d", value, erased) && erased == false && value == "6");
+        assert(store.write(b));
+        assert(store.exists("c") == false);
+        assert(store.get("d", value) && value == "6");
+        
+        /**
+         * Ordered iteration and seek.
+         */
+        std::string keys;
+        
+        auto it = store.new_iterator();
+        
+        for (it->seek_to_first(); it->valid(); it->next())
+        {
+            keys += it->key() + ",";
+        }
+        
+        assert(keys == "a,d,e,empty,");
+        
+        it->seek("da");
+        
+        assert(it->valid() && it->key() == "e" && it->value() == "7");
+        
+        printf("Test kv_store_log: batch and iterator passed.\n");
+        
+        /**
+         * Snapshots do not see later writes.
+         */
+        {
+            auto snap = store.get_snapshot();
+            
+            assert(store.put("a", "8"));
+            assert(store.erase("d"));
+            assert(store.put("f", "9"));
+            
+            assert(store.get("a", value, snap.get()) && value == "4");
+            assert(store.get("d", value, snap.get()) && value == "6");
+            assert(store.get("f", value, snap.get()) == false);
+            assert(store.get("a", value) && value == "8");
+            
+            keys.clear();
+            
+            auto it2 = store.new_iterator(snap.get());
+            
+            for (it2->seek_to_first(); it2->valid(); it2->next())
+            {
+                keys += it2->key() + "=" + it2->value() + ",";
+            }
+            
+            assert(keys == "a=4,d=6,e=7,empty=,");
+        }
+        
+        printf("Test kv_store_log: snapshot passed.\n");
+        
+        /**
+         * Fill several segments, overwrite everything and compact.
+         */
+        for (auto round = 0; round < 3; round++)
+        {
+            for (auto i = 0; i < 2000; i++)
+            {
+                store.put(
+                    "key" + std::to_string(i),
+                    std::string(64, 'a' + round) + std::to_string(i)
+                );
+            }
+        }
+        
+        auto bytes_before = store.bytes_on_disk();
+        
+        store.compact();
+        
+        auto bytes_after = store.bytes_on_disk();
+        
+        printf(
+            "Test kv_store_log: compaction %llu -> %llu bytes.\n",
+            static_cast<unsigned long long> (bytes_before),
+            static_cast<unsigned long long> (bytes_after)
+        );
+        
+        assert(bytes_after < bytes_before / 2);
+        
+        for (auto i = 0; i < 2000; i++)
+        {
+            assert(
+                store.get("key" + std::to_string(i), value) &&
+                value == std::string(64, 'c') + std::to_string(i)
+            );
+        }
+        
+        assert(store.exists("d") == false);
+        assert(store.get("a", value) && value == "8");
+    }
+    
+    /**
+     * Recovery replays the segments, a torn tail is cut off.
+     */
+    {
+        std::uint32_t last = 0;
+        
+        std::ifstream ifs(path + "/MANIFEST");
+        
+        std::uint32_t id;
+        
+        while (ifs >> id)
+        {
+            last = id;
+        }
+        
+        auto f = std::fopen(
+            (path + "/" + std::to_string(last) + ".seg").c_str(), "ab"
+        );
+        
+        const char torn[] = { 0x67, 0x6c, 0x76, 0x6b, 0x40, 0x00 };
+        
+        std::fwrite(torn, 1, sizeof(torn), f);
+        
+        std::fclose(f);
+        
+        kv_store_log store(64 * 1024);
+        
+        assert(store.open(path));
+        
+        std::string value;
+        
+        assert(store.size() == 2000 + 4);
+        assert(store.get("key1999", value) && value == std::string(64, 'c') + "1999");
+        assert(store.exists("d") == false);
+        assert(store.put("after", "torn"));
+        
+        store.close();
+        
+        assert(store.open(path));
+        assert(store.get("after", value) && value == "torn");
+        
+        printf("Test kv_store_log: recovery passed.\n");
+        
+        /**
+         * Migration into a second store.
+         */
+        kv_store_log copy;
+        
+        auto path_copy = path + "_copy";
+        
+        std::remove((path_copy + "/1.seg").c_str());
+        std::remove((path_copy + "/MANIFEST").c_str());
+        
+        assert(copy.open(path_copy));
+        assert(
+            migrate(store, copy) == static_cast<std::int64_t> (store.size())
+        );
+        assert(copy.get("key7", value) && value == std::string(64, 'c') + "7");
+        
+        copy.close();
+        
+        std::remove((path_copy + "/1.seg").c_str());
+        std::remove((path_copy + "/MANIFEST").c_str());
+        std::remove(path_copy.c_str());
+        
+        printf("Test kv_store_log: migrate passed.\n");
+    }
+    
+    remove_all();
+    
+    /**
+     * The benchmark suite.
+     */
+    {
+        kv_store_log store;
+        
+        assert(store.open(path));
+        
+        benchmark(store, 200000);
+    }
+    
+    remove_all();
+    
+    std::remove(path.c_str());
+    
+    return 0;
+}
@@ -27,11 +27,13 @@
 #include <coin/checkpoint_sync.hpp>
 #include <coin/constants.hpp>
 #include <coin/endian.hpp>
+#include <coin/globals.hpp>
 #include <coin/hash.hpp>
 #include <coin/inventory_vector.hpp>
 #include <coin/logger.hpp>
 #include <coin/message.hpp>
 #include <coin/protocol.hpp>
+#include <coin/random.hpp>
 #include <coin/stack_impl.hpp>
 #include <coin/time.hpp>
 
@@ -517,6 +519,15 @@ void message::decode()
                 log_error("Message failed to decode alert.");
             }
         }
+        else if (
+            m_header.command == "sketch" || m_header.command == "recondiff"
+            )
+        {
+            /**
+             * The payload is read in place by the tx_reconciliation of the
+             * connection.
+             */
+        }
         else
         {
             log_error(
@@ -623,7 +634,12 @@ data_buffer message::create_version()
     /**
      * Set the payload services.
      */
-    m_protocol_version.services = 1;
+    m_protocol_version.services = protocol::service_network;
+    
+    if (globals::instance().option_tx_reconciliation())
+    {
+        m_protocol_version.services |= protocol::service_tx_reconciliation;
+    }
     
     /**
      * Set the payload timestamp (non-adjusted).
@@ -671,7 +687,7 @@ data_buffer message::create_version()
      */
     if (m_protocol_version.nonce == 0)
     {
-        m_protocol_version.nonce = std::rand();
+        m_protocol_version.nonce = random::secure_uint64();
     }
     
     /**
@@ -804,7 +820,7 @@ data_buffer message::create_ping()
     /**
      * Set the ping nonce.
      */
-    m_protocol_ping.nonce = std::rand();
+    m_protocol_ping.nonce = random::secure_uint64();
     
     /**
      * Encode the payload nonce to little endian.
@@ -832,7 +848,7 @@ data_buffer message::create_pong()
     /**
      * Set the pong nonce.
      */
-    m_protocol_pong.nonce = std::rand();
+    m_protocol_pong.nonce = random::secure_uint64();
     
     /**
      * Encode the payload nonce to little endian.
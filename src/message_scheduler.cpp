@@ -0,0 +1,621 @@
+/*
+ * Copyright (c) 2013-2014 John Connor (BM-NC49AxAjcqVcF5jNPu85Rb8MJ2d9JqZt)
+ *
+ * This file is part of coinpp.
+ *
+ * coinpp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License with
+ * additional permissions to the one published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version. For more information see LICENSE.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include <coin/logger.hpp>
+#include <coin/message_scheduler.hpp>
+
+using namespace coin;
+
+message_scheduler::message_scheduler(boost::asio::io_service & ios)
+    : m_cursor(0)
+    , m_service_posted(false)
+    , m_timer_pending(false)
+    , m_stopped(false)
+    , io_service_(ios)
+    , strand_(ios)
+    , timer_(ios)
+{
+    // ...
+}
+
+void message_scheduler::stop()
+{
+    std::lock_guard<std::mutex> l1(mutex_);
+    
+    m_stopped = true;
+    
+    m_peers.clear();
+    
+    timer_.cancel();
+}
+
+void message_scheduler::add_peer(
+    const void * peer, const std::function<bool ()> & is_congested,
+    const std::function<void (const bool &)> & set_paused
+    )
+{
+    std::lock_guard<std::mutex> l1(mutex_);
+    
+    auto & p = m_peers[peer];
+    
+    p.bytes = 0;
+    p.deficit = 0;
+    p.is_congested = is_congested;
+    p.set_paused = set_paused;
+    p.paused = false;
+}
+
+void message_scheduler::remove_peer(const void * peer)
+{
+    std::lock_guard<std::mutex> l1(mutex_);
+    
+    m_peers.erase(peer);
+}
+
+message_scheduler::push_result_t message_scheduler::push(
+    const void * peer, const std::function<void ()> & f,
+    const std::size_t & bytes
+    )
+{
+    std::unique_lock<std::mutex> l1(mutex_);
+    
+    if (m_stopped)
+    {
+        return push_unknown;
+    }
+    
+    auto it = m_peers.find(peer);
+    
+    if (it == m_peers.end())
+    {
+        return push_unknown;
+    }
+    
+    auto & p = it->second;
+    
+    /**
+     * A paused peer can only overshoot its budget by what was already
+     * read, at twice the budget it ignored the pause.
+     */
+    if (
+        p.messages.size() > 0 && (p.messages.size() >= 2 * max_queued ||
+        p.bytes + bytes > 2 * max_queued_bytes)
+        )
+    {
+        return push_full;
+    }
+    
+    p.messages.push_back(std::make_pair(f, bytes));
+    
+    p.bytes += bytes;
+    
+    schedule();
+    
+    /**
+     * Pause reading from the peer while it is over budget.
+     */
+    if (
+        p.paused == false && (p.messages.size() >= max_queued ||
+        p.bytes >= max_queued_bytes)
+        )
+    {
+        p.paused = true;
+        
+        auto set_paused = p.set_paused;
+        
+        l1.unlock();
+        
+        if (set_paused)
+        {
+            set_paused(true);
+        }
+    }
+    
+    return push_queued;
+}
+
+std::size_t message_scheduler::queued(const void * peer)
+{
+    std::lock_guard<std::mutex> l1(mutex_);
+    
+    auto it = m_peers.find(peer);
+    
+    return it == m_peers.end() ? 0 : it->second.messages.size();
+}
+
+std::size_t message_scheduler::queued_bytes(const void * peer)
+{
+    std::lock_guard<std::mutex> l1(mutex_);
+    
+    auto it = m_peers.find(peer);
+    
+    return it == m_peers.end() ? 0 : it->second.bytes;
+}
+
+void message_scheduler::schedule()
+{
+    if (m_service_posted == false && m_stopped == false)
+    {
+        m_service_posted = true;
+        
+        auto self(shared_from_this());
+        
+        strand_.post([self]() { self->service(); });
+    }
+}
+
+void message_scheduler::service()
+{
+    std::unique_lock<std::mutex> l1(mutex_);
+    
+    m_service_posted = false;
+    
+    if (m_stopped)
+    {
+        return;
+    }
+    
+    /**
+     * Visit every peer once, starting after the last one serviced.
+     */
+    std::vector<const void *> order;
+    
+    for (auto it = m_peers.upper_bound(m_cursor); it != m_peers.end(); ++it)
+    {
+        order.push_back(it->first);
+    }
+    
+    for (
+        auto it = m_peers.begin();
+        it != m_peers.end() && it->first <= m_cursor; ++it
+        )
+    {
+        order.push_back(it->first);
+    }
+    
+    auto pending = false;
+    auto congested = false;
+    
+    for (auto & i : order)
+    {
+        auto it = m_peers.find(i);
+        
+        if (it == m_peers.end())
+        {
+            continue;
+        }
+        
+        if (it->second.messages.empty())
+        {
+            it->second.deficit = 0;
+            
+            continue;
+        }
+        
+        m_cursor = i;
+        
+        it->second.deficit += quantum;
+        
+        while (it->second.deficit > 0 && it->second.messages.empty() == false)
+        {
+            auto is_congested = it->second.is_congested;
+            
+            l1.unlock();
+            
+            /**
+             * Pause the peer while its output queue is full.
+             */
+            if (is_congested && is_congested())
+            {
+                l1.lock();
+                
+                it = m_peers.find(i);
+                
+                if (it != m_peers.end())
+                {
+                    congested = true;
+                    
+                    /**
+                     * Do not let the peer bank time while it is paused.
+                     */
+                    it->second.deficit = std::min<std::int64_t> (
+                        it->second.deficit, quantum
+                    );
+                }
+                
+                break;
+            }
+            
+            l1.lock();
+            
+            it = m_peers.find(i);
+            
+            if (it == m_peers.end() || it->second.messages.empty())
+            {
+                break;
+            }
+            
+            auto f = std::move(it->second.messages.front().first);
+            
+            it->second.bytes -= it->second.messages.front().second;
+            
+            it->second.messages.pop_front();
+            
+            /**
+             * Resume reading once drained to half the budget.
+             */
+            std::function<void (const bool &)> set_paused;
+            
+            if (
+                it->second.paused &&
+                it->second.messages.size() <= max_queued / 2 &&
+                it->second.bytes <= max_queued_bytes / 2
+                )
+            {
+                it->second.paused = false;
+                
+                set_paused = it->second.set_paused;
+            }
+            
+            l1.unlock();
+            
+            if (set_paused)
+            {
+                set_paused(false);
+            }
+            
+            auto start = std::chrono::steady_clock::now();
+            
+            try
+            {
+                f();
+            }
+            catch (std::exception & e)
+            {
+                log_error(
+                    "Message scheduler handler failed, what = " <<
+                    e.what() << "."
+                );
+            }
+            
+            auto elapsed = std::chrono::duration_cast<
+                std::chrono::microseconds
+            > (std::chrono::steady_clock::now() - start).count();
+            
+            l1.lock();
+            
+            /**
+             * The handler may have removed the peer.
+             */
+            it = m_peers.find(i);
+            
+            if (it == m_peers.end())
+            {
+                break;
+            }
+            
+            it->second.deficit -= std::max<std::int64_t> (elapsed, 1);
+        }
+        
+        if (it != m_peers.end())
+        {
+            if (it->second.messages.empty())
+            {
+                it->second.deficit = 0;
+            }
+            else if (it->second.deficit <= 0)
+            {
+                pending = true;
+            }
+        }
+    }
+    
+    /**
+     * Yield the strand between rounds so other handlers interleave.
+     */
+    if (pending)
+    {
+        schedule();
+    }
+    else if (congested && m_timer_pending == false)
+    {
+        m_timer_pending = true;
+        
+        auto self(shared_from_this());
+        
+        timer_.expires_from_now(
+            std::chrono::milliseconds(interval_congested)
+        );
+        timer_.async_wait(strand_.wrap(
+            [self](const boost::system::error_code & ec)
+        {
+            std::lock_guard<std::mutex> l1(self->mutex_);
+            
+            self->m_timer_pending = false;
+            
+            if (!ec)
+            {
+                self->schedule();
+            }
+        }));
+    }
+}
+
+/**
+ * Spins for the given number of microseconds (a stand-in for handling a
+ * message).
+ */
+static void spin(const std::int64_t & microseconds)
+{
+    auto start = std::chrono::steady_clock::now();
+    
+    while (
+        std::chrono::duration_cast<std::chrono::microseconds> (
+        std::chrono::steady_clock::now() - start).count() < microseconds
+        )
+    {
+        // ...
+    }
+}
+
+int message_scheduler::run_test()
+{
+    /**
+     * One abusive peer floods expensive messages (e.g. getdata for old
+     * blocks) while the other peers send cheap messages at a steady rate.
+     * Measure how long the cheap messages wait, first handled in arrival
+     * order (as on_read did) and then through the scheduler.
+     */
+    enum
+    {
+        peers = 4,
+        abusive_messages = 1000,
+        abusive_cost = 1000,
+        messages = 50,
+        cost = 50,
+        interval = 5000,
+    };
+    
+    char peer_abusive = 0;
+    
+    char peer[peers];
+    
+    for (auto fair : { false, true })
+    {
+        boost::asio::io_service ios;
+        
+        boost::asio::strand s(ios);
+        
+        std::shared_ptr<boost::asio::io_service::work> work(
+            new boost::asio::io_service::work(ios)
+        );
+        
+        std::thread worker([&ios]() { ios.run(); });
+        
+        auto scheduler = std::make_shared<message_scheduler> (ios);
+        
+        scheduler->add_peer(&peer_abusive, std::function<bool ()> ());
+        
+        for (auto i = 0; i < peers; i++)
+        {
+            scheduler->add_peer(&peer[i], std::function<bool ()> ());
+        }
+        
+        std::mutex mutex_latencies;
+        
+        std::vector<std::int64_t> latencies;
+        
+        std::atomic<int> handled(0);
+        
+        auto post = [&](const void * p, const std::function<void ()> & f)
+        {
+            if (fair)
+            {
+                auto ret = scheduler->push(p, f);
+                
+                assert(ret == push_queued);
+                
+                (void)ret;
+            }
+            else
+            {
+                s.post(f);
+            }
+        };
+        
+        for (auto i = 0; i < abusive_messages; i++)
+        {
+            post(&peer_abusive, [&handled]()
+            {
+                spin(abusive_cost);
+                
+                ++handled;
+            });
+        }
+        
+        for (auto i = 0; i < messages; i++)
+        {
+            for (auto j = 0; j < peers; j++)
+            {
+                auto start = std::chrono::steady_clock::now();
+                
+                post(&peer[j], [&, start]()
+                {
+                    spin(cost);
+                    
+                    std::lock_guard<std::mutex> l1(mutex_latencies);
+                    
+                    latencies.push_back(
+                        std::chrono::duration_cast<
+                        std::chrono::microseconds> (
+                        std::chrono::steady_clock::now() - start).count()
+                    );
+                    
+                    ++handled;
+                });
+            }
+            
+            std::this_thread::sleep_for(std::chrono::microseconds(interval));
+        }
+        
+        while (handled < abusive_messages + messages * peers)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        
+        scheduler->stop();
+        
+        work.reset();
+        
+        worker.join();
+        
+        std::sort(latencies.begin(), latencies.end());
+        
+        printf(
+            "Test message_scheduler: %s, other peers median latency %lld "
+            "us, worst %lld us.\n", fair ? "scheduled" : "arrival order",
+            static_cast<long long> (latencies[latencies.size() / 2]),
+            static_cast<long long> (latencies.back())
+        );
+    }
+    
+    /**
+     * A congested peer is paused and resumes once its output drains.
+     */
+    boost::asio::io_service ios;
+    
+    std::shared_ptr<boost::asio::io_service::work> work(
+        new boost::asio::io_service::work(ios)
+    );
+    
+    std::thread worker([&ios]() { ios.run(); });
+    
+    auto scheduler = std::make_shared<message_scheduler> (ios);
+    
+    std::atomic<bool> congested(true);
+    
+    std::atomic<int> handled(0);
+    
+    scheduler->add_peer(&peer[0], [&congested]() { return congested.load(); });
+    
+    scheduler->push(&peer[0], [&handled]() { ++handled; });
+    
+    std::this_thread::sleep_for(
+        std::chrono::milliseconds(interval_congested * 3)
+    );
+    
+    auto paused = handled == 0;
+    
+    congested = false;
+    
+    std::this_thread::sleep_for(
+        std::chrono::milliseconds(interval_congested * 3)
+    );
+    
+    auto resumed = handled == 1;
+    
+    /**
+     * A peer over its byte budget has its reads paused, pushing past twice
+     * the budget is refused and reading resumes once it drained.
+     */
+    enum { block_size = 1000000 };
+    
+    std::atomic<int> pauses(0), resumes(0);
+    
+    std::atomic<std::size_t> handled_blocks(0);
+    
+    congested = true;
+    
+    scheduler->add_peer(&peer[1], [&congested]() { return congested.load(); },
+        [&pauses, &resumes](const bool & flag)
+        {
+            if (flag)
+            {
+                ++pauses;
+            }
+            else
+            {
+                ++resumes;
+            }
+        }
+    );
+    
+    std::size_t pushed = 0, paused_at = 0;
+    
+    while (
+        scheduler->push(&peer[1], [&handled_blocks]() { ++handled_blocks; },
+        block_size) == push_queued
+        )
+    {
+        pushed++;
+        
+        if (pauses > 0 && paused_at == 0)
+        {
+            paused_at = pushed;
+        }
+    }
+    
+    assert(paused_at == max_queued_bytes / block_size + 1);
+    assert(pushed == 2 * max_queued_bytes / block_size);
+    assert(scheduler->queued_bytes(&peer[1]) == pushed * block_size);
+    assert(scheduler->push(&peer[2], [](){}, block_size) == push_unknown);
+    
+    congested = false;
+    
+    for (auto i = 0; i < 100 && handled_blocks < pushed; i++)
+    {
+        std::this_thread::sleep_for(
+            std::chrono::milliseconds(interval_congested)
+        );
+    }
+    
+    auto budget =
+        pauses == 1 && resumes == 1 && handled_blocks == pushed &&
+        scheduler->queued_bytes(&peer[1]) == 0
+    ;
+    
+    scheduler->stop();
+    
+    assert(scheduler->push(&peer[1], [](){}, block_size) == push_unknown);
+    
+    work.reset();
+    
+    worker.join();
+    
+    printf(
+        "Test message_scheduler: congested peer %s.\n",
+        paused && resumed ? "paused and resumed" : "failed"
+    );
+    
+    printf(
+        "Test message_scheduler: reading paused at %d MB queued, flooding "
+        "refused at %d MB, %s.\n", static_cast<int> (paused_at),
+        static_cast<int> (pushed), budget ? "resumed once drained" : "failed"
+    );
+    
+    return paused && resumed && budget ? 0 : -1;
+}
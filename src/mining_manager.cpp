@@ -33,6 +33,7 @@
 #include <coin/tcp_connection_manager.hpp>
 #include <coin/utility.hpp>
 #include <coin/wallet.hpp>
+#include <coin/wallet_manager.hpp>
 
 using namespace coin;
 
@@ -320,6 +321,12 @@ void mining_manager::loop(const bool & is_proof_of_stake)
             std::this_thread::sleep_for(std::chrono::seconds(1));
         }
 
+        /**
+         * Make sure the wallet has caught up with the chain so it does not
+         * stake coins that were already spent.
+         */
+        wallet_manager::instance().sync();
+        
         /**
          * Attempt to create a new block of transactions.
          */
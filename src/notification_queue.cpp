@@ -0,0 +1,415 @@
+/*
+ * Copyright (c) 2013-2014 John Connor (BM-NC49AxAjcqVcF5jNPu85Rb8MJ2d9JqZt)
+ *
+ * This file is part of coinpp.
+ *
+ * coinpp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License with
+ * additional permissions to the one published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version. For more information see LICENSE.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <future>
+#include <map>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include <coin/logger.hpp>
+#include <coin/notification_queue.hpp>
+
+using namespace coin;
+
+notification_queue::notification_queue()
+    : m_sequence_posted(0)
+    , m_sequence_done(0)
+    , m_stop(false)
+    , m_running(false)
+{
+    // ...
+}
+
+notification_queue::~notification_queue()
+{
+    stop();
+}
+
+void notification_queue::start()
+{
+    std::lock_guard<std::mutex> l1(mutex_);
+    
+    if (m_thread.joinable() == false)
+    {
+        m_stop = false;
+        
+        m_running = true;
+        
+        m_thread = std::thread(&notification_queue::run, this);
+        
+        m_thread_id = m_thread.get_id();
+    }
+}
+
+void notification_queue::stop()
+{
+    std::unique_lock<std::mutex> l1(mutex_);
+    
+    m_stop = true;
+    
+    condition_posted_.notify_one();
+    
+    /**
+     * A notification stopping the queue it runs on can't join itself.
+     */
+    if (
+        m_thread.joinable() == false ||
+        m_thread_id == std::this_thread::get_id()
+        )
+    {
+        return;
+    }
+    
+    l1.unlock();
+    
+    m_thread.join();
+}
+
+std::uint64_t notification_queue::post(const std::function<void ()> & f)
+{
+    std::unique_lock<std::mutex> l1(mutex_);
+    
+    auto sequence = ++m_sequence_posted;
+    
+    /**
+     * Once stopping the worker thread still drains what is posted so the
+     * order holds.
+     */
+    if (m_running)
+    {
+        m_notifications.push_back(f);
+        
+        condition_posted_.notify_one();
+    }
+    else
+    {
+        l1.unlock();
+        
+        /**
+         * Not started, run it inline as before.
+         */
+        f();
+        
+        l1.lock();
+        
+        if (sequence > m_sequence_done)
+        {
+            m_sequence_done = sequence;
+        }
+        
+        condition_done_.notify_all();
+    }
+    
+    return sequence;
+}
+
+void notification_queue::wait(const std::uint64_t & sequence)
+{
+    std::unique_lock<std::mutex> l1(mutex_);
+    
+    /**
+     * A notification waiting on the queue it runs on would never return.
+     */
+    if (m_running && m_thread_id == std::this_thread::get_id())
+    {
+        return;
+    }
+    
+    condition_done_.wait(l1, [this, sequence]()
+    {
+        return m_sequence_done >= sequence;
+    });
+}
+
+void notification_queue::wait()
+{
+    std::unique_lock<std::mutex> l1(mutex_);
+    
+    auto sequence = m_sequence_posted;
+    
+    l1.unlock();
+    
+    wait(sequence);
+}
+
+std::size_t notification_queue::size()
+{
+    std::lock_guard<std::mutex> l1(mutex_);
+    
+    return m_notifications.size();
+}
+
+void notification_queue::run()
+{
+    std::unique_lock<std::mutex> l1(mutex_);
+    
+    for (;;)
+    {
+        condition_posted_.wait(l1, [this]()
+        {
+            return m_stop || m_notifications.size() > 0;
+        });
+        
+        /**
+         * Everything posted before stop still runs.
+         */
+        if (m_notifications.size() == 0)
+        {
+            m_running = false;
+            
+            break;
+        }
+        
+        auto f = std::move(m_notifications.front());
+        
+        m_notifications.pop_front();
+        
+        l1.unlock();
+        
+        try
+        {
+            f();
+        }
+        catch (std::exception & e)
+        {
+            log_error(
+                "Notification queue caught exception, what = " << e.what() <<
+                "."
+            );
+        }
+        
+        l1.lock();
+        
+        ++m_sequence_done;
+        
+        condition_done_.notify_all();
+    }
+}
+
+int notification_queue::run_test()
+{
+    enum
+    {
+        wallet_transactions = 100000,
+        blocks = 100,
+        block_transactions = 1000,
+    };
+    
+    /**
+     * A stand in for a wallet with 100k transactions, every transaction in
+     * a block is looked up by it's inputs and outputs and the ones that
+     * involve the wallet are written out.
+     */
+    std::map<std::uint64_t, std::vector<char> > wallet;
+    
+    for (std::uint64_t i = 0; i < wallet_transactions; i++)
+    {
+        wallet[i * 7919] = std::vector<char> (256, 0);
+    }
+    
+    std::vector<char> wallet_db;
+    
+    auto sync_block = [&wallet, &wallet_db](const std::uint64_t & height)
+    {
+        for (std::uint64_t i = 0; i < block_transactions; i++)
+        {
+            auto id = height * block_transactions + i;
+            
+            for (auto j = 0; j < 4; j++)
+            {
+                auto it = wallet.find((id * 4 + j) * 13);
+                
+                if (it != wallet.end())
+                {
+                    wallet_db.insert(
+                        wallet_db.end(), it->second.begin(), it->second.end()
+                    );
+                }
+            }
+        }
+    };
+    
+    /**
+     * Connect the blocks notifying the wallet inline.
+     */
+    std::int64_t inline_worst = 0, inline_total = 0;
+    
+    for (std::uint64_t i = 0; i < blocks; i++)
+    {
+        auto time_start = std::chrono::steady_clock::now();
+        
+        sync_block(i);
+        
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds> (
+            std::chrono::steady_clock::now() - time_start
+        ).count();
+        
+        inline_worst = std::max<std::int64_t> (inline_worst, elapsed);
+        inline_total += elapsed;
+    }
+    
+    auto queue = std::make_shared<notification_queue> ();
+    
+    queue->start();
+    
+    /**
+     * Hold the worker thread on the first notification so the block
+     * notifications stay queued.
+     */
+    std::promise<void> gate;
+    
+    auto gate_future = gate.get_future().share();
+    
+    queue->post([gate_future]() { gate_future.wait(); });
+    
+    std::vector<std::uint64_t> order;
+    
+    /**
+     * Connect the blocks posting the notifications to the queue.
+     */
+    std::int64_t queued_worst = 0, queued_total = 0;
+    
+    for (std::uint64_t i = 0; i < blocks; i++)
+    {
+        auto time_start = std::chrono::steady_clock::now();
+        
+        queue->post([i, &sync_block, &order]()
+        {
+            sync_block(i);
+            
+            order.push_back(i);
+        });
+        
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds> (
+            std::chrono::steady_clock::now() - time_start
+        ).count();
+        
+        queued_worst = std::max<std::int64_t> (queued_worst, elapsed);
+        queued_total += elapsed;
+    }
+    
+    assert(queue->size() >= blocks);
+    
+    /**
+     * The chain-state strand keeps running while the wallet work waits.
+     */
+    boost::asio::io_service ios;
+    
+    boost::asio::strand s(ios);
+    
+    std::unique_ptr<boost::asio::io_service::work> work(
+        new boost::asio::io_service::work(ios)
+    );
+    
+    std::thread thread([&ios]() { ios.run(); });
+    
+    std::promise<std::size_t> connected;
+    
+    s.post([&]()
+    {
+        connected.set_value(queue->size());
+    });
+    
+    assert(connected.get_future().get() >= blocks);
+    
+    auto time_wait = std::chrono::steady_clock::now();
+    
+    gate.set_value();
+    
+    /**
+     * The sync barrier.
+     */
+    queue->wait();
+    
+    auto wait = std::chrono::duration_cast<std::chrono::milliseconds> (
+        std::chrono::steady_clock::now() - time_wait
+    ).count();
+    
+    assert(queue->size() == 0);
+    assert(order.size() == blocks);
+    
+    for (std::size_t i = 0; i < order.size(); i++)
+    {
+        assert(order[i] == i);
+    }
+    
+    /**
+     * A barrier on the worker thread returns instead of waiting on itself.
+     */
+    std::promise<void> nested;
+    
+    queue->post([&]()
+    {
+        queue->post([&order]() { order.push_back(blocks); });
+        
+        queue->wait();
+        
+        order.push_back(blocks + 1);
+        
+        nested.set_value();
+    });
+    
+    nested.get_future().wait();
+    
+    queue->wait();
+    
+    assert(order.size() == blocks + 2);
+    assert(order[blocks] == blocks + 1 && order[blocks + 1] == blocks);
+    
+    /**
+     * Notifications posted before stop still run.
+     */
+    queue->post([&order]() { order.push_back(blocks + 2); });
+    
+    queue->stop();
+    
+    assert(order.size() == blocks + 3);
+    
+    /**
+     * Once stopped notifications run inline.
+     */
+    queue->post([&order]() { order.push_back(blocks + 3); });
+    
+    assert(order.size() == blocks + 4);
+    
+    work.reset();
+    
+    thread.join();
+    
+    printf(
+        "Test notification_queue: %d blocks of %d transactions against a "
+        "stand in 100k transaction wallet, inline connect worst %lld us "
+        "(total %lld ms), queued connect worst %lld us (total %lld us), "
+        "barrier %lld ms.\n", static_cast<int> (blocks),
+        static_cast<int> (block_transactions),
+        static_cast<long long> (inline_worst),
+        static_cast<long long> (inline_total / 1000),
+        static_cast<long long> (queued_worst),
+        static_cast<long long> (queued_total), static_cast<long long> (wait)
+    );
+    
+    return 0;
+}
@@ -0,0 +1,438 @@
+/*
+ * Copyright (c) 2013-2014 John Connor (BM-NC49AxAjcqVcF5jNPu85Rb8MJ2d9JqZt)
+ *
+ * This file is part of coinpp.
+ *
+ * coinpp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License with
+ * additional permissions to the one published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version. For more information see LICENSE.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <limits>
+
+#include <coin/peer_quality.hpp>
+
+using namespace coin;
+
+peer_quality::peer_quality()
+    : m_ping_nonce(0)
+    , m_ping_rtt(-1)
+    , m_block_latency(-1)
+    , m_bytes_useful(0)
+    , m_bytes_wasted(0)
+    , m_time_last_useful(0)
+{
+    // ...
+}
+
+void peer_quality::on_ping_sent(const std::uint64_t & nonce)
+{
+    m_ping_nonce = nonce;
+    m_time_ping_sent = std::chrono::steady_clock::now();
+}
+
+void peer_quality::on_pong(const std::uint64_t & nonce)
+{
+    /**
+     * Only a pong matching the outstanding ping is a valid sample.
+     */
+    if (m_ping_nonce != 0 && nonce == m_ping_nonce)
+    {
+        m_ping_nonce = 0;
+        
+        on_ping_rtt(
+            std::chrono::duration_cast<std::chrono::milliseconds> (
+            std::chrono::steady_clock::now() - m_time_ping_sent).count()
+        );
+    }
+}
+
+void peer_quality::on_ping_rtt(const std::int64_t & val)
+{
+    /**
+     * Exponentially weighted moving average (alpha = 1/8).
+     */
+    m_ping_rtt = m_ping_rtt < 0 ? val : (m_ping_rtt * 7 + val) / 8;
+}
+
+void peer_quality::on_block_requested(const sha256 & hash)
+{
+    if (m_blocks_requested.size() >= max_blocks_requested)
+    {
+        return;
+    }
+    
+    m_blocks_requested.insert(
+        std::make_pair(hash, std::chrono::steady_clock::now())
+    );
+}
+
+void peer_quality::on_block_received(const sha256 & hash)
+{
+    auto it = m_blocks_requested.find(hash);
+    
+    if (it != m_blocks_requested.end())
+    {
+        on_block_latency(
+            std::chrono::duration_cast<std::chrono::milliseconds> (
+            std::chrono::steady_clock::now() - it->second).count()
+        );
+        
+        m_blocks_requested.erase(it);
+    }
+}
+
+void peer_quality::on_block_latency(const std::int64_t & val)
+{
+    /**
+     * Exponentially weighted moving average (alpha = 1/8).
+     */
+    m_block_latency =
+        m_block_latency < 0 ? val : (m_block_latency * 7 + val) / 8
+    ;
+}
+
+void peer_quality::on_bytes_useful(const std::size_t & len)
+{
+    m_bytes_useful += len;
+    m_time_last_useful = std::time(0);
+}
+
+void peer_quality::on_bytes_wasted(const std::size_t & len)
+{
+    m_bytes_wasted += len;
+}
+
+const std::int64_t & peer_quality::ping_rtt() const
+{
+    return m_ping_rtt;
+}
+
+const std::int64_t & peer_quality::block_latency() const
+{
+    return m_block_latency;
+}
+
+const std::uint64_t & peer_quality::bytes_useful() const
+{
+    return m_bytes_useful;
+}
+
+const std::uint64_t & peer_quality::bytes_wasted() const
+{
+    return m_bytes_wasted;
+}
+
+const std::time_t & peer_quality::time_last_useful() const
+{
+    return m_time_last_useful;
+}
+
+bool peer_quality::select_eviction(
+    std::vector<candidate_t> candidates, std::size_t & id
+    )
+{
+    auto rtt = [](const candidate_t & c)
+    {
+        return
+            c.quality.ping_rtt() < 0 ?
+            std::numeric_limits<std::int64_t>::max() : c.quality.ping_rtt()
+        ;
+    };
+    
+    /**
+     * Protect the peers with the lowest ping round trip time.
+     */
+    std::sort(
+        candidates.begin(), candidates.end(),
+        [&rtt](const candidate_t & a, const candidate_t & b)
+    {
+        return rtt(a) < rtt(b);
+    });
+    
+    auto protect = std::min(
+        candidates.size(), static_cast<std::size_t> (protect_by_ping)
+    );
+    
+    candidates.erase(candidates.begin(), candidates.begin() + protect);
+    
+    /**
+     * Protect the peers that most recently sent us useful data.
+     */
+    std::sort(
+        candidates.begin(), candidates.end(),
+        [](const candidate_t & a, const candidate_t & b)
+    {
+        return
+            a.quality.time_last_useful() > b.quality.time_last_useful()
+        ;
+    });
+    
+    protect = 0;
+    
+    while (
+        protect < candidates.size() && protect < protect_by_useful &&
+        candidates[protect].quality.bytes_useful() > 0
+        )
+    {
+        protect++;
+    }
+    
+    candidates.erase(candidates.begin(), candidates.begin() + protect);
+    
+    /**
+     * Protect the longest connected half of the remaining peers.
+     */
+    std::sort(
+        candidates.begin(), candidates.end(),
+        [](const candidate_t & a, const candidate_t & b)
+    {
+        return a.time_connected < b.time_connected;
+    });
+    
+    candidates.erase(
+        candidates.begin(), candidates.begin() + candidates.size() / 2
+    );
+    
+    if (candidates.empty())
+    {
+        return false;
+    }
+    
+    /**
+     * Select the network group with the most peers, ties are broken by
+     * the group holding the youngest connection.
+     */
+    std::map<
+        std::vector<std::uint8_t>, std::pair<std::size_t, std::time_t>
+    > groups;
+    
+    for (auto & i : candidates)
+    {
+        auto & g = groups[i.group];
+        
+        g.first++;
+        g.second = std::max(g.second, i.time_connected);
+    }
+    
+    auto group = groups.begin();
+    
+    for (auto it = groups.begin(); it != groups.end(); ++it)
+    {
+        if (
+            it->second.first > group->second.first ||
+            (it->second.first == group->second.first &&
+            it->second.second > group->second.second)
+            )
+        {
+            group = it;
+        }
+    }
+    
+    /**
+     * Select the worst peer of the group: the most wasteful, then the
+     * slowest and finally the youngest.
+     */
+    auto score = [](const candidate_t & c)
+    {
+        return
+            static_cast<std::int64_t> (c.quality.bytes_wasted()) -
+            static_cast<std::int64_t> (c.quality.bytes_useful())
+        ;
+    };
+    
+    auto slowness = [](const candidate_t & c)
+    {
+        return
+            c.quality.ping_rtt() < 0 ?
+            static_cast<std::int64_t> (unknown_rtt) : c.quality.ping_rtt()
+        ;
+    };
+    
+    const candidate_t * worst = 0;
+    
+    for (auto & i : candidates)
+    {
+        if (i.group != group->first)
+        {
+            continue;
+        }
+        
+        if (
+            worst == 0 || score(i) > score(*worst) ||
+            (score(i) == score(*worst) && (slowness(i) > slowness(*worst) ||
+            (slowness(i) == slowness(*worst) &&
+            i.time_connected > worst->time_connected)))
+            )
+        {
+            worst = &i;
+        }
+    }
+    
+    id = worst->id;
+    
+    return true;
+}
+
+std::size_t peer_quality::select_outbound(
+    const std::vector<std::int64_t> & rtts
+    )
+{
+    std::size_t ret = 0;
+    
+    std::int64_t best = std::numeric_limits<std::int64_t>::max();
+    
+    for (std::size_t i = 0; i < rtts.size(); i++)
+    {
+        auto rtt = rtts[i] < 0 ? static_cast<std::int64_t> (unknown_rtt) :
+            rtts[i]
+        ;
+        
+        if (rtt < best)
+        {
+            best = rtt;
+            
+            ret = i;
+        }
+    }
+    
+    return ret;
+}
+
+int peer_quality::run_test()
+{
+    /**
+     * Simulate a full set of inbound slots where an attacker controlling
+     * a single network group floods us with slow, useless connections.
+     */
+    std::vector<candidate_t> candidates;
+    
+    std::time_t now = 1400000000;
+    
+    enum
+    {
+        honest_fast = protect_by_ping,
+        honest_useful = protect_by_useful,
+        honest_other = 8,
+        sybil = 40
+    };
+    
+    std::size_t id = 0;
+    
+    for (auto i = 0; i < honest_fast; i++)
+    {
+        candidate_t c;
+        
+        c.id = id++;
+        c.group = { 10, static_cast<std::uint8_t> (i) };
+        c.time_connected = now - 100 + i;
+        c.quality.on_ping_rtt(20 + i);
+        
+        candidates.push_back(c);
+    }
+    
+    for (auto i = 0; i < honest_useful; i++)
+    {
+        candidate_t c;
+        
+        c.id = id++;
+        c.group = { 20, static_cast<std::uint8_t> (i) };
+        c.time_connected = now - 50 + i;
+        c.quality.on_ping_rtt(300);
+        c.quality.on_bytes_useful(1000000 + i);
+        
+        candidates.push_back(c);
+    }
+    
+    for (auto i = 0; i < honest_other; i++)
+    {
+        candidate_t c;
+        
+        c.id = id++;
+        c.group = { 30, static_cast<std::uint8_t> (i) };
+        c.time_connected = now - 3600 + i;
+        c.quality.on_ping_rtt(150);
+        
+        candidates.push_back(c);
+    }
+    
+    auto sybil_begin = id;
+    
+    for (auto i = 0; i < sybil; i++)
+    {
+        candidate_t c;
+        
+        c.id = id++;
+        c.group = { 66, 66 };
+        c.time_connected = now + i;
+        c.quality.on_bytes_wasted(1000 * (i % 5));
+        
+        candidates.push_back(c);
+    }
+    
+    /**
+     * Evict until every sybil peer is gone or eviction is refused.
+     */
+    auto evicted = 0;
+    
+    std::size_t victim;
+    
+    while (peer_quality::select_eviction(candidates, victim))
+    {
+        assert(victim >= honest_fast + honest_useful);
+        
+        if (victim < sybil_begin)
+        {
+            break;
+        }
+        
+        evicted++;
+        
+        for (auto it = candidates.begin(); it != candidates.end(); ++it)
+        {
+            if (it->id == victim)
+            {
+                candidates.erase(it);
+                
+                break;
+            }
+        }
+    }
+    
+    printf("Test peer_quality: evicted %d/%d sybil peers.\n", evicted, sybil);
+    
+    assert(evicted > sybil / 2);
+    
+    /**
+     * The outbound selection prefers measured, fast peers.
+     */
+    assert(peer_quality::select_outbound({ -1, 250, 80, 700 }) == 2);
+    assert(peer_quality::select_outbound({ 900, -1 }) == 1);
+    assert(peer_quality::select_outbound({}) == 0);
+    
+    /**
+     * Pongs with an unknown nonce are ignored.
+     */
+    peer_quality q;
+    
+    q.on_ping_sent(1234);
+    q.on_pong(4321);
+    assert(q.ping_rtt() == -1);
+    q.on_pong(1234);
+    assert(q.ping_rtt() >= 0);
+    
+    return 0;
+}
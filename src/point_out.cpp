@@ -24,31 +24,43 @@
 using namespace coin;
 
 point_out::point_out()
-    : data_buffer()
-    , m_hash()
+    : m_hash()
     , m_n(static_cast<std::uint32_t> (-1))
 {
     // ...
 }
 
 point_out::point_out(const sha256 & h, const std::uint32_t & n)
-    : data_buffer()
-    , m_hash(h)
+    : m_hash(h)
     , m_n(n)
 {
     // ...
 }
 
-void point_out::encode()
+void point_out::encode(data_buffer & buffer) const
 {
-    write_sha256(m_hash);
-    write_uint32(m_n);
+    buffer.write_sha256(m_hash);
+    buffer.write_uint32(m_n);
 }
 
-void point_out::decode()
+data_buffer point_out::encode() const
 {
-    m_hash = read_sha256();
-    m_n = read_uint32();
+    data_buffer ret;
+    
+    encode(ret);
+    
+    return ret;
+}
+
+void point_out::decode(data_buffer & buffer)
+{
+    m_hash = buffer.read_sha256();
+    m_n = buffer.read_uint32();
+}
+
+std::size_t point_out::size() const
+{
+    return sha256::digest_length + sizeof(m_n);
 }
 
 void point_out::set_null()
@@ -0,0 +1,305 @@
+/*
+ * Copyright (c) 2013-2014 John Connor (BM-NC49AxAjcqVcF5jNPu85Rb8MJ2d9JqZt)
+ *
+ * This file is part of coinpp.
+ *
+ * coinpp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License with
+ * additional permissions to the one published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version. For more information see LICENSE.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <coin/chacha20.hpp>
+#include <coin/random.hpp>
+
+using namespace coin;
+
+/**
+ * Implements the (per-thread) buffered ChaCha20 generator. Every refill
+ * re-keys from its own output so earlier output can not be recovered from
+ * the state.
+ */
+class csprng
+{
+    public:
+    
+        /**
+         * The number of bytes generated before reseeding from the OS.
+         */
+        enum { reseed_interval = 1024 * 1024 };
+    
+        /**
+         * The number of keystream bytes generated at a time.
+         */
+        enum { buffer_length = 8 * chacha20::block_length };
+    
+        /**
+         * Constructor
+         */
+        csprng()
+            : m_position(buffer_length)
+            , m_generated(reseed_interval)
+        {
+            // ...
+        }
+    
+        /**
+         * Destructor
+         */
+        ~csprng()
+        {
+            std::memset(&m_buffer[0], 0, m_buffer.size());
+        }
+    
+        /**
+         * Fills the buffer.
+         * @param buf The buffer.
+         * @param len The length.
+         */
+        void bytes(std::uint8_t * buf, std::size_t len)
+        {
+            while (len > 0)
+            {
+                if (m_position == m_buffer.size())
+                {
+                    refill();
+                }
+                
+                auto n = std::min(len, m_buffer.size() - m_position);
+                
+                std::memcpy(buf, &m_buffer[m_position], n);
+                
+                /**
+                 * Never hand out the same bytes twice.
+                 */
+                std::memset(&m_buffer[m_position], 0, n);
+                
+                m_position += n;
+                
+                buf += n;
+                len -= n;
+            }
+        }
+    
+    private:
+    
+        /**
+         * Refills the buffer (and reseeds when due).
+         */
+        void refill()
+        {
+            std::array<std::uint8_t, chacha20::key_length> key;
+            
+            if (m_generated >= reseed_interval)
+            {
+                /**
+                 * Seed from the OS (through the OpenSSL PRNG).
+                 */
+                if (RAND_bytes(&key[0], static_cast<int> (key.size())) != 1)
+                {
+                    throw std::runtime_error("RAND_bytes failed");
+                }
+                
+                m_cipher.set_key(&key[0]);
+                
+                m_generated = 0;
+            }
+            
+            /**
+             * Take the next key then the output.
+             */
+            m_cipher.keystream(&key[0], key.size());
+            m_cipher.keystream(&m_buffer[0], m_buffer.size());
+            
+            m_cipher.set_key(&key[0]);
+            
+            std::memset(&key[0], 0, key.size());
+            
+            m_position = 0;
+            
+            m_generated += m_buffer.size();
+        }
+    
+        /**
+         * The chacha20.
+         */
+        chacha20 m_cipher;
+    
+        /**
+         * The buffer.
+         */
+        std::array<std::uint8_t, buffer_length> m_buffer;
+    
+        /**
+         * The position in the buffer.
+         */
+        std::size_t m_position;
+    
+        /**
+         * The number of bytes generated since the last reseed.
+         */
+        std::size_t m_generated;
+};
+
+random::fast & random::generator()
+{
+    static thread_local fast g_fast(secure_uint64());
+    
+    return g_fast;
+}
+
+void random::bytes(std::uint8_t * buf, const std::size_t & len)
+{
+    static thread_local csprng g_csprng;
+    
+    g_csprng.bytes(buf, len);
+}
+
+int random::run_test()
+{
+    enum { draws = 4000000, threads = 4 };
+    
+    /**
+     * The previous (shared, unsynchronized) generator for comparison.
+     */
+    std::random_device rd;
+    std::mt19937_64 gen(rd());
+    
+    std::uint64_t sink = 0;
+    
+    auto start = std::chrono::steady_clock::now();
+    
+    for (auto i = 0; i < draws; i++)
+    {
+        std::uniform_int_distribution<std::uint64_t> dist;
+        
+        sink += dist(gen) % 1000;
+    }
+    
+    auto elapsed_mt = std::chrono::duration_cast<
+        std::chrono::microseconds
+    > (std::chrono::steady_clock::now() - start).count();
+    
+    start = std::chrono::steady_clock::now();
+    
+    for (auto i = 0; i < draws; i++)
+    {
+        sink += uint64(1000);
+    }
+    
+    auto elapsed_fast = std::chrono::duration_cast<
+        std::chrono::microseconds
+    > (std::chrono::steady_clock::now() - start).count();
+    
+    start = std::chrono::steady_clock::now();
+    
+    for (auto i = 0; i < draws; i++)
+    {
+        sink += secure_uint64() % 1000;
+    }
+    
+    auto elapsed_secure = std::chrono::duration_cast<
+        std::chrono::microseconds
+    > (std::chrono::steady_clock::now() - start).count();
+    
+    start = std::chrono::steady_clock::now();
+    
+    for (auto i = 0; i < draws / 16; i++)
+    {
+        std::uint64_t val;
+        
+        RAND_bytes(reinterpret_cast<std::uint8_t *> (&val), sizeof(val));
+        
+        sink += val % 1000;
+    }
+    
+    auto elapsed_openssl = 16 * std::chrono::duration_cast<
+        std::chrono::microseconds
+    > (std::chrono::steady_clock::now() - start).count();
+    
+    printf(
+        "Test random: %d draws, mt19937_64 %lld us, fast %lld us, "
+        "chacha20 %lld us, RAND_bytes %lld us (%llu).\n", draws,
+        static_cast<long long> (elapsed_mt),
+        static_cast<long long> (elapsed_fast),
+        static_cast<long long> (elapsed_secure),
+        static_cast<long long> (elapsed_openssl),
+        static_cast<unsigned long long> (sink % 10)
+    );
+    
+    /**
+     * Every thread must get its own streams and the generators must be
+     * safe to use concurrently (run under -fsanitize=thread).
+     */
+    std::mutex mutex;
+    
+    std::set<std::uint64_t> firsts_fast, firsts_secure;
+    
+    std::vector<std::thread> workers;
+    
+    for (auto i = 0; i < threads; i++)
+    {
+        workers.push_back(std::thread([&]()
+        {
+            auto first_fast = generator()();
+            auto first_secure = secure_uint64();
+            
+            std::uint64_t counts[10] = { 0 };
+            
+            for (auto j = 0; j < draws / threads; j++)
+            {
+                counts[uint32(10)]++;
+                
+                std::uint8_t buf[24];
+                
+                bytes(buf, sizeof(buf));
+            }
+            
+            /**
+             * A uniform draw over 10 buckets.
+             */
+            for (auto & j : counts)
+            {
+                assert(j > draws / threads / 10 * 95 / 100);
+                assert(j < draws / threads / 10 * 105 / 100);
+            }
+            
+            std::lock_guard<std::mutex> l1(mutex);
+            
+            firsts_fast.insert(first_fast);
+            firsts_secure.insert(first_secure);
+        }));
+    }
+    
+    for (auto & i : workers)
+    {
+        i.join();
+    }
+    
+    assert(firsts_fast.size() == threads);
+    assert(firsts_secure.size() == threads);
+    
+    printf("Test random: %d threads passed.\n", threads);
+    
+    return 0;
+}
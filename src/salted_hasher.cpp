@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2013-2014 John Connor (BM-NC49AxAjcqVcF5jNPu85Rb8MJ2d9JqZt)
+ *
+ * This file is part of coinpp.
+ *
+ * coinpp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License with
+ * additional permissions to the one published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version. For more information see LICENSE.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <vector>
+
+#include <coin/flat_map.hpp>
+#include <coin/hash.hpp>
+#include <coin/protocol.hpp>
+#include <coin/random.hpp>
+#include <coin/salted_hasher.hpp>
+
+using namespace coin;
+
+const std::pair<std::uint64_t, std::uint64_t> & salted_hasher::salt()
+{
+    static const std::pair<std::uint64_t, std::uint64_t> g_salt(
+        random::secure_uint64(), random::secure_uint64()
+    );
+    
+    return g_salt;
+}
+
+std::size_t salted_hasher::operator () (const inventory_vector & val) const
+{
+    return static_cast<std::size_t> (
+        hash(
+            val.hash(), static_cast<std::uint32_t> (val.type()),
+            sha256::digest_length + sizeof(std::uint32_t)
+        )
+    );
+}
+
+/**
+ * Runs insert, lookup and erase over keys with M and returns the elapsed
+ * microseconds of each phase.
+ */
+template <typename M>
+static std::vector<long long> benchmark(
+    const std::vector<sha256> & keys, const std::vector<sha256> & absent,
+    std::size_t & found
+    )
+{
+    std::vector<long long> ret;
+    
+    M m;
+    
+    auto start = std::chrono::steady_clock::now();
+    
+    for (std::size_t i = 0; i < keys.size(); i++)
+    {
+        m[keys[i]] = static_cast<std::int32_t> (i);
+    }
+    
+    auto now = std::chrono::steady_clock::now();
+    
+    ret.push_back(
+        std::chrono::duration_cast<std::chrono::microseconds> (
+        now - start).count()
+    );
+    
+    start = now;
+    
+    for (auto & i : keys)
+    {
+        found += m.count(i);
+    }
+    
+    for (auto & i : absent)
+    {
+        found += m.count(i);
+    }
+    
+    now = std::chrono::steady_clock::now();
+    
+    ret.push_back(
+        std::chrono::duration_cast<std::chrono::microseconds> (
+        now - start).count()
+    );
+    
+    start = now;
+    
+    for (auto & i : keys)
+    {
+        found += m.erase(i);
+    }
+    
+    now = std::chrono::steady_clock::now();
+    
+    ret.push_back(
+        std::chrono::duration_cast<std::chrono::microseconds> (
+        now - start).count()
+    );
+    
+    return ret;
+}
+
+int salted_hasher::run_test()
+{
+    salted_hasher hasher;
+    
+    auto h = hash::sha256_random();
+    
+    /**
+     * The output index must change the hash of a point_out.
+     */
+    if (hasher(point_out(h, 0)) == hasher(point_out(h, 1)))
+    {
+        printf("Test salted_hasher: point_out collision.\n");
+        
+        return -1;
+    }
+    
+    flat_map<sha256, std::int32_t> m;
+    
+    std::map<sha256, std::int32_t> reference;
+    
+    /**
+     * Interleave inserts and erases so lookups run over tombstones.
+     */
+    for (auto i = 0; i < 100000; i++)
+    {
+        auto key = hash::sha256_random();
+        
+        m[key] = i;
+        reference[key] = i;
+        
+        if (i % 3 == 0)
+        {
+            m.erase(reference.begin()->first);
+            reference.erase(reference.begin());
+        }
+    }
+    
+    if (m.size() != reference.size())
+    {
+        printf("Test salted_hasher: size mismatch.\n");
+        
+        return -1;
+    }
+    
+    for (auto & i : reference)
+    {
+        auto it = m.find(i.first);
+        
+        if (it == m.end() || it->second != i.second)
+        {
+            printf("Test salted_hasher: lookup mismatch.\n");
+            
+            return -1;
+        }
+    }
+    
+    std::size_t count = 0;
+    
+    for (auto & i : m)
+    {
+        count += reference.count(i.first);
+    }
+    
+    if (count != reference.size())
+    {
+        printf("Test salted_hasher: iteration mismatch.\n");
+        
+        return -1;
+    }
+    
+    for (auto len : { 1000, 20000, 200000 })
+    {
+        std::vector<sha256> keys, absent;
+        
+        for (auto i = 0; i < len; i++)
+        {
+            keys.push_back(hash::sha256_random());
+            absent.push_back(hash::sha256_random());
+        }
+        
+        std::size_t found_map = 0, found_flat_map = 0;
+        
+        auto elapsed_map = benchmark< std::map<sha256, std::int32_t> > (
+            keys, absent, found_map
+        );
+        auto elapsed_flat_map = benchmark< flat_map<sha256, std::int32_t> > (
+            keys, absent, found_flat_map
+        );
+        
+        if (found_map != found_flat_map)
+        {
+            printf("Test salted_hasher: benchmark mismatch.\n");
+            
+            return -1;
+        }
+        
+        printf(
+            "Test salted_hasher: %d keys, std::map insert %lld, lookup %lld, "
+            "erase %lld us, flat_map insert %lld, lookup %lld, erase %lld "
+            "us.\n", len, elapsed_map[0], elapsed_map[1], elapsed_map[2],
+            elapsed_flat_map[0], elapsed_flat_map[1], elapsed_flat_map[2]
+        );
+    }
+    
+    return 0;
+}
@@ -125,21 +125,44 @@ script::script()
 }
 
 script::script(const script & other)
-    : std::vector<std::uint8_t> (other)
+    : prevector<28, std::uint8_t> (other)
 {
     // ...
 }
 
+script::script(script && other)
+    : prevector<28, std::uint8_t> (std::move(other))
+{
+    // ...
+}
+
+script & script::operator = (const script & other)
+{
+    prevector<28, std::uint8_t>::operator = (other);
+    
+    return *this;
+}
+
+script & script::operator = (script && other)
+{
+    prevector<28, std::uint8_t>::operator = (std::move(other));
+    
+    return *this;
+}
+
 script::script(
     const std::uint8_t * ptr_begin, const std::uint8_t * ptr_end
     )
-    : std::vector<std::uint8_t>(ptr_begin, ptr_end)
+    : prevector<28, std::uint8_t> (ptr_begin, ptr_end)
 {
     // ...
 }
 
-script::script(const_iterator it_begin, const_iterator it_end)
-    : std::vector<std::uint8_t> (it_begin, it_end)
+script::script(
+    std::vector<std::uint8_t>::const_iterator it_begin,
+    std::vector<std::uint8_t>::const_iterator it_end
+    )
+    : prevector<28, std::uint8_t> (it_begin, it_end)
 {
     // ...
 }
@@ -2124,13 +2147,9 @@ void script::print() const
 
 types::id_script_t script::get_id() const
 {
-    std::vector<std::uint8_t> bytes = *this;
-
     types::id_script_t ret;
     
-    auto hash160 = hash::sha256_ripemd160(
-        &bytes[0], bytes.size()
-    );
+    auto hash160 = hash::sha256_ripemd160(data(), size());
     
     std::memcpy(&ret.digest()[0], &hash160[0], hash160.size());
     
@@ -2429,7 +2448,7 @@ bool script::sign_signature(
         ;
         
         tx_in.script_signature() <<
-            static_cast< std::vector<std::uint8_t> >(subscript)
+            std::vector<std::uint8_t> (subscript.begin(), subscript.end())
         ;
         
         if (solved == false)
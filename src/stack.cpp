@@ -25,6 +25,7 @@
 #include <coin/protocol.hpp>
 #include <coin/stack.hpp>
 #include <coin/stack_impl.hpp>
+#include <coin/wallet_manager.hpp>
 
 using namespace coin;
 
@@ -86,6 +87,11 @@ void stack::send_coins(
 {
     if (stack_impl_)
     {
+        /**
+         * Wait for the wallet notifications so the balance is current.
+         */
+        wallet_manager::instance().sync();
+        
         stack_impl_->send_coins(amount, destination, wallet_values);
     }
     else
@@ -0,0 +1,267 @@
+/*
+ * Copyright (c) 2013-2014 John Connor (BM-NC49AxAjcqVcF5jNPu85Rb8MJ2d9JqZt)
+ *
+ * This file is part of coinpp.
+ *
+ * coinpp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License with
+ * additional permissions to the one published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version. For more information see LICENSE.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cassert>
+#include <cstring>
+
+#include <coin/block.hpp>
+#include <coin/db_tx.hpp>
+#include <coin/hash.hpp>
+#include <coin/logger.hpp>
+#include <coin/stake_index.hpp>
+#include <coin/transaction.hpp>
+#include <coin/transaction_index.hpp>
+
+using namespace coin;
+
+stake_index & stake_index::instance()
+{
+    static stake_index g_stake_index;
+    
+    return g_stake_index;
+}
+
+bool stake_index::get(
+    db_tx & tx_db, const point_out & previous_out, entry_t & entry
+    )
+{
+    if (find(previous_out, entry))
+    {
+        return true;
+    }
+    
+    transaction tx_previous;
+    
+    transaction_index tx_index;
+    
+    if (
+        tx_previous.read_from_disk(tx_db, previous_out, tx_index) == false
+        )
+    {
+        return false;
+    }
+    
+    return get(tx_previous, previous_out.n(), tx_index, entry);
+}
+
+bool stake_index::get(
+    const transaction & tx, const std::uint32_t & n,
+    const transaction_index & tx_index, entry_t & entry
+    )
+{
+    if (n >= tx.transactions_out().size())
+    {
+        return false;
+    }
+    
+    auto previous_out = point_out(tx.get_hash(), n);
+    
+    if (find(previous_out, entry))
+    {
+        return true;
+    }
+    
+    const auto & position = tx_index.get_transaction_position();
+    
+    /**
+     * Read the block header.
+     */
+    block blk;
+    
+    if (
+        blk.read_from_disk(position.file_index(), position.block_position(),
+        false) == false
+        )
+    {
+        return false;
+    }
+    
+    entry.value = tx.transactions_out()[n].value();
+    entry.time_tx = tx.time();
+    entry.time_block = blk.header().timestamp;
+    entry.hash_block = blk.get_hash();
+    entry.tx_offset = position.tx_position() - position.block_position();
+    entry.script_public_key = tx.transactions_out()[n].script_public_key();
+    
+    /**
+     * Don't cache a spent output, on_block_connected has forgotten it.
+     */
+    if (
+        n < tx_index.spent().size() &&
+        tx_index.spent()[n].is_null() == false
+        )
+    {
+        return true;
+    }
+    
+    insert(previous_out, entry);
+    
+    return true;
+}
+
+void stake_index::on_block_connected(
+    const block & blk, const std::uint32_t & block_position,
+    const std::vector<std::uint32_t> & tx_positions
+    )
+{
+    assert(tx_positions.size() == blk.transactions().size());
+    
+    auto hash_block = blk.get_hash();
+    
+    for (std::size_t i = 0; i < blk.transactions().size(); i++)
+    {
+        const auto & tx = blk.transactions()[i];
+        
+        if (tx.is_coin_base() == false)
+        {
+            std::lock_guard<std::mutex> l1(mutex_);
+            
+            for (auto & j : tx.transactions_in())
+            {
+                m_entries.erase(make_key(j.previous_out()));
+            }
+        }
+        
+        auto hash_tx = tx.get_hash();
+        
+        for (std::uint32_t j = 0; j < tx.transactions_out().size(); j++)
+        {
+            entry_t entry;
+            
+            entry.value = tx.transactions_out()[j].value();
+            entry.time_tx = tx.time();
+            entry.time_block = blk.header().timestamp;
+            entry.hash_block = hash_block;
+            entry.tx_offset = tx_positions[i] - block_position;
+            entry.script_public_key =
+                tx.transactions_out()[j].script_public_key()
+            ;
+            
+            insert(point_out(hash_tx, j), entry);
+        }
+    }
+}
+
+void stake_index::on_block_disconnected(const block & blk)
+{
+    std::lock_guard<std::mutex> l1(mutex_);
+    
+    for (auto & i : blk.transactions())
+    {
+        if (i.is_coin_base() == false)
+        {
+            for (auto & j : i.transactions_in())
+            {
+                m_entries.erase(make_key(j.previous_out()));
+            }
+        }
+        
+        auto hash_tx = i.get_hash();
+        
+        for (std::uint32_t j = 0; j < i.transactions_out().size(); j++)
+        {
+            m_entries.erase(make_key(point_out(hash_tx, j)));
+        }
+    }
+}
+
+void stake_index::clear()
+{
+    std::lock_guard<std::mutex> l1(mutex_);
+    
+    m_entries.clear();
+}
+
+std::size_t stake_index::size()
+{
+    std::lock_guard<std::mutex> l1(mutex_);
+    
+    return m_entries.size();
+}
+
+stake_index::key_t stake_index::make_key(const point_out & previous_out)
+{
+    key_t ret;
+    
+    std::memcpy(
+        &ret.first[0], previous_out.get_hash().digest(), sha256::digest_length
+    );
+    
+    ret.second = previous_out.n();
+    
+    return ret;
+}
+
+bool stake_index::find(const point_out & previous_out, entry_t & entry)
+{
+    std::lock_guard<std::mutex> l1(mutex_);
+    
+    auto it = m_entries.find(make_key(previous_out));
+    
+    if (it == m_entries.end())
+    {
+        return false;
+    }
+    
+    entry.value = it->second.value;
+    entry.time_tx = it->second.time_tx;
+    entry.time_block = it->second.time_block;
+    entry.hash_block = sha256::from_digest(&it->second.hash_block[0]);
+    entry.tx_offset = it->second.tx_offset;
+    entry.script_public_key = it->second.script_public_key;
+    
+    return true;
+}
+
+void stake_index::insert(const point_out & previous_out, const entry_t & entry)
+{
+    record_t record;
+    
+    record.value = entry.value;
+    record.time_tx = entry.time_tx;
+    record.time_block = entry.time_block;
+    record.tx_offset = entry.tx_offset;
+    std::memcpy(
+        &record.hash_block[0], entry.hash_block.digest(),
+        sha256::digest_length
+    );
+    record.script_public_key = entry.script_public_key;
+    
+    std::lock_guard<std::mutex> l1(mutex_);
+    
+    /**
+     * Evict random entries when full.
+     */
+    while (m_entries.size() >= max_entries)
+    {
+        auto it = m_entries.lower_bound(
+            make_key(point_out(hash::sha256_random(), 0))
+        );
+        
+        if (it == m_entries.end())
+        {
+            it = m_entries.begin();
+        }
+        
+        m_entries.erase(it);
+    }
+    
+    m_entries[make_key(previous_out)] = record;
+}
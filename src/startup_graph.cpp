@@ -0,0 +1,512 @@
+/*
+ * Copyright (c) 2013-2014 John Connor (BM-NC49AxAjcqVcF5jNPu85Rb8MJ2d9JqZt)
+ *
+ * This file is part of coinpp.
+ *
+ * coinpp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License with
+ * additional permissions to the one published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version. For more information see LICENSE.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+
+#include <coin/logger.hpp>
+#include <coin/startup_graph.hpp>
+
+using namespace coin;
+
+void startup_graph::add(
+    const std::string & name, const std::function<bool ()> & f,
+    const std::vector<std::string> & dependencies
+    )
+{
+    m_phases.push_back({ name, f, dependencies });
+}
+
+bool startup_graph::run()
+{
+    enum { state_waiting, state_running, state_done, state_failed };
+    
+    std::map<std::string, std::int32_t> states;
+    
+    for (auto & i : m_phases)
+    {
+        states[i.name] = state_waiting;
+    }
+    
+    m_timings.clear();
+    
+    std::mutex mutex;
+    
+    std::condition_variable condition;
+    
+    std::exception_ptr error;
+    
+    std::vector<std::thread> threads;
+    
+    auto running = 0;
+    
+    auto start = std::chrono::steady_clock::now();
+    
+    auto elapsed = [&start]()
+    {
+        return static_cast<std::uint32_t> (
+            std::chrono::duration_cast<std::chrono::milliseconds> (
+            std::chrono::steady_clock::now() - start).count()
+        );
+    };
+    
+    std::unique_lock<std::mutex> l1(mutex);
+    
+    for (;;)
+    {
+        auto changed = false;
+        
+        for (auto & i : m_phases)
+        {
+            if (states[i.name] != state_waiting)
+            {
+                continue;
+            }
+            
+            auto is_ready = true;
+            auto is_blocked = false;
+            
+            for (auto & j : i.dependencies)
+            {
+                auto it = states.find(j);
+                
+                if (it == states.end() || it->second == state_failed)
+                {
+                    is_blocked = true;
+                }
+                else if (it->second != state_done)
+                {
+                    is_ready = false;
+                }
+            }
+            
+            if (is_blocked)
+            {
+                log_error(
+                    "Startup phase " << i.name << " skipped, a dependency "
+                    "failed or does not exist."
+                );
+                
+                states[i.name] = state_failed;
+                
+                m_timings.push_back({ i.name, elapsed(), 0, false });
+                
+                changed = true;
+            }
+            else if (is_ready)
+            {
+                states[i.name] = state_running;
+                
+                running++;
+                
+                auto phase = &i;
+                
+                auto milliseconds_start = elapsed();
+                
+                threads.push_back(std::thread(
+                    [&, phase, milliseconds_start]()
+                {
+                    auto success = false;
+                    
+                    std::exception_ptr e;
+                    
+                    try
+                    {
+                        success = phase->f();
+                    }
+                    catch (...)
+                    {
+                        e = std::current_exception();
+                    }
+                    
+                    std::lock_guard<std::mutex> l2(mutex);
+                    
+                    auto milliseconds = elapsed() - milliseconds_start;
+                    
+                    states[phase->name] = success ? state_done : state_failed;
+                    
+                    m_timings.push_back(
+                        { phase->name, milliseconds_start, milliseconds,
+                        success }
+                    );
+                    
+                    log_info(
+                        "Startup phase " << phase->name << " " <<
+                        (success ? "completed" : "failed") << " in " <<
+                        milliseconds << " ms (started at +" <<
+                        milliseconds_start << " ms)."
+                    );
+                    
+                    if (e && error == nullptr)
+                    {
+                        error = e;
+                    }
+                    
+                    running--;
+                    
+                    condition.notify_one();
+                }));
+                
+                changed = true;
+            }
+        }
+        
+        if (changed)
+        {
+            continue;
+        }
+        
+        if (running == 0)
+        {
+            /**
+             * Anything still waiting is part of a cycle.
+             */
+            for (auto & i : m_phases)
+            {
+                if (states[i.name] == state_waiting)
+                {
+                    log_error(
+                        "Startup phase " << i.name << " skipped, it's "
+                        "dependencies form a cycle."
+                    );
+                    
+                    states[i.name] = state_failed;
+                    
+                    m_timings.push_back({ i.name, elapsed(), 0, false });
+                }
+            }
+            
+            break;
+        }
+        
+        condition.wait(l1);
+    }
+    
+    l1.unlock();
+    
+    for (auto & i : threads)
+    {
+        i.join();
+    }
+    
+    auto success = true;
+    
+    std::uint32_t milliseconds_serial = 0;
+    
+    for (auto & i : m_timings)
+    {
+        success = success && i.success;
+        
+        milliseconds_serial += i.milliseconds;
+    }
+    
+    log_info(
+        "Startup phases " << (success ? "completed" : "failed") << " in " <<
+        elapsed() << " ms (" << milliseconds_serial << " ms if run serially)."
+    );
+    
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+    
+    return success;
+}
+
+const std::vector<startup_graph::timing_t> & startup_graph::timings() const
+{
+    return m_timings;
+}
+
+void startup_graph::parallel(
+    const std::vector< std::function<void ()> > & jobs
+    )
+{
+    std::size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    
+    threads = std::min(threads, jobs.size());
+    
+    if (threads <= 1)
+    {
+        for (auto & i : jobs)
+        {
+            i();
+        }
+        
+        return;
+    }
+    
+    std::atomic<std::size_t> next(0);
+    
+    std::mutex mutex;
+    
+    std::exception_ptr error;
+    
+    auto work = [&]()
+    {
+        for (;;)
+        {
+            auto index = next++;
+            
+            if (index >= jobs.size())
+            {
+                break;
+            }
+            
+            try
+            {
+                jobs[index]();
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> l1(mutex);
+                
+                if (error == nullptr)
+                {
+                    error = std::current_exception();
+                }
+            }
+        }
+    };
+    
+    std::vector<std::thread> workers;
+    
+    for (std::size_t i = 1; i < threads; i++)
+    {
+        workers.push_back(std::thread(work));
+    }
+    
+    work();
+    
+    for (auto & i : workers)
+    {
+        i.join();
+    }
+    
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+}
+
+int startup_graph::run_test()
+{
+    /**
+     * Three independent loading phases and one that depends on two of
+     * them, the overlapped run should take about as long as the longest
+     * chain instead of the sum.
+     */
+    auto sleep = [](const std::uint32_t & milliseconds)
+    {
+        return [milliseconds]()
+        {
+            std::this_thread::sleep_for(
+                std::chrono::milliseconds(milliseconds)
+            );
+            
+            return true;
+        };
+    };
+    
+    std::mutex mutex;
+    
+    std::condition_variable condition;
+    
+    std::size_t running = 0, running_maximum = 0;
+    
+    std::set<std::string> done;
+    
+    /**
+     * An independent phase waits (bounded) for the others to be running
+     * at the same time.
+     */
+    auto independent = [&](
+        const std::string & name, const std::uint32_t & milliseconds
+        )
+    {
+        return [&, name, milliseconds]()
+        {
+            std::unique_lock<std::mutex> l1(mutex);
+            
+            running_maximum = std::max(running_maximum, ++running);
+            
+            condition.notify_all();
+            
+            condition.wait_for(l1, std::chrono::seconds(10), [&]()
+            {
+                return running_maximum == 3;
+            });
+            
+            l1.unlock();
+            
+            std::this_thread::sleep_for(
+                std::chrono::milliseconds(milliseconds)
+            );
+            
+            l1.lock();
+            
+            --running;
+            
+            done.insert(name);
+            
+            return true;
+        };
+    };
+    
+    auto rescan_after = false;
+    
+    startup_graph graph;
+    
+    graph.add("block_index", independent("block_index", 300));
+    graph.add("wallet", independent("wallet", 200));
+    graph.add("peers", independent("peers", 100));
+    graph.add("wallet_rescan", [&]()
+    {
+        std::lock_guard<std::mutex> l1(mutex);
+        
+        rescan_after =
+            done.count("block_index") > 0 && done.count("wallet") > 0
+        ;
+        
+        return sleep(100)();
+    }, { "block_index", "wallet" });
+    
+    auto start = std::chrono::steady_clock::now();
+    
+    auto success = graph.run();
+    
+    auto milliseconds = std::chrono::duration_cast<
+        std::chrono::milliseconds
+    > (std::chrono::steady_clock::now() - start).count();
+    
+    assert(success);
+    
+    /**
+     * The independent phases ran at the same time and the dependent one
+     * only after both of it's dependencies.
+     */
+    assert(running_maximum == 3);
+    assert(rescan_after);
+    
+    auto & timings = graph.timings();
+    
+    assert(timings.size() == 4);
+    assert(timings.back().name == "wallet_rescan");
+    
+    for (auto & i : timings)
+    {
+        assert(i.success);
+        
+        if (i.name == "block_index" || i.name == "wallet")
+        {
+            assert(
+                timings.back().milliseconds_start >=
+                i.milliseconds_start + i.milliseconds
+            );
+        }
+    }
+    
+    printf(
+        "Test startup_graph: 700 ms of phases completed in %lld ms.\n",
+        static_cast<long long> (milliseconds)
+    );
+    
+    /**
+     * A failed phase skips it's dependents and an exception is rethrown.
+     */
+    startup_graph graph_failed;
+    
+    graph_failed.add("block_index", []()
+    {
+        throw std::runtime_error("failed stake modifier checkpoint");
+        
+        return true;
+    });
+    graph_failed.add("peers", sleep(10));
+    graph_failed.add("wallet_rescan", sleep(10), { "block_index" });
+    
+    auto did_throw = false;
+    
+    try
+    {
+        graph_failed.run();
+    }
+    catch (std::exception & e)
+    {
+        did_throw = true;
+    }
+    
+    assert(did_throw);
+    assert(graph_failed.timings().size() == 3);
+    
+    for (auto & i : graph_failed.timings())
+    {
+        assert(i.success == (i.name == "peers"));
+    }
+    
+    /**
+     * A cycle does not hang.
+     */
+    startup_graph graph_cycle;
+    
+    graph_cycle.add("a", sleep(1), { "b" });
+    graph_cycle.add("b", sleep(1), { "a" });
+    
+    assert(graph_cycle.run() == false);
+    
+    /**
+     * The parallel jobs.
+     */
+    std::vector<std::uint64_t> sums(64, 0);
+    
+    std::vector< std::function<void ()> > jobs;
+    
+    for (std::size_t i = 0; i < sums.size(); i++)
+    {
+        jobs.push_back([i, &sums]()
+        {
+            for (auto j = 0; j < 100000; j++)
+            {
+                sums[i] += j;
+            }
+        });
+    }
+    
+    parallel(jobs);
+    
+    for (auto & i : sums)
+    {
+        assert(i == 4999950000ULL);
+    }
+    
+    printf("Test startup_graph: passed.\n");
+    
+    return 0;
+}
@@ -0,0 +1,547 @@
+/*
+ * Copyright (c) 2013-2014 John Connor (BM-NC49AxAjcqVcF5jNPu85Rb8MJ2d9JqZt)
+ *
+ * This file is part of coinpp.
+ *
+ * coinpp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License with
+ * additional permissions to the one published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version. For more information see LICENSE.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+#include <coin/logger.hpp>
+#include <coin/status_bus.hpp>
+
+using namespace coin;
+
+const status_bus::key_t status_bus::key_reload =
+    std::make_pair(status_bus::kind_wallet_transaction, "*")
+;
+
+status_bus::status_bus()
+    : m_sequence(0)
+    , m_stats()
+{
+    // ...
+}
+
+void status_bus::insert(const std::map<std::string, std::string> & pairs)
+{
+    auto k = kind(pairs);
+    
+    std::string identity;
+    
+    if (k == kind_wallet_transaction)
+    {
+        /**
+         * Coalesce the updates of the same transaction only.
+         */
+        auto it = pairs.find("wallet.transaction.hash");
+        
+        if (it != pairs.end())
+        {
+            identity = it->second;
+        }
+    }
+    
+    std::lock_guard<std::mutex> l1(mutex_);
+    
+    m_stats.inserted++;
+    
+    /**
+     * Events of an unknown kind are never coalesced.
+     */
+    if (k == kind_other)
+    {
+        identity = std::to_string(m_sequence);
+    }
+    
+    auto key = std::make_pair(k, identity);
+    
+    auto it = m_events.find(key);
+    
+    if (it == m_events.end())
+    {
+        auto reload_pending = m_events.count(key_reload) > 0;
+        
+        if (
+            m_events.size() >= maximum_events &&
+            (k != kind_wallet_transaction || reload_pending == false)
+            )
+        {
+            make_room();
+        }
+        
+        /**
+         * A pending reload covers every wallet transaction (including this
+         * one when make_room has just collapsed them).
+         */
+        if (
+            k == kind_wallet_transaction &&
+            m_events.count(key_reload) > 0
+            )
+        {
+            m_stats.coalesced++;
+            
+            return;
+        }
+        
+        event_t event;
+        
+        event.sequence = m_sequence++;
+        event.pairs = pairs;
+        
+        m_order[event.sequence] = key;
+        
+        m_events[key] = event;
+        
+        m_stats.pending_maximum = std::max(
+            m_stats.pending_maximum, m_events.size()
+        );
+    }
+    else
+    {
+        /**
+         * A transaction the consumer has not seen yet stays new.
+         */
+        auto it_value = it->second.pairs.find("value");
+        
+        auto is_new =
+            k == kind_wallet_transaction &&
+            it_value != it->second.pairs.end() && it_value->second == "new"
+        ;
+        
+        /**
+         * The latest event replaces the pending one but keeps its place.
+         */
+        it->second.pairs = pairs;
+        
+        if (is_new)
+        {
+            it->second.pairs["value"] = "new";
+        }
+        
+        m_stats.coalesced++;
+    }
+}
+
+std::vector< std::map<std::string, std::string> > status_bus::drain()
+{
+    std::vector< std::map<std::string, std::string> > ret;
+    
+    std::lock_guard<std::mutex> l1(mutex_);
+    
+    ret.reserve(m_order.size());
+    
+    for (auto & i : m_order)
+    {
+        auto it = m_events.find(i.second);
+        
+        assert(it != m_events.end());
+        
+        ret.push_back(std::move(it->second.pairs));
+    }
+    
+    m_events.clear();
+    m_order.clear();
+    
+    m_stats.delivered += ret.size();
+    
+    return ret;
+}
+
+void status_bus::clear()
+{
+    std::lock_guard<std::mutex> l1(mutex_);
+    
+    m_events.clear();
+    m_order.clear();
+}
+
+std::size_t status_bus::size()
+{
+    std::lock_guard<std::mutex> l1(mutex_);
+    
+    return m_events.size();
+}
+
+status_bus::stats_t status_bus::stats()
+{
+    std::lock_guard<std::mutex> l1(mutex_);
+    
+    return m_stats;
+}
+
+status_bus::kind_t status_bus::kind(
+    const std::map<std::string, std::string> & pairs
+    )
+{
+    auto it = pairs.find("type");
+    
+    if (it != pairs.end())
+    {
+        const auto & type = it->second;
+        
+        if (type == "block")
+        {
+            return kind_block;
+        }
+        else if (type == "blockchain")
+        {
+            return kind_blockchain;
+        }
+        else if (type == "database")
+        {
+            return kind_database;
+        }
+        else if (type == "mining")
+        {
+            return kind_mining;
+        }
+        else if (type == "network")
+        {
+            return kind_network;
+        }
+        else if (type == "wallet")
+        {
+            return kind_wallet;
+        }
+        else if (type == "wallet.transaction")
+        {
+            return kind_wallet_transaction;
+        }
+    }
+    
+    return kind_other;
+}
+
+int status_bus::run_test()
+{
+    enum
+    {
+        events = 1000000,
+        transactions = 20000,
+        interval_drain = 100,
+    };
+    
+    status_bus bus;
+    
+    std::atomic<bool> done(false);
+    
+    std::int64_t latency_maximum = 0;
+    
+    std::string height_last;
+    
+    auto now = []()
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds> (
+            std::chrono::steady_clock::now().time_since_epoch()
+        ).count();
+    };
+    
+    /**
+     * The consumer drains a batch per tick like the status_manager does.
+     */
+    auto consume = [&]()
+    {
+        for (auto & i : bus.drain())
+        {
+            /**
+             * A (collapsed) wallet reload has no time.
+             */
+            if (i.count("time") == 0)
+            {
+                continue;
+            }
+            
+            auto latency = now() - std::stoll(i["time"]);
+            
+            latency_maximum = std::max<std::int64_t> (
+                latency_maximum, latency
+            );
+            
+            if (i["type"] == "block")
+            {
+                height_last = i["block.number"];
+            }
+        }
+    };
+    
+    std::thread consumer([&]()
+    {
+        while (done == false)
+        {
+            std::this_thread::sleep_for(
+                std::chrono::milliseconds(interval_drain)
+            );
+            
+            consume();
+        }
+    });
+    
+    auto time_start = std::chrono::steady_clock::now();
+    
+    /**
+     * Flood block height, balance, hashrate, peers and (unique) wallet
+     * transaction events.
+     */
+    for (auto i = 0; i < events; i++)
+    {
+        std::map<std::string, std::string> pairs;
+        
+        switch (i % 5)
+        {
+            case 0:
+            {
+                pairs["type"] = "block";
+                pairs["block.number"] = std::to_string(i);
+            }
+            break;
+            case 1:
+            {
+                pairs["type"] = "wallet";
+                pairs["wallet.balance"] = std::to_string(i);
+            }
+            break;
+            case 2:
+            {
+                pairs["type"] = "mining";
+                pairs["mining.hashes_per_second"] = std::to_string(i);
+            }
+            break;
+            case 3:
+            {
+                pairs["type"] = "network";
+                pairs["network.tcp.connections"] = std::to_string(i % 125);
+            }
+            break;
+            default:
+            {
+                pairs["type"] = "wallet.transaction";
+                pairs["wallet.transaction.hash"] = std::to_string(
+                    (i / 5) % transactions
+                );
+            }
+            break;
+        }
+        
+        pairs["time"] = std::to_string(now());
+        
+        bus.insert(pairs);
+    }
+    
+    auto milliseconds_insert =
+        std::chrono::duration_cast<std::chrono::milliseconds> (
+        std::chrono::steady_clock::now() - time_start).count()
+    ;
+    
+    done = true;
+    
+    consumer.join();
+    
+    consume();
+    
+    auto stats = bus.stats();
+    
+    printf(
+        "Test status_bus: %d events in %lld ms, delivered = %llu, "
+        "coalesced = %llu, dropped = %llu, pending maximum = %zu, "
+        "latency maximum = %lld ms.\n", static_cast<int> (events),
+        static_cast<long long> (milliseconds_insert),
+        static_cast<unsigned long long> (stats.delivered),
+        static_cast<unsigned long long> (stats.coalesced),
+        static_cast<unsigned long long> (stats.dropped),
+        stats.pending_maximum, static_cast<long long> (latency_maximum / 1000)
+    );
+    
+    /**
+     * The pending events never exceed the cap.
+     */
+    assert(stats.pending_maximum <= maximum_events);
+    
+    /**
+     * The last block height always reaches the consumer.
+     */
+    assert(height_last == std::to_string(events - 5));
+    
+    assert(stats.dropped == 0);
+    assert(stats.delivered + stats.coalesced == events);
+    
+    /**
+     * A new transaction that is updated before the consumer sees it is
+     * delivered once, as new, with the latest values.
+     */
+    std::map<std::string, std::string> tx;
+    
+    tx["type"] = "wallet.transaction";
+    tx["value"] = "new";
+    tx["wallet.transaction.hash"] = "a";
+    tx["wallet.transaction.confirmations"] = "0";
+    
+    bus.insert(tx);
+    
+    tx["value"] = "updated";
+    tx["wallet.transaction.confirmations"] = "1";
+    
+    bus.insert(tx);
+    
+    /**
+     * Keys missing from the latest event are not carried over.
+     */
+    std::map<std::string, std::string> block;
+    
+    block["type"] = "block";
+    block["block.number"] = "1";
+    block["block.hash"] = "b";
+    
+    bus.insert(block);
+    
+    block.erase("block.hash");
+    block["block.number"] = "2";
+    
+    bus.insert(block);
+    
+    auto drained = bus.drain();
+    
+    assert(drained.size() == 2);
+    assert(drained[0]["value"] == "new");
+    assert(drained[0]["wallet.transaction.confirmations"] == "1");
+    assert(drained[1]["block.number"] == "2");
+    assert(drained[1].count("block.hash") == 0);
+    
+    /**
+     * When full only events of an unknown kind are dropped.
+     */
+    bus.insert(tx);
+    
+    for (std::size_t i = 0; i < maximum_events * 2; i++)
+    {
+        std::map<std::string, std::string> other;
+        
+        other["type"] = "other";
+        
+        bus.insert(other);
+    }
+    
+    drained = bus.drain();
+    
+    assert(drained.size() == maximum_events);
+    assert(drained[0]["wallet.transaction.hash"] == "a");
+    
+    /**
+     * When full of wallet transactions they collapse into a reload that
+     * absorbs the ones that follow, other kinds are still delivered.
+     */
+    bus.insert(block);
+    
+    for (std::size_t i = 0; i < maximum_events * 2; i++)
+    {
+        tx["wallet.transaction.hash"] = std::to_string(i);
+        
+        bus.insert(tx);
+    }
+    
+    bus.insert(block);
+    
+    assert(bus.size() <= maximum_events);
+    
+    drained = bus.drain();
+    
+    auto reloads = 0;
+    
+    for (auto & i : drained)
+    {
+        if (i["value"] == "reload")
+        {
+            reloads++;
+        }
+        else
+        {
+            assert(i["type"] != "wallet.transaction");
+        }
+    }
+    
+    assert(reloads == 1);
+    assert(drained[0]["type"] == "block");
+    
+    return 0;
+}
+
+void status_bus::make_room()
+{
+    /**
+     * Drop the oldest event of an unknown kind.
+     */
+    for (auto it = m_order.begin(); it != m_order.end(); ++it)
+    {
+        if (it->second.first == kind_other)
+        {
+            m_events.erase(it->second);
+            
+            m_order.erase(it);
+            
+            m_stats.dropped++;
+            
+            return;
+        }
+    }
+    
+    /**
+     * The other kinds have one event each except wallet transactions
+     * (one per transaction), collapse those into a reload that takes the
+     * place of the oldest.
+     */
+    std::uint64_t sequence = 0;
+    
+    std::size_t collapsed = 0;
+    
+    for (auto it = m_order.begin(); it != m_order.end();)
+    {
+        if (it->second.first == kind_wallet_transaction)
+        {
+            if (collapsed++ == 0)
+            {
+                sequence = it->first;
+            }
+            
+            m_events.erase(it->second);
+            
+            it = m_order.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+    
+    if (collapsed > 0)
+    {
+        event_t event;
+        
+        event.sequence = sequence;
+        event.pairs["type"] = "wallet.transaction";
+        event.pairs["value"] = "reload";
+        
+        m_order[event.sequence] = key_reload;
+        
+        m_events[key_reload] = event;
+        
+        m_stats.coalesced += collapsed - 1;
+    }
+}
@@ -45,14 +45,12 @@ void status_manager::start()
 void status_manager::stop()
 {
     timer_.cancel();
-    pairs_.clear();
+    status_bus_.clear();
 }
 
 void status_manager::insert(const std::map<std::string, std::string> & pairs)
 {
-    std::lock_guard<std::mutex> l1(mutex_);
-
-    pairs_.push_back(pairs);
+    status_bus_.insert(pairs);
 }
 
 void status_manager::do_tick(const std::uint32_t & interval)
@@ -69,47 +67,18 @@ void status_manager::do_tick(const std::uint32_t & interval)
         }
         else
         {
-            std::lock_guard<std::mutex> l1(mutex_);
-
-            if (pairs_.size() > 0)
-            {
-                /**
-                 * Get the pairs at the front.
-                 */
-                const auto & pairs = pairs_.front();
-                
-                /**
-                 * Callback the pairs.
-                 */
-                stack_impl_.on_status(pairs);
-                
-                /**
-                 * Erase the pairs at the front.
-                 */
-                pairs_.erase(pairs_.begin());
-
-                if (pairs_.size() > 0)
-                {
-                    /**
-                     * Start the timer.
-                     */
-                    do_tick(interval_callback);
-                }
-                else
-                {
-                    /**
-                     * Start the timer.
-                     */
-                    do_tick(1000);
-                }
-            }
-            else
+            /**
+             * Callback every pending (coalesced) event.
+             */
+            for (auto & i : status_bus_.drain())
             {
-                /**
-                 * Start the timer.
-                 */
-                do_tick(1000);
+                stack_impl_.on_status(i);
             }
+            
+            /**
+             * Start the timer.
+             */
+            do_tick(interval_callback);
         }
     }));
 }
@@ -31,6 +31,7 @@
 #include <coin/globals.hpp>
 #include <coin/logger.hpp>
 #include <coin/message.hpp>
+#include <coin/message_scheduler.hpp>
 #include <coin/network.hpp>
 #include <coin/random.hpp>
 #include <coin/tcp_acceptor.hpp>
@@ -38,6 +39,7 @@
 #include <coin/tcp_connection_manager.hpp>
 #include <coin/tcp_transport.hpp>
 #include <coin/transaction_pool.hpp>
+#include <coin/tx_reconciliation.hpp>
 #include <coin/stack_impl.hpp>
 #include <coin/time.hpp>
 #include <coin/utility.hpp>
@@ -57,6 +59,12 @@ tcp_connection::tcp_connection(
     , m_protocol_version_start_height(-1)
     , m_sent_getaddr(false)
     , m_dos_score(0)
+    , m_time_connected(std::time(0))
+    , m_check_sequence(
+        std::make_shared<check_pool::sequence> (
+        check_pool::instance(), globals::instance().strand())
+    )
+    , m_tx_reconciliation_flood(false)
     , io_service_(ios)
     , strand_(ios)
     , stack_impl_(owner)
@@ -66,13 +74,18 @@ tcp_connection::tcp_connection(
     , timer_delayed_stop_(ios)
     , timer_getblocks_(ios)
     , timer_addr_rebroadcast_(ios)
+    , timer_tx_reconciliation_(ios)
 {
-    // ...
+    m_bytes_sent.fill(0);
+    m_bytes_received.fill(0);
 }
 
 tcp_connection::~tcp_connection()
 {
-    // ...
+    if (auto scheduler = message_scheduler_.lock())
+    {
+        scheduler->remove_peer(this);
+    }
 }
 
 void tcp_connection::start()
@@ -91,6 +104,20 @@ void tcp_connection::start()
                 on_read(buf, len);
             });
 
+            /**
+             * Add to the message_scheduler.
+             */
+            add_to_message_scheduler();
+
+            /**
+             * Set the upload shaping token buckets.
+             */
+            transport->set_token_buckets(
+                stack_impl_.get_tcp_connection_manager()->token_bucket_relay(),
+                stack_impl_.get_tcp_connection_manager(
+                    )->token_bucket_historical()
+            );
+            
             /**
              * Start the transport accepting the connection.
              */
@@ -150,6 +177,20 @@ void tcp_connection::start(const boost::asio::ip::tcp::endpoint & ep)
                 on_read(buf, len);
             });
 
+            /**
+             * Add to the message_scheduler.
+             */
+            add_to_message_scheduler();
+
+            /**
+             * Set the upload shaping token buckets.
+             */
+            transport->set_token_buckets(
+                stack_impl_.get_tcp_connection_manager()->token_bucket_relay(),
+                stack_impl_.get_tcp_connection_manager(
+                    )->token_bucket_historical()
+            );
+            
             /**
              * Start the transport connecting to the endpoint.
              */
@@ -215,10 +256,20 @@ void tcp_connection::stop()
     }
     
     read_queue_.clear();
+    
+    /**
+     * Drop any messages not yet handled.
+     */
+    if (auto scheduler = message_scheduler_.lock())
+    {
+        scheduler->remove_peer(this);
+    }
+    
     timer_ping_.cancel();
     timer_getblocks_.cancel();
     timer_addr_rebroadcast_.cancel();
     timer_delayed_stop_.cancel();
+    timer_tx_reconciliation_.cancel();
 }
 
 void tcp_connection::stop_after(const std::uint32_t & interval)
@@ -252,6 +303,16 @@ void tcp_connection::send(const char * buf, const std::size_t & len)
 {
     if (auto transport = m_tcp_transport.lock())
     {
+        /**
+         * The command follows the four byte magic in the header.
+         */
+        if (len >= message::header_length)
+        {
+            std::string command(buf + 4, std::find(buf + 4, buf + 16, 0));
+            
+            m_bytes_sent[traffic_class(command)] += len;
+        }
+        
         transport->write(buf, len);
     }
     else
@@ -304,7 +365,7 @@ void tcp_connection::send_addr_message(const bool & local_address_only)
         /**
          * Write the message.
          */
-        t->write(msg.data(), msg.size());
+        write_message(t, msg);
     }
     else
     {
@@ -355,7 +416,7 @@ void tcp_connection::send_getblocks_message(
         /**
          * Write the message.
          */
-        t->write(msg.data(), msg.size());
+        write_message(t, msg);
     }
     else
     {
@@ -394,7 +455,7 @@ void tcp_connection::send_inv_message(
         /**
          * Write the message.
          */
-        t->write(msg.data(), msg.size());
+        write_message(t, msg);
     }
     else
     {
@@ -404,7 +465,7 @@ void tcp_connection::send_inv_message(
 
 void tcp_connection::send_inv_message(
     const inventory_vector::type_t & type,
-    const std::vector<sha256> & block_hashes
+    const std::vector<sha256> & block_hashes, const bool & historical
     )
 {
     if (auto t = m_tcp_transport.lock())
@@ -437,7 +498,7 @@ void tcp_connection::send_inv_message(
         /**
          * Write the message.
          */
-        t->write(msg.data(), msg.size());
+        write_message(t, msg, historical);
     }
     else
     {
@@ -493,7 +554,7 @@ void tcp_connection::send_relayed_inv_message(
         /**
          * Write the message.
          */
-        t->write(msg.data(), msg.size());
+        write_message(t, msg);
     }
     else
     {
@@ -557,7 +618,7 @@ void tcp_connection::send_checkpoint_message(checkpoint_sync & checkpoint)
             /**
              * Write the message.
              */
-            t->write(msg.data(), msg.size());
+            write_message(t, msg);
         }
     }
     else
@@ -626,6 +687,177 @@ bool tcp_connection::is_transport_valid()
     return false;
 }
 
+const std::uint64_t & tcp_connection::bytes_sent(
+    const traffic_class_t & val
+    ) const
+{
+    return m_bytes_sent[val];
+}
+
+const std::uint64_t & tcp_connection::bytes_received(
+    const traffic_class_t & val
+    ) const
+{
+    return m_bytes_received[val];
+}
+
+tcp_connection::traffic_class_t tcp_connection::traffic_class(
+    const std::string & command
+    )
+{
+    if (command == "block")
+    {
+        return traffic_class_block;
+    }
+    else if (command == "tx")
+    {
+        return traffic_class_tx;
+    }
+    else if (
+        command == "inv" || command == "getdata" || command == "sketch" ||
+        command == "recondiff"
+        )
+    {
+        return traffic_class_inv;
+    }
+    
+    return traffic_class_control;
+}
+
+const char * tcp_connection::traffic_class_name(const traffic_class_t & val)
+{
+    switch (val)
+    {
+        case traffic_class_control:
+            return "control";
+        case traffic_class_inv:
+            return "inv";
+        case traffic_class_tx:
+            return "tx";
+        case traffic_class_block:
+            return "block";
+        case traffic_class_block_historical:
+            return "block.historical";
+        default:
+            break;
+    }
+    
+    return "unknown";
+}
+
+peer_quality tcp_connection::quality()
+{
+    std::lock_guard<std::mutex> l1(mutex_peer_quality_);
+    
+    return m_peer_quality;
+}
+
+const std::time_t & tcp_connection::time_connected() const
+{
+    return m_time_connected;
+}
+
+bool tcp_connection::is_tx_reconciliation_flood()
+{
+    std::lock_guard<std::mutex> l1(mutex_tx_reconciliation_);
+    
+    return m_tx_reconciliation_flood;
+}
+
+bool tcp_connection::relay_tx_reconciled(
+    const sha256 & hash_tx, const bool & is_source
+    )
+{
+    std::shared_ptr<tx_reconciliation> reconciliation;
+    
+    {
+        std::lock_guard<std::mutex> l1(mutex_tx_reconciliation_);
+        
+        if (m_tx_reconciliation_flood)
+        {
+            return false;
+        }
+        
+        reconciliation = m_tx_reconciliation;
+    }
+    
+    if (reconciliation == nullptr)
+    {
+        return false;
+    }
+    
+    /**
+     * The peer we got the transaction from already has it.
+     */
+    if (is_source == false && reconciliation->add(hash_tx) == false)
+    {
+        send_inv_message(inventory_vector::type_msg_tx, hash_tx);
+    }
+    
+    return true;
+}
+
+void tcp_connection::write_message(
+    const std::shared_ptr<tcp_transport> & t, message & msg,
+    const bool & historical
+    )
+{
+    m_bytes_sent[
+        historical ? traffic_class_block_historical :
+        traffic_class(msg.header().command)
+    ] += msg.size();
+    
+    t->write(msg.data(), msg.size(), historical);
+}
+
+void tcp_connection::add_to_message_scheduler()
+{
+    message_scheduler_ =
+        stack_impl_.get_tcp_connection_manager()->get_message_scheduler()
+    ;
+    
+    if (auto scheduler = message_scheduler_.lock())
+    {
+        std::weak_ptr<tcp_transport> transport(m_tcp_transport);
+        
+        std::weak_ptr<check_pool::sequence> sequence(m_check_sequence);
+        
+        /**
+         * Hold the peer's messages while its output is full or it has as
+         * many checks in flight as allowed, the held messages pause its
+         * reads.
+         */
+        scheduler->add_peer(this, [transport, sequence]()
+        {
+            if (auto s = sequence.lock())
+            {
+                if (s->is_full())
+                {
+                    return true;
+                }
+            }
+            
+            if (auto t = transport.lock())
+            {
+                return t->bytes_queued() >= max_bytes_queued;
+            }
+            
+            return false;
+        },
+        [transport](const bool & paused)
+        {
+            /**
+             * Stop reading from the peer while its messages are over
+             * budget.
+             */
+            if (auto t = transport.lock())
+            {
+                t->set_read_paused(paused);
+            }
+        });
+    }
+}
+
 void tcp_connection::on_read(const char * buf, const std::size_t & len)
 {
     auto buffer = std::string(buf, len);
@@ -635,7 +867,9 @@ void tcp_connection::on_read(const char * buf, const std::size_t & len)
      */
     if (buffer.find("HTTP/1.") == std::string::npos)
     {
-        std::lock_guard<std::mutex> l1(mutex_read_queue_);
+        auto flooding = false;
+        
+        std::unique_lock<std::mutex> l1(mutex_read_queue_);
         
         /**
          * Append to the read queue.
@@ -652,43 +886,103 @@ void tcp_connection::on_read(const char * buf, const std::size_t & len)
             /**
              * Allocate the message.
              */
-            message msg(packet.data(), packet.size());
+            auto msg = std::make_shared<message> (
+                packet.data(), packet.size()
+            );
         
             try
             {
                 /**
                  * Decode the message.
                  */
-                msg.decode();
+                msg->decode();
             }
             catch (std::exception & e)
             {
                 break;
             }
             
+            /**
+             * Account for the received bytes.
+             */
+            m_bytes_received[traffic_class(msg->header().command)] +=
+                message::header_length + msg->header().length
+            ;
+            
             /**
              * Erase the full/partial packet.
              */
             read_queue_.erase(
                 read_queue_.begin(), read_queue_.begin() +
-                message::header_length + msg.header().length
+                message::header_length + msg->header().length
             );
             
-            try
+            auto self(shared_from_this());
+            
+            auto f = [this, self, msg]()
             {
-                /**
-                 * Handle the message.
-                 */
-                handle_message(msg);
-            }
-            catch (std::exception & e)
+                try
+                {
+                    /**
+                     * Handle the message.
+                     */
+                    handle_message(*msg);
+                }
+                catch (std::exception & e)
+                {
+                    log_error(
+                        "TCP connection failed to handle message, "
+                        "what = " << e.what() << "."
+                    );
+                }
+            };
+            
+            /**
+             * Queue the message on the message_scheduler so that the
+             * peers are handled fairly, without one it is handled inline.
+             */
+            if (auto scheduler = message_scheduler_.lock())
             {
-                log_error(
-                    "TCP connection failed to handle message, "
-                    "what = " << e.what() << "."
+                auto result = scheduler->push(
+                    this, f, message::header_length + msg->header().length
                 );
+                
+                if (result == message_scheduler::push_full)
+                {
+                    flooding = true;
+                    
+                    break;
+                }
+                else if (result == message_scheduler::push_unknown)
+                {
+                    /**
+                     * We were removed on stop or the scheduler is stopped,
+                     * the message is dropped.
+                     */
+                    log_debug(
+                        "TCP connection is not scheduled, dropping message."
+                    );
+                    
+                    break;
+                }
+            }
+            else
+            {
+                f();
             }
         }
+        
+        l1.unlock();
+        
+        if (flooding)
+        {
+            log_error(
+                "TCP connection kept sending while paused with too many "
+                "messages queued, stopping."
+            );
+            
+            stop();
+        }
     }
     else
     {
@@ -748,7 +1042,7 @@ void tcp_connection::send_verack_message()
         /**
          * Write the message.
          */
-        t->write(msg.data(), msg.size());
+        write_message(t, msg);
     }
     else
     {
@@ -817,7 +1111,7 @@ void tcp_connection::send_version_message()
         /**
          * Write the message.
          */
-        t->write(msg.data(), msg.size());
+        write_message(t, msg);
     }
     else
     {
@@ -851,7 +1145,7 @@ void tcp_connection::send_addr_message(const protocol::network_address_t & addr)
             /**
              * Write the message.
              */
-            t->write(msg.data(), msg.size());
+            write_message(t, msg);
         }
         else
         {
@@ -877,7 +1171,7 @@ void tcp_connection::send_getaddr_message()
         /**
          * Write the message.
          */
-        t->write(msg.data(), msg.size());
+        write_message(t, msg);
     }
     else
     {
@@ -904,10 +1198,17 @@ void tcp_connection::send_ping_message()
             msg.protocol_ping().nonce << "."
         );
         
+        std::lock_guard<std::mutex> l1(mutex_peer_quality_);
+        
+        /**
+         * Remember the nonce to measure the round trip time.
+         */
+        m_peer_quality.on_ping_sent(msg.protocol_ping().nonce);
+        
         /**
          * Write the message.
          */
-        t->write(msg.data(), msg.size());
+        write_message(t, msg);
     }
     else
     {
@@ -942,7 +1243,7 @@ void tcp_connection::send_pong_message(const std::uint64_t & nonce)
         /**
          * Write the message.
          */
-        t->write(msg.data(), msg.size());
+        write_message(t, msg);
     }
     else
     {
@@ -968,6 +1269,20 @@ void tcp_connection::send_getdata_message()
              */
             msg.protocol_getdata().inventory = getdata_;
             
+            std::lock_guard<std::mutex> l2(mutex_peer_quality_);
+            
+            /**
+             * Remember when each block was requested to measure the
+             * delivery latency.
+             */
+            for (auto & i : getdata_)
+            {
+                if (i.type() == inventory_vector::type_msg_block)
+                {
+                    m_peer_quality.on_block_requested(i.hash());
+                }
+            }
+            
             /**
              * Clear the getdata.
              */
@@ -981,7 +1296,7 @@ void tcp_connection::send_getdata_message()
             /**
              * Write the message.
              */
-            t->write(msg.data(), msg.size());
+            write_message(t, msg);
         }
     }
     else
@@ -990,7 +1305,9 @@ void tcp_connection::send_getdata_message()
     }
 }
 
-void tcp_connection::send_block_message(const block & blk)
+void tcp_connection::send_block_message(
+    const block & blk, const bool & historical
+    )
 {
     if (auto t = m_tcp_transport.lock())
     {
@@ -1012,7 +1329,7 @@ void tcp_connection::send_block_message(const block & blk)
         /**
          * Write the message.
          */
-        t->write(msg.data(), msg.size());
+        write_message(t, msg, historical);
     }
     else
     {
@@ -1048,7 +1365,7 @@ void tcp_connection::send_tx_message(const transaction & tx)
         /**
          * Write the message.
          */
-        t->write(msg.data(), msg.size());
+        write_message(t, msg);
     }
     else
     {
@@ -1075,7 +1392,7 @@ void tcp_connection::send_mempool_message()
         /**
          * Write the message.
          */
-        t->write(msg.data(), msg.size());
+        write_message(t, msg);
     }
     else
     {
@@ -1250,6 +1567,27 @@ void tcp_connection::relay_inv(
      */
     msg.encode();
 
+    if (
+        inv.type() == inventory_vector::type_msg_tx &&
+        globals::instance().option_tx_reconciliation()
+        )
+    {
+        /**
+         * Push the transaction to peers that do not reconcile (and our
+         * flood peers), queue it for reconciliation with the rest.
+         */
+        stack_impl_.get_tcp_connection_manager()->for_each_tcp_connection(
+            [this, &inv, &msg](const std::shared_ptr<tcp_connection> & j)
+        {
+            if (j->relay_tx_reconciled(inv.hash(), j.get() == this) == false)
+            {
+                j->send(msg.data(), msg.size());
+            }
+        });
+        
+        return;
+    }
+
     /**
      * Broadcast the message to "all" connected peers.
      */
@@ -1262,7 +1600,11 @@ bool tcp_connection::handle_message(message & msg)
 {
     if (msg.header().command == "verack")
     {
-        // ...
+        /**
+         * Send a ping right away so the round trip time is known early
+         * (used by eviction and outbound peer selection).
+         */
+        send_ping_message();
     }
     else if (msg.header().command == "version")
     {
@@ -1321,6 +1663,11 @@ bool tcp_connection::handle_message(message & msg)
                  */
                 m_protocol_version_services = msg.protocol_version().services;
                 
+                /**
+                 * Start set reconciliation of transactions if supported.
+                 */
+                start_tx_reconciliation();
+                
                 /**
                  * Set the protocol version timestamp.
                  */
@@ -1696,6 +2043,10 @@ bool tcp_connection::handle_message(message & msg)
             "TCP connection got pong, nonce = " <<
             msg.protocol_pong().nonce << "."
         );
+        
+        std::lock_guard<std::mutex> l1(mutex_peer_quality_);
+        
+        m_peer_quality.on_pong(msg.protocol_pong().nonce);
     }
     else if (msg.header().command == "inv")
     {
@@ -1735,7 +2086,9 @@ bool tcp_connection::handle_message(message & msg)
             /**
              * Open the transaction database for reading.
              */
-            db_tx tx_db("r");
+            auto reader = db_tx::reader();
+            
+            auto & tx_db = *reader;
             
             auto index = 0;
             
@@ -1748,6 +2101,17 @@ bool tcp_connection::handle_message(message & msg)
                  */
                 inventory_cache_.insert(i);
 
+                /**
+                 * The peer has the transaction, don't reconcile it.
+                 */
+                if (
+                    m_tx_reconciliation &&
+                    i.type() == inventory_vector::type_msg_tx
+                    )
+                {
+                    m_tx_reconciliation->remove(i.hash());
+                }
+                
                 auto already_have = inventory_vector::already_have(tx_db, i);
                 
                 if (already_have == false)
@@ -1864,10 +2228,20 @@ bool tcp_connection::handle_message(message & msg)
                          */
                         blk.read_from_disk(it->second);
                         
+                        /**
+                         * Blocks well below the best block are served as
+                         * historical (bulk) traffic so they never delay
+                         * fresh blocks and transactions.
+                         */
+                        auto historical =
+                            it->second->height() + historical_block_depth <
+                            globals::instance().best_block_height()
+                        ;
+                        
                         /**
                          * Send the block message.
                          */
-                        send_block_message(blk);
+                        send_block_message(blk, historical);
 
                         /**
                          * Trigger them to send a getblocks request for the
@@ -1893,10 +2267,12 @@ bool tcp_connection::handle_message(message & msg)
                             );
            
                             /**
-                             * Send an inv message.
+                             * Send an inv message on the same queue as the
+                             * block so it can't overtake it.
                              */
                             send_inv_message(
-                                inventory_vector::type_msg_block, block_hashes
+                                inventory_vector::type_msg_block, block_hashes,
+                                historical
                             );
                             
                             /**
@@ -2104,13 +2480,8 @@ bool tcp_connection::handle_message(message & msg)
     }
     else if (msg.header().command == "tx")
     {
-        const auto & tx = msg.protocol_tx().tx;
-        
-        std::vector<sha256> queue_work;
-        std::vector<sha256> queue_erase;
+        auto tx = msg.protocol_tx().tx;
         
-        db_tx txdb("r");
-
         /**
          * Allocate the inventory_vector.
          */
@@ -2121,118 +2492,108 @@ bool tcp_connection::handle_message(message & msg)
          */
         inventory_cache_.insert(inv);
         
-        bool missing_inputs = false;
-        
-        data_buffer buffer;
+        /**
+         * The peer has the transaction, don't reconcile it.
+         */
+        if (m_tx_reconciliation)
+        {
+            m_tx_reconciliation->remove(inv.hash());
+        }
         
-        tx->encode(buffer);
+        auto self(shared_from_this());
         
-        if (tx->accept_to_transaction_pool(txdb, &missing_inputs))
+        /**
+         * Run the context-free checks on the check_pool and accept (in
+         * order) on the chain-state strand.
+         */
+        m_check_sequence->push(
+            [tx]()
+            {
+                return tx->check();
+            },
+            [this, self, tx](const bool & success)
+            {
+                if (success)
+                {
+                    do_accept_transaction(tx);
+                }
+                else
+                {
+                    std::lock_guard<std::mutex> l1(mutex_peer_quality_);
+                    
+                    /**
+                     * The transaction was invalid.
+                     */
+                    m_peer_quality.on_bytes_wasted(tx->size());
+                }
+            },
+            tx->size()
+        );
+    }
+    else if (msg.header().command == "sketch")
+    {
+        if (m_tx_reconciliation && m_tx_reconciliation->is_initiator() == false)
         {
-            /**
-             * Inform the wallet_manager.
-             */
-            wallet_manager::instance().sync_with_wallets(*tx, 0, true);
+            data_buffer buffer_differences;
+            
+            std::vector<sha256> to_announce;
             
             /**
-             * Relay the inv.
-             */
-            relay_inv(inv, buffer);
-
-            queue_work.push_back(inv.hash());
-            queue_erase.push_back(inv.hash());
-
-            /**
-             * Recursively process any orphan transactions that depended on
-             * this one.
+             * Reconcile the sketch (read in place) against our set.
              */
-            for (auto i = 0; i < queue_work.size(); i++)
+            if (
+                m_tx_reconciliation->reconcile(
+                msg, buffer_differences, to_announce) == false
+                )
             {
-                auto hash_previous = queue_work[i];
-
-                auto it = globals::instance().orphan_transactions_by_previous()[
-                    hash_previous].begin()
-                ;
-                
-                for (
-                    ;
-                    it != globals::instance().orphan_transactions_by_previous()[
-                    hash_previous].end();
-                    ++it
-                    )
-                {
-                    data_buffer buffer2(it->second->data(), it->second->size());
-                    
-                    transaction tx2;
-                    
-                    tx2.decode(buffer2);
-                    
-                    inventory_vector inv2(
-                        inventory_vector::type_msg_tx, tx2.get_hash()
-                    );
-                    
-                    bool missing_inputs2 = false;
-
-                    if (
-                        tx2.accept_to_transaction_pool(txdb, &missing_inputs2)
-                        )
-                    {
-                        log_debug(
-                            "TCP connection accepted orphan transaction " <<
-                            inv2.hash().to_string().substr(0, 10) << "."
-                        )
-                        /**
-                         * Inform the wallet_manager.
-                         */
-                        wallet_manager::instance().sync_with_wallets(
-                            tx2, 0, true
-                        );
-
-                        relay_inv(inv2, buffer2);
-                        
-                        queue_work.push_back(inv2.hash());
-                        queue_erase.push_back(inv2.hash());
-                    }
-                    else if (missing_inputs2 == false)
-                    {
-                        /**
-                         * Invalid orphan.
-                         */
-                        queue_erase.push_back(inv2.hash());
-                        
-                        log_debug(
-                            "TCP connection removed invalid orphan "
-                            "transaction " <<
-                            inv2.hash().to_string().substr(0, 10) << "."
-                        );
-                    }
-                }
+                log_debug(
+                    "TCP connection failed to decode sketch, announcing " <<
+                    to_announce.size() << " transactions."
+                );
             }
-
-            for (auto & i : queue_erase)
+            
+            if (to_announce.size() > 0)
             {
-                utility::erase_orphan_tx(i);
+                send_inv_message(inventory_vector::type_msg_tx, to_announce);
+            }
+            
+            if (auto t = m_tcp_transport.lock())
+            {
+                message msg_differences("recondiff", buffer_differences);
+                
+                msg_differences.encode();
+                
+                write_message(t, msg_differences);
             }
         }
-        else if (missing_inputs)
+        else
         {
-            utility::add_orphan_tx(buffer);
-
             /**
-             * Limit the size of the orphan transactions.
+             * Set the Denial-of-Service score for the connection.
              */
-            auto evicted = utility::limit_orphan_tx_size(
-                constants::max_orphan_transactions
-            );
+            set_dos_score(m_dos_score + 1);
+        }
+    }
+    else if (msg.header().command == "recondiff")
+    {
+        if (m_tx_reconciliation && m_tx_reconciliation->is_initiator())
+        {
+            std::vector<sha256> to_announce;
+            
+            m_tx_reconciliation->on_differences(msg, to_announce);
             
-            if (evicted > 0)
+            if (to_announce.size() > 0)
             {
-                log_debug(
-                    "TCP connection orphans overflow, evicted = " <<
-                    evicted << "."
-                );
+                send_inv_message(inventory_vector::type_msg_tx, to_announce);
             }
         }
+        else
+        {
+            /**
+             * Set the Denial-of-Service score for the connection.
+             */
+            set_dos_score(m_dos_score + 1);
+        }
     }
     else if (msg.header().command == "block")
     {
@@ -2258,18 +2619,75 @@ bool tcp_connection::handle_message(message & msg)
              */
             inventory_cache_.insert(inv);
             
+            std::unique_lock<std::mutex> l3(mutex_peer_quality_);
+            
+            m_peer_quality.on_block_received(inv.hash());
+            
             /**
-             * Process the block.
+             * Don't spend the check_pool on blocks we already have.
              */
-            if (
-                stack_impl_.process_block(
-                shared_from_this(), msg.protocol_block().blk)
-                )
+            if (inventory_vector::already_have(*db_tx::reader(), inv))
             {
+                log_debug(
+                    "TCP connection got duplicate block " <<
+                    inv.hash().to_string().substr(0, 20) << "."
+                );
+                
                 /**
-                 * The inv as been fulfilled.
+                 * The block was a duplicate.
                  */
+                m_peer_quality.on_bytes_wasted(msg.size());
+                
+                return true;
             }
+            
+            l3.unlock();
+            
+            auto self(shared_from_this());
+            
+            auto blk = msg.protocol_block().blk;
+            
+            auto len = msg.size();
+            
+            /**
+             * Run the context-free checks on the check_pool and process
+             * (in order) on the chain-state strand. The check_pool has no
+             * connection, the DoS score is applied on the strand.
+             */
+            m_check_sequence->push(
+                [blk]()
+                {
+                    if (blk->check_block(0))
+                    {
+                        blk->set_is_checked(true);
+                    }
+                    
+                    return blk->is_checked();
+                },
+                [this, self, blk, len](const bool & success)
+                {
+                    if (success)
+                    {
+                        do_process_block(blk, len);
+                    }
+                    else
+                    {
+                        /**
+                         * Check it again with the connection to set it's
+                         * Denial-of-Service score.
+                         */
+                        blk->check_block(self);
+                        
+                        std::lock_guard<std::mutex> l1(mutex_peer_quality_);
+                        
+                        /**
+                         * The block was invalid.
+                         */
+                        m_peer_quality.on_bytes_wasted(len);
+                    }
+                },
+                len
+            );
         }
     }
     else if (msg.header().command == "mempool")
@@ -2345,6 +2763,301 @@ bool tcp_connection::handle_message(message & msg)
     return true;
 }
 
+void tcp_connection::do_accept_transaction(
+    const std::shared_ptr<transaction> & tx
+    )
+{
+    std::vector<sha256> queue_work;
+    std::vector<sha256> queue_erase;
+    
+    auto reader = db_tx::reader();
+    
+    auto & txdb = *reader;
+
+    /**
+     * Allocate the inventory_vector.
+     */
+    inventory_vector inv(inventory_vector::type_msg_tx, tx->get_hash());
+    
+    bool missing_inputs = false;
+    
+    data_buffer buffer;
+    
+    tx->encode(buffer);
+    
+    if (tx->accept_to_transaction_pool(txdb, &missing_inputs))
+    {
+        std::unique_lock<std::mutex> l1(mutex_peer_quality_);
+        
+        m_peer_quality.on_bytes_useful(buffer.size());
+        
+        l1.unlock();
+        
+        /**
+         * Inform the wallet_manager.
+         */
+        wallet_manager::instance().sync_with_wallets(*tx, 0, true);
+        
+        /**
+         * Relay the inv.
+         */
+        relay_inv(inv, buffer);
+
+        queue_work.push_back(inv.hash());
+        queue_erase.push_back(inv.hash());
+
+        /**
+         * Recursively process any orphan transactions that depended on
+         * this one.
+         */
+        for (std::size_t i = 0; i < queue_work.size(); i++)
+        {
+            auto hash_previous = queue_work[i];
+
+            auto it = globals::instance().orphan_transactions_by_previous()[
+                hash_previous].begin()
+            ;
+            
+            for (
+                ;
+                it != globals::instance().orphan_transactions_by_previous()[
+                hash_previous].end();
+                ++it
+                )
+            {
+                data_buffer buffer2(it->second->data(), it->second->size());
+                
+                transaction tx2;
+                
+                tx2.decode(buffer2);
+                
+                inventory_vector inv2(
+                    inventory_vector::type_msg_tx, tx2.get_hash()
+                );
+                
+                bool missing_inputs2 = false;
+
+                if (
+                    tx2.accept_to_transaction_pool(txdb, &missing_inputs2)
+                    )
+                {
+                    log_debug(
+                        "TCP connection accepted orphan transaction " <<
+                        inv2.hash().to_string().substr(0, 10) << "."
+                    )
+                    /**
+                     * Inform the wallet_manager.
+                     */
+                    wallet_manager::instance().sync_with_wallets(
+                        tx2, 0, true
+                    );
+
+                    relay_inv(inv2, buffer2);
+                    
+                    queue_work.push_back(inv2.hash());
+                    queue_erase.push_back(inv2.hash());
+                }
+                else if (missing_inputs2 == false)
+                {
+                    /**
+                     * Invalid orphan.
+                     */
+                    queue_erase.push_back(inv2.hash());
+                    
+                    log_debug(
+                        "TCP connection removed invalid orphan "
+                        "transaction " <<
+                        inv2.hash().to_string().substr(0, 10) << "."
+                    );
+                }
+            }
+        }
+
+        for (auto & i : queue_erase)
+        {
+            utility::erase_orphan_tx(i);
+        }
+    }
+    else if (missing_inputs)
+    {
+        utility::add_orphan_tx(buffer);
+        
+        std::unique_lock<std::mutex> l1(mutex_peer_quality_);
+        
+        m_peer_quality.on_bytes_useful(buffer.size());
+        
+        l1.unlock();
+
+        /**
+         * Limit the size of the orphan transactions.
+         */
+        auto evicted = utility::limit_orphan_tx_size(
+            constants::max_orphan_transactions
+        );
+        
+        if (evicted > 0)
+        {
+            log_debug(
+                "TCP connection orphans overflow, evicted = " <<
+                evicted << "."
+            );
+        }
+    }
+    else
+    {
+        std::lock_guard<std::mutex> l1(mutex_peer_quality_);
+        
+        /**
+         * The transaction was invalid or a duplicate.
+         */
+        m_peer_quality.on_bytes_wasted(buffer.size());
+    }
+}
+
+void tcp_connection::do_process_block(
+    const std::shared_ptr<block> & blk, const std::size_t & len
+    )
+{
+    /**
+     * Process the block.
+     */
+    if (stack_impl_.process_block(shared_from_this(), blk))
+    {
+        std::lock_guard<std::mutex> l1(mutex_peer_quality_);
+        
+        /**
+         * The inv as been fulfilled.
+         */
+        m_peer_quality.on_bytes_useful(len);
+    }
+    else
+    {
+        std::lock_guard<std::mutex> l1(mutex_peer_quality_);
+        
+        /**
+         * The block was invalid or a duplicate.
+         */
+        m_peer_quality.on_bytes_wasted(len);
+    }
+}
+
+void tcp_connection::start_tx_reconciliation()
+{
+    if (
+        globals::instance().option_tx_reconciliation() == false ||
+        (m_protocol_version_services &
+        protocol::service_tx_reconciliation) == 0
+        )
+    {
+        return;
+    }
+    
+    /**
+     * The side that opened the connection sends the sketches.
+     */
+    auto reconciliation = std::make_shared<tx_reconciliation> (
+        m_direction == direction_outgoing
+    );
+    
+    if (m_direction == direction_outgoing)
+    {
+        /**
+         * Serializes choosing the flood peers between connections.
+         */
+        static std::mutex g_mutex_flood_peers;
+        
+        std::lock_guard<std::mutex> l1(g_mutex_flood_peers);
+        
+        std::size_t flood_peers = 0;
+        
+        stack_impl_.get_tcp_connection_manager()->for_each_tcp_connection(
+            [this, &flood_peers](const std::shared_ptr<tcp_connection> & j)
+        {
+            if (j.get() != this && j->is_tx_reconciliation_flood())
+            {
+                flood_peers++;
+            }
+        });
+        
+        std::lock_guard<std::mutex> l2(mutex_tx_reconciliation_);
+        
+        /**
+         * Keep pushing transactions to a few outbound peers so they
+         * propagate quickly, the others only reconcile.
+         */
+        m_tx_reconciliation_flood =
+            flood_peers < tx_reconciliation::max_flood_peers
+        ;
+        
+        m_tx_reconciliation = reconciliation;
+    }
+    else
+    {
+        std::lock_guard<std::mutex> l1(mutex_tx_reconciliation_);
+        
+        m_tx_reconciliation = reconciliation;
+    }
+    
+    if (m_direction == direction_outgoing)
+    {
+        auto self(shared_from_this());
+        
+        /**
+         * Start the tx_reconciliation timer.
+         */
+        timer_tx_reconciliation_.expires_from_now(
+            std::chrono::seconds(tx_reconciliation::interval)
+        );
+        timer_tx_reconciliation_.async_wait(globals::instance().strand().wrap(
+            std::bind(&tcp_connection::do_tx_reconciliation, self,
+            std::placeholders::_1))
+        );
+    }
+    
+    log_debug(
+        "TCP connection is reconciling transactions, initiator = " <<
+        reconciliation->is_initiator() << ", flood = " <<
+        is_tx_reconciliation_flood() << "."
+    );
+}
+
+void tcp_connection::do_tx_reconciliation(const boost::system::error_code & ec)
+{
+    if (ec)
+    {
+        // ...
+    }
+    else
+    {
+        data_buffer buffer;
+        
+        /**
+         * Send a sketch of our set unless one is still in flight.
+         */
+        if (m_tx_reconciliation->create_sketch(buffer))
+        {
+            if (auto t = m_tcp_transport.lock())
+            {
+                message msg("sketch", buffer);
+                
+                msg.encode();
+                
+                write_message(t, msg);
+            }
+        }
+        
+        auto self(shared_from_this());
+        
+        timer_tx_reconciliation_.expires_from_now(
+            std::chrono::seconds(tx_reconciliation::interval)
+        );
+        timer_tx_reconciliation_.async_wait(globals::instance().strand().wrap(
+            std::bind(&tcp_connection::do_tx_reconciliation, self,
+            std::placeholders::_1))
+        );
+    }
+}
+
 void tcp_connection::do_ping(const boost::system::error_code & ec)
 {
     if (ec)
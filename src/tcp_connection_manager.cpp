@@ -18,20 +18,28 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <atomic>
 #include <cassert>
+#include <thread>
 
 #include <coin/address_manager.hpp>
+#include <coin/check_pool.hpp>
 #include <coin/configuration.hpp>
 #include <coin/globals.hpp>
 #include <coin/logger.hpp>
 #include <coin/message.hpp>
+#include <coin/message_scheduler.hpp>
 #include <coin/network.hpp>
+#include <coin/peer_quality.hpp>
+#include <coin/random.hpp>
 #include <coin/stack_impl.hpp>
 #include <coin/status_manager.hpp>
 #include <coin/tcp_connection.hpp>
 #include <coin/tcp_connection_manager.hpp>
+#include <coin/tcp_connection_race.hpp>
 #include <coin/tcp_transport.hpp>
 #include <coin/time.hpp>
+#include <coin/token_bucket.hpp>
 #include <coin/utility.hpp>
 
 using namespace coin;
@@ -39,8 +47,20 @@ using namespace coin;
 tcp_connection_manager::tcp_connection_manager(
     boost::asio::io_service & ios, stack_impl & owner
     )
-    : io_service_(ios)
-    , resolver_(ios)
+    : m_token_bucket_relay(new token_bucket(0, upload_burst))
+    , m_token_bucket_historical(new token_bucket(0, upload_burst))
+    , m_message_scheduler(std::make_shared<message_scheduler> (ios))
+    , m_bytes_sent_last(0)
+    , m_bytes_received_last(0)
+    , m_time_last_status(std::chrono::steady_clock::now())
+    , m_time_started(std::chrono::steady_clock::now())
+    , m_time_to_connected(-1)
+    , m_tcp_connection_race(std::make_shared<tcp_connection_race> (
+        ios, globals::instance().strand(), race_stagger,
+        minimum_tcp_connections)
+    )
+    , m_stopped(false)
+    , io_service_(ios)
     , strand_(ios)
     , stack_impl_(owner)
     , timer_(ios)
@@ -50,6 +70,16 @@ tcp_connection_manager::tcp_connection_manager(
 
 void tcp_connection_manager::start()
 {
+    /**
+     * Set the upload shaping rates.
+     */
+    m_token_bucket_relay->set_rate(
+        stack_impl_.get_configuration().network_tcp_upload_relay_maximum()
+    );
+    m_token_bucket_historical->set_rate(
+        stack_impl_.get_configuration().network_tcp_upload_historical_maximum()
+    );
+    
     std::vector<boost::asio::ip::tcp::resolver::query> queries;
     
     /**
@@ -69,7 +99,91 @@ void tcp_connection_manager::start()
     /**
      * Randomize the host names.
      */
-    std::random_shuffle(queries.begin(), queries.end());
+    std::shuffle(queries.begin(), queries.end(), random::generator());
+    
+    m_time_started = std::chrono::steady_clock::now();
+    
+    m_stopped = false;
+    
+    std::weak_ptr<tcp_connection_manager> weak(shared_from_this());
+    
+    /**
+     * Race through the tcp_connection's, the handlers run on the
+     * globals strand.
+     */
+    m_tcp_connection_race->set_handlers(
+        [weak](const boost::asio::ip::tcp::endpoint & ep) -> bool
+        {
+            if (auto self = weak.lock())
+            {
+                return self->connect(ep);
+            }
+            
+            return false;
+        },
+        [weak](
+            const boost::asio::ip::tcp::endpoint & ep
+            ) -> tcp_connection_race::state_t
+        {
+            if (auto self = weak.lock())
+            {
+                std::lock_guard<std::recursive_mutex> l1(
+                    self->mutex_tcp_connections_
+                );
+                
+                auto it = self->m_tcp_connections.find(ep);
+                
+                if (it != self->m_tcp_connections.end())
+                {
+                    if (auto connection = it->second.lock())
+                    {
+                        return
+                            connection->protocol_version() > 0 ?
+                            tcp_connection_race::state_established :
+                            tcp_connection_race::state_handshaking
+                        ;
+                    }
+                }
+            }
+            
+            return tcp_connection_race::state_failed;
+        },
+        [weak](const boost::asio::ip::tcp::endpoint & ep)
+        {
+            if (auto self = weak.lock())
+            {
+                std::lock_guard<std::recursive_mutex> l1(
+                    self->mutex_tcp_connections_
+                );
+                
+                auto it = self->m_tcp_connections.find(ep);
+                
+                if (it != self->m_tcp_connections.end())
+                {
+                    if (auto connection = it->second.lock())
+                    {
+                        connection->stop();
+                    }
+                    
+                    self->m_tcp_connections.erase(it);
+                }
+            }
+        },
+        [weak]() -> std::size_t
+        {
+            if (auto self = weak.lock())
+            {
+                return self->update_time_to_connected();
+            }
+            
+            return 0;
+        }
+    );
+    
+    /**
+     * Start the check_pool.
+     */
+    check_pool::instance().start();
     
     /**
      * Start host name resolution.
@@ -90,9 +204,26 @@ void tcp_connection_manager::start()
 
 void tcp_connection_manager::stop()
 {
-    resolver_.cancel();
+    m_stopped = true;
+    
     timer_.cancel();
     
+    /**
+     * Stop racing, the lookups in progress finish on their own threads
+     * and their results are dropped.
+     */
+    m_tcp_connection_race->stop();
+    
+    /**
+     * Stop the check_pool.
+     */
+    check_pool::instance().stop();
+    
+    /**
+     * Stop the message_scheduler.
+     */
+    m_message_scheduler->stop();
+    
     std::lock_guard<std::recursive_mutex> l1(mutex_tcp_connections_);
     
     for (auto & i : m_tcp_connections)
@@ -166,7 +297,8 @@ void tcp_connection_manager::handle_accept(
     }
     else if (
         m_tcp_connections.size() >=
-        stack_impl_.get_configuration().network_tcp_inbound_maximum()
+        stack_impl_.get_configuration().network_tcp_inbound_maximum() &&
+        evict_incoming() == false
         )
     {
         log_error(
@@ -222,6 +354,21 @@ void tcp_connection_manager::broadcast(
     }
 }
 
+void tcp_connection_manager::for_each_tcp_connection(
+    const std::function<void (const std::shared_ptr<tcp_connection> &)> & f
+    )
+{
+    std::lock_guard<std::recursive_mutex> l1(mutex_tcp_connections_);
+    
+    for (auto & i : m_tcp_connections)
+    {
+        if (auto j = i.second.lock())
+        {
+            f(j);
+        }
+    }
+}
+
 std::map< boost::asio::ip::tcp::endpoint, std::weak_ptr<tcp_connection> > &
     tcp_connection_manager::tcp_connections()
 {
@@ -230,6 +377,24 @@ std::map< boost::asio::ip::tcp::endpoint, std::weak_ptr<tcp_connection> > &
     return m_tcp_connections;
 }
 
+const std::shared_ptr<token_bucket> &
+    tcp_connection_manager::token_bucket_relay() const
+{
+    return m_token_bucket_relay;
+}
+
+const std::shared_ptr<token_bucket> &
+    tcp_connection_manager::token_bucket_historical() const
+{
+    return m_token_bucket_historical;
+}
+
+const std::shared_ptr<message_scheduler> &
+    tcp_connection_manager::get_message_scheduler() const
+{
+    return m_message_scheduler;
+}
+
 bool tcp_connection_manager::connect(const boost::asio::ip::tcp::endpoint & ep)
 {
     std::lock_guard<std::recursive_mutex> l1(mutex_tcp_connections_);
@@ -323,64 +488,53 @@ void tcp_connection_manager::tick(const boost::system::error_code & ec)
          */
         if (m_tcp_connections.size() < minimum_tcp_connections + 1)
         {
-            for (
-                auto i = 0; i <
-                minimum_tcp_connections - m_tcp_connections.size(); i++
-                )
-            {
-                /**
-                 * Get a network address from the address_manager.
-                 */
-                auto addr = stack_impl_.get_address_manager()->select(
-                    10 + std::min(m_tcp_connections.size(),
-                    static_cast<std::size_t> (8)) * 10
-                );
+            std::vector<protocol::network_address_t> racers;
+            std::vector<std::int64_t> racers_rtts;
             
-                /**
-                 * Only connect to one peer per group.
-                 */
-                bool is_in_same_group = false;
-
-                for (auto & i : m_tcp_connections)
+            /**
+             * The network groups of the racers, only one racer per group.
+             */
+            std::set< std::vector<std::uint8_t> > groups;
+            
+            auto slots = std::min(
+                static_cast<std::size_t> (race_maximum),
+                (minimum_tcp_connections - m_tcp_connections.size()) *
+                race_factor
+            );
+            
+            for (std::size_t i = 0; i < slots; i++)
+            {
+                std::vector<protocol::network_address_t> candidates;
+                std::vector<std::int64_t> rtts;
+                
+                for (auto j = 0; j < outgoing_candidates; j++)
                 {
-                    if (auto j = i.second.lock())
+                    /**
+                     * Get a network address from the address_manager.
+                     */
+                    auto addr = stack_impl_.get_address_manager()->select(
+                        10 + std::min(m_tcp_connections.size(),
+                        static_cast<std::size_t> (8)) * 10
+                    );
+                    
+                    /**
+                     * Only connect to one peer per group.
+                     */
+                    if (
+                        addr.is_valid() == false || addr.is_local() ||
+                        groups.count(addr.group()) > 0 ||
+                        is_in_same_group(addr)
+                        )
                     {
-                        if (auto k = j->get_tcp_transport().lock())
-                        {
-                            try
-                            {
-                                auto addr_tmp =
-                                    protocol::network_address_t::from_endpoint(
-                                    k->socket().remote_endpoint()
-                                );
-                                
-                                if (addr.group() == addr_tmp.group())
-                                {
-                                    is_in_same_group = true;
-                                }
-                            }
-                            catch (std::exception & e)
-                            {
-                                // ...
-                            }
-                        }
+                        // ...
                     }
-                }
-
-                if (
-                    addr.is_valid() == false || addr.is_local() ||
-                    is_in_same_group
-                    )
-                {
-                    // ...
-                }
-                else
-                {
                     /**
-                     * Do not retry connections to the same network address more
-                     * often than every 10 minutes.
+                     * Do not retry connections to the same network address
+                     * more often than every 10 minutes.
                      */
-                    if (time::instance().get_adjusted() - addr.last_try < 600)
+                    else if (
+                        time::instance().get_adjusted() - addr.last_try < 600
+                        )
                     {
                         log_debug(
                             "TCP connection manager attempted to "
@@ -392,27 +546,49 @@ void tcp_connection_manager::tick(const boost::system::error_code & ec)
                     }
                     else
                     {
-                        /**
-                         * Connect to the endpoint.
-                         */
-                        if (connect(
-                            boost::asio::ip::tcp::endpoint(
-                            addr.ipv4_mapped_address(), addr.port))
-                            )
-                        {
-                            log_debug(
-                                "TCP connection manager is connecting to " <<
-                                addr.ipv4_mapped_address() << ":" << addr.port <<
-                                ", last seen = " <<
-                                (time::instance().get_adjusted() -
-                                addr.timestamp) / 60 << " mins, " <<
-                                m_tcp_connections.size() << " connected peers."
-                            );
-                        }
+                        auto it = m_address_rtts.find(
+                            addr.ipv4_mapped_address()
+                        );
+                        
+                        candidates.push_back(addr);
+                        rtts.push_back(
+                            it == m_address_rtts.end() ? -1 : it->second
+                        );
                     }
                 }
+                
+                if (candidates.size() > 0)
+                {
+                    /**
+                     * Prefer the candidate with the lowest known round trip
+                     * time.
+                     */
+                    auto index = peer_quality::select_outbound(rtts);
+                    
+                    groups.insert(candidates[index].group());
+                    
+                    racers.push_back(candidates[index]);
+                    racers_rtts.push_back(rtts[index]);
+                }
+            }
+            
+            /**
+             * Start the racers with the lowest known round trip time first.
+             */
+            std::vector<protocol::network_address_t> ordered;
+            
+            while (racers.size() > 0)
+            {
+                auto index = peer_quality::select_outbound(racers_rtts);
+                
+                ordered.push_back(racers[index]);
+                
+                racers.erase(racers.begin() + index);
+                racers_rtts.erase(racers_rtts.begin() + index);
             }
             
+            race(ordered);
+            
             auto self(shared_from_this());
             
             timer_.expires_from_now(std::chrono::seconds(8));
@@ -448,6 +624,139 @@ void tcp_connection_manager::tick(const boost::system::error_code & ec)
             m_tcp_connections.size()
         );
         
+        update_time_to_connected();
+        
+        if (m_time_to_connected >= 0)
+        {
+            status["network.tcp.time_to_connected"] = std::to_string(
+                m_time_to_connected
+            );
+        }
+        
+        /**
+         * Sum the per-peer bandwidth by traffic class.
+         */
+        std::uint64_t bytes_sent = 0, bytes_received = 0;
+        
+        std::uint64_t bytes_sent_class[
+            tcp_connection::traffic_class_maximum
+        ] = { 0 };
+        std::uint64_t bytes_received_class[
+            tcp_connection::traffic_class_maximum
+        ] = { 0 };
+        
+        if (m_address_rtts.size() > max_address_rtts)
+        {
+            m_address_rtts.clear();
+        }
+        
+        for (auto & i : m_tcp_connections)
+        {
+            if (auto connection = i.second.lock())
+            {
+                /**
+                 * A row per connection.
+                 */
+                auto row =
+                    "network.tcp.peer." + i.first.address().to_string() + ":" +
+                    std::to_string(i.first.port()) + "."
+                ;
+                
+                if (auto t = connection->get_tcp_transport().lock())
+                {
+                    bytes_sent += t->bytes_sent();
+                    bytes_received += t->bytes_received();
+                    
+                    status[row + "bytes_sent"] = std::to_string(
+                        t->bytes_sent()
+                    );
+                    status[row + "bytes_received"] = std::to_string(
+                        t->bytes_received()
+                    );
+                    status[row + "bytes_queued"] = std::to_string(
+                        t->bytes_queued()
+                    );
+                }
+                
+                /**
+                 * Remember the round trip time for outgoing peer selection.
+                 */
+                auto rtt = connection->quality().ping_rtt();
+                
+                if (rtt >= 0)
+                {
+                    m_address_rtts[i.first.address()] = rtt;
+                }
+                
+                status[row + "direction"] =
+                    connection->direction() ==
+                    tcp_connection::direction_outgoing ? "outgoing" :
+                    "incoming"
+                ;
+                status[row + "ping_rtt"] = std::to_string(rtt);
+                
+                for (auto j = 0; j < tcp_connection::traffic_class_maximum; j++)
+                {
+                    auto cls = static_cast<tcp_connection::traffic_class_t> (j);
+                    
+                    std::string name = tcp_connection::traffic_class_name(cls);
+                    
+                    bytes_sent_class[j] += connection->bytes_sent(cls);
+                    bytes_received_class[j] += connection->bytes_received(cls);
+                    
+                    status[row + "bytes_sent." + name] = std::to_string(
+                        connection->bytes_sent(cls)
+                    );
+                    status[row + "bytes_received." + name] = std::to_string(
+                        connection->bytes_received(cls)
+                    );
+                }
+            }
+        }
+        
+        auto now = std::chrono::steady_clock::now();
+        
+        auto elapsed = std::chrono::duration_cast<std::chrono::seconds> (
+            now - m_time_last_status
+        ).count();
+        
+        /**
+         * The totals drop when connections close so only report positive
+         * deltas.
+         */
+        if (elapsed > 0)
+        {
+            status["network.tcp.bps_sent"] = std::to_string(
+                bytes_sent > m_bytes_sent_last ?
+                (bytes_sent - m_bytes_sent_last) / elapsed : 0
+            );
+            status["network.tcp.bps_received"] = std::to_string(
+                bytes_received > m_bytes_received_last ?
+                (bytes_received - m_bytes_received_last) / elapsed : 0
+            );
+        }
+        
+        m_bytes_sent_last = bytes_sent;
+        m_bytes_received_last = bytes_received;
+        m_time_last_status = now;
+        
+        status["network.tcp.bytes_sent"] = std::to_string(bytes_sent);
+        status["network.tcp.bytes_received"] = std::to_string(bytes_received);
+        
+        for (auto i = 0; i < tcp_connection::traffic_class_maximum; i++)
+        {
+            std::string name = tcp_connection::traffic_class_name(
+                static_cast<tcp_connection::traffic_class_t> (i)
+            );
+            
+            status["network.tcp.bytes_sent." + name] = std::to_string(
+                bytes_sent_class[i]
+            );
+            status["network.tcp.bytes_received." + name] = std::to_string(
+                bytes_received_class[i]
+            );
+        }
+        
         /**
          * Callback status.
          */
@@ -455,6 +764,163 @@ void tcp_connection_manager::tick(const boost::system::error_code & ec)
     }
 }
 
+bool tcp_connection_manager::evict_incoming()
+{
+    std::lock_guard<std::recursive_mutex> l1(mutex_tcp_connections_);
+    
+    std::vector<boost::asio::ip::tcp::endpoint> endpoints;
+    
+    std::vector<peer_quality::candidate_t> candidates;
+    
+    for (auto & i : m_tcp_connections)
+    {
+        if (auto connection = i.second.lock())
+        {
+            if (
+                connection->direction() == tcp_connection::direction_incoming
+                )
+            {
+                peer_quality::candidate_t candidate;
+                
+                candidate.id = endpoints.size();
+                candidate.group = protocol::network_address_t::from_endpoint(
+                    i.first).group()
+                ;
+                candidate.time_connected = connection->time_connected();
+                candidate.quality = connection->quality();
+                
+                endpoints.push_back(i.first);
+                candidates.push_back(candidate);
+            }
+        }
+    }
+    
+    std::size_t id;
+    
+    if (peer_quality::select_eviction(candidates, id))
+    {
+        auto it = m_tcp_connections.find(endpoints[id]);
+        
+        if (it != m_tcp_connections.end())
+        {
+            log_info(
+                "TCP connection manager is evicting " << it->first <<
+                " to make room for a new connection."
+            );
+            
+            if (auto connection = it->second.lock())
+            {
+                connection->stop();
+            }
+            
+            m_tcp_connections.erase(it);
+            
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+bool tcp_connection_manager::is_in_same_group(
+    const protocol::network_address_t & addr
+    )
+{
+    std::lock_guard<std::recursive_mutex> l1(mutex_tcp_connections_);
+    
+    for (auto & i : m_tcp_connections)
+    {
+        if (auto j = i.second.lock())
+        {
+            if (auto k = j->get_tcp_transport().lock())
+            {
+                try
+                {
+                    auto addr_tmp = protocol::network_address_t::from_endpoint(
+                        k->socket().remote_endpoint()
+                    );
+                    
+                    if (addr.group() == addr_tmp.group())
+                    {
+                        return true;
+                    }
+                }
+                catch (std::exception & e)
+                {
+                    // ...
+                }
+            }
+        }
+    }
+    
+    return false;
+}
+
+void tcp_connection_manager::race(
+    const std::vector<protocol::network_address_t> & candidates
+    )
+{
+    std::vector<boost::asio::ip::tcp::endpoint> endpoints;
+    
+    for (auto & i : candidates)
+    {
+        boost::asio::ip::tcp::endpoint ep(i.ipv4_mapped_address(), i.port);
+        
+        log_debug(
+            "TCP connection manager is racing " << ep << ", last seen = " <<
+            (time::instance().get_adjusted() - i.timestamp) / 60 <<
+            " mins, " << m_tcp_connections.size() << " connected peers."
+        );
+        
+        endpoints.push_back(ep);
+    }
+    
+    m_tcp_connection_race->start(endpoints);
+}
+
+std::size_t tcp_connection_manager::update_time_to_connected()
+{
+    auto established = established_tcp_connections();
+    
+    /**
+     * Track how long it took to reach full connectivity.
+     */
+    if (m_time_to_connected < 0 && established >= minimum_tcp_connections)
+    {
+        m_time_to_connected =
+            std::chrono::duration_cast<std::chrono::milliseconds> (
+            std::chrono::steady_clock::now() - m_time_started).count()
+        ;
+        
+        log_info(
+            "TCP connection manager established " << established <<
+            " connections in " << m_time_to_connected << " ms."
+        );
+    }
+    
+    return established;
+}
+
+std::size_t tcp_connection_manager::established_tcp_connections()
+{
+    std::lock_guard<std::recursive_mutex> l1(mutex_tcp_connections_);
+    
+    std::size_t ret = 0;
+    
+    for (auto & i : m_tcp_connections)
+    {
+        if (auto connection = i.second.lock())
+        {
+            if (connection->protocol_version() > 0)
+            {
+                ret++;
+            }
+        }
+    }
+    
+    return ret;
+}
+
 void tcp_connection_manager::do_resolve(
     const std::vector<boost::asio::ip::tcp::resolver::query> & queries
     )
@@ -465,61 +931,149 @@ void tcp_connection_manager::do_resolve(
     assert(queries.size() <= 100);
     
     /**
-     * Resolve the first entry.
+     * The threads only hold us while posting, a lookup blocked in
+     * getaddrinfo must not keep us alive.
      */
-    resolver_.async_resolve(queries.front(),
-        strand_.wrap([this, queries](
-            const boost::system::error_code & ec,
-            const boost::asio::ip::tcp::resolver::iterator & it
-            )
+    std::weak_ptr<tcp_connection_manager> weak(shared_from_this());
+    
+    /**
+     * The index of the next query to resolve.
+     */
+    auto next = std::make_shared< std::atomic<std::size_t> > (0);
+    
+    auto threads = std::min(
+        static_cast<std::size_t> (resolve_threads), queries.size()
+    );
+    
+    /**
+     * Resolve the entries in parallel, getaddrinfo blocks so each thread
+     * does its own lookups rather than queueing behind the others on the
+     * single resolver thread. The threads are detached, getaddrinfo can not
+     * be cancelled so stop does not wait for them, a thread finds us gone
+     * or stopped after its lookup and drops the results.
+     */
+    for (std::size_t i = 0; i < threads; i++)
+    {
+        std::thread([weak, queries, next]()
+        {
+            for (;;)
             {
-                if (ec)
+                std::size_t index = (*next)++;
+                
+                if (index >= queries.size())
                 {
-                    // ...
+                    break;
+                }
+                
+                if (auto self = weak.lock())
+                {
+                    if (self->m_stopped)
+                    {
+                        break;
+                    }
                 }
                 else
+                {
+                    break;
+                }
+                
+                const auto & q = queries[index];
+                
+                boost::asio::io_service ios;
+                
+                boost::asio::ip::tcp::resolver resolver(ios);
+                
+                boost::system::error_code ec;
+                
+                auto it = resolver.resolve(q, ec);
+                
+                std::vector<boost::asio::ip::tcp::endpoint> endpoints;
+                
+                if (ec)
                 {
                     log_debug(
-                        "TCP connection manager resolved " << it->endpoint() <<
+                        "TCP connection manager failed to resolve " <<
+                        q.host_name() << ", message = " << ec.message() <<
                         "."
                     );
-                    
-                    /**
-                     * Create the network address.
-                     */
-                    protocol::network_address_t addr =
-                        protocol::network_address_t::from_endpoint(
-                        it->endpoint()
-                    );
-                    
-                    /**
-                     * Add to the address manager.
-                     */
-                    stack_impl_.get_address_manager()->add(
-                        addr, protocol::network_address_t::from_endpoint(
-                        boost::asio::ip::tcp::endpoint(
-                        boost::asio::ip::address::from_string("127.0.0.1"), 0))
-                    );
+                }
+                else
+                {
+                    for (
+                        ; it != boost::asio::ip::tcp::resolver::iterator();
+                        ++it
+                        )
+                    {
+                        endpoints.push_back(it->endpoint());
+                    }
                 }
                 
-                if (queries.size() > 0)
+                auto self = weak.lock();
+                
+                /**
+                 * Drop results that arrive after we stopped.
+                 */
+                if (self == nullptr || self->m_stopped)
                 {
-                    auto tmp = queries;
-                    
-                    /**
-                     * Remove the first entry.
-                     */
-                    tmp.erase(tmp.begin());
-                    
-                    if (tmp.size() > 0)
+                    break;
+                }
+                
+                if (endpoints.size() > 0)
+                {
+                    self->io_service_.post(globals::instance().strand().wrap(
+                        [weak, endpoints]()
                     {
+                        auto self = weak.lock();
+                        
+                        if (self == nullptr || self->m_stopped)
+                        {
+                            return;
+                        }
+                        
+                        for (auto & j : endpoints)
+                        {
+                            log_debug(
+                                "TCP connection manager resolved " << j <<
+                                "."
+                            );
+                            
+                            /**
+                             * Add to the address manager.
+                             */
+                            self->stack_impl_.get_address_manager()->add(
+                                protocol::network_address_t::from_endpoint(j),
+                                protocol::network_address_t::from_endpoint(
+                                boost::asio::ip::tcp::endpoint(
+                                boost::asio::ip::address::from_string(
+                                "127.0.0.1"), 0))
+                            );
+                        }
+                        
+                        std::lock_guard<std::recursive_mutex> l1(
+                            self->mutex_tcp_connections_
+                        );
+                        
                         /**
-                         * Keep resolving as long as we have entries.
+                         * If we are short on connections tick now instead
+                         * of waiting for the timer.
                          */
-                        do_resolve(tmp);
-                    }
+                        if (
+                            self->m_tcp_connections.size() <
+                            minimum_tcp_connections
+                            )
+                        {
+                            self->timer_.expires_from_now(
+                                std::chrono::seconds(0)
+                            );
+                            self->timer_.async_wait(
+                                globals::instance().strand().wrap(
+                                std::bind(&tcp_connection_manager::tick, self,
+                                std::placeholders::_1))
+                            );
+                        }
+                    }));
                 }
             }
-        )
-    );
+        }).detach();
+    }
 }
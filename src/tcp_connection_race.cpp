@@ -0,0 +1,513 @@
+/*
+ * Copyright (c) 2013-2014 John Connor (BM-NC49AxAjcqVcF5jNPu85Rb8MJ2d9JqZt)
+ *
+ * This file is part of coinpp.
+ *
+ * coinpp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License with
+ * additional permissions to the one published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version. For more information see LICENSE.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cassert>
+#include <cstdio>
+#include <map>
+
+#include <coin/logger.hpp>
+#include <coin/tcp_connection_race.hpp>
+
+using namespace coin;
+
+tcp_connection_race::tcp_connection_race(
+    boost::asio::io_service & ios, boost::asio::strand & s,
+    const std::uint32_t & stagger, const std::size_t & minimum
+    )
+    : m_stagger(stagger)
+    , m_minimum(minimum)
+    , m_stopped(false)
+    , io_service_(ios)
+    , strand_(s)
+    , timer_(ios)
+{
+    // ...
+}
+
+void tcp_connection_race::set_handlers(
+    const std::function<
+        bool (const boost::asio::ip::tcp::endpoint &)
+    > & f_connect,
+    const std::function<
+        state_t (const boost::asio::ip::tcp::endpoint &)
+    > & f_state,
+    const std::function<
+        void (const boost::asio::ip::tcp::endpoint &)
+    > & f_cancel,
+    const std::function<std::size_t ()> & f_established
+    )
+{
+    m_on_connect = f_connect;
+    m_on_state = f_state;
+    m_on_cancel = f_cancel;
+    m_on_established = f_established;
+}
+
+void tcp_connection_race::start(
+    const std::vector<boost::asio::ip::tcp::endpoint> & candidates
+    )
+{
+    auto self(shared_from_this());
+    
+    strand_.dispatch([this, self, candidates]()
+    {
+        if (m_stopped)
+        {
+            return;
+        }
+        
+        for (std::size_t i = 0; i < candidates.size(); i++)
+        {
+            auto ep = candidates[i];
+            
+            if (i == 0)
+            {
+                do_connect(ep);
+            }
+            else
+            {
+                /**
+                 * Stagger the starts so the fastest peers win without
+                 * flooding the network with connection attempts.
+                 */
+                auto timer = std::make_shared<
+                    boost::asio::basic_waitable_timer<
+                    std::chrono::steady_clock>
+                > (io_service_);
+                
+                m_timers_start.insert(timer);
+                
+                timer->expires_from_now(
+                    std::chrono::milliseconds(i * m_stagger)
+                );
+                timer->async_wait(strand_.wrap(
+                    [this, self, ep, timer](
+                    const boost::system::error_code & ec)
+                    {
+                        m_timers_start.erase(timer);
+                        
+                        if (ec)
+                        {
+                            // ...
+                        }
+                        else
+                        {
+                            do_connect(ep);
+                        }
+                    })
+                );
+            }
+        }
+        
+        if (candidates.size() > 0)
+        {
+            timer_.expires_from_now(std::chrono::milliseconds(m_stagger));
+            timer_.async_wait(strand_.wrap(
+                std::bind(&tcp_connection_race::tick, self,
+                std::placeholders::_1))
+            );
+        }
+    });
+}
+
+void tcp_connection_race::stop()
+{
+    m_stopped = true;
+    
+    auto self(shared_from_this());
+    
+    strand_.dispatch([this, self]()
+    {
+        timer_.cancel();
+        
+        for (auto & i : m_timers_start)
+        {
+            i->cancel();
+        }
+        
+        m_timers_start.clear();
+        
+        m_racing.clear();
+    });
+}
+
+std::size_t tcp_connection_race::racing()
+{
+    return m_racing.size();
+}
+
+void tcp_connection_race::do_connect(
+    const boost::asio::ip::tcp::endpoint & ep
+    )
+{
+    /**
+     * Do not start once stopped or enough connections are established.
+     */
+    if (m_stopped || m_on_established() >= m_minimum)
+    {
+        return;
+    }
+    
+    if (m_on_connect(ep))
+    {
+        m_racing.insert(ep);
+    }
+}
+
+void tcp_connection_race::tick(const boost::system::error_code & ec)
+{
+    if (ec)
+    {
+        // ...
+    }
+    else if (m_stopped == false)
+    {
+        auto established = m_on_established();
+        
+        std::size_t pending = 0;
+        
+        auto it = m_racing.begin();
+        
+        while (it != m_racing.end())
+        {
+            auto state = m_on_state(*it);
+            
+            if (state != state_handshaking)
+            {
+                /**
+                 * The racer failed or won.
+                 */
+                it = m_racing.erase(it);
+            }
+            else if (established >= m_minimum)
+            {
+                log_debug(
+                    "TCP connection race is cancelling connection to " <<
+                    *it << "."
+                );
+                
+                /**
+                 * The race is over, stop the losers.
+                 */
+                m_on_cancel(*it);
+                
+                it = m_racing.erase(it);
+            }
+            else
+            {
+                pending++;
+                
+                ++it;
+            }
+        }
+        
+        /**
+         * Keep checking while racers handshake or are yet to start.
+         */
+        if (pending > 0 || m_timers_start.size() > 0)
+        {
+            auto self(shared_from_this());
+            
+            timer_.expires_from_now(std::chrono::milliseconds(m_stagger));
+            timer_.async_wait(strand_.wrap(
+                std::bind(&tcp_connection_race::tick, self,
+                std::placeholders::_1))
+            );
+        }
+    }
+}
+
+int tcp_connection_race::run_test()
+{
+    enum
+    {
+        stagger = 100,
+        minimum = 2,
+        peer_refused = 0,
+        peer_silent = 1,
+        peer_slow = 2,
+        peers = 8,
+    };
+    
+    typedef boost::asio::basic_waitable_timer<
+        std::chrono::steady_clock
+    > timer_t;
+    
+    boost::asio::io_service ios;
+    
+    boost::asio::strand s(ios);
+    
+    /**
+     * The loopback peers in order of preference, the first refuses the
+     * connection, the second accepts but never answers and the others
+     * answer the handshake (a single byte) after the delay in
+     * milliseconds.
+     */
+    const std::int64_t delays[peers] = { 0, -1, 2000, 10, 10, 10, 10, 10 };
+    
+    std::vector< std::shared_ptr<boost::asio::ip::tcp::acceptor> > acceptors;
+    
+    std::vector< std::shared_ptr<boost::asio::ip::tcp::socket> > accepted;
+    
+    std::vector< std::shared_ptr<timer_t> > timers;
+    
+    std::map<boost::asio::ip::tcp::endpoint, std::size_t> indexes;
+    
+    std::vector<boost::asio::ip::tcp::endpoint> candidates;
+    
+    for (std::size_t i = 0; i < peers; i++)
+    {
+        auto acceptor = std::make_shared<boost::asio::ip::tcp::acceptor> (
+            ios, boost::asio::ip::tcp::endpoint(
+            boost::asio::ip::address_v4::loopback(), 0)
+        );
+        
+        indexes[acceptor->local_endpoint()] = i;
+        
+        candidates.push_back(acceptor->local_endpoint());
+        
+        if (i == peer_refused)
+        {
+            acceptor->close();
+            
+            continue;
+        }
+        
+        acceptors.push_back(acceptor);
+        
+        auto socket = std::make_shared<boost::asio::ip::tcp::socket> (ios);
+        
+        acceptor->async_accept(*socket,
+            [&, i, socket](const boost::system::error_code & ec)
+            {
+                if (ec)
+                {
+                    // ...
+                }
+                else
+                {
+                    accepted.push_back(socket);
+                    
+                    /**
+                     * The silent peer never answers.
+                     */
+                    if (delays[i] < 0)
+                    {
+                        return;
+                    }
+                    
+                    auto timer = std::make_shared<timer_t> (ios);
+                    
+                    timers.push_back(timer);
+                    
+                    timer->expires_from_now(
+                        std::chrono::milliseconds(delays[i])
+                    );
+                    timer->async_wait(
+                        [socket](const boost::system::error_code & ec)
+                        {
+                            if (ec)
+                            {
+                                // ...
+                            }
+                            else
+                            {
+                                static const char c = 0;
+                                
+                                boost::system::error_code ignored;
+                                
+                                boost::asio::write(
+                                    *socket, boost::asio::buffer(&c, 1),
+                                    ignored
+                                );
+                            }
+                        }
+                    );
+                }
+            }
+        );
+    }
+    
+    std::map<
+        boost::asio::ip::tcp::endpoint,
+        std::shared_ptr<boost::asio::ip::tcp::socket>
+    > sockets;
+    
+    std::map<boost::asio::ip::tcp::endpoint, state_t> states;
+    
+    std::set<std::size_t> attempted, cancelled, won;
+    
+    auto time_start = std::chrono::steady_clock::now();
+    
+    std::int64_t time_connected = -1;
+    
+    auto race = std::make_shared<tcp_connection_race> (
+        ios, s, stagger, minimum
+    );
+    
+    race->set_handlers(
+        [&](const boost::asio::ip::tcp::endpoint & ep)
+        {
+            attempted.insert(indexes[ep]);
+            
+            auto socket = std::make_shared<boost::asio::ip::tcp::socket> (
+                ios
+            );
+            
+            auto buf = std::make_shared<char> (0);
+            
+            sockets[ep] = socket;
+            
+            states[ep] = state_handshaking;
+            
+            socket->async_connect(ep,
+                [&, ep, socket, buf](const boost::system::error_code & ec)
+                {
+                    if (ec)
+                    {
+                        states[ep] = state_failed;
+                        
+                        return;
+                    }
+                    
+                    boost::asio::async_read(
+                        *socket, boost::asio::buffer(buf.get(), 1),
+                        [&, ep, socket, buf](
+                        const boost::system::error_code & ec, std::size_t)
+                        {
+                            if (ec)
+                            {
+                                states[ep] = state_failed;
+                                
+                                return;
+                            }
+                            
+                            states[ep] = state_established;
+                            
+                            won.insert(indexes[ep]);
+                            
+                            if (won.size() == minimum)
+                            {
+                                time_connected =
+                                    std::chrono::duration_cast<
+                                    std::chrono::milliseconds> (
+                                    std::chrono::steady_clock::now() -
+                                    time_start).count()
+                                ;
+                            }
+                        }
+                    );
+                }
+            );
+            
+            return true;
+        },
+        [&](const boost::asio::ip::tcp::endpoint & ep)
+        {
+            return states[ep];
+        },
+        [&](const boost::asio::ip::tcp::endpoint & ep)
+        {
+            cancelled.insert(indexes[ep]);
+            
+            sockets[ep]->close();
+        },
+        [&]()
+        {
+            return won.size();
+        }
+    );
+    
+    race->start(candidates);
+    
+    /**
+     * Run until every start is due, bounded in case the race hangs.
+     */
+    auto done = false;
+    
+    timer_t timer_done(ios);
+    
+    timer_done.expires_from_now(
+        std::chrono::milliseconds((peers + 1) * stagger)
+    );
+    timer_done.async_wait([&](const boost::system::error_code &)
+    {
+        done = true;
+    });
+    
+    while (done == false)
+    {
+        ios.run_one();
+    }
+    
+    race->stop();
+    
+    /**
+     * The first two fast peers win, the silent and slow peers are
+     * cancelled and the rest are never started.
+     */
+    assert(won == std::set<std::size_t> ({ 3, 4 }));
+    assert(cancelled == std::set<std::size_t> ({ peer_silent, peer_slow }));
+    assert(attempted == std::set<std::size_t> ({ 0, 1, 2, 3, 4 }));
+    assert(states[candidates[peer_refused]] == state_failed);
+    assert(race->racing() == 0);
+    assert(time_connected >= 4 * stagger && time_connected < 5 * stagger);
+    
+    printf(
+        "Test tcp_connection_race: %d of %d loopback peers (refused, "
+        "silent, slow and fast) established in %lld ms, %d attempted, "
+        "%d cancelled.\n", static_cast<int> (won.size()),
+        static_cast<int> (peers), static_cast<long long> (time_connected),
+        static_cast<int> (attempted.size()),
+        static_cast<int> (cancelled.size())
+    );
+    
+    /**
+     * Drain the handlers that refer to this frame.
+     */
+    for (auto & i : acceptors)
+    {
+        i->close();
+    }
+    
+    for (auto & i : accepted)
+    {
+        i->close();
+    }
+    
+    for (auto & i : sockets)
+    {
+        i.second->close();
+    }
+    
+    for (auto & i : timers)
+    {
+        i->cancel();
+    }
+    
+    ios.reset();
+    
+    while (ios.poll() > 0)
+    {
+        // ...
+    }
+    
+    return 0;
+}
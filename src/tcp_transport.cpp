@@ -25,6 +25,7 @@
 #include <coin/globals.hpp>
 #include <coin/logger.hpp>
 #include <coin/tcp_transport.hpp>
+#include <coin/token_bucket.hpp>
 
 using namespace coin;
 
@@ -203,13 +204,22 @@ tcp_transport::tcp_transport(
     , m_close_after_writes(false)
     , m_read_timeout(0)
     , m_write_timeout(0)
+    , m_read_paused(false)
+    , m_read_deferred(false)
     , m_time_last_read(0)
     , m_time_last_write(0)
+    , m_bytes_sent(0)
+    , m_bytes_received(0)
+    , m_bytes_queued(0)
     , io_service_(ios)
     , strand_(s)
     , connect_timeout_timer_(ios)
     , read_timeout_timer_(ios)
     , write_timeout_timer_(ios)
+    , shaping_timer_(ios)
+    , write_in_progress_(false)
+    , write_in_progress_bulk_(false)
+    , shaping_in_progress_(false)
 #if (defined __IPHONE_OS_VERSION_MAX_ALLOWED)
     , readStreamRef_(0)
     , writeStreamRef_(0)
@@ -450,6 +460,7 @@ void tcp_transport::stop()
         connect_timeout_timer_.cancel();
         read_timeout_timer_.cancel();
         write_timeout_timer_.cancel();
+        shaping_timer_.cancel();
         
         /**
          * Close the socket.
@@ -478,37 +489,54 @@ void tcp_transport::set_on_read(
     m_on_read = f;
 }
 
-void tcp_transport::write(const char * buf, const std::size_t & len)
+void tcp_transport::write(
+    const char * buf, const std::size_t & len, const bool & bulk
+    )
 {
     auto self(shared_from_this());
     
     std::vector<char> buffer(buf, buf + len);
     
-    if (m_state == state_connected)
+    io_service_.post(strand_.wrap(
+        [this, self, buffer, bulk]()
     {
-        io_service_.post(strand_.wrap(
-            [this, self, buffer]()
+        m_bytes_queued += buffer.size();
+        
+        if (bulk)
         {
-            bool write_in_progress = write_queue_.size() > 0;
-            
-            write_queue_.push_back(buffer);
-          
-            if (write_in_progress == false)
-            {
-                do_write(
-                    &write_queue_.front()[0], write_queue_.front().size()
-                );
-            }
-        }));
-    }
-    else
-    {
-        io_service_.post(strand_.wrap(
-            [this, self, buffer]()
+            write_queue_bulk_.push_back(buffer);
+        }
+        else
         {
             write_queue_.push_back(buffer);
-        }));
-    }
+        }
+        
+        do_write_next();
+    }));
+}
+
+void tcp_transport::set_token_buckets(
+    const std::shared_ptr<token_bucket> & relay,
+    const std::shared_ptr<token_bucket> & bulk
+    )
+{
+    m_token_bucket_relay = relay;
+    m_token_bucket_bulk = bulk;
+}
+
+std::uint64_t tcp_transport::bytes_sent() const
+{
+    return m_bytes_sent;
+}
+
+std::uint64_t tcp_transport::bytes_received() const
+{
+    return m_bytes_received;
+}
+
+std::size_t tcp_transport::bytes_queued() const
+{
+    return m_bytes_queued;
 }
 
 tcp_transport::state_t & tcp_transport::state()
@@ -548,6 +576,23 @@ void tcp_transport::set_write_timeout(const std::uint32_t & val)
     m_write_timeout = val;
 }
 
+void tcp_transport::set_read_paused(const bool & flag)
+{
+    std::lock_guard<std::mutex> l1(mutex_read_);
+    
+    m_read_paused = flag;
+    
+    /**
+     * Start the read the read handler left to us.
+     */
+    if (m_read_paused == false && m_read_deferred)
+    {
+        m_read_deferred = false;
+        
+        do_read();
+    }
+}
+
 const std::time_t & tcp_transport::time_last_read()
 {
     return m_time_last_read;
@@ -607,13 +652,7 @@ void tcp_transport::do_connect(const boost::asio::ip::tcp::endpoint & ep)
                         m_on_complete(ec, self);
                     }
             
-                    if (write_queue_.size() > 0)
-                    {
-                        do_write(
-                            &write_queue_.front()[0],
-                            write_queue_.front().size()
-                        );
-                    }
+                    do_write_next();
                     
                     do_read();
                 }
@@ -683,13 +722,7 @@ void tcp_transport::do_connect(
                         m_on_complete(ec, self);
                     }
             
-                    if (write_queue_.size() > 0)
-                    {
-                        do_write(
-                            &write_queue_.front()[0],
-                            write_queue_.front().size()
-                        );
-                    }
+                    do_write_next();
                     
                     do_read();
                 }
@@ -753,6 +786,8 @@ void tcp_transport::do_read()
                  */
                 m_time_last_read = std::time(0);
                 
+                m_bytes_received += len;
+                
                 read_timeout_timer_.cancel();
                         
                 /**
@@ -763,7 +798,19 @@ void tcp_transport::do_read()
                     m_on_read(self, read_buffer_, len);
                 }
                 
-                do_read();
+                std::lock_guard<std::mutex> l1(mutex_read_);
+                
+                /**
+                 * While paused the next read is started on resume.
+                 */
+                if (m_read_paused)
+                {
+                    m_read_deferred = true;
+                }
+                else
+                {
+                    do_read();
+                }
             }
         });
     }
@@ -817,11 +864,21 @@ void tcp_transport::do_write(const char * buf, const std::size_t & len)
                  */
                 m_time_last_write = std::time(0);
                 
+                m_bytes_sent += bytes_transferred;
+                
                 write_timeout_timer_.cancel();
                 
-                write_queue_.pop_front();
+                auto & queue =
+                    write_in_progress_bulk_ ? write_queue_bulk_ : write_queue_
+                ;
+                
+                m_bytes_queued -= queue.front().size();
                 
-                if (write_queue_.size() == 0)
+                queue.pop_front();
+                
+                write_in_progress_ = false;
+                
+                if (write_queue_.size() == 0 && write_queue_bulk_.size() == 0)
                 {
                     if (m_close_after_writes)
                     {
@@ -837,15 +894,74 @@ void tcp_transport::do_write(const char * buf, const std::size_t & len)
                 }
                 else
                 {
-                    do_write(
-                        &write_queue_.front()[0], write_queue_.front().size()
-                    );
+                    do_write_next();
                 }
             }
         });
     }
 }
 
+void tcp_transport::do_write_next()
+{
+    if (m_state != state_connected || write_in_progress_)
+    {
+        return;
+    }
+    
+    /**
+     * Normal writes (fresh blocks, transactions and control messages) always
+     * go before bulk writes.
+     */
+    auto bulk = write_queue_.size() == 0;
+    
+    auto & queue = bulk ? write_queue_bulk_ : write_queue_;
+    
+    if (queue.size() == 0)
+    {
+        return;
+    }
+    
+    auto & bucket = bulk ? m_token_bucket_bulk : m_token_bucket_relay;
+    
+    auto len = queue.front().size();
+    
+    if (bucket && bucket->consume(len) == false)
+    {
+        if (shaping_in_progress_ == false)
+        {
+            shaping_in_progress_ = true;
+            
+            auto self(shared_from_this());
+            
+            /**
+             * Retry once enough tokens are available.
+             */
+            shaping_timer_.expires_from_now(bucket->delay(len));
+            shaping_timer_.async_wait(strand_.wrap(
+                [this, self](boost::system::error_code ec)
+            {
+                shaping_in_progress_ = false;
+                
+                if (ec)
+                {
+                    // ...
+                }
+                else
+                {
+                    do_write_next();
+                }
+            }));
+        }
+        
+        return;
+    }
+    
+    write_in_progress_ = true;
+    write_in_progress_bulk_ = bulk;
+    
+    do_write(&queue.front()[0], len);
+}
+
 void tcp_transport::set_voip()
 {
 #if (defined __IPHONE_OS_VERSION_MAX_ALLOWED)
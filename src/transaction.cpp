@@ -18,36 +18,36 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
  
+#include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <cstdio>
 
 #include <coin/block.hpp>
+#include <coin/chain_replay.hpp>
 #include <coin/checkpoints.hpp>
 #include <coin/constants.hpp>
 #include <coin/globals.hpp>
 #include <coin/hash.hpp>
 #include <coin/logger.hpp>
 #include <coin/reward.hpp>
+#include <coin/stake_index.hpp>
 #include <coin/time.hpp>
 #include <coin/transaction.hpp>
 #include <coin/transaction_pool.hpp>
 #include <coin/utility.hpp>
+#include <coin/validation_cache.hpp>
 
 using namespace coin;
 
 transaction::transaction()
-    : data_buffer()
-    , m_version(current_version)
+    : m_version(current_version)
     , m_time(static_cast<std::uint32_t> (time::instance().get_adjusted()))
     , m_time_lock(0)
 {
     set_null();
 }
 
-void transaction::encode(const bool & encode_version)
-{
-    encode(*this, encode_version);
-}
-
 void transaction::encode(
     data_buffer & buffer, const bool & encode_version
     ) const
@@ -91,6 +91,15 @@ void transaction::encode(
     buffer.write_uint32(m_time_lock);
 }
 
+data_buffer transaction::encode(const bool & encode_version) const
+{
+    data_buffer ret;
+    
+    encode(ret, encode_version);
+    
+    return ret;
+}
+
 bool transaction::decode(data_buffer & buffer)
 {
     /**
@@ -108,6 +117,14 @@ bool transaction::decode(data_buffer & buffer)
      */
     auto number_transactions_in = buffer.read_var_int();
     
+    /**
+     * Reserve up front so the vector is allocated once, bounded by what the
+     * buffer could hold (an input is at least 41 bytes, an output 9).
+     */
+    m_transactions_in.reserve(
+        std::min<std::uint64_t> (number_transactions_in, buffer.size() / 41)
+    );
+    
     for (auto i = 0; i < number_transactions_in; i++)
     {
         /**
@@ -123,7 +140,7 @@ bool transaction::decode(data_buffer & buffer)
         /**
          * Retain the transaction_in.
          */
-        m_transactions_in.push_back(tx_in);
+        m_transactions_in.push_back(std::move(tx_in));
     }
     
     /**
@@ -131,6 +148,10 @@ bool transaction::decode(data_buffer & buffer)
      */
     auto number_transactions_out = buffer.read_var_int();
     
+    m_transactions_out.reserve(
+        std::min<std::uint64_t> (number_transactions_out, buffer.size() / 9)
+    );
+    
     for (auto i = 0; i < number_transactions_out; i++)
     {
         /**
@@ -146,7 +167,7 @@ bool transaction::decode(data_buffer & buffer)
         /**
          * Retain the transaction_out.
          */
-        m_transactions_out.push_back(tx_out);
+        m_transactions_out.push_back(std::move(tx_out));
     }
     
     /**
@@ -157,6 +178,31 @@ bool transaction::decode(data_buffer & buffer)
     return true;
 }
 
+std::size_t transaction::size(const bool & encode_version) const
+{
+    std::size_t ret = encode_version ? sizeof(m_version) : 0;
+    
+    ret += sizeof(m_time);
+    
+    ret += utility::get_var_int_size(m_transactions_in.size());
+    
+    for (auto & i : m_transactions_in)
+    {
+        ret += i.size();
+    }
+    
+    ret += utility::get_var_int_size(m_transactions_out.size());
+    
+    for (auto & i : m_transactions_out)
+    {
+        ret += i.size();
+    }
+    
+    ret += sizeof(m_time_lock);
+    
+    return ret;
+}
+
 void transaction::set_null()
 {
     m_version = current_version;
@@ -627,33 +673,49 @@ bool transaction::accept_to_transaction_pool(
 
 bool transaction::read_from_disk(const transaction_position & position)
 {
-    auto f = block::file_open(position.file_index(), 0, "rb");
+    /**
+     * Compressed blocks are decoded from memory, the transaction position
+     * is relative to the uncompressed block.
+     */
+    data_buffer buffer_block;
+    
+    std::shared_ptr<file> f;
     
-    if (f)
+    if (
+        block::open_from_disk(position.file_index(),
+        position.block_position(), buffer_block, f) == false
+        )
     {
-        if (f->seek_set(position.tx_position()) == 0)
-        {
-            /** 
-             * Allocate the buffer.
-             */
-            data_buffer buffer(f);
-            
-            /**
-             * Decode
-             */
-            decode(buffer);
-        }
-        else
-        {
-            throw std::runtime_error("seek failed");
-            
-            return false;
-        }
+        log_error("Transaction failed to open block file.");
+        
+        return false;
+    }
+    
+    if (f == nullptr)
+    {
+        buffer_block.seek(position.tx_position() - position.block_position());
+        
+        decode(buffer_block);
+        
+        return true;
+    }
+    
+    if (f->seek_set(position.tx_position()) == 0)
+    {
+        /** 
+         * Allocate the buffer.
+         */
+        data_buffer buffer(f);
+        
+        /**
+         * Decode
+         */
+        decode(buffer);
     }
     else
     {
-        throw std::runtime_error("failed to open block file");
-            
+        log_error("Transaction failed to seek block file.");
+        
         return false;
     }
 
@@ -1001,6 +1063,33 @@ bool transaction::connect_inputs(
             }
 
         }
+        /**
+         * Skip ECDSA signature verification when connecting blocks before
+         * the last blockchain checkpoint. This is safe because block
+         * merkle hashes are  still computed and checked, and any change
+         * will be caught at the next checkpoint. A chain replay may ask
+         * for them to be verified anyway.
+         */
+        auto verify_scripts =
+            (connect_block && (globals::instance().best_block_height() <
+            checkpoints::instance().get_total_blocks_estimate())) == false ||
+            chain_replay::verify_all_scripts()
+        ;
+        
+        /**
+         * Skip script execution for a transaction whose scripts all
+         * verified on entry to the transaction pool.
+         */
+        if (
+            verify_scripts && validation_cache::instance().get(
+            get_hash(), strict_pay_to_script_hash ?
+            validation_cache::flag_pay_to_script_hash :
+            validation_cache::flag_none)
+            )
+        {
+            verify_scripts = false;
+        }
+        
         /**
          * Only if all inputs pass do we perform expensive ECDSA signature
          * checks. This may help prevent CPU exhaustion attacks.
@@ -1037,21 +1126,19 @@ bool transaction::connect_inputs(
                 }
             }
             
-            /**
-             * Skip ECDSA signature verification when connecting blocks before
-             * the last blockchain checkpoint. This is safe because block
-             * merkle hashes are  still computed and checked, and any change
-             * will be caught at the next checkpoint.
-             */
-            if (
-                (connect_block && (globals::instance().best_block_height() <
-                checkpoints::instance().get_total_blocks_estimate())) == false
-                )
+            if (verify_scripts)
             {
-                if (
-                    script::verify_signature(tx_previous, *this, i,
-                    strict_pay_to_script_hash, 0) == false
-                    )
+                auto time_start = chain_replay::profile_start();
+                
+                auto verified = script::verify_signature(
+                    tx_previous, *this, i, strict_pay_to_script_hash, 0
+                );
+                
+                chain_replay::profile_stop(
+                    chain_replay::phase_script, time_start
+                );
+                
+                if (verified == false)
                 {
                     /**
                      * Only during transition phase for P2SH.
@@ -1361,21 +1448,17 @@ bool transaction::get_coin_age(db_tx & tx_db, std::uint64_t & coin_age) const
     for (auto & i : m_transactions_in)
     {
         /**
-         * Try to find the previous transaction in the database.
+         * Look up the previous output, this only touches the transaction
+         * database when it is not already indexed.
          */
-        transaction tx_previous;
-     
-        /**
-         * Allocate the transaction_index.
-         */
-        transaction_index tx_index;
+        stake_index::entry_t entry;
         
         /**
          * Check if the previous transaction is in the main chain.
          */
         if (
-            tx_previous.read_from_disk(tx_db, i.previous_out(),
-            tx_index) == false
+            stake_index::instance().get(tx_db, i.previous_out(),
+            entry) == false
             )
         {
             continue;
@@ -1384,24 +1467,7 @@ bool transaction::get_coin_age(db_tx & tx_db, std::uint64_t & coin_age) const
         /**
          * Check for timestamp violation.
          */
-        if (m_time < tx_previous.time())
-        {
-            return false;
-        }
-        
-        /**
-         * Allocate the block.
-         */
-        block blk;
-        
-        /**
-         * Read the block header.
-         */
-        if (
-            blk.read_from_disk(tx_index.get_transaction_position().file_index(),
-            tx_index.get_transaction_position().block_position(), false
-            ) == false
-            )
+        if (m_time < entry.time_tx)
         {
             return false;
         }
@@ -1411,18 +1477,14 @@ bool transaction::get_coin_age(db_tx & tx_db, std::uint64_t & coin_age) const
          * @note If the network is not secured by PoW miners then using a
          * large minimum stake age could result in an insecure network.
          */
-        if (blk.header().timestamp + constants::min_stake_age > m_time)
+        if (entry.time_block + constants::min_stake_age > m_time)
         {
             continue;
         }
         
-        const auto & value_in = tx_previous.transactions_out()[
-            i.previous_out().n()
-        ].value();
-        
         cent_second +=
-            big_number(value_in) *
-            (m_time - tx_previous.time()) / constants::cent
+            big_number(entry.value) *
+            (m_time - entry.time_tx) / constants::cent
         ;
     }
 
@@ -1459,16 +1521,6 @@ bool transaction::check()
         return false;
     }
     
-    /**
-     * Clear
-     */
-    clear();
-    
-    /**
-     * Encode
-     */
-    encode();
-    
     /**
      * Check the size.
      */
@@ -1597,3 +1649,101 @@ const std::vector<transaction_out> & transaction::transactions_out() const
 {
     return m_transactions_out;
 }
+
+int transaction::run_test()
+{
+    enum { transactions = 2000, iterations = 20 };
+    
+    /**
+     * A block worth of typical two input, two output pay-to-pubkey-hash
+     * transactions (107 byte signatures, 25 byte public key scripts).
+     */
+    data_buffer buffer;
+    
+    for (auto i = 0; i < transactions; i++)
+    {
+        transaction tx;
+        
+        for (auto j = 0; j < 2; j++)
+        {
+            transaction_in tx_in(hash::sha256_random(), j);
+            
+            tx_in.script_signature().resize(
+                107, static_cast<std::uint8_t> (j)
+            );
+            
+            tx.transactions_in().push_back(tx_in);
+            
+            script script_public_key;
+            
+            script_public_key.resize(25, static_cast<std::uint8_t> (i));
+            
+            tx.transactions_out().push_back(
+                transaction_out(100000 * (j + 1), script_public_key)
+            );
+        }
+        
+        auto offset = buffer.size();
+        
+        tx.encode(buffer);
+        
+        /**
+         * The computed size must match the encoded length.
+         */
+        assert(tx.size() == buffer.size() - offset);
+        assert(tx.encode().size() == tx.size());
+    }
+    
+    std::vector<transaction> txs;
+    
+    auto time_start = std::chrono::steady_clock::now();
+    
+    for (auto i = 0; i < iterations; i++)
+    {
+        data_buffer copy(buffer.data(), buffer.size());
+        
+        txs.clear();
+        
+        for (auto j = 0; j < transactions; j++)
+        {
+            transaction tx;
+            
+            tx.decode(copy);
+            
+            txs.push_back(std::move(tx));
+        }
+    }
+    
+    auto time_decode = std::chrono::steady_clock::now();
+    
+    /**
+     * Copy every transaction the way signature_hash does.
+     */
+    std::size_t inputs = 0;
+    
+    for (auto i = 0; i < iterations; i++)
+    {
+        for (auto & j : txs)
+        {
+            transaction tx_tmp(j);
+            
+            inputs += tx_tmp.transactions_in().size();
+        }
+    }
+    
+    auto time_copy = std::chrono::steady_clock::now();
+    
+    assert(inputs == iterations * transactions * 2);
+    
+    printf(
+        "Test transaction: %d transactions, decode = %lld us/block, "
+        "copy = %lld us/block.\n", static_cast<int> (transactions),
+        static_cast<long long> (std::chrono::duration_cast<
+        std::chrono::microseconds> (time_decode - time_start).count() /
+        iterations), static_cast<long long> (std::chrono::duration_cast<
+        std::chrono::microseconds> (time_copy - time_decode).count() /
+        iterations)
+    );
+    
+    return 0;
+}
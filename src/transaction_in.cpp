@@ -19,12 +19,12 @@
  */
 
 #include <coin/transaction_in.hpp>
+#include <coin/utility.hpp>
 
 using namespace coin;
 
 transaction_in::transaction_in()
-    : data_buffer()
-    , m_previous_out()
+    : m_previous_out()
     , m_sequence(std::numeric_limits<std::uint32_t>::max())
 {
     // ...
@@ -34,8 +34,7 @@ transaction_in::transaction_in(
     point_out point_out_previous, script script_signature,
     const std::uint32_t & sequence
     )
-    : data_buffer()
-    , m_previous_out(point_out_previous)
+    : m_previous_out(point_out_previous)
     , m_script_signature(script_signature)
     , m_sequence(sequence)
 {
@@ -47,19 +46,13 @@ transaction_in::transaction_in(
     script script_signature,
     const std::uint32_t & sequence
     )
-    : data_buffer()
-    , m_previous_out(point_out(hash_previous_tx, out))
+    : m_previous_out(point_out(hash_previous_tx, out))
     , m_script_signature(script_signature)
     , m_sequence(sequence)
 {
     // ...
 }
 
-void transaction_in::encode()
-{
-    encode(*this);
-}
-
 void transaction_in::encode(data_buffer & buffer) const
 {
     /**
@@ -91,9 +84,13 @@ void transaction_in::encode(data_buffer & buffer) const
     buffer.write_uint32(m_sequence);
 }
 
-void transaction_in::decode()
+data_buffer transaction_in::encode() const
 {
-    decode(*this);
+    data_buffer ret;
+    
+    encode(ret);
+    
+    return ret;
 }
 
 void transaction_in::decode(data_buffer & buffer)
@@ -114,16 +111,16 @@ void transaction_in::decode(data_buffer & buffer)
     auto len = buffer.read_var_int();
     
     /**
-     * Read the script.
+     * Read the script signature directly into its (usually inline) storage.
      */
-    auto bytes = buffer.read_bytes(len);
+    m_script_signature.resize(len);
     
-    /**
-     * Read the script signature.
-     */
-    m_script_signature.insert(
-        m_script_signature.begin(), bytes.begin(), bytes.end()
-    );
+    if (len > 0)
+    {
+        buffer.read_bytes(
+            reinterpret_cast<char *> (m_script_signature.data()), len
+        );
+    }
 
     /**
      * The sequence.
@@ -131,6 +128,15 @@ void transaction_in::decode(data_buffer & buffer)
     m_sequence = buffer.read_uint32();
 }
 
+std::size_t transaction_in::size() const
+{
+    return
+        m_previous_out.size() +
+        utility::get_var_int_size(m_script_signature.size()) +
+        m_script_signature.size() + sizeof(m_sequence)
+    ;
+}
+
 std::string transaction_in::to_string() const
 {
     std::string ret;
@@ -141,7 +147,9 @@ std::string transaction_in::to_string() const
     
     if (m_previous_out.is_null())
     {
-        ret += ", coinbase " + utility::hex_string(m_script_signature);
+        ret += ", coinbase " + utility::hex_string(
+            m_script_signature.begin(), m_script_signature.end()
+        );
     }
     else
     {
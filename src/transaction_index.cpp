@@ -159,3 +159,8 @@ std::vector<transaction_position> & transaction_index::spent()
 {
     return m_spent;
 }
+
+const std::vector<transaction_position> & transaction_index::spent() const
+{
+    return m_spent;
+}
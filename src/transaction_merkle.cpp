@@ -36,11 +36,6 @@ transaction_merkle::transaction_merkle(const transaction & tx)
     // ...
 }
 
-void transaction_merkle::encode()
-{
-    encode(*this);
-}
-
 void transaction_merkle::encode(data_buffer & buffer)
 {
     transaction::encode(buffer);
@@ -57,9 +52,13 @@ void transaction_merkle::encode(data_buffer & buffer)
     buffer.write_int32(m_index);
 }
 
-void transaction_merkle::decode()
+data_buffer transaction_merkle::encode()
 {
-    decode(*this);
+    data_buffer ret;
+    
+    encode(ret);
+    
+    return ret;
 }
 
 void transaction_merkle::decode(data_buffer & buffer)
@@ -99,7 +98,9 @@ bool transaction_merkle::accept_to_memory_pool(db_tx & tx_db)
 
 bool transaction_merkle::accept_to_memory_pool()
 {
-    db_tx tx_db("r");
+    auto reader = db_tx::reader();
+    
+    auto & tx_db = *reader;
     
     return accept_to_memory_pool(tx_db);
 }
@@ -19,12 +19,12 @@
  */
  
 #include <coin/transaction_out.hpp>
+#include <coin/utility.hpp>
 
 using namespace coin;
 
 transaction_out::transaction_out()
-    : data_buffer()
-    , m_value(0)
+    : m_value(0)
     , m_script_public_key()
 {
     // ...
@@ -33,18 +33,12 @@ transaction_out::transaction_out()
 transaction_out::transaction_out(
     const std::uint64_t & value, const script & script_public_key
     )
-    : data_buffer()
-    , m_value(value)
+    : m_value(value)
     , m_script_public_key(script_public_key)
 {
     // ...
 }
 
-void transaction_out::encode()
-{
-    encode(*this);
-}
-
 void transaction_out::encode(data_buffer & buffer) const
 {
     /**
@@ -69,9 +63,13 @@ void transaction_out::encode(data_buffer & buffer) const
     }
 }
 
-void transaction_out::decode()
+data_buffer transaction_out::encode() const
 {
-    decode(*this);
+    data_buffer ret;
+    
+    encode(ret);
+    
+    return ret;
 }
 
 void transaction_out::decode(data_buffer & buffer)
@@ -89,19 +87,25 @@ void transaction_out::decode(data_buffer & buffer)
     if (len > 0)
     {
         /**
-         * Read the script.
+         * Read the script directly into its (usually inline) storage.
          */
-        auto bytes = buffer.read_bytes(len);
+        m_script_public_key.resize(len);
         
-        /**
-         * Insert the script.
-         */
-        m_script_public_key.insert(
-            m_script_public_key.begin(), bytes.begin(), bytes.end()
+        buffer.read_bytes(
+            reinterpret_cast<char *> (m_script_public_key.data()), len
         );
     }
 }
 
+std::size_t transaction_out::size() const
+{
+    return
+        sizeof(m_value) +
+        utility::get_var_int_size(m_script_public_key.size()) +
+        m_script_public_key.size()
+    ;
+}
+
 std::string transaction_out::to_string() const
 {
     if (is_empty())
@@ -18,12 +18,25 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <stdexcept>
 
 #include <coin/constants.hpp>
+#include <coin/data_buffer.hpp>
+#include <coin/filesystem.hpp>
+#include <coin/hash.hpp>
 #include <coin/logger.hpp>
+#include <coin/message.hpp>
+#include <coin/random.hpp>
 #include <coin/stack_impl.hpp>
+#include <coin/startup_graph.hpp>
 #include <coin/transaction_pool.hpp>
+#include <coin/validation_cache.hpp>
 #include <coin/wallet.hpp>
 #include <coin/wallet_manager.hpp>
 
@@ -31,10 +44,27 @@ using namespace coin;
 
 transaction_pool::transaction_pool()
     : m_transactions_updated(0)
+    , m_save_stop(false)
 {
     // ...
 }
 
+transaction_pool::~transaction_pool()
+{
+    std::unique_lock<std::mutex> l1(mutex_save_);
+    
+    m_save_stop = true;
+    
+    condition_save_.notify_one();
+    
+    l1.unlock();
+    
+    if (m_save_thread.joinable())
+    {
+        m_save_thread.join();
+    }
+}
+
 transaction_pool & transaction_pool::instance()
 {
     static transaction_pool g_transaction_pool;
@@ -42,53 +72,101 @@ transaction_pool & transaction_pool::instance()
     return g_transaction_pool;
 }
 
-bool transaction_pool::accept(
-    db_tx & dbtx, transaction & tx, bool * missing_inputs
-    )
+void transaction_pool::start()
 {
-    if (missing_inputs)
+    auto path = filesystem::data_path() + "mempool.dat";
+    
+    try
     {
-        *missing_inputs = false;
+        load(*db_tx::reader(), path);
     }
-    
-    /**
-     * Check the transaction.
-     */
-    if (tx.check() == false)
+    catch (std::exception & e)
     {
-        throw std::runtime_error("check transaction failed");
-    
-        return false;
+        log_error(
+            "Transaction pool failed reading mempool file, path = " << path <<
+            ", what = " << e.what() << "."
+        );
     }
     
-    /**
-     * Coinbase is only valid in a block, not as a loose transaction.
-     */
-    if (tx.is_coin_base())
-    {
-        throw std::runtime_error("coin base as individual transaction");
+    std::lock_guard<std::mutex> l1(mutex_save_);
     
-        return false;
+    if (m_save_thread.joinable() == false)
+    {
+        m_save_stop = false;
+        
+        m_save_thread = std::thread(&transaction_pool::do_save, this);
     }
+}
+
+void transaction_pool::stop()
+{
+    std::unique_lock<std::mutex> l1(mutex_save_);
     
-    /**
-     * Coinstake is only valid in a block, not as a loose transaction.
-     */
-    if (tx.is_coin_stake())
-    {
-        throw std::runtime_error("coin stake as individual transaction");
+    m_save_stop = true;
     
-        return false;
+    condition_save_.notify_one();
+    
+    l1.unlock();
+    
+    if (m_save_thread.joinable())
+    {
+        m_save_thread.join();
     }
     
-    /**
-     * Only work on non standard transactions when on test net.
-     */
-    if (constants::test_net == false && tx.is_standard() == false)
+    save();
+}
+
+bool transaction_pool::accept(
+    db_tx & dbtx, transaction & tx, bool * missing_inputs,
+    const bool & is_checked
+    )
+{
+    if (missing_inputs)
     {
-        throw std::runtime_error("nonstandard transaction type");
+        *missing_inputs = false;
+    }
     
-        return false;
+    if (is_checked == false)
+    {
+        /**
+         * Check the transaction.
+         */
+        if (tx.check() == false)
+        {
+            throw std::runtime_error("check transaction failed");
+        
+            return false;
+        }
+        
+        /**
+         * Coinbase is only valid in a block, not as a loose transaction.
+         */
+        if (tx.is_coin_base())
+        {
+            throw std::runtime_error("coin base as individual transaction");
+        
+            return false;
+        }
+        
+        /**
+         * Coinstake is only valid in a block, not as a loose transaction.
+         */
+        if (tx.is_coin_stake())
+        {
+            throw std::runtime_error("coin stake as individual transaction");
+        
+            return false;
+        }
+        
+        /**
+         * Only work on non standard transactions when on test net.
+         */
+        if (constants::test_net == false && tx.is_standard() == false)
+        {
+            throw std::runtime_error("nonstandard transaction type");
+        
+            return false;
+        }
     }
     
     /**
@@ -223,16 +301,6 @@ bool transaction_pool::accept(
 
         auto fees = tx.get_value_in(inputs) - tx.get_value_out();
         
-        /**
-         * Clear the transaction's buffer.
-         */
-        tx.clear();
-        
-        /**
-         * Encode the transaction to get the size.
-         */
-        tx.encode();
-
         /**
          * Don't accept it if it can't get into a block.
          */
@@ -252,8 +320,9 @@ bool transaction_pool::accept(
 
         /**
          * Rate-limit free transactions. This mitigates 'penny-flooding'.
+         * Reloaded transactions were already let through once.
          */
-        if (fees < constants::min_relay_tx_fee)
+        if (fees < constants::min_relay_tx_fee && is_checked == false)
         {
             static std::mutex g_m;
             static double g_free_count;
@@ -314,6 +383,14 @@ bool transaction_pool::accept(
             
             return false;
         }
+        
+        /**
+         * Every input script verified, a block including this transaction
+         * need not run them again.
+         */
+        validation_cache::instance().set(
+            hash, validation_cache::flag_pay_to_script_hash
+        );
     }
     
     /**
@@ -346,6 +423,147 @@ bool transaction_pool::accept(
 
     return true;
 }
+
+std::size_t transaction_pool::load(db_tx & dbtx, const std::string & path)
+{
+    auto time_start = std::chrono::steady_clock::now();
+    
+    std::vector<entry_t> entries;
+    
+    if (read(path, entries) == false)
+    {
+        return 0;
+    }
+    
+    auto time_checked = std::chrono::steady_clock::now();
+    
+    /**
+     * Accept the transactions in arrival order so that transactions
+     * spending another pooled transaction find their inputs.
+     */
+    std::size_t accepted = 0;
+    
+    for (auto & i : entries)
+    {
+        try
+        {
+            if (accept(dbtx, i.tx, 0, true))
+            {
+                std::lock_guard<std::recursive_mutex> l1(mutex_);
+                
+                m_arrival_times[i.tx.get_hash()] = i.time;
+                
+                accepted++;
+            }
+        }
+        catch (std::exception & e)
+        {
+            log_debug(
+                "Transaction pool failed to reload transaction, what = " <<
+                e.what() << "."
+            );
+        }
+    }
+    
+    auto time_accepted = std::chrono::steady_clock::now();
+    
+    log_info(
+        "Transaction pool reloaded " << accepted << " of " <<
+        entries.size() << " transactions, read = " <<
+        std::chrono::duration_cast<std::chrono::milliseconds> (
+        time_checked - time_start).count() << "ms, accept = " <<
+        std::chrono::duration_cast<std::chrono::milliseconds> (
+        time_accepted - time_checked).count() << "ms."
+    );
+    
+    return accepted;
+}
+
+bool transaction_pool::save()
+{
+    return save(filesystem::data_path() + "mempool.dat");
+}
+
+bool transaction_pool::save(const std::string & path)
+{
+    data_buffer buffer;
+    
+    buffer.write_uint32(message::header_magic());
+    buffer.write_uint32(file_version);
+    
+    std::unique_lock<std::recursive_mutex> l1(mutex_);
+    
+    /**
+     * Write the transactions in arrival order.
+     */
+    std::vector< std::pair<std::time_t, const transaction *> > ordered;
+    
+    ordered.reserve(m_transactions.size());
+    
+    for (auto & i : m_transactions)
+    {
+        ordered.push_back(
+            std::make_pair(m_arrival_times[i.first], &i.second)
+        );
+    }
+    
+    std::stable_sort(
+        ordered.begin(), ordered.end(),
+        [](const std::pair<std::time_t, const transaction *> & a,
+        const std::pair<std::time_t, const transaction *> & b)
+        {
+            return a.first < b.first;
+        }
+    );
+    
+    buffer.write_var_int(ordered.size());
+    
+    for (auto & i : ordered)
+    {
+        buffer.write_uint64(static_cast<std::uint64_t> (i.first));
+        
+        i.second->encode(buffer);
+    }
+    
+    l1.unlock();
+    
+    /**
+     * Calculate the sha256d hash of the data portion.
+     */
+    auto digest = hash::sha256d(
+        reinterpret_cast<std::uint8_t *> (buffer.data()), buffer.size()
+    );
+    
+    log_debug(
+        "Transaction pool is writing mempool file, path = " << path <<
+        ", transactions = " << ordered.size() << "."
+    );
+    
+    /**
+     * Write to a temporary file and rename it over the old one so a crash
+     * never leaves a partially written file.
+     */
+    std::ofstream ofs(
+        path + ".tmp", std::ifstream::out | std::ifstream::binary
+    );
+    
+    ofs.write(buffer.data(), buffer.size());
+    ofs.write(reinterpret_cast<const char *> (&digest[0]), digest.size());
+    
+    ofs.close();
+    
+    if (ofs.fail() || std::rename((path + ".tmp").c_str(), path.c_str()) != 0)
+    {
+        log_error(
+            "Transaction pool failed writing mempool file, path = " << path <<
+            "."
+        );
+        
+        return false;
+    }
+    
+    return true;
+}
         
 bool transaction_pool::remove(transaction & tx)
 {
@@ -362,6 +580,8 @@ bool transaction_pool::remove(transaction & tx)
         
         m_transactions.erase(hash);
         
+        m_arrival_times.erase(hash);
+        
         m_transactions_updated++;
     }
 
@@ -373,6 +593,7 @@ void transaction_pool::clear()
     std::lock_guard<std::recursive_mutex> l1(mutex_);
     
     m_transactions.clear();
+    m_arrival_times.clear();
     transactions_next_.clear();
     
     ++m_transactions_updated;
@@ -433,6 +654,8 @@ bool transaction_pool::add_unchecked(const sha256 & hash, transaction & tx)
     
     m_transactions[hash] = tx;
     
+    m_arrival_times[hash] = std::time(0);
+    
     for (auto i = 0; i < tx.transactions_in().size(); i++)
     {
         transactions_next_[
@@ -444,3 +667,286 @@ bool transaction_pool::add_unchecked(const sha256 & hash, transaction & tx)
     
     return true;
 }
+
+bool transaction_pool::read(
+    const std::string & path, std::vector<entry_t> & entries
+    )
+{
+    entries.clear();
+    
+    /**
+     * Allocate the std::ifstream.
+     */
+    std::ifstream ifs(path, std::ifstream::in | std::ifstream::binary);
+    
+    if (ifs.good() == false)
+    {
+        log_debug(
+            "Transaction pool found no mempool file, path = " << path << "."
+        );
+        
+        return false;
+    }
+    
+    /**
+     * Get the file length.
+     */
+    ifs.seekg(0, ifs.end);
+    
+    std::size_t len = ifs.tellg();
+    
+    ifs.seekg(0, ifs.beg);
+    
+    if (len < sizeof(std::uint32_t) * 2 + 1 + sha256::digest_length)
+    {
+        throw std::runtime_error("invalid file length");
+    }
+    
+    /**
+     * Allocate the buffer.
+     */
+    std::vector<char> buf(len);
+    
+    /**
+     * Read the file.
+     */
+    ifs.read(&buf[0], len);
+    
+    /**
+     * Close the file.
+     */
+    ifs.close();
+    
+    len -= sha256::digest_length;
+    
+    /**
+     * Calculate the sha256d hash of the data portion.
+     */
+    auto digest = hash::sha256d(
+        reinterpret_cast<std::uint8_t *> (&buf[0]), len
+    );
+    
+    /**
+     * Verify that the digest matches the one at the end of the file.
+     */
+    if (std::memcmp(&digest[0], &buf[len], sha256::digest_length) != 0)
+    {
+        throw std::runtime_error("invalid file checksum");
+    }
+    
+    data_buffer buffer(&buf[0], len);
+    
+    if (buffer.read_uint32() != message::header_magic())
+    {
+        throw std::runtime_error("invalid file header magic");
+    }
+    
+    if (buffer.read_uint32() != file_version)
+    {
+        throw std::runtime_error("invalid file version");
+    }
+    
+    auto count = buffer.read_var_int();
+    
+    /**
+     * Every entry is at least a time and a few bytes of transaction.
+     */
+    if (count > buffer.remaining() / sizeof(std::uint64_t))
+    {
+        throw std::runtime_error("invalid file count");
+    }
+    
+    entries.resize(count);
+    
+    for (auto & i : entries)
+    {
+        i.time = static_cast<std::time_t> (buffer.read_uint64());
+        
+        i.tx.decode(buffer);
+    }
+    
+    /**
+     * Run the context-free checks in parallel.
+     */
+    enum { chunk_size = 1024 };
+    
+    std::vector<char> passed(entries.size(), 0);
+    
+    std::vector< std::function<void ()> > jobs;
+    
+    for (std::size_t i = 0; i < entries.size(); i += chunk_size)
+    {
+        jobs.push_back([i, &entries, &passed]()
+        {
+            auto end = std::min<std::size_t> (
+                i + chunk_size, entries.size()
+            );
+            
+            for (auto j = i; j < end; j++)
+            {
+                auto & tx = entries[j].tx;
+                
+                try
+                {
+                    passed[j] =
+                        tx.check() && tx.is_coin_base() == false &&
+                        tx.is_coin_stake() == false &&
+                        (constants::test_net || tx.is_standard())
+                    ;
+                }
+                catch (...)
+                {
+                    passed[j] = false;
+                }
+            }
+        });
+    }
+    
+    startup_graph::parallel(jobs);
+    
+    std::vector<entry_t> checked;
+    
+    checked.reserve(entries.size());
+    
+    for (std::size_t i = 0; i < entries.size(); i++)
+    {
+        if (passed[i])
+        {
+            checked.push_back(entries[i]);
+        }
+    }
+    
+    entries.swap(checked);
+    
+    return true;
+}
+
+void transaction_pool::do_save()
+{
+    auto updated_last = transactions_updated();
+    
+    std::unique_lock<std::mutex> l1(mutex_save_);
+    
+    while (m_save_stop == false)
+    {
+        condition_save_.wait_for(
+            l1, std::chrono::seconds(save_interval), [this]()
+        {
+            return m_save_stop;
+        });
+        
+        if (m_save_stop)
+        {
+            break;
+        }
+        
+        /**
+         * Only write the file when the pool has changed.
+         */
+        if (updated_last != transactions_updated())
+        {
+            updated_last = transactions_updated();
+            
+            l1.unlock();
+            
+            save();
+            
+            l1.lock();
+        }
+    }
+}
+
+int transaction_pool::run_test()
+{
+    enum { count = 50000 };
+    
+    transaction_pool pool;
+    
+    /**
+     * Fill the pool with standard looking pay-to-pubkey-hash spends.
+     */
+    for (std::size_t i = 0; i < count; i++)
+    {
+        std::vector<std::uint8_t> signature(72), public_key(33), id(20);
+        
+        random::bytes(&signature[0], signature.size());
+        random::bytes(&public_key[0], public_key.size());
+        random::bytes(&id[0], id.size());
+        
+        transaction tx;
+        
+        tx.set_time(static_cast<std::uint32_t> (std::time(0)));
+        
+        tx.transactions_in().push_back(
+            transaction_in(hash::sha256_random(), i % 4,
+            script() << signature << public_key)
+        );
+        
+        for (auto j = 0; j < 2; j++)
+        {
+            tx.transactions_out().push_back(transaction_out(
+                1000000 + i, script() << script::op_dup <<
+                script::op_hash160 << id << script::op_equalverify <<
+                script::op_checksig)
+            );
+        }
+        
+        pool.add_unchecked(tx.get_hash(), tx);
+    }
+    
+    /**
+     * Write into a temporary data directory so the test never touches the
+     * real one.
+     */
+#if (defined _MSC_VER)
+    auto temp = std::getenv("TEMP");
+#else
+    auto temp = std::getenv("TMPDIR");
+#endif
+    auto path_data = filesystem::data_path();
+    
+    auto path_test =
+        std::string(temp ? temp : "/tmp") + "/mempool.test." +
+        std::to_string(random::uint32())
+    ;
+    
+    filesystem::create_path(path_test);
+    
+    filesystem::set_data_path(path_test);
+    
+    auto path = filesystem::data_path() + "mempool.test.dat";
+    
+    auto time_start = std::chrono::steady_clock::now();
+    
+    auto success = pool.save(path);
+    
+    auto time_saved = std::chrono::steady_clock::now();
+    
+    std::vector<entry_t> entries;
+    
+    success = success && read(path, entries);
+    
+    auto time_read = std::chrono::steady_clock::now();
+    
+    std::remove(path.c_str());
+    std::remove(path_test.c_str());
+    
+    filesystem::set_data_path(path_data);
+    
+    if (success == false)
+    {
+        return -1;
+    }
+    
+    printf(
+        "Test transaction_pool: %zu transactions, save = %lldms, "
+        "read and check = %lldms.\n", entries.size(),
+        static_cast<long long> (
+        std::chrono::duration_cast<std::chrono::milliseconds> (
+        time_saved - time_start).count()), static_cast<long long> (
+        std::chrono::duration_cast<std::chrono::milliseconds> (
+        time_read - time_saved).count())
+    );
+    
+    return entries.size() == count ? 0 : -1;
+}
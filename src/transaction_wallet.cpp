@@ -18,9 +18,15 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
 #include <boost/lexical_cast.hpp>
 
 #include <coin/db_wallet.hpp>
+#include <coin/hash.hpp>
 #include <coin/tcp_connection.hpp>
 #include <coin/tcp_connection_manager.hpp>
 #include <coin/transaction_pool.hpp>
@@ -69,11 +75,6 @@ transaction_wallet::transaction_wallet(
     initialize(ptr_wallet);
 }
 
-void transaction_wallet::encode()
-{
-    encode(*this);
-}
-
 void transaction_wallet::encode(data_buffer & buffer)
 {
     auto is_spent = false;
@@ -106,11 +107,25 @@ void transaction_wallet::encode(data_buffer & buffer)
      */
     transaction_merkle::encode(buffer);
     
-    buffer.write_var_int(m_previous_transactions.size());
-    
-    for (auto & i : m_previous_transactions)
+    if (m_previous_transactions_encoded.size() > 0)
+    {
+        /**
+         * The previous transactions were never decoded, write them back as
+         * they were read.
+         */
+        buffer.write_bytes(
+            &m_previous_transactions_encoded[0],
+            m_previous_transactions_encoded.size()
+        );
+    }
+    else
     {
-        i.encode(buffer);
+        buffer.write_var_int(m_previous_transactions.size());
+        
+        for (auto & i : m_previous_transactions)
+        {
+            i.encode(buffer);
+        }
     }
     
     buffer.write_var_int(m_values.size());
@@ -145,9 +160,13 @@ void transaction_wallet::encode(data_buffer & buffer)
     m_values.erase("timesmart");
 }
 
-void transaction_wallet::decode()
+data_buffer transaction_wallet::encode()
 {
-    decode(*this);
+    data_buffer ret;
+    
+    encode(ret);
+    
+    return ret;
 }
 
 void transaction_wallet::decode(data_buffer & buffer)
@@ -164,16 +183,17 @@ void transaction_wallet::decode(data_buffer & buffer)
      */
     transaction_merkle::decode(buffer);
     
-    auto len = buffer.read_var_int();
+    /**
+     * Retain the previous transactions in their encoded form, they are
+     * decoded on first use.
+     */
+    const auto * ptr_previous_transactions = buffer.read_ptr();
     
-    for (auto i = 0; i < len; i++)
-    {
-        transaction_merkle tx_merkle;
-        
-        tx_merkle.decode(buffer);
-        
-        m_previous_transactions.push_back(tx_merkle);
-    }
+    skip_previous_transactions(buffer);
+    
+    m_previous_transactions_encoded.assign(
+        ptr_previous_transactions, buffer.read_ptr()
+    );
     
     auto len_values = buffer.read_var_int();
     
@@ -224,7 +244,7 @@ void transaction_wallet::decode(data_buffer & buffer)
     }
     else
     {
-        m_spent.assign(transaction_out().size(), is_spent);
+        m_spent.assign(transactions_out().size(), is_spent);
     }
     
     /**
@@ -247,6 +267,7 @@ void transaction_wallet::initialize(const wallet * ptr_wallet)
 {
     wallet_ = ptr_wallet;
     m_previous_transactions.clear();
+    m_previous_transactions_encoded.clear();
     m_values.clear();
     m_order_form.clear();
     m_time_received_is_tx_time = false;
@@ -397,6 +418,7 @@ void transaction_wallet::add_supporting_transactions(db_tx & tx_db)
      * Clear the previois transactions.
      */
     m_previous_transactions.clear();
+    m_previous_transactions_encoded.clear();
 
     const int copy_depth = 3;
     
@@ -482,6 +504,8 @@ void transaction_wallet::add_supporting_transactions(db_tx & tx_db)
 
 bool transaction_wallet::accept_wallet_transaction(db_tx & tx_db)
 {
+    load_previous_transactions();
+    
     /**
      * Add previous supporting transactions first.
      */
@@ -506,7 +530,9 @@ bool transaction_wallet::accept_wallet_transaction(db_tx & tx_db)
 
 bool transaction_wallet::accept_wallet_transaction()
 {
-    db_tx tx_db("r");
+    auto reader = db_tx::reader();
+    
+    auto & tx_db = *reader;
     
     return accept_wallet_transaction(tx_db);
 }
@@ -695,7 +721,9 @@ void transaction_wallet::relay_wallet_transaction(
     const std::shared_ptr<tcp_connection_manager> & connection_manager
     )
 {
-   db_tx tx_db("r");
+   auto reader = db_tx::reader();
+   
+   auto & tx_db = *reader;
    
    relay_wallet_transaction(tx_db, connection_manager);
 }
@@ -705,6 +733,8 @@ void transaction_wallet::relay_wallet_transaction(
     const std::shared_ptr<tcp_connection_manager> & connection_manager
     )
 {
+    load_previous_transactions();
+    
     for (auto & i : m_previous_transactions)
     {
         if ((i.is_coin_base() || i.is_coin_stake()) == false)
@@ -763,6 +793,8 @@ void transaction_wallet::relay_wallet_transaction(
 const std::vector<transaction_merkle> &
     transaction_wallet::previous_transactions() const
 {
+    load_previous_transactions();
+    
     return m_previous_transactions;
 }
 
@@ -843,6 +875,8 @@ bool transaction_wallet::is_confirmed() const
     std::map<sha256, const transaction_merkle *> previous_transactions;
     std::vector<const transaction_merkle *> work_queue;
     
+    load_previous_transactions();
+    
     work_queue.reserve(m_previous_transactions.size() + 1);
     
     work_queue.push_back(this);
@@ -904,3 +938,174 @@ const std::int64_t & transaction_wallet::order_position() const
 {
     return m_order_position;
 }
+
+int transaction_wallet::run_test()
+{
+    enum { transactions = 500000 };
+    
+    /**
+     * A wallet record with one supporting transaction, as written by
+     * add_supporting_transactions for an unconfirmed spend.
+     */
+    transaction_wallet wtx;
+    
+    for (auto i = 0; i < 2; i++)
+    {
+        script script_signature;
+        
+        script_signature.resize(107, static_cast<std::uint8_t> (i));
+        
+        wtx.transactions_in().push_back(
+            transaction_in(sha256::from_digest(&hash::sha256d(
+            reinterpret_cast<const std::uint8_t *> (&i), sizeof(i))[0]), i,
+            script_signature)
+        );
+        
+        script script_public_key;
+        
+        script_public_key.resize(25, static_cast<std::uint8_t> (i));
+        
+        wtx.transactions_out().push_back(
+            transaction_out(100000, script_public_key)
+        );
+    }
+    
+    wtx.m_previous_transactions.push_back(wtx);
+    wtx.m_spent.assign(wtx.transactions_out().size(), false);
+    wtx.set_order_position(1);
+    
+    data_buffer record;
+    
+    wtx.encode(record);
+    
+    auto time_start = std::chrono::steady_clock::now();
+    
+    std::int64_t order_positions = 0;
+    
+    for (auto i = 0; i < transactions; i++)
+    {
+        data_buffer buffer(record.data(), record.size());
+        
+        transaction_wallet wtx_loaded;
+        
+        wtx_loaded.decode(buffer);
+        
+        order_positions += wtx_loaded.order_position();
+    }
+    
+    auto time_load = std::chrono::steady_clock::now();
+    
+    assert(order_positions == transactions);
+    
+    /**
+     * Materializing and re-encoding must round trip.
+     */
+    data_buffer buffer(record.data(), record.size());
+    
+    transaction_wallet wtx_loaded;
+    
+    wtx_loaded.decode(buffer);
+    
+    data_buffer encoded_lazy;
+    
+    wtx_loaded.encode(encoded_lazy);
+    
+    assert(wtx_loaded.previous_transactions().size() == 1);
+    assert(
+        wtx_loaded.previous_transactions()[0].get_hash() == wtx.get_hash()
+    );
+    
+    data_buffer encoded;
+    
+    wtx_loaded.encode(encoded);
+    
+    assert(encoded.size() == record.size());
+    assert(encoded_lazy.size() == record.size());
+    assert(std::memcmp(encoded.data(), record.data(), record.size()) == 0);
+    
+    printf(
+        "Test transaction_wallet: %d records decoded in %lld ms.\n",
+        static_cast<int> (transactions),
+        static_cast<long long> (std::chrono::duration_cast<
+        std::chrono::milliseconds> (time_load - time_start).count())
+    );
+    
+    return 0;
+}
+
+void transaction_wallet::load_previous_transactions() const
+{
+    if (m_previous_transactions_encoded.size() > 0)
+    {
+        data_buffer buffer(
+            &m_previous_transactions_encoded[0],
+            m_previous_transactions_encoded.size()
+        );
+        
+        m_previous_transactions_encoded.clear();
+        
+        auto len = buffer.read_var_int();
+        
+        m_previous_transactions.reserve(len);
+        
+        for (auto i = 0; i < len; i++)
+        {
+            transaction_merkle tx_merkle;
+            
+            tx_merkle.decode(buffer);
+            
+            m_previous_transactions.push_back(tx_merkle);
+        }
+    }
+}
+
+void transaction_wallet::skip_previous_transactions(data_buffer & buffer)
+{
+    auto len = buffer.read_var_int();
+    
+    for (auto i = 0; i < len; i++)
+    {
+        /**
+         * The version and time.
+         */
+        buffer.skip(sizeof(std::uint32_t) + sizeof(std::uint32_t));
+        
+        auto len_in = buffer.read_var_int();
+        
+        for (auto j = 0; j < len_in; j++)
+        {
+            /**
+             * The previous out.
+             */
+            buffer.skip(sha256::digest_length + sizeof(std::uint32_t));
+            
+            /**
+             * The script signature and sequence.
+             */
+            buffer.skip(buffer.read_var_int());
+            buffer.skip(sizeof(std::uint32_t));
+        }
+        
+        auto len_out = buffer.read_var_int();
+        
+        for (auto j = 0; j < len_out; j++)
+        {
+            /**
+             * The value and script public key.
+             */
+            buffer.skip(sizeof(std::int64_t));
+            buffer.skip(buffer.read_var_int());
+        }
+        
+        /**
+         * The time lock and block hash.
+         */
+        buffer.skip(sizeof(std::uint32_t) + sha256::digest_length);
+        
+        /**
+         * The merkle branch and index.
+         */
+        buffer.skip(buffer.read_var_int() * sha256::digest_length);
+        buffer.skip(sizeof(std::int32_t));
+    }
+}
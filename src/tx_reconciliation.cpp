@@ -0,0 +1,976 @@
+/*
+ * Copyright (c) 2013-2014 John Connor (BM-NC49AxAjcqVcF5jNPu85Rb8MJ2d9JqZt)
+ *
+ * This file is part of coinpp.
+ *
+ * coinpp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License with
+ * additional permissions to the one published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version. For more information see LICENSE.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <memory>
+
+#include <coin/data_buffer.hpp>
+#include <coin/hash.hpp>
+#include <coin/random.hpp>
+#include <coin/salted_hasher.hpp>
+#include <coin/tx_reconciliation.hpp>
+
+using namespace coin;
+
+tx_reconciliation::sketch::sketch(const std::size_t & cells)
+    : m_cells(
+        (cells + hash_count - 1) / hash_count * hash_count, cell_t{ 0, 0, 0 }
+    )
+{
+    // ...
+}
+
+void tx_reconciliation::sketch::insert(const std::uint64_t & val)
+{
+    update(m_cells, val, 1);
+}
+
+bool tx_reconciliation::sketch::subtract(const sketch & other)
+{
+    if (m_cells.size() != other.m_cells.size())
+    {
+        return false;
+    }
+    
+    for (std::size_t i = 0; i < m_cells.size(); i++)
+    {
+        m_cells[i].count -= other.m_cells[i].count;
+        m_cells[i].key_sum ^= other.m_cells[i].key_sum;
+        m_cells[i].check_sum ^= other.m_cells[i].check_sum;
+    }
+    
+    return true;
+}
+
+bool tx_reconciliation::sketch::decode(
+    std::vector<std::uint64_t> & positive,
+    std::vector<std::uint64_t> & negative
+    ) const
+{
+    if (m_cells.empty())
+    {
+        return false;
+    }
+    
+    auto cells = m_cells;
+    
+    /**
+     * Peel the pure cells (holding a single id) until none are left.
+     */
+    std::vector<std::size_t> pure;
+    
+    for (std::size_t i = 0; i < cells.size(); i++)
+    {
+        pure.push_back(i);
+    }
+    
+    while (pure.size() > 0)
+    {
+        auto index = pure.back();
+        
+        pure.pop_back();
+        
+        auto & cell = cells[index];
+        
+        if (
+            (cell.count == 1 || cell.count == -1) &&
+            check(cell.key_sum) == cell.check_sum
+            )
+        {
+            auto val = cell.key_sum;
+            auto count = cell.count;
+            
+            /**
+             * A (crafted) cell holding an id that does not hash to it would
+             * be peeled back and forth forever.
+             */
+            auto hashed = false;
+            
+            for (std::uint32_t i = 0; i < hash_count; i++)
+            {
+                if (position(cells.size(), val, i) == index)
+                {
+                    hashed = true;
+                }
+            }
+            
+            if (hashed == false)
+            {
+                continue;
+            }
+            
+            (count == 1 ? positive : negative).push_back(val);
+            
+            /**
+             * A sketch never holds more ids than it has cells.
+             */
+            if (positive.size() + negative.size() > cells.size())
+            {
+                return false;
+            }
+            
+            update(cells, val, -count);
+            
+            for (std::uint32_t i = 0; i < hash_count; i++)
+            {
+                pure.push_back(position(cells.size(), val, i));
+            }
+        }
+    }
+    
+    for (auto & i : cells)
+    {
+        if (i.count != 0 || i.key_sum != 0 || i.check_sum != 0)
+        {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+void tx_reconciliation::sketch::encode(data_buffer & buffer) const
+{
+    buffer.write_var_int(m_cells.size());
+    
+    for (auto & i : m_cells)
+    {
+        buffer.write_int32(i.count);
+        buffer.write_uint64(i.key_sum);
+        buffer.write_uint32(i.check_sum);
+    }
+}
+
+bool tx_reconciliation::sketch::decode(data_buffer & buffer)
+{
+    auto len = buffer.read_var_int();
+    
+    if (len > maximum_cells || len % hash_count != 0)
+    {
+        return false;
+    }
+    
+    m_cells.resize(len);
+    
+    for (auto & i : m_cells)
+    {
+        i.count = buffer.read_int32();
+        i.key_sum = buffer.read_uint64();
+        i.check_sum = buffer.read_uint32();
+    }
+    
+    return true;
+}
+
+std::size_t tx_reconciliation::sketch::size() const
+{
+    return m_cells.size();
+}
+
+void tx_reconciliation::sketch::update(
+    std::vector<cell_t> & cells, const std::uint64_t & val,
+    const std::int32_t & count
+    )
+{
+    for (std::uint32_t i = 0; i < hash_count; i++)
+    {
+        auto & cell = cells[position(cells.size(), val, i)];
+        
+        cell.count += count;
+        cell.key_sum ^= val;
+        cell.check_sum ^= check(val);
+    }
+}
+
+std::size_t tx_reconciliation::sketch::position(
+    const std::size_t & cells, const std::uint64_t & val,
+    const std::uint32_t & index
+    )
+{
+    auto part = cells / hash_count;
+    
+    /**
+     * Each hash indexes its own part so an id never lands twice in the
+     * same cell.
+     */
+    return index * part + mix(val, index) % part;
+}
+
+std::uint32_t tx_reconciliation::sketch::check(const std::uint64_t & val)
+{
+    return static_cast<std::uint32_t> (
+        mix(val, hash_count) >> 32
+    );
+}
+
+std::uint64_t tx_reconciliation::sketch::mix(
+    const std::uint64_t & val, const std::uint32_t & seed
+    )
+{
+    /**
+     * The splitmix64 finalizer, the ids are already salted hashes.
+     */
+    auto ret = val + (seed + 1) * 0x9e3779b97f4a7c15ULL;
+    
+    ret = (ret ^ (ret >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    ret = (ret ^ (ret >> 27)) * 0x94d049bb133111ebULL;
+    
+    return ret ^ (ret >> 31);
+}
+
+tx_reconciliation::tx_reconciliation(const bool & is_initiator)
+    : m_is_initiator(is_initiator)
+    , m_in_flight(false)
+    , m_time_in_flight(0)
+    , m_difference(0)
+{
+    // ...
+}
+
+const bool & tx_reconciliation::is_initiator() const
+{
+    return m_is_initiator;
+}
+
+bool tx_reconciliation::add(const sha256 & hash_tx)
+{
+    std::lock_guard<std::mutex> l1(mutex_);
+    
+    if (m_set.size() >= max_set_size)
+    {
+        return false;
+    }
+    
+    m_set.insert(hash_tx);
+    
+    return true;
+}
+
+void tx_reconciliation::remove(const sha256 & hash_tx)
+{
+    std::lock_guard<std::mutex> l1(mutex_);
+    
+    m_set.erase(hash_tx);
+}
+
+std::size_t tx_reconciliation::size()
+{
+    std::lock_guard<std::mutex> l1(mutex_);
+    
+    return m_set.size();
+}
+
+bool tx_reconciliation::create_sketch(data_buffer & buffer)
+{
+    std::lock_guard<std::mutex> l1(mutex_);
+    
+    if (m_in_flight)
+    {
+        /**
+         * If the differences never arrived reconcile the transactions
+         * again in the next round.
+         */
+        if (std::time(0) - m_time_in_flight < interval * 5)
+        {
+            return false;
+        }
+        
+        for (auto & i : m_snapshot)
+        {
+            m_set.insert(i.second);
+        }
+    }
+    
+    /**
+     * Size the sketch for the last difference plus a share of our set
+     * since the difference grows with the transaction rate.
+     */
+    sketch s(
+        std::min<std::size_t> (maximum_cells, std::max<std::size_t> (
+        minimum_cells, m_difference * 2 + m_set.size() / 4))
+    );
+    
+    auto salt = random::uint64();
+    
+    m_snapshot.clear();
+    
+    for (auto & i : m_set)
+    {
+        auto id = short_id(i, salt);
+        
+        m_snapshot[id] = i;
+        
+        s.insert(id);
+    }
+    
+    m_set.clear();
+    
+    buffer.write_uint64(salt);
+    
+    s.encode(buffer);
+    
+    m_in_flight = true;
+    m_time_in_flight = std::time(0);
+    
+    return true;
+}
+
+bool tx_reconciliation::reconcile(
+    data_buffer & buffer, data_buffer & buffer_differences,
+    std::vector<sha256> & to_announce
+    )
+{
+    auto salt = buffer.read_uint64();
+    
+    sketch theirs;
+    
+    auto success = theirs.decode(buffer) && theirs.size() > 0;
+    
+    std::lock_guard<std::mutex> l1(mutex_);
+    
+    std::map<std::uint64_t, sha256> ours;
+    
+    std::vector<std::uint64_t> positive, negative;
+    
+    if (success)
+    {
+        sketch s(theirs.size());
+        
+        for (auto & i : m_set)
+        {
+            auto id = short_id(i, salt);
+            
+            ours[id] = i;
+            
+            s.insert(id);
+        }
+        
+        success = s.subtract(theirs) && s.decode(positive, negative);
+    }
+    
+    if (success)
+    {
+        for (auto & i : positive)
+        {
+            auto it = ours.find(i);
+            
+            if (it != ours.end())
+            {
+                to_announce.push_back(it->second);
+            }
+        }
+    }
+    else
+    {
+        /**
+         * Fall back to announcing everything, the initiator does the same.
+         */
+        to_announce.insert(to_announce.end(), m_set.begin(), m_set.end());
+        
+        negative.clear();
+    }
+    
+    buffer_differences.write_uint8(success ? 1 : 0);
+    buffer_differences.write_var_int(
+        success ? positive.size() + negative.size() : m_set.size()
+    );
+    buffer_differences.write_var_int(negative.size());
+    
+    for (auto & i : negative)
+    {
+        buffer_differences.write_uint64(i);
+    }
+    
+    m_set.clear();
+    
+    return success;
+}
+
+bool tx_reconciliation::on_differences(
+    data_buffer & buffer, std::vector<sha256> & to_announce
+    )
+{
+    auto success = buffer.read_uint8() == 1;
+    auto difference = buffer.read_var_int();
+    auto count = buffer.read_var_int();
+    
+    if (count > maximum_cells)
+    {
+        return false;
+    }
+    
+    std::vector<std::uint64_t> requested;
+    
+    for (std::size_t i = 0; i < count; i++)
+    {
+        requested.push_back(buffer.read_uint64());
+    }
+    
+    std::lock_guard<std::mutex> l1(mutex_);
+    
+    if (m_in_flight == false)
+    {
+        return false;
+    }
+    
+    if (success)
+    {
+        for (auto & i : requested)
+        {
+            auto it = m_snapshot.find(i);
+            
+            if (it != m_snapshot.end())
+            {
+                to_announce.push_back(it->second);
+            }
+        }
+        
+        m_difference = difference;
+    }
+    else
+    {
+        for (auto & i : m_snapshot)
+        {
+            to_announce.push_back(i.second);
+        }
+        
+        /**
+         * The difference was at least as large as both sets.
+         */
+        m_difference = difference + m_snapshot.size();
+    }
+    
+    m_snapshot.clear();
+    
+    m_in_flight = false;
+    
+    return true;
+}
+
+std::uint64_t tx_reconciliation::short_id(
+    const sha256 & hash_tx, const std::uint64_t & salt
+    )
+{
+    return salted_hasher(salt, ~salt).hash(hash_tx, 0, sha256::digest_length);
+}
+
+int tx_reconciliation::run_test()
+{
+    /**
+     * Check that a sketch decodes the symmetric difference.
+     */
+    {
+        sketch a(120), b(120);
+        
+        for (auto i = 0; i < 1000; i++)
+        {
+            auto val = random::uint64();
+            
+            a.insert(val);
+            b.insert(val);
+        }
+        
+        for (auto i = 0; i < 10; i++)
+        {
+            a.insert(random::uint64());
+        }
+        
+        for (auto i = 0; i < 15; i++)
+        {
+            b.insert(random::uint64());
+        }
+        
+        data_buffer buffer;
+        
+        b.encode(buffer);
+        
+        sketch c;
+        
+        data_buffer buffer_in(buffer.data(), buffer.size());
+        
+        std::vector<std::uint64_t> positive, negative;
+        
+        if (
+            c.decode(buffer_in) == false || a.subtract(c) == false ||
+            a.decode(positive, negative) == false || positive.size() != 10 ||
+            negative.size() != 15
+            )
+        {
+            printf("Test tx_reconciliation: sketch failed.\n");
+            
+            return -1;
+        }
+    }
+    
+    /**
+     * Check that a crafted sketch, an id in a cell of another id and the
+     * reverse, does not peel forever.
+     */
+    {
+        /**
+         * The cells (and their check) a short id is inserted into.
+         */
+        auto cells_of = [](const std::uint64_t & val)
+        {
+            sketch s(minimum_cells);
+            
+            s.insert(val);
+            
+            data_buffer buffer;
+            
+            s.encode(buffer);
+            
+            data_buffer buffer_in(buffer.data(), buffer.size());
+            
+            std::map<std::size_t, std::uint32_t> ret;
+            
+            auto len = buffer_in.read_var_int();
+            
+            for (std::size_t i = 0; i < len; i++)
+            {
+                auto count = buffer_in.read_int32();
+                
+                buffer_in.read_uint64();
+                
+                auto check_sum = buffer_in.read_uint32();
+                
+                if (count != 0)
+                {
+                    ret[i] = check_sum;
+                }
+            }
+            
+            return ret;
+        };
+        
+        std::uint64_t u = 0, v = 0;
+        
+        std::size_t x = 0, y = 0;
+        
+        std::map<std::size_t, std::uint32_t> cells_u, cells_v;
+        
+        for (auto found = false; found == false; )
+        {
+            u = random::uint64();
+            v = random::uint64();
+            
+            cells_u = cells_of(u);
+            cells_v = cells_of(v);
+            
+            auto found_x = false, found_y = false;
+            
+            for (auto & i : cells_u)
+            {
+                if (cells_v.count(i.first) == 0)
+                {
+                    x = i.first;
+                    
+                    found_x = true;
+                }
+            }
+            
+            for (auto & i : cells_v)
+            {
+                if (cells_u.count(i.first) == 0)
+                {
+                    y = i.first;
+                    
+                    found_y = true;
+                }
+            }
+            
+            found = found_x && found_y;
+        }
+        
+        data_buffer buffer;
+        
+        buffer.write_var_int(minimum_cells);
+        
+        for (std::size_t i = 0; i < minimum_cells; i++)
+        {
+            buffer.write_int32(i == x || i == y ? 1 : 0);
+            buffer.write_uint64(i == x ? v : i == y ? u : 0);
+            buffer.write_uint32(
+                i == x ? cells_v.begin()->second :
+                i == y ? cells_u.begin()->second : 0
+            );
+        }
+        
+        data_buffer buffer_in(buffer.data(), buffer.size());
+        
+        sketch crafted;
+        
+        std::vector<std::uint64_t> positive, negative;
+        
+        if (
+            crafted.decode(buffer_in) == false ||
+            crafted.decode(positive, negative) == true ||
+            positive.size() + negative.size() > minimum_cells
+            )
+        {
+            printf("Test tx_reconciliation: crafted sketch failed.\n");
+            
+            return -1;
+        }
+    }
+    
+    /**
+     * Simulate a network of nodes relaying transactions, first pushing
+     * every transaction to every peer (as relay_inv does) and then with
+     * reconciliation. Messages are delivered after a fixed latency and
+     * inv/getdata/tx round trips are modelled for announced transactions.
+     */
+    enum
+    {
+        nodes = 40,
+        outbound = 4,
+        transactions = 500,
+        duration = 50000,
+        latency = 50,
+        header_length = 24,
+        inventory_length = 36,
+        tx_length = 250,
+    };
+    
+    std::vector< std::vector<int> > peers(nodes);
+    
+    std::map<std::pair<int, int>, bool> initiators;
+    
+    for (auto i = 0; i < nodes; i++)
+    {
+        while (
+            std::count_if(peers[i].begin(), peers[i].end(), [&](int j)
+            { return initiators[std::make_pair(i, j)]; }) < outbound
+            )
+        {
+            auto j = static_cast<int> (random::uint64(nodes));
+            
+            if (
+                j != i &&
+                std::find(peers[i].begin(), peers[i].end(), j) ==
+                peers[i].end()
+                )
+            {
+                peers[i].push_back(j);
+                peers[j].push_back(i);
+                
+                initiators[std::make_pair(i, j)] = true;
+                initiators[std::make_pair(j, i)] = false;
+            }
+        }
+    }
+    
+    std::vector<sha256> hashes;
+    
+    std::map<sha256, int> indexes;
+    
+    for (auto i = 0; i < transactions; i++)
+    {
+        hashes.push_back(hash::sha256_random());
+        
+        indexes[hashes.back()] = i;
+    }
+    
+    for (auto reconciling : { false, true })
+    {
+        typedef std::pair< std::int64_t, std::uint64_t > key_t;
+        
+        std::map< key_t, std::function<void ()> > events;
+        
+        std::int64_t now = 0;
+        
+        std::uint64_t sequence = 0;
+        
+        std::uint64_t bytes = 0;
+        
+        auto post = [&](const std::int64_t & when, std::function<void ()> f)
+        {
+            events[std::make_pair(when, sequence++)] = f;
+        };
+        
+        std::map<
+            std::pair<int, int>, std::shared_ptr<tx_reconciliation>
+        > links;
+        
+        std::map<std::pair<int, int>, bool> floods;
+        
+        for (auto i = 0; i < nodes; i++)
+        {
+            auto flooded = 0;
+            
+            for (auto & j : peers[i])
+            {
+                auto initiator = initiators[std::make_pair(i, j)];
+                
+                links[std::make_pair(i, j)] =
+                    std::make_shared<tx_reconciliation> (initiator)
+                ;
+                
+                floods[std::make_pair(i, j)] =
+                    reconciling == false ||
+                    (initiator && flooded++ < max_flood_peers)
+                ;
+            }
+        }
+        
+        std::vector< std::vector<std::int64_t> > arrivals(
+            nodes, std::vector<std::int64_t> (transactions, -1)
+        );
+        
+        std::vector< std::vector<bool> > requested(
+            nodes, std::vector<bool> (transactions, false)
+        );
+        
+        std::vector<std::int64_t> created(transactions);
+        
+        std::function<void (int, int, int)> receive_tx;
+        
+        std::function<void (int, int, const std::vector<int> &)> announce;
+        
+        auto send = [&](
+            const std::size_t & len, const std::function<void ()> & f)
+        {
+            bytes += header_length + len;
+            
+            post(now + latency, f);
+        };
+        
+        announce = [&](int from, int to, const std::vector<int> & txs)
+        {
+            if (txs.empty())
+            {
+                return;
+            }
+            
+            send(1 + txs.size() * inventory_length, [&, from, to, txs]()
+            {
+                std::vector<int> getdata;
+                
+                for (auto & i : txs)
+                {
+                    links[std::make_pair(to, from)]->remove(hashes[i]);
+                    
+                    if (arrivals[to][i] < 0 && requested[to][i] == false)
+                    {
+                        requested[to][i] = true;
+                        
+                        getdata.push_back(i);
+                    }
+                }
+                
+                if (getdata.empty())
+                {
+                    return;
+                }
+                
+                send(1 + getdata.size() * inventory_length,
+                    [&, from, to, getdata]()
+                {
+                    for (auto & i : getdata)
+                    {
+                        send(tx_length, [&, from, to, i]()
+                        {
+                            receive_tx(to, from, i);
+                        });
+                    }
+                });
+            });
+        };
+        
+        receive_tx = [&](int node, int from, int tx)
+        {
+            if (from >= 0)
+            {
+                links[std::make_pair(node, from)]->remove(hashes[tx]);
+            }
+            
+            if (arrivals[node][tx] >= 0)
+            {
+                return;
+            }
+            
+            arrivals[node][tx] = now;
+            
+            for (auto & i : peers[node])
+            {
+                auto link = std::make_pair(node, i);
+                
+                if (floods[link])
+                {
+                    /**
+                     * relay_inv pushes to every peer, including the one
+                     * the transaction came from.
+                     */
+                    if (reconciling && i == from)
+                    {
+                        continue;
+                    }
+                    
+                    send(tx_length, [&, node, i, tx]()
+                    {
+                        receive_tx(i, node, tx);
+                    });
+                }
+                else if (i != from && links[link]->add(hashes[tx]) == false)
+                {
+                    announce(node, i, std::vector<int> (1, tx));
+                }
+            }
+        };
+        
+        for (auto i = 0; i < transactions; i++)
+        {
+            created[i] = static_cast<std::int64_t> (i) * duration / transactions;
+            
+            auto node = static_cast<int> (random::uint64(nodes));
+            
+            post(created[i], [&, node, i]() { receive_tx(node, -1, i); });
+        }
+        
+        if (reconciling)
+        {
+            for (auto & i : links)
+            {
+                if (i.second->is_initiator() == false)
+                {
+                    continue;
+                }
+                
+                auto a = i.first.first, b = i.first.second;
+                
+                for (
+                    auto t = static_cast<std::int64_t> (
+                    random::uint64(interval * 1000));
+                    t < duration + 10000; t += interval * 1000
+                    )
+                {
+                    post(t, [&, a, b]()
+                    {
+                        data_buffer buffer;
+                        
+                        if (
+                            links[std::make_pair(a, b)]->create_sketch(
+                            buffer) == false
+                            )
+                        {
+                            return;
+                        }
+                        
+                        auto payload = std::make_shared<data_buffer> (
+                            buffer.data(), buffer.size()
+                        );
+                        
+                        send(payload->size(), [&, a, b, payload]()
+                        {
+                            data_buffer buffer_differences;
+                            
+                            std::vector<sha256> to_announce;
+                            
+                            links[std::make_pair(b, a)]->reconcile(
+                                *payload, buffer_differences, to_announce
+                            );
+                            
+                            std::vector<int> txs;
+                            
+                            for (auto & j : to_announce)
+                            {
+                                txs.push_back(indexes[j]);
+                            }
+                            
+                            announce(b, a, txs);
+                            
+                            auto differences = std::make_shared<
+                                data_buffer> (buffer_differences.data(),
+                                buffer_differences.size()
+                            );
+                            
+                            send(differences->size(),
+                                [&, a, b, differences]()
+                            {
+                                std::vector<sha256> to_announce;
+                                
+                                links[std::make_pair(a, b)]->on_differences(
+                                    *differences, to_announce
+                                );
+                                
+                                std::vector<int> txs;
+                                
+                                for (auto & j : to_announce)
+                                {
+                                    txs.push_back(indexes[j]);
+                                }
+                                
+                                announce(a, b, txs);
+                            });
+                        });
+                    });
+                }
+            }
+        }
+        
+        while (events.size() > 0)
+        {
+            auto it = events.begin();
+            
+            now = it->first.first;
+            
+            auto f = it->second;
+            
+            events.erase(it);
+            
+            f();
+        }
+        
+        std::vector<std::int64_t> delays;
+        
+        for (auto i = 0; i < nodes; i++)
+        {
+            for (auto j = 0; j < transactions; j++)
+            {
+                if (arrivals[i][j] >= 0)
+                {
+                    delays.push_back(arrivals[i][j] - created[j]);
+                }
+            }
+        }
+        
+        std::sort(delays.begin(), delays.end());
+        
+        printf(
+            "Test tx_reconciliation: %s, %zu of %d delivered, %llu bytes "
+            "per transaction per node, delay median %lld ms, 95th %lld ms, "
+            "worst %lld ms.\n", reconciling ? "reconciling" : "flooding",
+            delays.size(), nodes * transactions,
+            static_cast<unsigned long long> (bytes / transactions / nodes),
+            static_cast<long long> (delays[delays.size() / 2]),
+            static_cast<long long> (delays[delays.size() * 95 / 100]),
+            static_cast<long long> (delays.back())
+        );
+        
+        if (delays.size() != nodes * transactions)
+        {
+            return -1;
+        }
+    }
+    
+    return 0;
+}
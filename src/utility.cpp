@@ -341,17 +341,40 @@ const std::shared_ptr<block_index> utility::get_last_block_index(
     const std::shared_ptr<block_index> & index, const bool & is_pos
     )
 {
-    auto tmp = index;
+    if (index == 0 || index->is_proof_of_stake() == is_pos)
+    {
+        return index;
+    }
     
-    while (
-        tmp && tmp->block_index_previous() &&
-        (tmp->is_proof_of_stake() != is_pos)
-        )
+    /**
+     * Use the direct link to the closest previous block of the type.
+     */
+    auto ret =
+        is_pos ? index->block_index_previous_pos() :
+        index->block_index_previous_pow()
+    ;
+    
+    if (ret)
+    {
+        return ret;
+    }
+    
+    /**
+     * There is none, return the first block like a full walk would.
+     */
+    ret = block_index::get_ancestor(index, 0);
+    
+    if (ret == 0)
     {
-        tmp = tmp->block_index_previous();
+        ret = index;
     }
     
-    return tmp;
+    while (ret->block_index_previous())
+    {
+        ret = ret->block_index_previous();
+    }
+    
+    return ret;
 }
 
 std::uint32_t utility::compute_max_bits(
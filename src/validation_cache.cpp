@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2013-2014 John Connor (BM-NC49AxAjcqVcF5jNPu85Rb8MJ2d9JqZt)
+ *
+ * This file is part of coinpp.
+ *
+ * coinpp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License with
+ * additional permissions to the one published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version. For more information see LICENSE.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <coin/hash.hpp>
+#include <coin/key.hpp>
+#include <coin/key_store_basic.hpp>
+#include <coin/script.hpp>
+#include <coin/transaction.hpp>
+#include <coin/validation_cache.hpp>
+
+using namespace coin;
+
+validation_cache & validation_cache::instance()
+{
+    static validation_cache g_validation_cache;
+    
+    return g_validation_cache;
+}
+
+bool validation_cache::get(const sha256 & hash, const std::uint32_t & flags)
+{
+    std::lock_guard<std::mutex> l1(mutex_);
+    
+    return m_valid.count(make_key(hash, flags)) > 0;
+}
+
+void validation_cache::set(const sha256 & hash, const std::uint32_t & flags)
+{
+    std::lock_guard<std::mutex> l1(mutex_);
+    
+    /**
+     * Evict random entries when full.
+     */
+    while (m_valid.size() >= max_cache_size)
+    {
+        auto it = m_valid.lower_bound(
+            make_key(hash::sha256_random(), flag_none)
+        );
+        
+        if (it == m_valid.end())
+        {
+            it = m_valid.begin();
+        }
+        
+        m_valid.erase(it);
+    }
+    
+    m_valid.insert(make_key(hash, flags));
+}
+
+std::size_t validation_cache::size()
+{
+    std::lock_guard<std::mutex> l1(mutex_);
+    
+    return m_valid.size();
+}
+
+int validation_cache::run_test()
+{
+    enum { transactions = 1000 };
+    
+    key_store_basic store;
+    
+    key k;
+    
+    k.make_new_key(true);
+    
+    store.add_key(k);
+    
+    /**
+     * A block worth of single input pay-to-pubkey-hash spends.
+     */
+    std::vector< std::pair<transaction, transaction> > txs;
+    
+    for (auto i = 0; i < transactions; i++)
+    {
+        transaction tx_from;
+        
+        tx_from.transactions_in().push_back(
+            transaction_in(hash::sha256_random(), 0)
+        );
+        
+        script script_public_key;
+        
+        script_public_key.set_destination(k.get_public_key().get_id());
+        
+        tx_from.transactions_out().push_back(
+            transaction_out(1000000, script_public_key)
+        );
+        
+        transaction tx_to;
+        
+        tx_to.transactions_in().push_back(
+            transaction_in(tx_from.get_hash(), 0)
+        );
+        tx_to.transactions_out().push_back(
+            transaction_out(990000, script_public_key)
+        );
+        
+        if (script::sign_signature(store, tx_from, tx_to, 0) == false)
+        {
+            return -1;
+        }
+        
+        txs.push_back(std::make_pair(tx_from, tx_to));
+    }
+    
+    validation_cache cache;
+    
+    /**
+     * Accept into the transaction pool, every script is run and the
+     * result is cached.
+     */
+    auto time_start = std::chrono::steady_clock::now();
+    
+    for (auto & i : txs)
+    {
+        if (script::verify_signature(i.first, i.second, 0, true, 0) == false)
+        {
+            return -1;
+        }
+        
+        cache.set(i.second.get_hash(), flag_pay_to_script_hash);
+    }
+    
+    auto time_pool = std::chrono::steady_clock::now();
+    
+    /**
+     * Connect the block, every transaction is known.
+     */
+    for (auto & i : txs)
+    {
+        if (cache.get(i.second.get_hash(), flag_pay_to_script_hash) == false)
+        {
+            return -1;
+        }
+    }
+    
+    auto time_connect = std::chrono::steady_clock::now();
+    
+    /**
+     * A different set of flags is not covered.
+     */
+    assert(cache.get(txs[0].second.get_hash(), flag_none) == false);
+    
+    printf(
+        "Test validation_cache: %d transactions, scripts = %lld ms, cached "
+        "= %lld us.\n", static_cast<int> (transactions),
+        static_cast<long long> (
+        std::chrono::duration_cast<std::chrono::milliseconds> (
+        time_pool - time_start).count()), static_cast<long long> (
+        std::chrono::duration_cast<std::chrono::microseconds> (
+        time_connect - time_pool).count())
+    );
+    
+    return 0;
+}
+
+validation_cache::key_t validation_cache::make_key(
+    const sha256 & hash, const std::uint32_t & flags
+    )
+{
+    key_t ret;
+    
+    std::memcpy(&ret.first[0], hash.digest(), sha256::digest_length);
+    
+    ret.second = flags;
+    
+    return ret;
+}
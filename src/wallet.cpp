@@ -39,6 +39,7 @@
 #include <coin/random.hpp>
 #include <coin/reward.hpp>
 #include <coin/stack_impl.hpp>
+#include <coin/stake_index.hpp>
 #include <coin/status_manager.hpp>
 #include <coin/time.hpp>
 #include <coin/tcp_connection_manager.hpp>
@@ -960,7 +961,9 @@ void wallet::reaccept_wallet_transactions()
 {
     std::lock_guard<std::recursive_mutex> l1(mutex_);
     
-    db_tx tx_db("r");
+    auto reader = db_tx::reader();
+    
+    auto & tx_db = *reader;
     
     bool repeat = true;
     
@@ -1104,7 +1107,9 @@ void wallet::fix_spent_coins(
         coins.push_back(&i.second);
     }
     
-    db_tx txdb("r");
+    auto reader = db_tx::reader();
+    
+    auto & txdb = *reader;
     
     for (auto & i : coins)
     {
@@ -1213,12 +1218,12 @@ bool wallet::add_to_wallet_if_involving_me(
         /**
          * Get merkle branch if transaction was found in a block.
          */
-        if (blk)
+        if (blk && globals::instance().is_client() == false)
         {
-            wtx.set_merkle_branch(blk);
+            wtx.locate_in_block(*blk);
         }
         
-        return add_to_wallet(wtx);
+        return add_to_wallet(wtx, blk != 0);
     }
     else
     {
@@ -1321,6 +1326,16 @@ void wallet::update_spent(const transaction & tx) const
 }
 
 bool wallet::add_to_wallet(const transaction_wallet & wtx_in)
+{
+    return add_to_wallet(
+        wtx_in, wtx_in.block_hash() != 0 &&
+        globals::instance().block_indexes().count(wtx_in.block_hash()) > 0
+    );
+}
+
+bool wallet::add_to_wallet(
+    const transaction_wallet & wtx_in, const bool & is_block_indexed
+    )
 {
     std::lock_guard<std::recursive_mutex> l1(mutex_);
     
@@ -1352,7 +1367,7 @@ bool wallet::add_to_wallet(const transaction_wallet & wtx_in)
      
         if (wtx.block_hash() != 0)
         {
-            if (globals::instance().block_indexes().count(wtx_in.block_hash()))
+            if (is_block_indexed)
             {
                 auto latest_now = wtx.time_received();
                 
@@ -1947,7 +1962,9 @@ bool wallet::create_transaction(
     
     tx_new.bind_wallet(*this);
     
-    db_tx tx_db("r");
+    auto reader = db_tx::reader();
+    
+    auto & tx_db = *reader;
     
     fee_out = globals::instance().transaction_fee();
     
@@ -2481,7 +2498,9 @@ bool wallet::create_coin_stake(
 
     for (auto & pcoin : coins)
     {
-        db_tx tx_db("r");
+        auto reader = db_tx::reader();
+        
+        auto & tx_db = *reader;
         
         transaction_index tx_index;
 			
@@ -2494,17 +2513,13 @@ bool wallet::create_coin_stake(
         }
 
         /**
-         * Allocate the block.
+         * Look up the containing block time and offset.
          */
-        block blk;
+        stake_index::entry_t entry_from;
 
-        /**
-         * Read the block from disk, excluding the transactions.
-         */
         if (
-            blk.read_from_disk(tx_index.get_transaction_position().file_index(),
-            tx_index.get_transaction_position().block_position(), false) ==
-            false
+            stake_index::instance().get(pcoin.first, pcoin.second, tx_index,
+            entry_from) == false
             )
         {
             continue;
@@ -2516,7 +2531,7 @@ bool wallet::create_coin_stake(
          * Check the minimum age.
          */
         if (
-            blk.header().timestamp + constants::min_stake_age >
+            entry_from.time_block + constants::min_stake_age >
             tx_new.time() - max_stake_search_interval
             )
         {
@@ -2539,11 +2554,8 @@ bool wallet::create_coin_stake(
             );
             
             if (
-                kernel::check_stake_kernel_hash(bits, blk,
-                tx_index.get_transaction_position().tx_position() -
-                tx_index.get_transaction_position().block_position(),
-                pcoin.first, prevout_stake, tx_new.time() - n,
-                hash_proof_of_stake)
+                kernel::check_stake_kernel_hash(bits, entry_from,
+                prevout_stake, tx_new.time() - n, hash_proof_of_stake)
                 )
             {
                 std::vector< std::vector<std::uint8_t> > solutions;
@@ -2605,7 +2617,7 @@ bool wallet::create_coin_stake(
                     transaction_out(0, script_pub_key_out)
                 );
                 
-                if (blk.header().timestamp + stake_split_age > tx_new.time())
+                if (entry_from.time_block + stake_split_age > tx_new.time())
                 {
                     tx_new.transactions_out().push_back(
                         transaction_out(0, script_pub_key_out)
@@ -2708,7 +2720,9 @@ bool wallet::create_coin_stake(
      */
     std::uint64_t coin_age;
     
-    db_tx tx_db("r");
+    auto reader = db_tx::reader();
+    
+    auto & tx_db = *reader;
     
     index = utility::get_last_block_index(
         stack_impl::get_block_index_best(), false
@@ -2993,7 +3007,7 @@ bool wallet::select_coins_min_conf(
     /**
      * Shuffle the coins.
      */
-    std::random_shuffle(coins.begin(), coins.end(), random::uint32);
+    std::shuffle(coins.begin(), coins.end(), random::generator());
 
     for (auto & output : coins)
     {
@@ -3162,7 +3176,7 @@ void wallet::approximate_best_subset(
         {
             for (auto i = 0; i < value.size(); i++)
             {
-                if (pass == 0 ? std::rand() % 2 : !included[i])
+                if (pass == 0 ? random::uint32(2) != 0 : !included[i])
                 {
                     total += value[i].first;
                     
@@ -3202,7 +3216,7 @@ const std::map<sha256, transaction_wallet> & wallet::transactions() const
     return m_transactions;
 }
 
-std::map<sha256, std::int32_t> & wallet::request_counts()
+flat_map<sha256, std::int32_t> & wallet::request_counts()
 {
     std::lock_guard<std::recursive_mutex> l1(mutex_);
     
@@ -3381,7 +3395,9 @@ void wallet::resend_transactions_tick(const boost::system::error_code & ec)
              */
             time_last_resend_ = std::time(0);
             
-            db_tx tx_db("r");
+            auto reader = db_tx::reader();
+            
+            auto & tx_db = *reader;
             
             /**
              * Sort by time.
@@ -3496,7 +3512,7 @@ bool wallet::do_encrypt(const std::string & passphrase)
     /**
      * Generate the master key.
      */
-    RAND_bytes(&master_key[0], crypter::wallet_key_size);
+    random::bytes(&master_key[0], crypter::wallet_key_size);
 
     key_wallet_master master_key_wallet;
 
@@ -3513,7 +3529,9 @@ bool wallet::do_encrypt(const std::string & passphrase)
     /**
      * Generate the master key wallet.
      */
-    RAND_bytes(&master_key_wallet.salt()[0], crypter::wallet_salt_size);
+    random::bytes(
+        &master_key_wallet.salt()[0], crypter::wallet_salt_size
+    );
     
     /**
      * Allocate the crypter.
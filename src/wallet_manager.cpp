@@ -18,6 +18,8 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <coin/block.hpp>
+#include <coin/globals.hpp>
 #include <coin/wallet_manager.hpp>
 
 using namespace coin;
@@ -37,19 +39,47 @@ void wallet_manager::register_wallet(const std::shared_ptr<wallet> & val)
     {
         val->start();
         
-        m_wallets.insert(val);
+        /**
+         * The notifications run on the wallet's own thread, they carry the
+         * chain data they need so they don't read chain state.
+         */
+        auto queue = std::make_shared<notification_queue> ();
+        
+        queue->start();
+        
+        m_wallets[val] = queue;
     }
 }
 
 void wallet_manager::unregister_wallet(const std::shared_ptr<wallet> & val)
 {
-    std::lock_guard<std::mutex> l1(mutex_);
-    
     if (val)
     {
-        val->stop();
+        std::shared_ptr<notification_queue> queue;
+        
+        std::unique_lock<std::mutex> l1(mutex_);
+        
+        auto it = m_wallets.find(val);
+        
+        if (it != m_wallets.end())
+        {
+            queue = it->second;
+            
+            m_wallets.erase(it);
+        }
+        
+        l1.unlock();
         
-        m_wallets.erase(val);
+        /**
+         * Let the wallet catch up before it is stopped, the wallet thread
+         * may call back into us so this is done without holding the lock.
+         */
+        if (queue)
+        {
+            queue->stop();
+        }
+        
+        val->stop();
     }
 }
 
@@ -59,7 +89,7 @@ bool wallet_manager::is_from_me(const transaction & tx) const
     
     for (auto & i : m_wallets)
     {
-        if (i->is_from_me(tx))
+        if (i.first->is_from_me(tx))
         {
             return true;
         }
@@ -70,12 +100,10 @@ bool wallet_manager::is_from_me(const transaction & tx) const
 
 void wallet_manager::erase_from_wallets(const sha256 & val) const
 {
-    std::lock_guard<std::mutex> l1(mutex_);
-    
-    for (auto & i : m_wallets)
+    post([val](const std::shared_ptr<wallet> & w)
     {
-        i->erase_from_wallet(val);
-    }
+        w->erase_from_wallet(val);
+    });
 }
 
 void wallet_manager::sync_with_wallets(
@@ -90,54 +118,166 @@ void wallet_manager::sync_with_wallets(
          */
         if (tx.is_coin_stake())
         {
-            std::lock_guard<std::mutex> l1(mutex_);
-            
-            for (auto & i : m_wallets)
+            post([tx](const std::shared_ptr<wallet> & w)
             {
-                if (i->is_from_me(tx))
+                if (w->is_from_me(tx))
                 {
-                    i->disable_transaction(tx);
+                    w->disable_transaction(tx);
                 }
-            }
+            });
         }
     }
     else
     {
-        std::lock_guard<std::mutex> l1(mutex_);
+        /**
+         * The block may be gone by the time the wallet gets to it.
+         */
+        std::shared_ptr<block> b;
         
-        for (auto & i : m_wallets)
+        if (blk)
         {
-            i->add_to_wallet_if_involving_me(tx, blk, update);
+            b = std::make_shared<block> (*blk);
         }
+        
+        post([tx, b, update](const std::shared_ptr<wallet> & w)
+        {
+            w->add_to_wallet_if_involving_me(tx, b.get(), update);
+        });
     }
 }
 
-void wallet_manager::set_best_chain(const block_locator val)
+void wallet_manager::on_block_connected(const block & blk)
 {
-    std::lock_guard<std::mutex> l1(mutex_);
+    std::unique_lock<std::mutex> l1(mutex_);
+    
+    if (m_wallets.size() == 0)
+    {
+        return;
+    }
+    
+    l1.unlock();
+    
+    /**
+     * Copy the block once for every wallet, the merkle tree is built here
+     * since the wallet threads share it.
+     */
+    auto b = std::make_shared<block> (blk);
+    
+    b->build_merkle_tree();
+    
+    post([b](const std::shared_ptr<wallet> & w)
+    {
+        for (auto & i : b->transactions())
+        {
+            w->add_to_wallet_if_involving_me(i, b.get(), true);
+        }
+    });
+}
+
+void wallet_manager::on_block_disconnected(const block & blk)
+{
+    std::vector<transaction> transactions;
+    
+    for (auto & i : blk.transactions())
+    {
+        if (i.is_coin_stake())
+        {
+            transactions.push_back(i);
+        }
+    }
+    
+    if (transactions.size() > 0)
+    {
+        /**
+         * Wallets need to refund inputs when disconnecting coinstake
+         * (ppcoin).
+         */
+        post([transactions](const std::shared_ptr<wallet> & w)
+        {
+            for (auto & i : transactions)
+            {
+                if (w->is_from_me(i))
+                {
+                    w->disable_transaction(i);
+                }
+            }
+        });
+    }
+}
+
+void wallet_manager::sync()
+{
+    std::vector< std::shared_ptr<notification_queue> > queues;
+    
+    std::vector<std::uint64_t> sequences;
+    
+    std::unique_lock<std::mutex> l1(mutex_);
     
     for (auto & i : m_wallets)
     {
-        i->set_best_chain(val);
+        queues.push_back(i.second);
+        
+        /**
+         * A no-op marks the point to wait for.
+         */
+        sequences.push_back(i.second->post([]() {}));
+    }
+    
+    l1.unlock();
+    
+    for (std::size_t i = 0; i < queues.size(); i++)
+    {
+        queues[i]->wait(sequences[i]);
     }
 }
 
+void wallet_manager::set_best_chain(const block_locator val)
+{
+    post([val](const std::shared_ptr<wallet> & w)
+    {
+        w->set_best_chain(val);
+    });
+}
+
 void wallet_manager::on_transaction_updated(const sha256 & val)
+{
+    post([val](const std::shared_ptr<wallet> & w)
+    {
+        /**
+         * This reads the depth in the main chain so it goes back to the
+         * strand, in order after the notifications before it.
+         */
+        globals::instance().io_service().post(
+            globals::instance().strand().wrap([w, val]()
+        {
+            w->on_transaction_updated(val);
+        }));
+    });
+}
+
+void wallet_manager::on_inventory(const sha256 & val)
 {
     std::lock_guard<std::mutex> l1(mutex_);
     
     for (auto & i : m_wallets)
     {
-        i->on_transaction_updated(val);
+        i.first->on_inventory(val);
     }
 }
 
-void wallet_manager::on_inventory(const sha256 & val)
+void wallet_manager::post(
+    const std::function<void (const std::shared_ptr<wallet> &)> & f
+    ) const
 {
     std::lock_guard<std::mutex> l1(mutex_);
     
     for (auto & i : m_wallets)
     {
-        i->on_inventory(val);
+        auto w = i.first;
+        
+        i.second->post([f, w]()
+        {
+            f(w);
+        });
     }
 }